@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "AllocCount.h"
+
+using namespace std;
+
+#ifdef BENCH_ALLOCS
+
+// Every allocation since startup
+static atomic<size_t> gAllocs(0);
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Replaced Operators
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// malloc, counted; the array, nothrow and sized forms all come through
+/// here or the matching delete
+void *operator new(size_t size) {
+   gAllocs.fetch_add(1, memory_order_relaxed);
+   if (void *rtn = malloc(size ? size : 1))
+      return rtn;
+   throw bad_alloc();
+}
+
+/// free, to match
+void operator delete(void *ptr) noexcept {
+   free(ptr);
+}
+
+#ifdef __cpp_aligned_new
+
+/// over-aligned allocation, counted, as the plain form would miss it
+void *operator new(size_t size, align_val_t align) {
+   void *rtn;
+
+   gAllocs.fetch_add(1, memory_order_relaxed);
+#ifdef _MSC_VER
+   if ((rtn = _aligned_malloc(size ? size : 1, (size_t)align)))
+#else
+   if (!posix_memalign(&rtn, std::max(sizeof(void *), (size_t)align),
+    size ? size : 1))
+#endif
+      return rtn;
+   throw bad_alloc();
+}
+
+/// frees what the aligned form allocated
+void operator delete(void *ptr, align_val_t) noexcept {
+#ifdef _MSC_VER
+   _aligned_free(ptr);
+#else
+   free(ptr);
+#endif
+}
+
+#endif
+#endif
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+AllocCount Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// true if the operators above were built
+bool AllocCount::Enabled() {
+#ifdef BENCH_ALLOCS
+   return true;
+#else
+   return false;
+#endif
+}
+
+/// the running count, if kept
+size_t AllocCount::Get() {
+#ifdef BENCH_ALLOCS
+   return gAllocs.load();
+#else
+   return 0;
+#endif
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+
+// Heap allocations made through global operator new, so a benchmark can
+// show which queries allocate.  The replaced operators, costing a relaxed
+// atomic add per allocation, are built only with BENCH_ALLOCS defined, as
+// the BenchAllocs configuration does, so other builds keep the standard
+// allocator untouched.
+class AllocCount {
+public:
+   // True if this build counts allocations
+   static bool Enabled();
+
+   // Allocations so far, or always 0 if not Enabled
+   static size_t Get();
+};
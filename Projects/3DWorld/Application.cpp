@@ -9,6 +9,8 @@
 #include "Utility.h"
 #include "ModelMaker.h"
 #include "Renderer.h"
+#include "SceneCache.h"
+#include "Benchmark.h"
 
 using namespace std;
 using namespace glm;
@@ -67,7 +69,12 @@ Application::Application(int argc, char **argv) {
             AddStereoDisplay();
          }
          else if (!((string)*argv).compare("hmd")) {
-            AddHMDDisplay();
+            // optional "single" for single-pass instanced stereo
+            bool single = argv[1] && !((string)argv[1]).compare("single");
+
+            if (single)
+               argv++;
+            AddHMDDisplay(single);
          }
          else {
             throw WorldException("-D requires simple, stereo, or hmd");
@@ -92,15 +99,142 @@ Application::Application(int argc, char **argv) {
             mdlMaker = unique_ptr<ModelMaker>(new TableMaker(
                stof(temp[0]), stof(temp[1]), stof(temp[2])));
          }
+         else if (!((string)*argv).compare("grid")) {
+            argv++;
+            mdlMaker = unique_ptr<ModelMaker>(new GridMaker(stoi(*argv)));
+         }
+         else if (!((string)*argv).compare("field")) {
+            argv++;
+            mdlMaker = unique_ptr<ModelMaker>(
+             new CylinderFieldMaker(stoi(*argv)));
+         }
+         else if (!((string)*argv).compare("file")) {
+            string file = *++argv;
+            uint lods = FileMaker::cLodLevels;
+
+            // optional LOD level count, 0 for none
+            if (argv[1] && isdigit((uchar)argv[1][0]))
+               lods = stoi(*++argv);
+            mdlMaker = unique_ptr<ModelMaker>(new FileMaker(file, lods));
+         }
          else
             throw WorldException("-S requires cube,... ");
       }
+      if (!((string)*argv).compare("-M")) {
+         argv++;
+         if (!((string)*argv).compare("static"))
+            mOptions.dynamic = false;
+         else if (!((string)*argv).compare("dynamic"))
+            mOptions.dynamic = true;
+         else
+            throw WorldException("-M requires static or dynamic");
+      }
+      if (!((string)*argv).compare("-V")) {
+         argv++;
+         if (!((string)*argv).compare("full"))
+            mOptions.packed = false;
+         else if (!((string)*argv).compare("packed"))
+            mOptions.packed = true;
+         else
+            throw WorldException("-V requires full or packed");
+      }
+      if (!((string)*argv).compare("-U")) {
+         argv++;
+         if (!((string)*argv).compare("direct"))
+            mOptions.indirect = false;
+         else if (!((string)*argv).compare("indirect"))
+            mOptions.indirect = true;
+         else
+            throw WorldException("-U requires direct or indirect");
+      }
+      if (!((string)*argv).compare("-T")) {
+         argv++;
+         if (!((string)*argv).compare("2d"))
+            mOptions.textureArrays = false;
+         else if (!((string)*argv).compare("arrays"))
+            mOptions.textureArrays = true;
+         else
+            throw WorldException("-T requires 2d or arrays");
+      }
+      if (!((string)*argv).compare("-O")) {
+         argv++;
+         if (!((string)*argv).compare("off"))
+            mOptions.optimize = mOptions.overdraw = false;
+         else if (!((string)*argv).compare("cache")) {
+            mOptions.optimize = true;
+            mOptions.overdraw = false;
+         }
+         else if (!((string)*argv).compare("overdraw"))
+            mOptions.optimize = mOptions.overdraw = true;
+         else
+            throw WorldException("-O requires off, cache or overdraw");
+      }
+      if (!((string)*argv).compare("-L")) {
+         argv++;
+         mOptions.lodPixels = stof(*argv);
+         if (mOptions.lodPixels < 0.0f)
+            throw WorldException("-L requires a pixel error of 0 or more");
+      }
+      if (!((string)*argv).compare("-K")) {
+         argv++;
+         mOptions.shadowTaps = (uint)stoi(*argv);
+         if (mOptions.shadowTaps != 1 && mOptions.shadowTaps != 4
+          && mOptions.shadowTaps != 9)
+            throw WorldException("-K requires 1, 4 or 9 shadow taps");
+      }
+      if (!((string)*argv).compare("-P")) {
+         argv++;
+         if (stoi(*argv) < 0)
+            throw WorldException("-P requires a light count of 0 or more");
+         mOptions.pointLights = (uint)stoi(*argv);
+      }
+      if (!((string)*argv).compare("-I")) {
+         argv++;
+         if (!((string)*argv).compare("on"))
+            mOptions.stats = true;
+         else if (!((string)*argv).compare("off"))
+            mOptions.stats = false;
+         else
+            throw WorldException("-I requires on or off");
+      }
+      if (!((string)*argv).compare("-C")) {
+         argv++;
+         if (!((string)*argv).compare("off"))
+            mCache = CacheOff;
+         else if (!((string)*argv).compare("on"))
+            mCache = CacheOn;
+         else if (!((string)*argv).compare("bake")) {
+            if (mDisplays.empty())
+               throw WorldException("-C bake requires a prior -D for its "
+                "GL context");
+            mCache = CacheBake;
+         }
+         else
+            throw WorldException("-C requires off, on or bake");
+      }
+      if (!((string)*argv).compare("-B")) {
+         argv++;
+         mBenchmark = *argv;
+      }
    }
 
+   // Benchmarks build their own scenes
+   if (!mBenchmark.empty())
+      return;
+
    // By this point, some -S arg should have generated a mdlMaker
    if (!mdlMaker)
       throw WorldException("No model specified");
 
+   // Dynamic scenes follow live Model edits, so they're never cached
+   if (mCache != CacheOff && !mOptions.dynamic) {
+      mOptions.cacheKey = SceneCache::MakeKey(*mdlMaker, mOptions);
+      if (mCache == CacheOn && SceneCache::Valid(mOptions.cacheKey))
+         return;    // Renderer loads the baked scene, with no mMdl
+   }
+   else if (mCache == CacheBake)
+      throw WorldException("-C bake requires -M static");
+
    mMdl = mdlMaker->MakeModel();
 }
 
@@ -158,10 +292,10 @@ void Application::InitOpenGL() {
 }
 
 // create a new HMD display and input, and initilize FBs
-void Application::AddHMDDisplay() {
+void Application::AddHMDDisplay(bool singlePass) {
    InitOpenVR();
    mDisplays.push_back(
-    shared_ptr<Display>(new HMDDisplay(hmd)));
+    shared_ptr<Display>(new HMDDisplay(hmd, singlePass)));
    mInputs.push_back(
     shared_ptr<HMDInput>(new OpenVRHMDInput(hmd, 0.005f, 30.0f)));
    InitOpenGL();
@@ -178,9 +312,20 @@ void Application::AddSimpleDisplay(int wd, int ht) {
    InitOpenGL(); 
 }
 
-// create a new renderer and run, after model has been
+// create a new renderer and run, after model has been, or run the
+// requested benchmark or bake instead
 void Application::Run() {
-   Renderer(mMdl, mDisplays, mInputs).Run();
+   if (!mBenchmark.empty())
+      Benchmark::Run(mBenchmark, !mDisplays.empty());
+   else if (mCache == CacheBake) {
+      SceneCompiler scene;
+
+      SceneCache::Build(*mMdl, mOptions, &scene);
+      SceneCache::Save(mOptions.cacheKey, scene);
+      printf("Baked %s\n", SceneCache::FileName(mOptions.cacheKey).c_str());
+   }
+   else
+      Renderer(mMdl, mDisplays, mInputs, mOptions).Run();
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
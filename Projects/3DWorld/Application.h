@@ -4,6 +4,7 @@
 #include "Model.h"
 #include "Display.h"
 #include "ModelMaker.h"
+#include "Renderer.h"
 #include "Shader.h"
 
 // Application class for 3D World Project
@@ -12,6 +13,12 @@ class Application {
    vr::IVRSystem *hmd;
  
    std::shared_ptr<Model> mMdl; // Current Model
+   std::string mBenchmark;      // Benchmark to run instead, if any
+   RenderOptions mOptions;      // Set by -M, -V, -O, -L, -K, -P and -I
+
+   // Set by -C: ignore baked scenes, use one if valid, or bake and exit
+   enum CacheMode {CacheOff, CacheOn, CacheBake};
+   CacheMode mCache = CacheOn;
 
    std::vector<std::shared_ptr<Display>> mDisplays;
    std::vector<std::shared_ptr<HMDInput>> mInputs;
@@ -29,7 +36,7 @@ public:
    void Run();
 
    // Call these to add different kinds of display
-   void AddHMDDisplay();
+   void AddHMDDisplay(bool singlePass);
    void AddSimpleDisplay(int, int);
    std::string GetTrackedDeviceString(vr::IVRSystem *,
     vr::TrackedDeviceIndex_t, vr::TrackedDeviceProperty, 
@@ -0,0 +1,1630 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <thread>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "AllocCount.h"
+#include "Benchmark.h"
+#include "DrawList.h"
+#include "FrameGraph.h"
+#include "LightClusters.h"
+#include "Material.h"
+#include "Model.h"
+#include "MeshLoader.h"
+#include "ModelMaker.h"
+#include "PackedVertex.h"
+#include "Parallel.h"
+#include "ProfiledCylinderModel.h"
+#include "SceneCache.h"
+#include "SceneCompiler.h"
+#include "Shader.h"
+#include "ShadowMaps.h"
+#include "TangentGen.h"
+#include "TextureArrays.h"
+#include "Utility.h"
+#include "VertexXform.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Helper Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// returns mean milliseconds per call of ftn over reps calls
+template <class Ftn>
+static double TimeMs(int reps, Ftn ftn) {
+   auto start = chrono::high_resolution_clock::now();
+
+   for (int i = 0; i < reps; i++)
+      ftn();
+
+   chrono::duration<double, milli> elapsed =
+    chrono::high_resolution_clock::now() - start;
+   return elapsed.count() / reps;
+}
+
+/// flattens mdl the way Renderer::CreateBuffers did before SceneCompiler:
+/// per-node maps of lists, then a copy of each list before concatenation.
+/// Returns bytes of the final per-texture vectors.
+static size_t LegacyFlatten(const Model &mdl) {
+   VMap vertMap = mdl.GetVertices(mat4(1.0f), mat4(1.0f));
+   TMap trngMap = mdl.GetTriangles();
+   NMap normMap = mdl.GetNormal();
+   size_t bytes = 0;
+
+   for (VMap::iterator it = vertMap.begin(); it != vertMap.end(); it++) {
+      vector<Vertex> verts;
+      vector<uint> inds;
+      list<vector<Vertex>> v = vertMap.at(it->first);
+      list<TriangleSet> t = trngMap.at(it->first);
+
+      while (v.size()) {
+         inds.insert(inds.end(),
+            t.front().mIndices.begin(), t.front().mIndices.end());
+         verts.insert(verts.end(), v.front().begin(), v.front().end());
+         v.pop_front();
+         t.pop_front();
+      }
+      bytes += verts.size() * sizeof(Vertex) + inds.size() * sizeof(uint);
+   }
+
+   return bytes;
+}
+
+/// the tangent loop Renderer used before TangentGen: last triangle wins,
+/// and no guard on a zero UV determinant
+static void LegacyTangents(Vertex *verts, const uint *inds, uint numInds) {
+   for (uint x = 0; x < numInds; x++) {
+      Vertex v1 = verts[inds[x]];
+      Vertex v2 = verts[inds[x+1]];
+      Vertex v3 = verts[inds[x+2]];
+
+      vec3 DP1 = vec3(v2.loc - v1.loc);
+      vec3 DP2 = vec3(v3.loc - v1.loc);
+      vec2 DT1 = v2.texLoc - v1.texLoc;
+      vec2 DT2 = v3.texLoc - v1.texLoc;
+
+      float r = 1.0f / (DT1.x * DT2.y - DT1.y * DT2.x);
+      vec3 tangent = (DP1 * DT2.y - DP2 * DT1.y)*r;
+      vec3 biTangent = (DT1.x * DP2 - DP1 * DT2.x)*r;
+
+      verts[inds[x]].tangent = tangent;
+      verts[inds[x+1]].tangent = tangent;
+      verts[inds[x+2]].tangent = tangent;
+
+      verts[inds[x++]].biTangent = biTangent;
+      verts[inds[x++]].biTangent = biTangent;
+      verts[inds[x]].biTangent = biTangent;
+   }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Benchmarks
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// true if a and b are the same kind of texture, from the same name and
+/// image or color
+static bool SameTexture(const shared_ptr<Texture> &a,
+ const shared_ptr<Texture> &b) {
+   auto aClr = dynamic_cast<TextureClr *>(a.get());
+   auto bClr = dynamic_cast<TextureClr *>(b.get());
+
+   if (!a || !b)
+      return !a == !b;
+   if (!aClr != !bClr || (aClr && memcmp(aClr->GetColor(), bClr->GetColor(),
+    4)))
+      return false;
+   return a->GetName() == b->GetName() && a->GetFile() == b->GetFile();
+}
+
+/// true if a and b, including their instanced meshes and LODs, hold the
+/// same textures, vertices, indices and instances
+static bool SameScene(SceneCompiler &a, SceneCompiler &b) {
+   auto &aBatches = a.GetBatches(), &bBatches = b.GetBatches();
+   auto &aGroups = a.GetGroups(), &bGroups = b.GetGroups();
+
+   if (aBatches.size() != bBatches.size() || aGroups.size() != bGroups.size()
+    || a.GetNodes().size() != b.GetNodes().size())
+      return false;
+
+   for (uint i = 0; i < aBatches.size(); i++)
+      if (!SameTexture(aBatches[i].mTex, bBatches[i].mTex)
+       || !SameTexture(aBatches[i].mTexNormal, bBatches[i].mTexNormal)
+       || aBatches[i].mNumVerts != bBatches[i].mNumVerts
+       || aBatches[i].mNumIndices != bBatches[i].mNumIndices
+       || memcmp(aBatches[i].mVerts, bBatches[i].mVerts,
+       aBatches[i].mNumVerts * sizeof(Vertex))
+       || memcmp(aBatches[i].mIndices, bBatches[i].mIndices,
+       aBatches[i].mNumIndices * sizeof(uint)))
+         return false;
+
+   for (uint i = 0; i < aGroups.size(); i++)
+      if (aGroups[i].mInstances.size() != bGroups[i].mInstances.size()
+       || memcmp(aGroups[i].mInstances.data(), bGroups[i].mInstances.data(),
+       aGroups[i].mInstances.size() * sizeof(Instance))
+       || !aGroups[i].mMesh != !bGroups[i].mMesh
+       || (aGroups[i].mMesh && !SameScene(*aGroups[i].mMesh,
+       *bGroups[i].mMesh))
+       || aGroups[i].mLodErrors != bGroups[i].mLodErrors
+       || aGroups[i].mLods.size() != bGroups[i].mLods.size())
+         return false;
+      else
+         for (uint l = 0; l < aGroups[i].mLods.size(); l++)
+            if (!SameScene(*aGroups[i].mLods[l], *bGroups[i].mLods[l]))
+               return false;
+
+   return true;
+}
+
+/// legacy VMap/TMap flattening vs. SceneCompiler, on the room and a grid
+static void BenchCompile() {
+   vector<pair<string, shared_ptr<Model>>> scenes = {
+    {"room(6)", RoomMaker(6).MakeModel()},
+    {"grid(64)", GridMaker(64).MakeModel()}};
+   SceneCompiler sc;
+   size_t bytes;
+
+   for (auto &scene : scenes) {
+      int reps = scene.first == "room(6)" ? 1000 : 5;
+      double legacyMs = TimeMs(reps, [&]() {
+         bytes = LegacyFlatten(*scene.second);
+      });
+      double compileMs = TimeMs(reps, [&]() {
+         sc.Compile(*scene.second, mat4(1.0f), mat4(1.0f));
+      });
+
+      printf("compile %-10s legacy %9.3f ms  compiler %9.3f ms  (%.1fx)"
+       "  %zu batches, %zu bytes\n", scene.first.c_str(), legacyMs,
+       compileMs, legacyMs / compileMs, sc.GetBatches().size(),
+       sc.GetArenaBytes());
+      if (bytes != sc.GetArenaBytes())
+         throw WorldException("Legacy and compiled scene sizes differ");
+   }
+}
+
+/// returns number of draw calls needed for sc's batches and groups
+static size_t CountDraws(SceneCompiler &sc) {
+   size_t draws = sc.GetBatches().size();
+
+   for (auto &group : sc.GetGroups())
+      if (group.mMesh)
+         draws += group.mMesh->GetBatches().size();
+
+   return draws;
+}
+
+/// baked vs. instanced compilation: memory, draw calls and compile time
+static void BenchInstancing() {
+   vector<pair<string, shared_ptr<Model>>> scenes = {
+    {"multicube", MultiCubeMaker(1.0f).MakeModel()},
+    {"room(6)", RoomMaker(6).MakeModel()},
+    {"grid(64)", GridMaker(64).MakeModel()}};
+   SceneCompiler sc;
+   size_t bakedBytes, bakedDraws, instances;
+
+   for (auto &scene : scenes) {
+      sc.SetInstancing(false);
+      double bakedMs = TimeMs(5, [&]() {
+         sc.Compile(*scene.second, mat4(1.0f), mat4(1.0f));
+      });
+      bakedBytes = sc.GetArenaBytes();
+      bakedDraws = CountDraws(sc);
+
+      sc.SetInstancing(true);
+      double instMs = TimeMs(5, [&]() {
+         sc.Compile(*scene.second, mat4(1.0f), mat4(1.0f));
+      });
+      instances = 0;
+      for (auto &group : sc.GetGroups())
+         instances += group.mInstances.size();
+
+      printf("instancing %-10s baked %10zu bytes %4zu draws %9.3f ms  "
+       "instanced %10zu bytes %4zu draws %9.3f ms  (%zu instances)\n",
+       scene.first.c_str(), bakedBytes, bakedDraws, bakedMs,
+       sc.GetArenaBytes(), CountDraws(sc), instMs, instances);
+   }
+}
+
+/// cost of moving one object: full recompile vs. dynamic-mode refresh
+static void BenchDynamic() {
+   shared_ptr<CmpModel> grid
+    = dynamic_pointer_cast<CmpModel>(GridMaker(64).MakeModel());
+   SceneCompiler sc;
+   size_t moved;
+   int step = 0;
+
+   // Refresh must leave fully baked leaves, and so the scene, where their
+   // vertices are
+   sc.Compile(*grid, mat4(1.0f), mat4(1.0f));
+   Aabb before = sc.GetNodes()[0].mBounds;
+   grid->SetXform(0, translate(mat4(1.0f), vec3(0, 0, 100)));
+   sc.Refresh();
+   if (sc.GetNodes()[0].mBounds.mMin != before.mMin
+    || sc.GetNodes()[0].mBounds.mMax != before.mMax)
+      throw WorldException("Refresh moved the bounds of baked leaves");
+
+   // child 0 is a table (five leaves), child 1 a vase (one leaf)
+   for (uint child = 0; child < 2; child++) {
+      auto move = [&]() {
+         grid->SetXform(child, translate(mat4(1.0f), vec3(0, 0, step++)));
+      };
+
+      sc.SetDynamic(false);
+      double bakedMs = TimeMs(5, [&]() {
+         move();
+         sc.Compile(*grid, mat4(1.0f), mat4(1.0f));
+      });
+      size_t bakedBytes = sc.GetArenaBytes();
+
+      sc.SetDynamic(true);
+      sc.Compile(*grid, mat4(1.0f), mat4(1.0f));
+      double refreshMs = TimeMs(1000, [&]() {
+         move();
+         moved = sc.Refresh().size();
+      });
+
+      printf("dynamic %-6s recompile %9.3f ms %10zu bytes  "
+       "refresh %9.4f ms %6zu bytes\n", child ? "vase" : "table", bakedMs,
+       bakedBytes, refreshMs, moved * sizeof(Instance));
+   }
+
+   // With nothing moved Refresh reports nothing, and after moves, nested
+   // and through the table every cell shares, it must leave the scene as
+   // a fresh compile would
+   shared_ptr<CmpModel> table
+    = dynamic_pointer_cast<CmpModel>(grid->GetChild(0).mdl);
+
+   if (!sc.Refresh().empty())
+      throw WorldException("Refresh moved instances though nothing moved");
+   grid->SetXform(0, translate(mat4(1.0f), vec3(1, 2, 3)));
+   grid->SetXform(2 * 64 * 64 - 1, mat4(1.0f));
+   table->SetXform(0, translate(mat4(1.0f), vec3(0, 1, 0)));
+   sc.Refresh();
+
+   SceneCompiler fresh;
+   fresh.SetDynamic(true);
+   fresh.Compile(*grid, mat4(1.0f), mat4(1.0f));
+   for (uint i = 0; i < sc.GetNodes().size(); i++) {
+      const SceneNode &a = sc.GetNodes()[i], &b = fresh.GetNodes()[i];
+
+      if (a.mWorld != b.mWorld || a.mBounds.mMin != b.mBounds.mMin
+       || a.mBounds.mMax != b.mBounds.mMax)
+         throw WorldException(StringPrintf(
+          "Refreshed node %u differs from a fresh compile", i));
+   }
+}
+
+/// vertices/second of each VertexXform kernel vs. the old per-vertex loop,
+/// on 1M vertices, checking each kernel against the scalar result
+static void BenchXform() {
+   const size_t cNumVerts = 1 << 20;
+   mat4 xfm = translate(mat4(1.0f), vec3(1, 2, 3))
+    * rotate(mat4(1.0f), 0.7f, vec3(0, 1, 1))
+    * scale(mat4(1.0f), vec3(2, 1, 0.5f));
+   mat3 normXfm = inverse(transpose(mat3(xfm)));
+   mat4 texXfm = translate(mat4(1.0f), vec3(0.25f, 0.5f, 0))
+    * scale(mat4(1.0f), vec3(3, 2, 1));
+   vector<Vertex> src(cNumVerts), ref, out;
+
+   for (size_t i = 0; i < cNumVerts; i++) {
+      float f = (float)i / cNumVerts;
+      src[i] = Vertex(vec4(f, 1 - f, 2 * f, 1), normalize(vec3(1, f, 2)),
+       vec2(f, 3 * f), vec4(1, 0, f, 0), vec4(0, 1, -f, 0));
+   }
+
+   // old loop: full mat4 texture transform, tangents untouched
+   out = src;
+   double legacyMs = TimeMs(10, [&]() {
+      for (auto &v : out) {
+         v.loc = xfm * v.loc;
+         v.normal = normXfm * v.normal;
+         v.texLoc = vec2(texXfm * vec4(v.texLoc.x, v.texLoc.y, 0, 1));
+      }
+   });
+   printf("xform %-8s %9.3f ms  %8.1f Mverts/s\n", "legacy", legacyMs,
+    cNumVerts / legacyMs / 1e3);
+
+   ref = src;
+   VertexXform::Apply(VertexXform::Scalar, ref.data(), ref.size(), xfm,
+    normXfm, texXfm);
+
+   for (int k = 0; k < VertexXform::NumKernels; k++) {
+      auto kernel = (VertexXform::Kernel)k;
+      float maxErr = 0.0f;
+
+      if (!VertexXform::Supported(kernel)) {
+         printf("xform %-8s unsupported\n", VertexXform::Name(kernel));
+         continue;
+      }
+
+      out = src;
+      double ms = TimeMs(10, [&]() {
+         VertexXform::Apply(kernel, out.data(), out.size(), xfm, normXfm,
+          texXfm);
+      });
+
+      // compare one application against the scalar kernel
+      out = src;
+      VertexXform::Apply(kernel, out.data(), out.size(), xfm, normXfm,
+       texXfm);
+      for (size_t i = 0; i < cNumVerts; i++) {
+         const float *a = (const float *)&out[i], *b = (const float *)&ref[i];
+         for (int f = 0; f < 15; f++)
+            maxErr = std::max(maxErr, std::abs(a[f] - b[f]));
+      }
+
+      printf("xform %-8s %9.3f ms  %8.1f Mverts/s  (%.2fx, max err %g)\n",
+       VertexXform::Name(kernel), ms, cNumVerts / ms / 1e3, legacyMs / ms,
+       maxErr);
+      if (maxErr > 1e-4f)
+         throw WorldException(StringPrintf(
+          "%s vertex transform disagrees with scalar",
+          VertexXform::Name(kernel)));
+   }
+}
+
+/// BVH frustum culling of grid(64) from its center: traversal time and
+/// objects kept, for one eye, each eye of a stereo pair culled separately,
+/// and the combined stereo frustum
+static void BenchCull() {
+   shared_ptr<Model> grid = GridMaker(64).MakeModel();
+   mat4 view = lookAt(vec3(0, 1.2f, 0), vec3(0, 1, -1), vec3(0, 1, 0));
+   mat4 prj = perspective(1.6f, 1.0f, 0.1f, 30.0f);
+   mat4 left = prj * translate(mat4(1.0f), vec3(0.032f, 0, 0)) * view;
+   mat4 right = prj * translate(mat4(1.0f), vec3(-0.032f, 0, 0)) * view;
+   SceneCompiler sc;
+
+   for (int inst = 0; inst < 2; inst++) {
+      CullStats mono, eyes, combined;
+
+      sc.SetInstancing(inst != 0);
+      sc.Compile(*grid, mat4(1.0f), mat4(1.0f));
+
+      double monoMs = TimeMs(100, [&]() {
+         mono = CullStats();
+         sc.Cull(Frustum::FromMatrix(prj * view), &mono);
+      });
+      double eyesMs = TimeMs(100, [&]() {
+         eyes = CullStats();
+         sc.Cull(Frustum::FromMatrix(left), &eyes);
+         sc.Cull(Frustum::FromMatrix(right), &eyes);
+      });
+      double combinedMs = TimeMs(100, [&]() {
+         combined = CullStats();
+         sc.Cull(Frustum::Combine(left, right), &combined);
+      });
+
+      printf("cull %-9s mono %7.3f ms %5u vis %5u culled  per-eye %7.3f ms "
+       "%5u vis  combined %7.3f ms %5u vis %5u culled\n",
+       inst ? "instanced" : "baked", monoMs, mono.mVisible, mono.mCulled,
+       eyesMs, eyes.mVisible / 2, combinedMs, combined.mVisible,
+       combined.mCulled);
+   }
+}
+
+/// GPU bytes of vertices and indices as uploaded full and -V packed, the
+/// time to pack, and the worst position error packing introduced
+static void BenchVFormat() {
+   vector<pair<string, shared_ptr<Model>>> scenes = {
+    {"multicube", MultiCubeMaker(1.0f).MakeModel()},
+    {"room(6)", RoomMaker(6).MakeModel()},
+    {"grid(64)", GridMaker(64).MakeModel()}};
+   SceneCompiler sc;
+   vector<Batch *> batches;
+   vector<PackedVertex> packed;
+   vec3 scale, bias;
+
+   sc.SetInstancing(true);
+   for (auto &scene : scenes) {
+      size_t fullVerts = 0, fullInds = 0, packVerts = 0, packInds = 0;
+      float maxErr = 0.0f;
+
+      sc.Compile(*scene.second, mat4(1.0f), mat4(1.0f));
+      batches.clear();
+      for (auto &batch : sc.GetBatches())
+         batches.push_back(&batch);
+      for (auto &group : sc.GetGroups())
+         if (group.mMesh)
+            for (auto &batch : group.mMesh->GetBatches())
+               batches.push_back(&batch);
+
+      double packMs = TimeMs(10, [&]() {
+         for (auto batch : batches) {
+            packed.resize(batch->mNumVerts);
+            PackedVertex::PackAll(batch->mVerts, batch->mNumVerts,
+             packed.data(), &scale, &bias);
+         }
+      });
+
+      for (auto batch : batches) {
+         packed.resize(batch->mNumVerts);
+         PackedVertex::PackAll(batch->mVerts, batch->mNumVerts,
+          packed.data(), &scale, &bias);
+         for (uint v = 0; v < batch->mNumVerts; v++) {
+            vec2 xy = unpackSnorm2x16(packed[v].posXY);
+            vec3 pos = vec3(xy, unpackSnorm2x16(packed[v].posZW).x)
+             * scale + bias;
+            Vertex &vert = batch->mVerts[v];
+
+            maxErr = std::max(maxErr,
+             length(pos - vec3(vert.loc) / vert.loc.w));
+         }
+
+         fullVerts += batch->mNumVerts * sizeof(Vertex);
+         fullInds += batch->mNumIndices * sizeof(uint);
+         packVerts += batch->mNumVerts * sizeof(PackedVertex);
+         packInds += batch->mNumIndices * (batch->mNumVerts < 65536
+          ? sizeof(GLushort) : sizeof(uint));
+      }
+
+      printf("vformat %-10s full %9zu+%9zu bytes  packed %9zu+%9zu bytes  "
+       "(%.2fx verts %.2fx inds)  pack %8.3f ms  max err %.2g\n",
+       scene.first.c_str(), fullVerts, fullInds, packVerts, packInds,
+       (double)fullVerts / packVerts, (double)fullInds / packInds, packMs,
+       maxErr);
+   }
+}
+
+/// vertex shader runs per frame, as simulated cache misses times draws,
+/// and vertex counts, before and after SceneCompiler::Optimize
+static void BenchMeshOpt() {
+   vector<pair<string, shared_ptr<Model>>> scenes = {
+    {"multicube", MultiCubeMaker(1.0f).MakeModel()},
+    {"room(6)", RoomMaker(6).MakeModel()},
+    {"grid(64)", GridMaker(64).MakeModel()}};
+   SceneCompiler sc;
+   vector<MeshReport> reports;
+
+   sc.SetInstancing(true);
+   for (auto &scene : scenes)
+      for (int overdraw = 0; overdraw < 2; overdraw++) {
+         size_t runsBefore = 0, runsAfter = 0, vertsBefore = 0;
+         size_t vertsAfter = 0, tris = 0;
+         double optMs = 0.0;
+
+         for (int rep = 0; rep < 5; rep++) {
+            sc.Compile(*scene.second, mat4(1.0f), mat4(1.0f));
+            reports.clear();
+            optMs += TimeMs(1, [&]() {sc.Optimize(overdraw != 0, &reports);});
+         }
+
+         for (auto &rpt : reports) {
+            runsBefore += (size_t)rpt.mBefore.mMisses * rpt.mInstances;
+            runsAfter += (size_t)rpt.mAfter.mMisses * rpt.mInstances;
+            vertsBefore += rpt.mVertsBefore;
+            vertsAfter += rpt.mVertsAfter;
+            tris += (size_t)rpt.mAfter.mTriangles * rpt.mInstances;
+         }
+
+         printf("meshopt %-10s %-8s verts %7zu -> %7zu  vs runs %8zu -> "
+          "%8zu  ACMR %.3f -> %.3f  %8.3f ms\n", scene.first.c_str(),
+          overdraw ? "overdraw" : "cache", vertsBefore, vertsAfter,
+          runsBefore, runsAfter, (double)runsBefore / tris,
+          (double)runsAfter / tris, optMs / 5);
+      }
+}
+
+/// legacy tangent loop vs. TangentGen on one and on all cores, over a
+/// 512x512-quad wavy height field, checking the results match across
+/// thread counts
+static void BenchTangents() {
+   const uint cSide = 512, cRow = cSide + 1;
+   vector<Vertex> verts, single, multi;
+   vector<uint> inds;
+   float height;
+
+   for (uint y = 0; y < cRow; y++)
+      for (uint x = 0; x < cRow; x++) {
+         height = 0.1f * sin(x * 0.05f) * cos(y * 0.07f);
+         verts.push_back(Vertex(vec4(x, y, height, 1.0f),
+          normalize(vec3(-0.005f * cos(x * 0.05f) * cos(y * 0.07f),
+          0.007f * sin(x * 0.05f) * sin(y * 0.07f), 1.0f)),
+          vec2(x / (float)cSide, y / (float)cSide)));
+      }
+   for (uint y = 0; y < cSide; y++)
+      for (uint x = 0; x < cSide; x++) {
+         uint v = y * cRow + x;
+
+         inds.insert(inds.end(), {v, v + 1, v + cRow, v + 1, v + cRow + 1,
+          v + cRow});
+      }
+
+   double legacyMs = TimeMs(5, [&]() {
+      LegacyTangents(verts.data(), inds.data(), (uint)inds.size());
+   });
+   single = verts;
+   double singleMs = TimeMs(5, [&]() {
+      TangentGen::Generate(single.data(), (uint)single.size(), inds.data(),
+       (uint)inds.size(), 1);
+   });
+   multi = verts;
+   double multiMs = TimeMs(5, [&]() {
+      TangentGen::Generate(multi.data(), (uint)multi.size(), inds.data(),
+       (uint)inds.size());
+   });
+
+   printf("tangents %zu tris  legacy %8.3f ms  1 thread %8.3f ms  "
+    "%u threads %8.3f ms  (%s)\n", inds.size() / 3, legacyMs, singleMs,
+    std::max(1u, thread::hardware_concurrency()), multiMs,
+    memcmp(single.data(), multi.data(), single.size() * sizeof(Vertex))
+    ? "MISMATCH" : "identical");
+}
+
+/// scene setup from scratch (ModelMaker plus SceneCache::Build) vs.
+/// loading the baked file, checking the loaded scene matches.  The flat
+/// OBJ has no images, so its colors must bake in their place.
+static void BenchStartup() {
+   const uint cFlatSide = 64;
+   const char *objFile = "Resource/bench_bake.obj";
+   const char *mtlFile = "Resource/bench_bake.mtl";
+   vector<pair<string, shared_ptr<ModelMaker>>> makers = {
+    {"room(6)", make_shared<RoomMaker>(6)},
+    {"grid(64)", make_shared<GridMaker>(64)},
+    {"field(20)", make_shared<CylinderFieldMaker>(20)},
+    {"flat obj", make_shared<FileMaker>(objFile)}};
+   RenderOptions opts;
+   FILE *out;
+
+   // untextured OBJ: half its faces with no material, half with a
+   // color-only one, both of which load as TextureClr
+   out = fopen(mtlFile, "w");
+   if (!out)
+      throw WorldException(StringPrintf("Can't write %s", mtlFile));
+   fprintf(out, "newmtl red\nKd 0.8 0.1 0.1\n");
+   fclose(out);
+   out = fopen(objFile, "w");
+   if (!out)
+      throw WorldException(StringPrintf("Can't write %s", objFile));
+   fprintf(out, "mtllib bench_bake.mtl\n");
+   for (uint y = 0; y <= cFlatSide; y++)
+      for (uint x = 0; x <= cFlatSide; x++)
+         fprintf(out, "v %u %u %g\n", x, y, 0.1 * sin(0.3 * x + 0.2 * y));
+   for (uint y = 0; y < cFlatSide; y++) {
+      if (y == cFlatSide / 2)
+         fprintf(out, "usemtl red\n");
+      for (uint x = 0; x < cFlatSide; x++) {
+         uint v = y * (cFlatSide + 1) + x + 1;
+
+         fprintf(out, "f %u %u %u %u\n", v, v + 1, v + cFlatSide + 2,
+          v + cFlatSide + 1);
+      }
+   }
+   fclose(out);
+
+   for (auto &maker : makers) {
+      SceneCompiler cold, cached;
+      string key = SceneCache::MakeKey(*maker.second, opts);
+      size_t bytes;
+
+      double coldMs = TimeMs(3, [&]() {
+         SceneCache::Build(*maker.second->MakeModel(), opts, &cold);
+      });
+      SceneCache::Save(key, cold);
+      double cachedMs = TimeMs(3, [&]() {
+         if (!SceneCache::Load(key, &cached))
+            throw WorldException("Baked scene failed to load");
+      });
+      bytes = cold.GetArenaBytes();
+
+      printf("startup %-10s cold %9.3f ms  cached %8.3f ms  (%.1fx, %zu "
+       "arena bytes, %s)\n", maker.first.c_str(), coldMs, cachedMs,
+       coldMs / cachedMs, bytes, SameScene(cold, cached) ? "identical"
+       : "MISMATCH");
+      remove(SceneCache::FileName(key).c_str());
+      if (!SameScene(cold, cached))
+         throw WorldException(StringPrintf("Baked %s differs from its "
+          "build", maker.first.c_str()));
+   }
+
+   // the key must follow the OBJ's MTL library as well as the OBJ
+   FileMaker flat(objFile);
+   string key = SceneCache::MakeKey(flat, opts);
+   remove(mtlFile);
+   if (SceneCache::MakeKey(flat, opts) == key)
+      throw WorldException("Scene key ignores the OBJ's MTL library");
+   remove(objFile);
+}
+
+/// true if a and b hold the same parts, vertices and indices
+static bool SameParts(const vector<MeshPart> &a, const vector<MeshPart> &b) {
+   if (a.size() != b.size())
+      return false;
+   for (uint i = 0; i < a.size(); i++)
+      if (a[i].mMaterial != b[i].mMaterial || a[i].mIndices != b[i].mIndices
+       || a[i].mVerts.size() != b[i].mVerts.size()
+       || memcmp(a[i].mVerts.data(), b[i].mVerts.data(),
+       a[i].mVerts.size() * sizeof(Vertex)))
+         return false;
+   return true;
+}
+
+/// MeshLoader on one and on all cores, over a 10M-triangle height field
+/// written as OBJ (quads, no normals) and binary PLY (triangles, normals),
+/// checking the results match across thread counts.  Then an OBJ of
+/// relative indices, parsed in 4 chunks, must match its 1-thread parse.
+static void BenchLoad() {
+   const uint cSide = 2237, cRow = cSide + 1, cRelRow = 512;
+   const char *objFile = "Resource/bench_load.obj";
+   const char *plyFile = "Resource/bench_load.ply";
+   FILE *out;
+
+   auto heightAt = [](uint x, uint y) {
+      return 0.1f * sin(x * 0.05f) * cos(y * 0.07f);
+   };
+
+   out = fopen(objFile, "w");
+   for (uint y = 0; y < cRow; y++)
+      for (uint x = 0; x < cRow; x++)
+         fprintf(out, "v %u %u %.6f\n", x, y, heightAt(x, y));
+   for (uint y = 0; y < cSide; y++)
+      for (uint x = 0; x < cSide; x++) {
+         uint v = y * cRow + x + 1;
+
+         fprintf(out, "f %u %u %u %u\n", v, v + 1, v + cRow + 1, v + cRow);
+      }
+   fclose(out);
+
+   out = fopen(plyFile, "wb");
+   fprintf(out, "ply\nformat binary_little_endian 1.0\nelement vertex %u\n"
+    "property float x\nproperty float y\nproperty float z\n"
+    "property float nx\nproperty float ny\nproperty float nz\n"
+    "element face %u\nproperty list uchar int vertex_indices\nend_header\n",
+    cRow * cRow, 2 * cSide * cSide);
+   for (uint y = 0; y < cRow; y++)
+      for (uint x = 0; x < cRow; x++) {
+         vec3 nrm = normalize(vec3(-0.005f * cos(x * 0.05f) * cos(y * 0.07f),
+          0.007f * sin(x * 0.05f) * sin(y * 0.07f), 1.0f));
+         float vals[6] = {(float)x, (float)y, heightAt(x, y), nrm.x, nrm.y,
+          nrm.z};
+
+         fwrite(vals, sizeof(float), 6, out);
+      }
+   for (uint y = 0; y < cSide; y++)
+      for (uint x = 0; x < cSide; x++) {
+         int v = (int)(y * cRow + x);
+         int tris[2][3] = {{v, v + 1, v + (int)cRow},
+          {v + 1, v + (int)cRow + 1, v + (int)cRow}};
+
+         for (auto &tri : tris) {
+            fputc(3, out);
+            fwrite(tri, sizeof(int), 3, out);
+         }
+      }
+   fclose(out);
+
+   for (auto file : {objFile, plyFile}) {
+      vector<MeshPart> single, multi;
+      vector<MeshMaterial> materials;
+      size_t tris = 0;
+
+      double singleMs = TimeMs(1, [&]() {
+         MeshLoader::Load(file, &single, &materials, 1);
+      });
+      double multiMs = TimeMs(1, [&]() {
+         MeshLoader::Load(file, &multi, &materials);
+      });
+      for (auto &part : single)
+         tris += part.mIndices.size() / 3;
+
+      printf("load %-24s %zu tris  1 thread %9.1f ms  %u threads %9.1f ms "
+       " (%.1f Mtris/s, %s)\n", file, tris, singleMs,
+       std::max(1u, thread::hardware_concurrency()), multiMs,
+       tris / (1000.0 * multiMs), SameParts(single, multi) ? "identical"
+       : "MISMATCH");
+      remove(file);
+   }
+
+   // Relative indices, each row's faces just after its vertices, so the
+   // faces opening each chunk of a 4-way parse reach into the chunk
+   // before.  Vertex (y - 1, x) is x - 2 * cRelRow from the end of row y.
+   out = fopen(objFile, "w");
+   for (uint y = 0; y < cRelRow; y++) {
+      for (uint x = 0; x < cRelRow; x++)
+         fprintf(out, "v %u %u %.6f\n", x, y, heightAt(x, y));
+      for (uint x = 0; y && x < cRelRow - 1; x++) {
+         int v = (int)x - 2 * (int)cRelRow;
+
+         fprintf(out, "f %d %d %d %d\n", v, v + 1, v + (int)cRelRow + 1,
+          v + (int)cRelRow);
+      }
+   }
+   fclose(out);
+
+   vector<MeshPart> single, chunked;
+   vector<MeshMaterial> materials;
+
+   MeshLoader::Load(objFile, &single, &materials, 1);
+   MeshLoader::Load(objFile, &chunked, &materials, 4);
+   remove(objFile);
+   printf("load relative indices, 4 chunks  %s\n",
+    SameParts(single, chunked) ? "identical" : "MISMATCH");
+   if (!SameParts(single, chunked))
+      throw WorldException("Chunked OBJ parse misresolves relative indices");
+}
+
+/// DirectModel::SetLod over a 4-part, 2M-triangle height field, each part
+/// a tile with a UV seam down its middle: triangles, estimated and
+/// measured error per level, and whether every seam and tile-border
+/// vertex survived, then the chain's time on one core vs. all of them
+static void BenchSimplify() {
+   const uint cTile = 512, cRow = cTile + 1, cLevels = 6;
+   vector<Vertex> verts;
+   vector<TriangleSet> sets;
+   vector<uint> grid(cRow * cRow);
+   size_t locked = 0;
+   uchar clr[4] = {255, 255, 255, 255};
+
+   auto heightAt = [](float x, float y) {
+      return 0.1f * sin(3 * x) * cos(2 * y) + 0.02f * sin(17 * x + 5 * y);
+   };
+
+   // Tiles span [-1, 1]^2; the seam column is duplicated with u 1 and 0
+   for (uint tile = 0; tile < 4; tile++) {
+      shared_ptr<Texture> tex(new TextureClr(StringPrintf("tile %u", tile),
+       clr));
+      float x0 = tile % 2 ? 0.0f : -1.0f, y0 = tile / 2 ? 0.0f : -1.0f;
+
+      sets.push_back(TriangleSet("tile", tex, {}));
+      for (uint y = 0; y < cRow; y++)
+         for (uint x = 0; x < cRow; x++) {
+            float px = x0 + (float)x / cTile, py = y0 + (float)y / cTile;
+            Vertex vtx(vec4(px, py, heightAt(px, py), 1.0f),
+             vec3(0, 0, 1), vec2(2.0f * x / cTile, (float)y / cTile));
+
+            if (x == cTile / 2) {
+               verts.push_back(vtx);
+               vtx.texLoc.x = 0.0f;
+            }
+            if (x > cTile / 2)
+               vtx.texLoc.x -= 1.0f;
+            grid[y * cRow + x] = (uint)verts.size();
+            verts.push_back(vtx);
+            locked += x == 0 || y == 0 || x == cTile || y == cTile
+             || x == cTile / 2 ? 1 + (x == cTile / 2) : 0;
+         }
+
+      // Left of the seam uses the u = 1 copy, just before the u = 0 one
+      for (uint y = 0; y < cTile; y++)
+         for (uint x = 0; x < cTile; x++) {
+            uint v[4] = {grid[y * cRow + x], grid[y * cRow + x + 1],
+             grid[(y + 1) * cRow + x + 1], grid[(y + 1) * cRow + x]};
+
+            if (x + 1 == cTile / 2) {
+               v[1]--;
+               v[2]--;
+            }
+            sets.back().mIndices.insert(sets.back().mIndices.end(),
+             {v[0], v[1], v[2], v[0], v[2], v[3]});
+         }
+   }
+
+   DirectModel mdl("field", verts, sets);
+   double oneMs = TimeMs(1, [&]() {mdl.SetLod(cLevels, 0.5f, 1);});
+   double allMs = TimeMs(1, [&]() {mdl.SetLod(cLevels, 0.5f, 0);});
+
+   for (auto &level : mdl.GetLods()) {
+      const Model &lod = level.mMdl ? *level.mMdl : mdl;
+      VMap lodVerts = lod.GetVertices(mat4(1.0f), mat4(1.0f));
+      TMap lodTris = lod.GetTriangles();
+      size_t tris = 0, kept = 0;
+      float measured = 0.0f;
+
+      for (auto &part : lodTris) {
+         const vector<Vertex> &pv = lodVerts[part.first].front();
+
+         for (auto &vtx : pv) {
+            float tx = (vtx.loc.x + 1.0f) * cTile, ty = (vtx.loc.y + 1.0f)
+             * cTile;
+
+            kept += fmod(tx, (float)cTile) == 0.0f
+             || fmod(ty, (float)cTile) == 0.0f
+             || fmod(tx, (float)cTile) == cTile / 2;
+         }
+         for (auto &set : part.second)
+            for (uint i = 0; i < set.mIndices.size(); i += 3) {
+               vec3 a(pv[set.mIndices[i]].loc), b(pv[set.mIndices[i + 1]].loc),
+                c(pv[set.mIndices[i + 2]].loc), ctr = (a + b + c) / 3.0f;
+
+               measured = std::max(measured, std::abs(ctr.z
+                - heightAt(ctr.x, ctr.y)));
+               tris++;
+            }
+      }
+
+      printf("simplify %8zu tris  error est %.5f measured %.5f  seams %s\n",
+       tris, level.mError, measured, kept == locked ? "kept" : "LOST");
+   }
+   printf("simplify %u levels  1 thread %8.1f ms  %u threads %8.1f ms\n",
+    (uint)mdl.GetLods().size() - 1, oneMs, Parallel::Threads(0), allMs);
+}
+
+/// triangles drawn for the groups' visible instances at their LOD levels
+static size_t VisibleTriangles(SceneCompiler &sc) {
+   size_t tris = 0;
+
+   for (uint g = 0; g < sc.GetGroups().size(); g++) {
+      InstanceGroup &group = sc.GetGroups()[g];
+
+      for (uint l = 0; group.mMesh && l <= group.mLods.size(); l++) {
+         SceneCompiler &mesh = l ? *group.mLods[l - 1] : *group.mMesh;
+         size_t idxs = 0;
+
+         for (auto &batch : mesh.GetBatches())
+            idxs += batch.mNumIndices;
+         for (auto &run : sc.GetVisibleGroup(g, l))
+            tris += run.mCount * idxs / 3;
+      }
+   }
+
+   return tris;
+}
+
+/// triangles drawn by a field of LOD cylinders with every instance at its
+/// finest level vs. at its 1-pixel level, mono and stereo, the selection
+/// cost, and level switches while the viewer sways in place (hysteresis
+/// should hold them near zero) and while walking through the field
+static void BenchLod() {
+   shared_ptr<Model> field = CylinderFieldMaker(20).MakeModel();
+   mat4 prj = perspective(0.8f, 1.0f, 0.1f, 100.0f);
+   SceneCompiler sc;
+   CullStats stats;
+   uint switches;
+
+   // the compile-time HasLods test must agree with the levels built
+   CircleCylinderModel cyl("cyl", nullptr, 4, 1.0f, {0.0f}, nullptr);
+   for (uint lo = 0; lo <= 8; lo++)
+      for (uint hi = 0; hi <= 8; hi++) {
+         cyl.SetLod(lo, hi);
+         if (cyl.HasLods() == cyl.GetLods().empty())
+            throw WorldException(StringPrintf("HasLods wrong for SetLod(%u,"
+             " %u)", lo, hi));
+      }
+
+   sc.Compile(*field, mat4(1.0f), mat4(1.0f));
+
+   // viewer at eye height, looking down the field
+   auto views = [&](float z, bool stereo) {
+      mat4 view = lookAt(vec3(0, 0, z), vec3(0, 0, z + 1), vec3(0, 1, 0));
+
+      if (!stereo)
+         return vector<LodView>{LodView(prj * view, 1080.0f)};
+      return vector<LodView>{
+       LodView(prj * translate(mat4(1.0f), vec3(0.032f, 0, 0)) * view,
+       1440.0f),
+       LodView(prj * translate(mat4(1.0f), vec3(-0.032f, 0, 0)) * view,
+       1440.0f)};
+   };
+
+   for (int stereo = 0; stereo < 2; stereo++) {
+      vector<LodView> eyes = views(0.0f, stereo != 0);
+      Frustum frustum = stereo ? Frustum::Combine(eyes[0].mVP, eyes[1].mVP)
+       : Frustum::FromMatrix(eyes[0].mVP);
+      size_t fullTris, lodTris;
+      vector<uint> perLevel(sc.GetGroups()[0].mLods.size() + 1, 0);
+
+      for (auto &group : sc.GetGroups())
+         fill(group.mLevels.begin(), group.mLevels.end(), 0);
+      stats = CullStats();
+      sc.Cull(frustum, &stats);
+      fullTris = VisibleTriangles(sc);
+
+      double selectMs = TimeMs(100, [&]() {sc.SelectLods(eyes, 1.0f);});
+      stats = CullStats();
+      sc.Cull(frustum, &stats);
+      lodTris = VisibleTriangles(sc);
+      for (auto level : sc.GetGroups()[0].mLevels)
+         perLevel[level]++;
+
+      printf("lod %-6s %u visible  finest %8zu tris  1px %8zu tris (%.1fx)"
+       "  select %.3f ms  levels", stereo ? "stereo" : "mono",
+       stats.mVisible, fullTris, lodTris, (double)fullTris / lodTris,
+       selectMs);
+      for (auto count : perLevel)
+         printf(" %u", count);
+      printf("\n");
+   }
+
+   // sway +-1cm per frame about a fixed point, then walk 2m at 1cm/frame
+   sc.SelectLods(views(0.0f, false), 1.0f);
+   switches = 0;
+   for (int frame = 0; frame < 200; frame++)
+      switches += sc.SelectLods(views(frame % 2 ? 0.01f : -0.01f, false),
+       1.0f);
+   printf("lod sway   %u switches over 200 frames\n", switches);
+
+   switches = 0;
+   for (int frame = 0; frame < 200; frame++)
+      switches += sc.SelectLods(views(0.01f * frame, false), 1.0f);
+   printf("lod walk   %u switches over 200 frames\n", switches);
+}
+
+/// heap allocations made by ftn
+template <class Ftn>
+static size_t CountAllocs(Ftn ftn) {
+   size_t start = AllocCount::Get();
+
+   ftn();
+   return AllocCount::Get() - start;
+}
+
+/// heap allocations per query for each primitive: the Span tables must
+/// make none, while the map-returning adapters necessarily do.  Then per
+/// table-and-vase cell over a whole compile of grid(64), once warmed.
+/// Needs a BENCH_ALLOCS build, for AllocCount.
+static void BenchAlloc() {
+   const int cQueries = 10000;
+   uchar clr[4] = {255, 255, 255, 255};
+   shared_ptr<Texture> tex(new TextureClr("alloc", clr));
+   CubeModel cube("cube", tex, nullptr);
+   PlaneModel plane("plane", tex, nullptr);
+   shared_ptr<Model> grid = GridMaker(64).MakeModel();
+   SceneCompiler sc;
+   size_t sum = 0, spanAllocs, mapAllocs, compileAllocs;
+
+   if (!AllocCount::Enabled()) {
+      printf("alloc needs the BenchAllocs build, with BENCH_ALLOCS "
+       "defined\n");
+      return;
+   }
+   spanAllocs = CountAllocs([&]() {
+      for (int i = 0; i < cQueries; i++) {
+         for (auto &v : CubeModel::Vertices())
+            sum += v.loc.x > 0.0f;
+         for (uint idx : CubeModel::Indices())
+            sum += idx;
+         sum += PlaneModel::Vertices().size() + PlaneModel::Indices().size();
+      }
+   });
+   mapAllocs = CountAllocs([&]() {
+      for (int i = 0; i < cQueries; i++) {
+         sum += cube.GetNumVertices().size() + cube.GetNormal().size();
+         sum += cube.GetTriangles().size() + plane.GetNumVertices().size();
+      }
+   });
+
+   sc.Compile(*grid, mat4(1.0f), mat4(1.0f));
+   compileAllocs = CountAllocs([&]() {
+      sc.Compile(*grid, mat4(1.0f), mat4(1.0f));
+   });
+
+   // each loop makes four queries per iteration
+   printf("alloc span queries %6.2f per query  map queries %6.2f per query"
+    "  (%zu)\n", (double)spanAllocs / (4 * cQueries),
+    (double)mapAllocs / (4 * cQueries), sum);
+   printf("alloc compile grid(64) %zu allocations, %.3f per cell\n",
+    compileAllocs, compileAllocs / (64.0 * 64.0));
+   if (spanAllocs)
+      throw WorldException("Primitive Span queries allocated");
+}
+
+// The same profile through CylinderModel's virtual polarDist, as every
+// cylinder was sampled before ProfiledCylinderModel
+template <class Profile>
+class VirtualCylinderModel : public CylinderModel {
+   Profile mProfile;
+
+   float polarDist(float x) const override {return mProfile(cos(x), sin(x));}
+
+public:
+   VirtualCylinderModel(shared_ptr<Texture> t, const vector<float> &pts,
+    const Profile &profile) : CylinderModel("virtual", t, 4, 1.0f, pts,
+    nullptr), mProfile(profile) {}
+
+   using CylinderModel::SampleProfile;
+};
+
+// ProfiledCylinderModel with its sampling opened up for timing
+template <class Profile>
+class TimedCylinderModel : public ProfiledCylinderModel<Profile> {
+public:
+   using ProfiledCylinderModel<Profile>::ProfiledCylinderModel;
+   using ProfiledCylinderModel<Profile>::SampleProfile;
+};
+
+/// times vertex generation for one profile both ways, throwing if the
+/// vertices disagree
+template <class Profile>
+static void BenchProfile(const char *name, shared_ptr<Texture> tex,
+ const vector<float> &pts, const Profile &profile) {
+   VirtualCylinderModel<Profile> slow(tex, pts, profile);
+   TimedCylinderModel<Profile> fast(name, tex, 4, 1.0f, pts, nullptr,
+    profile);
+   uint n = (uint)pts.size();
+   vector<float> out(3 * n);
+   float maxErr = 0.0f;
+
+   // Untimed first pass, so neither side pays for first-touch page faults
+   slow.GetVertices(mat4(1.0f), mat4(1.0f));
+   double slowMs = TimeMs(50, [&]() {slow.GetVertices(mat4(1.0f),
+    mat4(1.0f));});
+   double fastMs = TimeMs(50, [&]() {fast.GetVertices(mat4(1.0f),
+    mat4(1.0f));});
+   double slowSampleMs = TimeMs(50, [&]() {slow.SampleProfile(pts.data(),
+    n, &out[0], &out[n], &out[2 * n]);});
+   double fastSampleMs = TimeMs(50, [&]() {fast.SampleProfile(pts.data(),
+    n, &out[0], &out[n], &out[2 * n]);});
+
+   VMap slowVerts = slow.GetVertices(mat4(1.0f), mat4(1.0f));
+   VMap fastVerts = fast.GetVertices(mat4(1.0f), mat4(1.0f));
+   const vector<Vertex> &a = slowVerts[tex].front();
+   const vector<Vertex> &b = fastVerts[tex].front();
+   for (size_t i = 0; i < a.size(); i++) {
+      maxErr = std::max(maxErr, length(a[i].loc - b[i].loc));
+      maxErr = std::max(maxErr, length(a[i].normal - b[i].normal));
+   }
+
+   printf("profile %-13s verts %7.3f -> %7.3f ms (%.2fx)  samples %7.3f -> "
+    "%7.3f ms (%.2fx)  max err %g\n", name, slowMs, fastMs, slowMs / fastMs,
+    slowSampleMs, fastSampleMs, slowSampleMs / fastSampleMs, maxErr);
+   if (maxErr > 1e-5f)
+      throw WorldException(StringPrintf(
+       "%s profile disagrees with its virtual version", name));
+}
+
+/// virtual polarDist against ProfiledCylinderModel for each profile, at
+/// 4096 samples: whole vertex generation, and the profile sampling alone
+static void BenchProfiles() {
+   const uint cSamples = 4096;
+   vector<float> pts(cSamples);
+   uchar clr[4] = {255, 255, 255, 255};
+   shared_ptr<Texture> tex(new TextureClr("profile", clr));
+
+   for (uint i = 0; i < cSamples; i++)
+      pts[i] = (float)(2 * M_PI * i / cSamples);
+
+   BenchProfile("circle", tex, pts, CircleProfile());
+   BenchProfile("ellipse", tex, pts, EllipseProfile(1.0f, 0.6f));
+   BenchProfile("star", tex, pts, StarProfile(7, 0.5f));
+   BenchProfile("gear", tex, pts, GearProfile(24, 0.15f, 4.0f));
+   BenchProfile("superellipse", tex, pts, SuperellipseProfile(5.0f));
+}
+
+/// state changes drawing draws, by material id, in the order of keys
+static DrawStats CountChanges(const MaterialRegistry &reg,
+ const vector<uint> &mats, const vector<uint64_t> &keys) {
+   MaterialState state;
+   DrawStats stats;
+
+   for (uint64_t key : keys)
+      state.Apply(reg.Get(mats[DrawList::GetDraw(key)]), &stats);
+   return stats;
+}
+
+/// 4096 draws over 64 diffuse textures, a third with one of 8 normal maps,
+/// scattered through a 100-unit cube: state changes drawn in creation
+/// order and sorted by key, and radix sort time against std::sort
+static void BenchMaterials() {
+   const uint cDraws = 4096, cTexs = 64, cNormals = 8;
+   uchar clr[4] = {255, 255, 255, 255};
+   vector<shared_ptr<Texture>> texs, normals;
+   MaterialRegistry reg;
+   vector<uint> mats;
+   DrawList unsorted, sorted;
+   mat4 vp = perspective(0.8f, 1.0f, 0.1f, 500.0f)
+    * lookAt(vec3(0, 0, -60), vec3(0), vec3(0, 1, 0));
+   uint seed = 1;
+
+   auto rnd = [&seed]() {
+      seed = seed * 1664525u + 1013904223u;
+      return seed >> 8;
+   };
+
+   for (uint t = 0; t < cTexs; t++)
+      texs.push_back(make_shared<TextureClr>(StringPrintf("diffuse %u", t),
+       clr));
+   for (uint t = 0; t < cNormals; t++)
+      normals.push_back(make_shared<TextureClr>(StringPrintf("normal %u", t),
+       clr));
+
+   for (uint d = 0; d < cDraws; d++) {
+      vec3 ctr(rnd() % 100 - 50.0f, rnd() % 100 - 50.0f, rnd() % 100 - 50.0f);
+      shared_ptr<Texture> nT = rnd() % 3 ? nullptr
+       : normals[rnd() % cNormals];
+
+      mats.push_back(reg.Register(texs[rnd() % cTexs], nT));
+      unsorted.Add(DrawList::MakeKey(reg.Get(mats.back()).mVariant,
+       mats.back(), (vp * vec4(ctr, 1.0f)).w, d));
+   }
+   sorted = unsorted;
+   sorted.Sort();
+
+   for (size_t i = 1; i < sorted.GetKeys().size(); i++)
+      if (sorted.GetKeys()[i - 1] > sorted.GetKeys()[i])
+         throw WorldException("DrawList sort out of order");
+
+   DrawStats before = CountChanges(reg, mats, unsorted.GetKeys());
+   DrawStats after = CountChanges(reg, mats, sorted.GetKeys());
+   printf("materials %u draws, %u materials  unsorted %5u shader %5u "
+    "texture  sorted %u shader %u texture\n", cDraws, reg.Size(),
+    before.mShaderSwitches, before.mTextureBinds, after.mShaderSwitches,
+    after.mTextureBinds);
+
+   // -U indirect keys leave out the variant, and submit one multi-draw
+   // per texture change rather than one call per draw
+   DrawList indirect;
+   uint64_t noShader = ~(uint64_t)0 >> DrawList::cShaderBits;
+   uint multiDraws = 0;
+   MaterialState state;
+   DrawStats scratch;
+
+   for (uint64_t key : unsorted.GetKeys())
+      indirect.Add(key & noShader);
+   indirect.Sort();
+   for (uint64_t key : indirect.GetKeys())
+      if (state.Apply(reg.Get(mats[DrawList::GetDraw(key)]), &scratch)
+       & (MaterialState::cTexture | MaterialState::cNormal))
+         multiDraws++;
+   printf("materials submits  direct %u draw calls  indirect %u "
+    "multi-draws, %u texture binds\n", cDraws, multiDraws,
+    scratch.mTextureBinds);
+
+   // -T arrays: the colors share one atlas, so runs break only where a
+   // draw needs another array
+   TextureArrays arrays;
+   TextureArrayState arrayState;
+   DrawStats arrayStats;
+
+   arrays.Plan(reg);
+   multiDraws = 0;
+   for (uint64_t key : indirect.GetKeys())
+      if (arrayState.Apply(arrays, reg.Get(mats[DrawList::GetDraw(key)]),
+       &arrayStats) & (MaterialState::cTexture | MaterialState::cNormal))
+         multiDraws++;
+   printf("materials submits  arrays %u arrays  %u multi-draws, %u "
+    "texture binds\n", arrays.Size(), multiDraws, arrayStats.mTextureBinds);
+
+   for (uint n : {cDraws, 1u << 17}) {
+      DrawList list;
+      vector<uint64_t> keys;
+
+      for (uint d = 0; d < n; d++)
+         keys.push_back((unsorted.GetKeys()[d % cDraws]
+          & ~(uint64_t)((1u << DrawList::cDrawBits) - 1))
+          | d % (1u << DrawList::cDrawBits));
+      double radixMs = TimeMs(20, [&]() {
+         list.Clear();
+         for (uint64_t key : keys)
+            list.Add(key);
+         list.Sort();
+      });
+      double stdMs = TimeMs(20, [&]() {
+         vector<uint64_t> copy(keys);
+         sort(copy.begin(), copy.end());
+      });
+      printf("materials sort %6u keys  radix %7.3f ms  std::sort %7.3f ms"
+       "  (%.1fx)\n", n, radixMs, stdMs, stdMs / radixMs);
+   }
+}
+
+/// the HMD frame graph at a typical 1512x1680 eye, two-pass and single
+/// pass, with a debug view of the depth that nothing reads: the textures
+/// its targets alias into, against one per target, and compile time
+static void BenchFrameGraph() {
+   const uint cWd = 1512, cHt = 1680;
+
+   for (int single = 0; single < 2; single++) {
+      auto build = [&](FrameGraph *graph) {
+         uint wd = single ? 2 * cWd : cWd;
+         FrameGraph::Target eyes[2], depth = 0;
+         FrameGraph::Pass submit;
+
+         for (uint e = 0; e < (single ? 1u : 2u); e++) {
+            FrameGraph::Target msaa = graph->Create("msaa",
+             TargetDesc(wd, cHt, GL_RGBA8, 8));
+            FrameGraph::Pass draw = graph->AddPass("eye", []() {});
+
+            depth = graph->Create("depth",
+             TargetDesc(wd, cHt, GL_DEPTH_COMPONENT24, 8));
+            eyes[e] = graph->Create("resolved", TargetDesc(wd, cHt,
+             GL_RGBA8));
+            graph->Write(draw, msaa, true);
+            graph->Write(draw, depth, true);
+            graph->AddResolve("resolve", msaa, eyes[e]);
+         }
+         graph->AddResolve("depth view", depth, graph->Create("view",
+          TargetDesc(wd, cHt, GL_DEPTH_COMPONENT24)));
+         submit = graph->AddOutput("submit", []() {});
+         graph->Read(submit, eyes[0]);
+         if (!single)
+            graph->Read(submit, eyes[1]);
+      };
+      FrameGraph graph;
+      double ms;
+
+      build(&graph);
+      graph.Compile();
+      ms = TimeMs(1000, [&]() {
+         FrameGraph scratch;
+
+         build(&scratch);
+         scratch.Compile();
+      });
+      printf("framegraph %-8s %u passes, %u culled  %u targets in %u "
+       "textures  %5.1f of %5.1f MB  compile %.4f ms\n", single
+       ? "single" : "two-pass", graph.GetPassCount(),
+       graph.GetCulledCount(), graph.GetTransientCount(),
+       graph.GetTextureCount(), graph.GetTextureBytes() / 1048576.0,
+       graph.GetTransientBytes() / 1048576.0, ms);
+   }
+
+   // lit and post each last sample a transient they don't attach, and
+   // keep their own attachment for the next reader, so none may discard
+   FrameGraph graph;
+   FrameGraph::Target shadow = graph.Create("shadow", TargetDesc(1024,
+    1024, GL_DEPTH_COMPONENT24));
+   FrameGraph::Target lit = graph.Create("lit", TargetDesc(cWd, cHt,
+    GL_RGBA8));
+   FrameGraph::Target post = graph.Create("post", TargetDesc(cWd, cHt,
+    GL_RGBA8));
+   FrameGraph::Pass shadowPass = graph.AddPass("shadow", []() {});
+   FrameGraph::Pass litPass = graph.AddPass("lit", []() {});
+   FrameGraph::Pass postPass = graph.AddPass("post", []() {});
+   FrameGraph::Pass submit = graph.AddOutput("submit", []() {});
+
+   graph.Write(shadowPass, shadow, true);
+   graph.Read(litPass, shadow);
+   graph.Write(litPass, lit, true);
+   graph.Read(postPass, lit);
+   graph.Write(postPass, post);
+   graph.Read(submit, post);
+   graph.Compile();
+   for (FrameGraph::Pass p : {shadowPass, litPass, postPass})
+      if (!graph.GetDiscards(p).empty())
+         throw WorldException("FrameGraph discards a target a pass only "
+          "reads");
+}
+
+/// cascaded shadows for 5 lights over 300 frames of a walk through a
+/// 40x40 scene, with one caster circling beside the path: cascades
+/// rendered per frame against rendering every one each frame, and
+/// fitting time
+static void BenchShadows() {
+   const uint cFrames = 300;
+   vector<LightSource> lights;
+   mat4 psp = perspective(1.2f, 1.0f, 0.5f, 100.0f);
+   Aabb scene(vec3(-20.0f, 0.0f, -20.0f), vec3(20.0f, 10.0f, 20.0f));
+   ShadowMaps shadows;
+   uint renders[2] = {0, 0};
+   double ms;
+
+   for (uint l = 0; l < 5; l++)
+      lights.push_back(LightSource(vec4(30.0f * cos(1.2566f * l), 25.0f,
+       30.0f * sin(1.2566f * l), 1.0f), vec3(1.0f)));
+
+   auto frame = [&](uint f, bool moving) {
+      float t = f / (float)cFrames;
+      vec3 eye(15.0f * cos(6.2832f * t), 1.7f, 15.0f * sin(6.2832f * t));
+      vec3 caster(-12.0f + 2.0f * cos(25.0f * t), 1.0f,
+       12.0f + 2.0f * sin(25.0f * t));
+
+      shadows.Setup(lights, scene);
+      shadows.Fit(psp * lookAt(eye, eye + vec3(-sin(6.2832f * t), 0.0f,
+       cos(6.2832f * t)), vec3(0.0f, 1.0f, 0.0f)));
+      if (moving)
+         shadows.Invalidate(Aabb(caster - vec3(0.5f), caster
+          + vec3(0.5f)));
+      for (uint layer = 0; layer < shadows.GetLayers(); layer++)
+         if (shadows.GetCascade(layer).mDirty)
+            shadows.MarkRendered(layer);
+   };
+
+   for (int moving = 0; moving < 2; moving++) {
+      uint before = shadows.GetRenders();
+
+      for (uint f = 0; f < cFrames; f++)
+         frame(f, moving != 0);
+      renders[moving] = shadows.GetRenders() - before;
+   }
+   ms = TimeMs(100, [&]() {frame(0, true);});
+
+   printf("shadows %u cascades  static %.2f  moving caster %.2f "
+    "renders/frame of %u  fit %.4f ms\n", shadows.GetLayers(),
+    renders[0] / (float)cFrames, renders[1] / (float)cFrames,
+    shadows.GetLayers(), ms);
+}
+
+// A quad filling the window at view depth 3, in the nearest cascades of
+// 5 lights, for timing main program variants by fragment cost.  Drawn
+// with no depth test, so every draw shades every pixel.
+class LitQuad {
+   GLuint mVao, mVbo;
+   vec3 mEye;
+   mat4 mVP;
+   vector<LightSource> mLights;
+   vector<mat4> mLightVPs;
+   ShadowMaps mShadows;
+   GLint mViewport[4];
+
+public:
+   LitQuad();
+   ~LitQuad();
+
+   // ms per draw through sdr's variant for features, lit by the first
+   // lights of the 5, after one untimed draw so the variant's first use
+   // isn't counted
+   double Time(Shader *sdr, uint features, uint lights);
+
+   uint GetPixels() const {return mViewport[2] * mViewport[3];}
+};
+
+/// the quad's vertices, with every other attribute held constant
+LitQuad::LitQuad() : mEye(0.0f, 0.0f, 3.0f) {
+   const vec4 quad[4] = {vec4(-10.0f, -10.0f, 0.0f, 1.0f),
+    vec4(10.0f, -10.0f, 0.0f, 1.0f), vec4(-10.0f, 10.0f, 0.0f, 1.0f),
+    vec4(10.0f, 10.0f, 0.0f, 1.0f)};
+
+   mVP = perspective(1.2f, 1.0f, 0.5f, 100.0f) * lookAt(mEye, vec3(0.0f),
+    vec3(0.0f, 1.0f, 0.0f));
+   for (uint l = 0; l < 5; l++)
+      mLights.push_back(LightSource(vec4(8.0f * cos(1.2566f * l),
+       8.0f * sin(1.2566f * l), 12.0f, 1.0f), vec3(0.2f)));
+   mShadows.Setup(mLights, Aabb(vec3(-10.0f, -10.0f, -1.0f),
+    vec3(10.0f, 10.0f, 1.0f)));
+   mShadows.Fit(mVP);
+   mShadows.GetMatrices(&mLightVPs);
+   mShadows.Create();
+
+   glGenVertexArrays(1, &mVao); GLChkErr;
+   glBindVertexArray(mVao); GLChkErr;
+   glGenBuffers(1, &mVbo); GLChkErr;
+   glBindBuffer(GL_ARRAY_BUFFER, mVbo); GLChkErr;
+   glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+   GLChkErr;
+   glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)0); GLChkErr;
+   glEnableVertexAttribArray(0); GLChkErr;
+   glVertexAttrib4f(1, 0.0f, 0.0f, 1.0f, 0.0f); GLChkErr;
+   glVertexAttrib4f(3, 1.0f, 0.0f, 0.0f, 0.0f); GLChkErr;
+   glVertexAttrib4f(4, 0.0f, 1.0f, 0.0f, 0.0f); GLChkErr;
+   for (uint c = 0; c < 4; c++) {
+      glVertexAttrib4f(5 + c, c == 0, c == 1, c == 2, c == 3); GLChkErr;
+      glVertexAttrib4f(9 + c, c == 0, c == 1, c == 2, c == 3); GLChkErr;
+      if (c < 3) {
+         glVertexAttrib4f(13 + c, c == 0, c == 1, c == 2, 0.0f); GLChkErr;
+      }
+   }
+
+   glGetIntegerv(GL_VIEWPORT, mViewport); GLChkErr;
+   glDisable(GL_DEPTH_TEST); GLChkErr;
+   mShadows.Use();
+}
+
+LitQuad::~LitQuad() {
+   glEnable(GL_DEPTH_TEST);
+   glBindVertexArray(0);
+   glDeleteBuffers(1, &mVbo);
+   glDeleteVertexArrays(1, &mVao);
+}
+
+double LitQuad::Time(Shader *sdr, uint features, uint lights) {
+   const uint cDraws = 20;
+
+   sdr->Configure(vector<LightSource>(mLights.begin(),
+    mLights.begin() + lights), mLightVPs, mShadows.GetSplits());
+   sdr->Run(mVP, mEye);
+   sdr->UseVariant(features);
+
+   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); GLChkErr;
+   glFinish(); GLChkErr;
+   return TimeMs(1, [&]() {
+      for (uint d = 0; d < cDraws; d++)
+         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+      glFinish();
+   }) / cDraws;
+}
+
+/// fragment cost of each shadow kernel under 5 lights, timed to glFinish.
+/// Run on a software GL such as llvmpipe, whose fragment work is all on
+/// the CPU, to compare kernels by shading cost alone.
+static void BenchShadowTaps() {
+   const uint cTaps[] = {1, 4, 9};
+   LitQuad quad;
+   double baseMs = 0.0;
+
+   for (uint taps : cTaps) {
+      Shader sdr(taps);
+      double ms;
+
+      sdr.SetShadowMap();
+      ms = quad.Time(&sdr, 0, 5);
+      baseMs = baseMs ? baseMs : ms;
+      printf("shadow taps %u  %7.3f ms/draw  %7.1f Mpix/s  (%.2fx 1 tap)\n",
+       taps, ms, quad.GetPixels() / (ms * 1000.0), ms / baseMs);
+   }
+}
+
+/// fragment cost of each main program variant a plain or normal-mapped
+/// batch may use, with and without shadows, under 1 and 5 lights
+static void BenchVariants() {
+   LitQuad quad;
+   Shader sdr;
+   double baseMs = 0.0;
+
+   sdr.SetShadowMap();
+   for (uint lights = 1; lights <= 5; lights += 4)
+      for (int shadows = 0; shadows < 2; shadows++)
+         for (uint features = 0; features <= Shader::cNormalMapped;
+          features += Shader::cNormalMapped) {
+            double ms;
+
+            sdr.SetFeature(Shader::cShadows, shadows != 0);
+            ms = quad.Time(&sdr, features, lights);
+            baseMs = baseMs ? baseMs : ms;
+            printf("variant %-28s %7.3f ms/draw  %7.1f Mpix/s  (%.2fx)\n",
+             Shader::VariantName(features | (shadows ? Shader::cShadows : 0)
+             | lights << Shader::cLightsShift).c_str(), ms,
+             quad.GetPixels() / (ms * 1000.0), ms / baseMs);
+         }
+}
+
+/// setup of the shadow program and every variant a plain or normal-mapped
+/// batch may use under 1 to 5 lights, twice: the first Shader compiles
+/// whatever the ProgramCache lacks, and the second should load it all
+static void BenchPrograms() {
+   const vector<uint> features = {0, Shader::cNormalMapped};
+   vector<mat4> vps;
+
+   for (int run = 0; run < 2; run++) {
+      Shader sdr;
+      double ms = 0.0;
+
+      sdr.SetShadowMap();
+      for (uint l = 1; l <= Shader::cMaxLights; l++) {
+         sdr.Configure(vector<LightSource>(l, LightSource(vec4(0.0f, 5.0f,
+          0.0f, 1.0f), vec3(1.0f))), vps, vec4(0.0f));
+         ms += TimeMs(1, [&]() {sdr.Precompile(features);});
+      }
+      printf("programs %s  %u variants and shadow  %.1f ms\n", run ? "second"
+       : "first", sdr.GetVariantCount(), ms);
+   }
+}
+
+/// throws unless every light of lights is listed in the cluster of each
+/// of cSamples points inside it that lie past the near plane
+static void CheckCoverage(const LightClusters &clusters,
+ const vector<PointLight> &lights, uint *seed) {
+   const uint cSamples = 8;
+   const vector<uint> &lists = clusters.GetLists();
+   auto rnd = [seed]() {
+      *seed = *seed * 1664525u + 1013904223u;
+      return (*seed >> 8) / 8388608.0f - 1.0f;
+   };
+
+   for (uint l = 0; l < lights.size(); l++)
+      for (uint k = 0; k < cSamples; k++) {
+         vec3 off(rnd(), rnd(), rnd()), pt;
+
+         if (dot(off, off) > 0.98f)
+            continue;
+         pt = lights[l].mPos + lights[l].mRadius * off;
+         if ((clusters.GetVP() * vec4(pt, 1.0f)).w < 0.1f)
+            continue;
+
+         const uvec2 &cell = clusters.GetCluster(clusters.ClusterOf(pt));
+         if (!binary_search(lists.begin() + cell.x,
+          lists.begin() + cell.x + cell.y, l))
+            throw WorldException(StringPrintf("Light %u missing from "
+             "cluster %u", l, clusters.ClusterOf(pt)));
+      }
+}
+
+/// CPU light binning of 64 to 4096 point lights around a 16:9 view,
+/// some behind the eye, with each kernel on one thread and on all of
+/// them.  Every run must list exactly what the scalar kernel lists on
+/// one thread, which must list each light in the cluster of every point
+/// it reaches.
+static void BenchClusters() {
+   const uint cCounts[] = {64, 512, 4096};
+   mat4 vp = perspective(1.2f, 16.0f / 9.0f, 0.1f, 100.0f)
+    * lookAt(vec3(0, 2, 0), vec3(0, 2, -1), vec3(0, 1, 0));
+   vector<uint> threads = {1};
+   uint seed = 1;
+   auto rnd = [&seed]() {
+      seed = seed * 1664525u + 1013904223u;
+      return (seed >> 8) / 16777216.0f;
+   };
+
+   if (Parallel::Threads(0) > 1)
+      threads.push_back(Parallel::Threads(0));
+   for (uint count : cCounts) {
+      vector<PointLight> lights;
+      LightClusters ref, clusters;
+      double baseMs = 0.0;
+
+      for (uint l = 0; l < count; l++)
+         lights.push_back(PointLight(vec3(60.0f * rnd() - 30.0f,
+          8.0f * rnd() - 2.0f, 5.0f - 60.0f * rnd()), 0.5f + 3.0f * rnd(),
+          vec3(1.0f)));
+      ref.Bin(vp, lights, LightClusters::Scalar, 1);
+      CheckCoverage(ref, lights, &seed);
+
+      for (int k = 0; k < LightClusters::NumKernels; k++)
+         for (uint t : threads) {
+            auto kernel = (LightClusters::Kernel)k;
+            bool same;
+
+            if (!LightClusters::Supported(kernel))
+               continue;
+            double ms = TimeMs(20, [&]() {
+               clusters.Bin(vp, lights, kernel, t);
+            });
+
+            same = clusters.GetLists() == ref.GetLists();
+            for (uint c = 0; c < LightClusters::cClusters; c++)
+               same = same && clusters.GetCluster(c) == ref.GetCluster(c);
+            baseMs = baseMs ? baseMs : ms;
+            printf("clusters %4u lights  %-6s %2u threads %8.3f ms  "
+             "%.1f per cluster  (%.2fx)\n", count,
+             LightClusters::Name(kernel), t, ms,
+             (double)ref.GetLists().size() / LightClusters::cClusters,
+             baseMs / ms);
+            if (!same)
+               throw WorldException(StringPrintf("%s light binning on %u "
+                "threads disagrees with scalar", LightClusters::Name(kernel),
+                t));
+         }
+   }
+}
+
+// A benchmark, and whether it needs a GL context: most build Textures or
+// GL objects, while a few exercise pure CPU code and can run headless
+struct BenchEntry {
+   void (*mRun)();
+   bool mNeedsGL;
+};
+
+// All benchmarks, by -B name
+static const map<string, BenchEntry> cBenchmarks = {
+   {"compile", {BenchCompile, true}},
+   {"cull", {BenchCull, true}},
+   {"instancing", {BenchInstancing, true}},
+   {"dynamic", {BenchDynamic, true}},
+   {"xform", {BenchXform, false}},
+   {"vformat", {BenchVFormat, true}},
+   {"meshopt", {BenchMeshOpt, true}},
+   {"tangents", {BenchTangents, false}},
+   {"startup", {BenchStartup, true}},
+   {"load", {BenchLoad, false}},
+   {"lod", {BenchLod, true}},
+   {"simplify", {BenchSimplify, true}},
+   {"profiles", {BenchProfiles, true}},
+   {"alloc", {BenchAlloc, true}},
+   {"materials", {BenchMaterials, true}},
+   {"framegraph", {BenchFrameGraph, false}},
+   {"shadows", {BenchShadows, true}},
+   {"shadowtaps", {BenchShadowTaps, true}},
+   {"variants", {BenchVariants, true}},
+   {"programs", {BenchPrograms, true}},
+   {"clusters", {BenchClusters, false}}
+};
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Benchmark Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// runs one benchmark by name, or all of them, skipping those needing GL
+/// if there's no context
+void Benchmark::Run(const string &name, bool haveGL) {
+   if (name == "all") {
+      for (auto &bench : cBenchmarks)
+         if (haveGL || !bench.second.mNeedsGL)
+            bench.second.mRun();
+         else
+            printf("%s skipped, needing a -D display\n", bench.first.c_str());
+   }
+   else if (cBenchmarks.count(name)) {
+      if (!haveGL && cBenchmarks.at(name).mNeedsGL)
+         throw WorldException(StringPrintf("-B %s requires a prior -D for "
+          "its GL context", name.c_str()));
+      cBenchmarks.at(name).mRun();
+   }
+   else
+      throw WorldException(StringPrintf("No benchmark named %s", name.c_str()));
+}
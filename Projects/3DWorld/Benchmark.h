@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+
+// CPU-side timing harnesses for the scene pipeline, selected by name with
+// the -B commandline flag and run in place of the render loop.  Scenes hold
+// GL textures, so most need a -D display (and thus a GL context) first,
+// but pure CPU ones such as clusters and framegraph run without one.
+class Benchmark {
+public:
+   // Run the named benchmark, or every benchmark for "all".  Without GL,
+   // "all" skips those needing it, and naming one of them throws.
+   static void Run(const std::string &, bool haveGL);
+};
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Bounds.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Aabb Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// extends the box to include pt
+void Aabb::Grow(const vec3 &pt) {
+   mMin = glm::min(mMin, pt);
+   mMax = glm::max(mMax, pt);
+}
+
+/// extends the box to include box, ignoring empty boxes
+void Aabb::Grow(const Aabb &box) {
+   if (!box.Empty()) {
+      mMin = glm::min(mMin, box.mMin);
+      mMax = glm::max(mMax, box.mMax);
+   }
+}
+
+/// transforms center, and extent by the absolute upper 3x3 (Arvo's method)
+Aabb Aabb::Transform(const mat4 &xfm) const {
+   vec3 center, extent;
+
+   if (Empty())
+      return Aabb();
+
+   center = vec3(xfm * vec4(Center(), 1.0f));
+   extent = Extent();
+   extent = abs(vec3(xfm[0])) * extent.x + abs(vec3(xfm[1])) * extent.y
+    + abs(vec3(xfm[2])) * extent.z;
+
+   return Aabb(center - extent, center + extent);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Frustum Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// Gribb/Hartmann extraction: each plane is the last row of vp plus or
+/// minus one of the others
+Frustum Frustum::FromMatrix(const mat4 &vp) {
+   Frustum rtn;
+   vec4 row[4];
+
+   for (int r = 0; r < 4; r++)
+      row[r] = vec4(vp[0][r], vp[1][r], vp[2][r], vp[3][r]);
+
+   for (int k = 0; k < cNumPlanes; k++)
+      rtn.mPlanes[k] = k % 2 ? row[3] - row[k / 2] : row[3] + row[k / 2];
+
+   return rtn;
+}
+
+/// outer side planes and mean inner planes, each then offset to hold all
+/// corners of both clip volumes
+Frustum Frustum::Combine(const mat4 &leftVp, const mat4 &rightVp) {
+   Frustum left = FromMatrix(leftVp), right = FromMatrix(rightVp), rtn;
+   mat4 inv[2] = {inverse(leftVp), inverse(rightVp)};
+   vec3 corners[16], normal;
+   float minDot;
+
+   for (int e = 0; e < 2; e++)
+      for (int c = 0; c < 8; c++) {
+         vec4 pt = inv[e] * vec4(c & 1 ? 1 : -1, c & 2 ? 1 : -1,
+          c & 4 ? 1 : -1, 1);
+         corners[8*e + c] = vec3(pt) / pt.w;
+      }
+
+   for (int k = 0; k < cNumPlanes; k++) {
+      if (k == cLeft)
+         normal = normalize(vec3(left.mPlanes[k]));
+      else if (k == cRight)
+         normal = normalize(vec3(right.mPlanes[k]));
+      else
+         normal = normalize(normalize(vec3(left.mPlanes[k]))
+          + normalize(vec3(right.mPlanes[k])));
+
+      minDot = dot(normal, corners[0]);
+      for (int c = 1; c < 16; c++)
+         minDot = std::min(minDot, dot(normal, corners[c]));
+      rtn.mPlanes[k] = vec4(normal, -minDot);
+   }
+
+   return rtn;
+}
+
+/// tests the box's nearest and farthest corners against each plane
+Frustum::Result Frustum::Classify(const Aabb &box) const {
+   vec3 center = box.Center(), extent = box.Extent();
+   Result rtn = cInside;
+   float dist, radius;
+
+   if (box.Empty())
+      return cOutside;
+
+   for (int k = 0; k < cNumPlanes; k++) {
+      dist = dot(vec3(mPlanes[k]), center) + mPlanes[k].w;
+      radius = dot(abs(vec3(mPlanes[k])), extent);
+      if (dist + radius < 0)
+         return cOutside;
+      if (dist - radius < 0)
+         rtn = cIntersects;
+   }
+
+   return rtn;
+}
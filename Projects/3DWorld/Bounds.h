@@ -0,0 +1,55 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Axis-aligned bounding box.  Default-constructed boxes are empty, and
+// growing an empty box by a point or box yields exactly that point or box.
+struct Aabb {
+   glm::vec3 mMin;
+   glm::vec3 mMax;
+
+   Aabb() : mMin(1e30f), mMax(-1e30f) {}
+   Aabb(const glm::vec3 &lo, const glm::vec3 &hi) : mMin(lo), mMax(hi) {}
+
+   bool Empty() const {return mMin.x > mMax.x;}
+   glm::vec3 Center() const {return 0.5f * (mMin + mMax);}
+   glm::vec3 Extent() const {return 0.5f * (mMax - mMin);}
+
+   void Grow(const glm::vec3 &);
+   void Grow(const Aabb &);
+
+   // Bounds of this box after affine transform xfm
+   Aabb Transform(const glm::mat4 &xfm) const;
+};
+
+// Six inward-facing planes (xyz normal, w offset) of a view volume, with
+// a point p inside plane k iff dot(planes[k].xyz, p) + planes[k].w >= 0
+struct Frustum {
+   enum Planes {cLeft, cRight, cBottom, cTop, cNear, cFar, cNumPlanes};
+   enum Result {cOutside, cIntersects, cInside};
+
+   glm::vec4 mPlanes[cNumPlanes];
+
+   // Planes of the clip volume of view-projection matrix vp
+   static Frustum FromMatrix(const glm::mat4 &vp);
+
+   // One frustum enclosing both eye frusta of a stereo pair, so a single
+   // culling pass serves both.  Side planes come from the outer eye, the
+   // rest from the eyes' mean orientation, each pushed out until it
+   // contains all eight corners of both eye volumes.
+   static Frustum Combine(const glm::mat4 &leftVp, const glm::mat4 &rightVp);
+
+   // Classify box as fully outside, straddling, or fully inside
+   Result Classify(const Aabb &) const;
+};
+
+// One eye's view for LOD selection: view-projection, and viewport height
+// in pixels
+struct LodView {
+   glm::mat4 mVP;
+   float mHeight;
+
+   LodView(const glm::mat4 &vp, float ht) : mVP(vp), mHeight(ht) {}
+};
@@ -27,7 +27,7 @@ SimpleDisplay Functions
 
 // Set up a wd x ht window, assuming that SDL is already initialized.  Throw
 // WorldExceptions for any difficulties.
-SimpleDisplay::SimpleDisplay(int wd, int ht) {
+SimpleDisplay::SimpleDisplay(int wd, int ht) : mHeight(ht) {
 
    mWindow = SDL_CreateWindow(
     "SDL Tutorial",
@@ -59,9 +59,10 @@ SimpleDisplay::SimpleDisplay(int wd, int ht) {
    );
 }
 
-// Redraw window content given viewTrans, shader, and num of preloaded indices
-void SimpleDisplay::Redraw( shared_ptr<Shader> sdr, uint numIdx) {
-   glDrawElements(GL_TRIANGLES, numIdx, GL_UNSIGNED_INT, (void*)0); GLChkErr;
+// Redraw window content given shader and the draw calls to make
+void SimpleDisplay::Redraw(shared_ptr<Shader> sdr,
+ const function<void()> &draw) {
+   draw();
 }
 
 // output pre-drawn buffer
@@ -77,7 +78,19 @@ void SimpleDisplay::PrepareWindow(std::shared_ptr<Shader> sdr,
    mat4 xfm = inp->GetViewTransform();
    vec3 absPos = vec3(xfm[3][0], xfm[3][1], xfm[3][2]);
 
-   sdr->Run(mPspXForm * mViewXForm * xfm, absPos);
+   mVP = mPspXForm * mViewXForm * xfm;
+   sdr->Run(mVP, absPos);
+}
+
+// view volume of the single eye
+Frustum SimpleDisplay::GetFrustum() const {
+   return Frustum::FromMatrix(mVP);
+}
+
+// the single eye, at window height
+void SimpleDisplay::GetLodViews(vector<LodView> *views) const {
+   views->clear();
+   views->push_back(LodView(mVP, (float)mHeight));
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
@@ -85,7 +98,8 @@ HMDDisplay Functions
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 // initilize and prepare bland SDL window for input
-HMDDisplay::HMDDisplay(IVRSystem *HMD) {
+HMDDisplay::HMDDisplay(IVRSystem *HMD, bool singlePass)
+ : mSinglePass(singlePass) {
    HMD->GetRecommendedRenderTargetSize(&mHMDDisplayWD, &mHMDDisplayHT);
 
    mWindow = SDL_CreateWindow(
@@ -104,143 +118,112 @@ HMDDisplay::HMDDisplay(IVRSystem *HMD) {
    InitContext(mWindow);
 }
 
-// create the different FBs for LR displays
+// create the frame graph's targets for LR displays
 void HMDDisplay::CreateFBs(shared_ptr<HMDInput> input) {
-   mLeft = shared_ptr<FrameBuffer>(new FrameBuffer());
-   mRight = shared_ptr<FrameBuffer>(new FrameBuffer());
    mLeftPsp = input->ComputeEyePerspective(HMDInput::cLeft);
    mRightPsp = input->ComputeEyePerspective(HMDInput::cRight);
-   CreateFrameBuffer(mLeft);
-   CreateFrameBuffer(mRight);
+   BuildGraph();
+   mGraph.Realize();
+   printf("frame graph %u passes, %u culled, %u targets in %u textures, "
+    "%.1f of %.1f MB\n", mGraph.GetPassCount(), mGraph.GetCulledCount(),
+    mGraph.GetTransientCount(), mGraph.GetTextureCount(),
+    mGraph.GetTextureBytes() / 1048576.0,
+    mGraph.GetTransientBytes() / 1048576.0);
 }
 
-// Create and manage a single FB for either L or R
-void HMDDisplay::CreateFrameBuffer(shared_ptr<FrameBuffer> buff) {
-   glGenFramebuffers(1, &buff->renderFramebufferId); GLChkErr;
-   glBindFramebuffer(
-    GL_FRAMEBUFFER, buff->renderFramebufferId); GLChkErr;
-
-   glGenRenderbuffers(1, &buff->depthBufferId); GLChkErr;
-   glBindRenderbuffer(GL_RENDERBUFFER, buff->depthBufferId); GLChkErr;
-   glRenderbufferStorageMultisample(
-    GL_RENDERBUFFER, 8, GL_DEPTH_COMPONENT, mHMDDisplayWD, mHMDDisplayHT);
-   GLChkErr;
-   glFramebufferRenderbuffer(
-    GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
-    buff->depthBufferId); GLChkErr;
-
-   glGenTextures(1, &buff->renderTextureId); GLChkErr;
-   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE,
-    buff->renderTextureId); GLChkErr;
-
-   glTexImage2DMultisample(
-    GL_TEXTURE_2D_MULTISAMPLE, 8, GL_RGBA8, mHMDDisplayWD, mHMDDisplayHT, 1);
-   GLChkErr;
-
-   glFramebufferTexture2D(
-    GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE,
-    buff->renderTextureId, 0); GLChkErr;
-
-   glGenFramebuffers(1, &buff->resolveFramebufferId); GLChkErr;
-   glBindFramebuffer(
-    GL_FRAMEBUFFER, buff->resolveFramebufferId); GLChkErr;
-
-   glGenTextures(1, &buff->resolveTextureId); GLChkErr;
-   glBindTexture(GL_TEXTURE_2D, buff->resolveTextureId); GLChkErr;
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); GLChkErr;
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0); GLChkErr;
-   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mHMDDisplayWD, mHMDDisplayHT,
-    0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); GLChkErr;
-
-   glFramebufferTexture2D(
-    GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-    buff->resolveTextureId, 0); GLChkErr;
-
-   // check FBO status
-   GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER); GLChkErr;
-   if (status != GL_FRAMEBUFFER_COMPLETE) {
-      throw WorldException(
-         "Frame Render Error");
+// declare each eye's 8x multisampled color and depth, drawn and resolved
+// into a texture for the compositor, right eye first.  Single pass
+// declares one double-wide set instead, submitted as two halves.
+void HMDDisplay::BuildGraph() {
+   uint wd = mSinglePass ? 2 * mHMDDisplayWD : mHMDDisplayWD;
+   TargetDesc color(wd, mHMDDisplayHT, GL_RGBA8, 8);
+   TargetDesc depth(wd, mHMDDisplayHT, GL_DEPTH_COMPONENT24, 8);
+   TargetDesc resolved(wd, mHMDDisplayHT, GL_RGBA8);
+   FrameGraph::Target eyes[2];
+   FrameGraph::Pass submit;
+
+   mGraph.SetClearColor(vec4(0.1f, 0.1f, 0.0f, 1.0f));
+   for (uint e = 0; e < (mSinglePass ? 1u : 2u); e++) {
+      string name = mSinglePass ? "eyes" : e ? "left eye" : "right eye";
+      FrameGraph::Target msaa = mGraph.Create(name + " msaa", color);
+      FrameGraph::Target z = mGraph.Create(name + " depth", depth);
+      FrameGraph::Pass draw = mGraph.AddPass(name, [this, e]() {
+         glEnable(GL_MULTISAMPLE); GLChkErr;
+         if (mSinglePass) {
+            glEnable(GL_CLIP_DISTANCE0); GLChkErr;
+            mSdr->RunStereo(mLeftPsp * mHMDXfm, mRightPsp * mHMDXfm,
+             mAbsPos);
+            (*mDraw)();
+            glDisable(GL_CLIP_DISTANCE0); GLChkErr;
+         }
+         else
+            RenderEye((e ? mLeftPsp : mRightPsp) * mHMDXfm);
+         glDisable(GL_MULTISAMPLE);
+      });
+
+      eyes[e] = mGraph.Create(name + " resolved", resolved);
+      mGraph.Write(draw, msaa, true);
+      mGraph.Write(draw, z, true);
+      mGraph.AddResolve(name + " resolve", msaa, eyes[e]);
    }
 
-   glBindFramebuffer(GL_FRAMEBUFFER, 0); GLChkErr;
+   submit = mGraph.AddOutput("submit", [this, eyes]() {
+      Texture_t right = {(void*)(uintptr_t)mGraph.GetTexture(eyes[0]),
+       TextureType_OpenGL, ColorSpace_Gamma};
+      Texture_t left = {(void*)(uintptr_t)mGraph.GetTexture(
+       eyes[mSinglePass ? 0 : 1]), TextureType_OpenGL, ColorSpace_Gamma};
+      VRTextureBounds_t leftBounds = {0.0f, 0.0f, 0.5f, 1.0f};
+      VRTextureBounds_t rightBounds = {0.5f, 0.0f, 1.0f, 1.0f};
+
+      VRCompositor()->Submit(Eye_Right, &right,
+       mSinglePass ? &rightBounds : nullptr);
+      VRCompositor()->Submit(Eye_Left, &left,
+       mSinglePass ? &leftBounds : nullptr);
+   });
+   mGraph.Read(submit, eyes[0]);
+   if (!mSinglePass)
+      mGraph.Read(submit, eyes[1]);
+   mGraph.Compile();
 }
 
-// redraw both FBs for LR
-void HMDDisplay::Redraw(shared_ptr<Shader> sdr, uint numIdx) {
-   glEnable(GL_MULTISAMPLE); GLChkErr;
-
-   // Right Eye
-   glBindFramebuffer(GL_FRAMEBUFFER, mRight->renderFramebufferId); GLChkErr;
-   glViewport(0, 0, mHMDDisplayWD, mHMDDisplayHT); GLChkErr;
-   RenderEye(mRightPsp * mHMDXfm, sdr, numIdx);
-   glBindFramebuffer(GL_FRAMEBUFFER, 0); GLChkErr;
-
-   glDisable(GL_MULTISAMPLE);
-
-   glBindFramebuffer(
-      GL_READ_FRAMEBUFFER, mRight->renderFramebufferId); GLChkErr;
-   glBindFramebuffer(
-      GL_DRAW_FRAMEBUFFER, mRight->resolveFramebufferId); GLChkErr;
-
-   glBlitFramebuffer(0, 0, mHMDDisplayWD, mHMDDisplayHT, 0, 0,
-      mHMDDisplayWD, mHMDDisplayHT, GL_COLOR_BUFFER_BIT, GL_LINEAR); GLChkErr;
-
-   glBindFramebuffer(GL_READ_FRAMEBUFFER, 0); GLChkErr;
-   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); GLChkErr;
-
-   glEnable(GL_MULTISAMPLE); GLChkErr;
-
-   // Left Eye
-   glBindFramebuffer(GL_FRAMEBUFFER, mLeft->renderFramebufferId); GLChkErr;
-   glViewport(0, 0, mHMDDisplayWD, mHMDDisplayHT); GLChkErr;
-
-   RenderEye(mLeftPsp * mHMDXfm, sdr, numIdx);
-
-   glBindFramebuffer(GL_FRAMEBUFFER, 0); GLChkErr;
-
-   glDisable(GL_MULTISAMPLE);
-
-   glBindFramebuffer(
-    GL_READ_FRAMEBUFFER, mLeft->renderFramebufferId); GLChkErr;
-   glBindFramebuffer(
-    GL_DRAW_FRAMEBUFFER, mLeft->resolveFramebufferId); GLChkErr;
-
-   glBlitFramebuffer(0, 0, mHMDDisplayWD, mHMDDisplayHT, 0, 0,
-    mHMDDisplayWD, mHMDDisplayHT, GL_COLOR_BUFFER_BIT, GL_LINEAR);
-
-   glBindFramebuffer(GL_READ_FRAMEBUFFER, 0); GLChkErr;
-   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); GLChkErr;
-
-
+// run the frame graph: both eyes drawn, resolved and submitted
+void HMDDisplay::Redraw(shared_ptr<Shader> sdr,
+ const function<void()> &draw) {
+   mSdr = sdr;
+   mDraw = &draw;
+   mGraph.Execute();
+   mGraph.Report();
+   mDraw = nullptr;
 }
 
-// draw either L or R framebuffers
-void HMDDisplay::RenderEye(const glm::mat4x4 &eye,
- shared_ptr<Shader> sdr, uint numIdx) {
-   sdr->Run(eye, mAbsPos);
+// draw one eye into the bound target
+void HMDDisplay::RenderEye(const glm::mat4x4 &eye) {
+   mSdr->Run(eye, mAbsPos);
 
    ClearConsole();
    PrintVec(mAbsPos);
-   glDrawElements(GL_TRIANGLES, numIdx, GL_UNSIGNED_INT, (void*)0); GLChkErr;
+   (*mDraw)();
 }
 
-// create textures from FBs and load to LR HMD displays
+// show the mirror window; Redraw has already submitted the eyes
 void HMDDisplay::SwapWindows() {
-   Texture_t rightEyeTexture = {
-      (void*)(uintptr_t)mRight->resolveTextureId, TextureType_OpenGL,
-      ColorSpace_Gamma};
-   VRCompositor()->Submit(Eye_Right, &rightEyeTexture);
+   SDL_GL_SwapWindow(mWindow);
+}
 
-   Texture_t leftEyeTexture = {
-      (void*)(uintptr_t)mLeft->resolveTextureId, TextureType_OpenGL,
-      ColorSpace_Gamma};
-   VRCompositor()->Submit(Eye_Left, &leftEyeTexture);
+// combined view volume of both eyes, so one culling pass serves both
+Frustum HMDDisplay::GetFrustum() const {
+   return Frustum::Combine(mLeftPsp * mHMDXfm, mRightPsp * mHMDXfm);
+}
 
-   SDL_GL_SwapWindow(mWindow);
+// both eyes, at render target height
+void HMDDisplay::GetLodViews(vector<LodView> *views) const {
+   views->clear();
+   views->push_back(LodView(mLeftPsp * mHMDXfm, (float)mHMDDisplayHT));
+   views->push_back(LodView(mRightPsp * mHMDXfm, (float)mHMDDisplayHT));
 }
 
-// set up both FB for new draw frames
+// take the new head pose; the frame graph clears the targets as it binds
+// them
 void HMDDisplay::PrepareWindow(std::shared_ptr<Shader> sdr, 
  shared_ptr<HMDInput> inp) {
    try {
@@ -252,49 +235,4 @@ void HMDDisplay::PrepareWindow(std::shared_ptr<Shader> sdr,
       ClearConsole();
       printf("%s\n", e.what());
    }
-
-   glClearColor(0.1, 0.1, 0.0, 1.0);
-   glEnable(GL_MULTISAMPLE); GLChkErr;
-
-   // Left Eye
-   glBindFramebuffer(GL_FRAMEBUFFER, mLeft->renderFramebufferId); GLChkErr;
-   glViewport(0, 0, mHMDDisplayWD, mHMDDisplayHT); GLChkErr;
-
-   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-   glBindFramebuffer(GL_FRAMEBUFFER, 0); GLChkErr;
-
-   glDisable(GL_MULTISAMPLE);
-
-   glBindFramebuffer(
-      GL_READ_FRAMEBUFFER, mLeft->renderFramebufferId); GLChkErr;
-   glBindFramebuffer(
-      GL_DRAW_FRAMEBUFFER, mLeft->resolveFramebufferId); GLChkErr;
-
-   glBlitFramebuffer(0, 0, mHMDDisplayWD, mHMDDisplayHT, 0, 0,
-      mHMDDisplayWD, mHMDDisplayHT, GL_COLOR_BUFFER_BIT, GL_LINEAR);
-
-   glBindFramebuffer(GL_READ_FRAMEBUFFER, 0); GLChkErr;
-   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); GLChkErr;
-
-   glEnable(GL_MULTISAMPLE); GLChkErr;
-
-   // Right Eye
-   glBindFramebuffer(GL_FRAMEBUFFER, mRight->renderFramebufferId); GLChkErr;
-   glViewport(0, 0, mHMDDisplayWD, mHMDDisplayHT); GLChkErr;
-   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   glBindFramebuffer(GL_FRAMEBUFFER, 0); GLChkErr;
-
-   glDisable(GL_MULTISAMPLE);
-
-   glBindFramebuffer(
-      GL_READ_FRAMEBUFFER, mRight->renderFramebufferId); GLChkErr;
-   glBindFramebuffer(
-      GL_DRAW_FRAMEBUFFER, mRight->resolveFramebufferId); GLChkErr;
-
-   glBlitFramebuffer(0, 0, mHMDDisplayWD, mHMDDisplayHT, 0, 0,
-      mHMDDisplayWD, mHMDDisplayHT, GL_COLOR_BUFFER_BIT, GL_LINEAR); GLChkErr;
-
-   glBindFramebuffer(GL_READ_FRAMEBUFFER, 0); GLChkErr;
-   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); GLChkErr;
-}
\ No newline at end of file
+}
@@ -1,22 +1,14 @@
 #pragma once
+#include <functional>
+#include <vector>
+#include "Bounds.h"
+#include "FrameGraph.h"
 #include "HMDInput.h"
 #include "Utility.h"
 #include "Shader.h"
 #include <SDL.h>
 #include <glm/glm.hpp>
 
-// for creating LR framebuffers for HMD
-struct FrameBuffer {
-   GLuint depthBufferId;
-   GLuint renderTextureId;
-   GLuint renderFramebufferId;
-   GLuint resolveTextureId;
-   GLuint resolveFramebufferId;
-
-   FrameBuffer() { depthBufferId  = renderTextureId =
-   renderFramebufferId = resolveTextureId = resolveFramebufferId = 0;}
-};
-
 // base display class
 class Display {
 protected:
@@ -30,13 +22,28 @@ public:
 
    static void InitContext(SDL_Window *);
 
-   // Redraw the display, given eyepoint perpsective transform, a Shader
-   // and data on GL vertex buffers to use.
-   virtual void Redraw(std::shared_ptr<Shader> sdr, uint numIndices) = 0;
+   // Redraw the display, given a Shader and a function issuing the draw
+   // calls, run once per eye after the eye's transform is set, or once
+   // for both eyes if GetPassViews is 2.
+   virtual void Redraw(std::shared_ptr<Shader> sdr,
+    const std::function<void()> &draw) = 0;
    virtual void CreateFBs(std::shared_ptr<HMDInput>) = 0;
    virtual void SwapWindows() = 0;
    virtual void PrepareWindow(std::shared_ptr<Shader> sdr, 
     std::shared_ptr<HMDInput>) = 0;
+
+   // View volume, as of the last PrepareWindow, covering every eye
+   virtual Frustum GetFrustum() const = 0;
+
+   // Each eye's view-projection and viewport height, as of the last
+   // PrepareWindow, for choosing LODs.  Replaces *views, reusing its
+   // storage.
+   virtual void GetLodViews(std::vector<LodView> *views) const = 0;
+
+   // Views each draw call covers: 1, or 2 if both eyes are drawn in one
+   // pass, by drawing every instance twice over, with gl_InstanceID
+   // picking the eye
+   virtual uint GetPassViews() const {return 1;}
 };
 
 // One-window monocular view
@@ -44,40 +51,54 @@ class SimpleDisplay : public Display {
    // member data
    glm::mat4 mViewXForm;  // Camera "back off" from origin and LH -> RH shift
    glm::mat4 mPspXForm;   // Perspective transform
+   glm::mat4 mVP;         // Full view-projection from last PrepareWindow
+   int mHeight;           // Window height in pixels
 public:
    // Add constructor parameters as needed
    SimpleDisplay(int, int);
 
-   void Redraw(std::shared_ptr<Shader> sdr,uint numIndices) override;
+   void Redraw(std::shared_ptr<Shader> sdr,
+    const std::function<void()> &draw) override;
    void CreateFBs(std::shared_ptr<HMDInput>) override {};
    void SwapWindows() override;
    void PrepareWindow(std::shared_ptr<Shader> sdr, 
     std::shared_ptr<HMDInput>) override;
+   Frustum GetFrustum() const override;
+   void GetLodViews(std::vector<LodView> *) const override;
 };
 
-// HMD dual framebuffer display
+// HMD dual framebuffer display.  Its eye, resolve and submit passes
+// run as a FrameGraph, so each eye's multisampled targets are cleared as
+// they are bound, and the two eyes' share one set of textures.
 class HMDDisplay : public Display {
    // member data
    uint mHMDDisplayHT;
    uint mHMDDisplayWD;
    glm::mat4x4 mLeftPsp;
    glm::mat4x4 mRightPsp;
-   std::shared_ptr<FrameBuffer> mLeft;
-   std::shared_ptr<FrameBuffer> mRight;
    glm::mat4x4 mHMDXfm;
    glm::vec3 mAbsPos;
+   bool mSinglePass;   // Both eyes side by side in one target, one pass
+   FrameGraph mGraph;
+   std::shared_ptr<Shader> mSdr;             // For the passes, in Redraw
+   const std::function<void()> *mDraw = nullptr;
 
-   void CreateFrameBuffer(std::shared_ptr<FrameBuffer>);
-   void RenderEye(const glm::mat4x4 &, std::shared_ptr<Shader>, uint);
+   void BuildGraph();
+   void RenderEye(const glm::mat4x4 &);
 
 public:
-   // Add constructor parameters as needed
-   HMDDisplay(vr::IVRSystem *);
+   // Add constructor parameters as needed.  singlePass draws both eyes
+   // at once into one double-wide target, submitted as two halves.
+   HMDDisplay(vr::IVRSystem *, bool singlePass = false);
 
-   void Redraw(std::shared_ptr<Shader> sdr, uint numIndices) override;
+   void Redraw(std::shared_ptr<Shader> sdr,
+    const std::function<void()> &draw) override;
    void CreateFBs(std::shared_ptr<HMDInput>) override;
    void SwapWindows() override;
    void PrepareWindow(std::shared_ptr<Shader> sdr, 
     std::shared_ptr<HMDInput>) override;
+   Frustum GetFrustum() const override;
+   void GetLodViews(std::vector<LodView> *) const override;
+   uint GetPassViews() const override {return mSinglePass ? 2 : 1;}
 };
 
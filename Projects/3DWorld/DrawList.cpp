@@ -0,0 +1,56 @@
+#include <cstring>
+
+#include "DrawList.h"
+
+using namespace std;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+DrawList Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// packs the fields, high to low, each clamped to its width
+uint64_t DrawList::MakeKey(uint shader, uint material, float depth,
+ uint draw) {
+   uint bits, bucket;
+
+   depth = depth > 0.0f ? depth : 0.0f;
+   memcpy(&bits, &depth, sizeof(bits));
+   bucket = bits >> (32 - cDepthBits);
+
+   return (uint64_t)(shader & ((1u << cShaderBits) - 1))
+    << (cDrawBits + cDepthBits + cMaterialBits)
+    | (uint64_t)(material & ((1u << cMaterialBits) - 1))
+    << (cDrawBits + cDepthBits)
+    | (uint64_t)bucket << cDrawBits
+    | (draw & ((1u << cDrawBits) - 1));
+}
+
+/// LSD radix sort, one byte per pass, ping-ponging with mScratch
+void DrawList::Sort() {
+   uint counts[256];
+   uint64_t diff = 0;
+   size_t n = mKeys.size();
+
+   // Bytes where every key agrees need no pass
+   for (size_t i = 1; i < n; i++)
+      diff |= mKeys[i] ^ mKeys[0];
+
+   mScratch.resize(n);
+   for (int shift = 0; shift < 64; shift += 8) {
+      if (!(diff >> shift & 0xFF))
+         continue;
+
+      memset(counts, 0, sizeof(counts));
+      for (uint64_t key : mKeys)
+         counts[key >> shift & 0xFF]++;
+      for (uint b = 0, sum = 0; b < 256; b++) {
+         uint count = counts[b];
+
+         counts[b] = sum;
+         sum += count;
+      }
+      for (uint64_t key : mKeys)
+         mScratch[counts[key >> shift & 0xFF]++] = key;
+      mKeys.swap(mScratch);
+   }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Utility.h"
+
+// One frame's draws, each a 64-bit sort key.  From the top: shader
+// variant, material id, a front-to-back depth bucket, and the draw's own
+// index, so sorting the keys groups draws by program, then by textures,
+// then orders each material's draws nearest first for early depth
+// rejection.  Keys are sorted by LSD radix sort, a byte per pass, which
+// skips any byte all keys share, as the high shader and material bytes
+// usually do.
+class DrawList {
+   std::vector<uint64_t> mKeys, mScratch;
+
+public:
+   static constexpr int cDrawBits = 20;
+   static constexpr int cDepthBits = 16;
+   static constexpr int cMaterialBits = 24;
+   static constexpr int cShaderBits = 4;
+
+   // Key for draw at view depth depth (clip w), drawn with variant shader
+   // and material.  Depth buckets are the top bits of the float, so they
+   // are finer near the eye; negative depths share bucket 0.
+   static uint64_t MakeKey(uint shader, uint material, float depth,
+    uint draw);
+
+   static uint GetDraw(uint64_t key) {
+      return (uint)(key & ((1u << cDrawBits) - 1));
+   }
+   static uint GetMaterial(uint64_t key) {
+      return (uint)(key >> (cDrawBits + cDepthBits)
+       & ((1u << cMaterialBits) - 1));
+   }
+
+   void Clear() {mKeys.clear();}
+   void Add(uint64_t key) {mKeys.push_back(key);}
+   void Sort();
+
+   const std::vector<uint64_t> &GetKeys() const {return mKeys;}
+};
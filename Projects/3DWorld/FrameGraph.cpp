@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "FrameGraph.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+TargetDesc Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// whether the format attaches as depth
+bool TargetDesc::IsDepth() const {
+   return mFormat == GL_DEPTH_COMPONENT || mFormat == GL_DEPTH_COMPONENT24
+    || mFormat == GL_DEPTH_COMPONENT32F;
+}
+
+/// approximate video memory, counting every format as 4 bytes a sample
+size_t TargetDesc::Bytes() const {
+   return (size_t)mWidth * mHeight * mSamples * 4;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+FrameGraph Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// the texture backing t, once realized
+GLuint FrameGraph::Texture(Target t) const {
+   const Resource &res = mResources[t];
+
+   if (res.mImported)
+      return res.mImported;
+   return res.mPhysical < 0 || res.mPhysical >= (int)mTextures.size() ? 0
+    : mTextures[res.mPhysical];
+}
+
+/// a framebuffer with the textures of attachments attached, shared by
+/// every pass attaching the same textures
+GLuint FrameGraph::GetFbo(const vector<Target> &attachments) {
+   vector<GLuint> texs;
+   bool color = false;
+   GLuint fbo;
+
+   for (Target t : attachments) {
+      texs.push_back(Texture(t));
+      texs.push_back((GLuint)(mResources[t].mLayer + 1));
+   }
+   for (auto &entry : mFbos)
+      if (entry.first == texs)
+         return entry.second;
+
+   glGenFramebuffers(1, &fbo); GLChkErr;
+   glBindFramebuffer(GL_FRAMEBUFFER, fbo); GLChkErr;
+   for (Target t : attachments) {
+      const TargetDesc &desc = mResources[t].mDesc;
+      GLenum att = desc.IsDepth() ? GL_DEPTH_ATTACHMENT
+       : GL_COLOR_ATTACHMENT0;
+
+      if (mResources[t].mLayer >= 0)
+         glFramebufferTextureLayer(GL_FRAMEBUFFER, att, Texture(t), 0,
+          mResources[t].mLayer);
+      else
+         glFramebufferTexture2D(GL_FRAMEBUFFER, att, desc.mSamples > 1
+          ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D, Texture(t), 0);
+      GLChkErr;
+      color = color || !desc.IsDepth();
+   }
+   if (!color) {
+      glDrawBuffer(GL_NONE); GLChkErr;
+      glReadBuffer(GL_NONE); GLChkErr;
+   }
+   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      throw WorldException("Frame Render Error");
+   glBindFramebuffer(GL_FRAMEBUFFER, 0); GLChkErr;
+
+   mFbos.push_back(make_pair(texs, fbo));
+   return fbo;
+}
+
+/// bind fbo to bind with a viewport covering desc
+void FrameGraph::BindFbo(GLenum bind, GLuint fbo, const TargetDesc &desc,
+ PassStats *stats) {
+   glBindFramebuffer(bind, fbo); GLChkErr;
+   glViewport(0, 0, desc.mWidth, desc.mHeight); GLChkErr;
+   stats->mBinds++;
+}
+
+/// tell GL the attachments pass used for the last time need not be kept,
+/// so a tiled or compressing GPU can skip storing them.  Returns whether
+/// there were any and GL could take them.
+bool FrameGraph::Discard(GLenum bind, const PassData &pass) {
+   GLenum atts[cMaxAttachments];
+   GLsizei count = 0;
+
+   if (pass.mDiscards.empty()
+    || !(GLEW_VERSION_4_3 || GLEW_ARB_invalidate_subdata))
+      return false;
+
+   // Compile keeps mDiscards within cMaxAttachments
+   for (Target t : pass.mDiscards)
+      atts[count++] = mResources[t].mDesc.IsDepth() ? GL_DEPTH_ATTACHMENT
+       : GL_COLOR_ATTACHMENT0;
+   glInvalidateFramebuffer(bind, count, atts); GLChkErr;
+   return true;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+FrameGraph Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// a transient, assigned a texture by Compile
+FrameGraph::Target FrameGraph::Create(const string &name,
+ const TargetDesc &desc) {
+   mResources.push_back({name, desc, 0, -1, -1, -1, -1});
+   return (Target)mResources.size() - 1;
+}
+
+/// an external texture, such as one read in later frames
+FrameGraph::Target FrameGraph::Import(const string &name,
+ const TargetDesc &desc, GLuint tex, int layer) {
+   mResources.push_back({name, desc, tex, layer, -1, -1, -1});
+   return (Target)mResources.size() - 1;
+}
+
+/// a drawing pass; an empty exec only clears
+FrameGraph::Pass FrameGraph::AddPass(const string &name,
+ const function<void()> &exec) {
+   PassData pass;
+
+   pass.mName = name;
+   pass.mKind = cDraw;
+   pass.mExec = exec;
+   pass.mSideEffect = pass.mCulled = pass.mSkipped = false;
+   pass.mClearMask = 0;
+   pass.mFbo = pass.mReadFbo = 0;
+   mPasses.push_back(pass);
+   return (Pass)mPasses.size() - 1;
+}
+
+/// a resolve of src into dst
+FrameGraph::Pass FrameGraph::AddResolve(const string &name, Target src,
+ Target dst) {
+   Pass p = AddPass(name, nullptr);
+
+   mPasses[p].mKind = cResolve;
+   Read(p, src);
+   Write(p, dst);
+   return p;
+}
+
+/// a pass kept for what it does outside the graph
+FrameGraph::Pass FrameGraph::AddOutput(const string &name,
+ const function<void()> &exec) {
+   Pass p = AddPass(name, exec);
+
+   mPasses[p].mKind = cOther;
+   mPasses[p].mSideEffect = true;
+   return p;
+}
+
+/// pass p samples, blits from or otherwise uses target t
+void FrameGraph::Read(Pass p, Target t) {
+   mPasses[p].mReads.push_back(t);
+}
+
+/// pass p renders into target t, clearing it first if clear
+void FrameGraph::Write(Pass p, Target t, bool clear) {
+   mPasses[p].mWrites.push_back({t, clear});
+}
+
+/// culls by reference count: a target is needed while a live pass reads
+/// it, and a pass while a needed target, an import or a side effect is
+/// among its outputs.  Then, walking the live passes in order, drops
+/// clears of targets holding nothing but a clear, and hands each
+/// transient, at its first use, a free texture of its description, or
+/// a new one, which it frees again after its last use.  That last use
+/// discards it only if the pass has it attached; a transient last
+/// sampled by some later pass was already stored by its writer.
+void FrameGraph::Compile() {
+   vector<uint> readers(mResources.size(), 0), passRefs(mPasses.size());
+   vector<Target> unread;
+   vector<bool> cleared(mResources.size(), false);
+   vector<int> free;
+
+   mTextureDescs.clear();
+   for (auto &res : mResources)
+      res.mFirst = res.mLast = res.mPhysical = -1;
+
+   for (auto &pass : mPasses)
+      for (Target t : pass.mReads)
+         readers[t]++;
+   for (uint p = 0; p < mPasses.size(); p++) {
+      PassData &pass = mPasses[p];
+
+      pass.mCulled = false;
+      pass.mClearMask = 0;
+      pass.mDiscards.clear();
+      passRefs[p] = (uint)pass.mWrites.size() + pass.mSideEffect;
+      for (auto &w : pass.mWrites)
+         passRefs[p] += mResources[w.mTarget].mImported != 0;
+   }
+   for (Target t = 0; t < mResources.size(); t++)
+      if (!readers[t])
+         unread.push_back(t);
+
+   while (!unread.empty()) {
+      Target t = unread.back();
+
+      unread.pop_back();
+      for (uint p = 0; p < mPasses.size(); p++)
+         for (auto &w : mPasses[p].mWrites)
+            if (w.mTarget == t && !mPasses[p].mCulled && !--passRefs[p]) {
+               mPasses[p].mCulled = true;
+               for (Target r : mPasses[p].mReads)
+                  if (!--readers[r])
+                     unread.push_back(r);
+            }
+   }
+
+   for (uint p = 0; p < mPasses.size(); p++) {
+      PassData &pass = mPasses[p];
+      uint colors = 0, depths = 0;
+
+      if (pass.mCulled)
+         continue;
+
+      for (Target t : pass.mReads) {
+         if (!mResources[t].mImported && mResources[t].mFirst < 0)
+            throw WorldException(StringPrintf("Pass %s reads %s before it "
+             "is written", pass.mName.c_str(), mResources[t].mName.c_str()));
+         mResources[t].mLast = p;
+      }
+      for (auto &w : pass.mWrites) {
+         Resource &res = mResources[w.mTarget];
+
+         if (res.mFirst < 0)
+            res.mFirst = p;
+         res.mLast = p;
+         (res.mDesc.IsDepth() ? depths : colors)++;
+         if (w.mClear && !cleared[w.mTarget])
+            pass.mClearMask |= res.mDesc.IsDepth() ? GL_DEPTH_BUFFER_BIT
+             : GL_COLOR_BUFFER_BIT;
+         cleared[w.mTarget] = w.mClear && !pass.mExec;
+      }
+      if (pass.mKind == cDraw && !colors && !depths)
+         throw WorldException(StringPrintf("Pass %s writes no target",
+          pass.mName.c_str()));
+      if (colors > 1 || depths > 1)
+         throw WorldException(StringPrintf("Pass %s writes more than one "
+          "color or depth target", pass.mName.c_str()));
+   }
+
+   for (uint p = 0; p < mPasses.size(); p++) {
+      PassData &pass = mPasses[p];
+      vector<Target> used(pass.mReads);
+
+      if (pass.mCulled)
+         continue;
+
+      for (auto &w : pass.mWrites)
+         used.push_back(w.mTarget);
+      for (Target t : used) {
+         Resource &res = mResources[t];
+
+         if (res.mImported || res.mFirst != (int)p || res.mPhysical >= 0)
+            continue;
+         for (uint f = 0; f < free.size() && res.mPhysical < 0; f++)
+            if (mTextureDescs[free[f]] == res.mDesc) {
+               res.mPhysical = free[f];
+               free.erase(free.begin() + f);
+            }
+         if (res.mPhysical < 0) {
+            res.mPhysical = (int)mTextureDescs.size();
+            mTextureDescs.push_back(res.mDesc);
+         }
+      }
+      for (Target t : used) {
+         Resource &res = mResources[t];
+         bool attached = pass.mKind == cResolve ? t == pass.mReads[0]
+          : pass.mKind == cDraw && any_of(pass.mWrites.begin(),
+          pass.mWrites.end(), [t](const Access &w) {return w.mTarget == t;});
+
+         if (res.mImported || res.mLast != (int)p)
+            continue;
+         if (find(free.begin(), free.end(), res.mPhysical) == free.end())
+            free.push_back(res.mPhysical);
+         if (attached && find(pass.mDiscards.begin(), pass.mDiscards.end(),
+          t) == pass.mDiscards.end())
+            pass.mDiscards.push_back(t);
+      }
+      if (pass.mDiscards.size() > cMaxAttachments)
+         throw WorldException(StringPrintf("Pass %s discards more than %u "
+          "targets", pass.mName.c_str(), cMaxAttachments));
+   }
+
+   mShownStats.assign(mPasses.size(), PassStats());
+   mCompiled = true;
+}
+
+/// one texture per compiled description, then the framebuffers of each
+/// live pass
+void FrameGraph::Realize() {
+   if (!mCompiled)
+      Compile();
+
+   mTextures.resize(mTextureDescs.size());
+   if (!mTextures.empty()) {
+      glGenTextures((GLsizei)mTextures.size(), mTextures.data()); GLChkErr;
+   }
+   for (uint i = 0; i < mTextures.size(); i++) {
+      const TargetDesc &desc = mTextureDescs[i];
+
+      if (desc.mSamples > 1) {
+         glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, mTextures[i]); GLChkErr;
+         glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.mSamples,
+          desc.mFormat, desc.mWidth, desc.mHeight, GL_TRUE); GLChkErr;
+      }
+      else {
+         glBindTexture(GL_TEXTURE_2D, mTextures[i]); GLChkErr;
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+         GLChkErr;
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0); GLChkErr;
+         glTexImage2D(GL_TEXTURE_2D, 0, desc.mFormat, desc.mWidth,
+          desc.mHeight, 0, desc.IsDepth() ? GL_DEPTH_COMPONENT : GL_RGBA,
+          desc.IsDepth() ? GL_FLOAT : GL_UNSIGNED_BYTE, nullptr); GLChkErr;
+      }
+   }
+
+   for (auto &pass : mPasses) {
+      vector<Target> writes;
+
+      if (pass.mCulled || pass.mKind == cOther)
+         continue;
+
+      for (auto &w : pass.mWrites)
+         writes.push_back(w.mTarget);
+      pass.mFbo = GetFbo(writes);
+      if (pass.mKind == cResolve)
+         pass.mReadFbo = GetFbo(pass.mReads);
+   }
+}
+
+/// binds each draw pass's framebuffer only if the last pass left another
+/// bound, and clears it in one call.  A resolve binds its own pair.
+void FrameGraph::Execute() {
+   GLuint bound = 0;
+
+   for (auto &pass : mPasses) {
+      if (pass.mCulled || pass.mSkipped)
+         continue;
+
+      pass.mStats = PassStats();
+      if (pass.mKind == cDraw) {
+         const TargetDesc &desc = mResources[pass.mWrites[0].mTarget].mDesc;
+
+         if (pass.mFbo != bound) {
+            BindFbo(GL_FRAMEBUFFER, pass.mFbo, desc, &pass.mStats);
+            bound = pass.mFbo;
+         }
+         if (pass.mClearMask) {
+            glClearColor(mClearColor.x, mClearColor.y, mClearColor.z,
+             mClearColor.w); GLChkErr;
+            glClear(pass.mClearMask); GLChkErr;
+            pass.mStats.mClears++;
+         }
+         if (pass.mExec)
+            pass.mExec();
+         pass.mStats.mDiscards += Discard(GL_FRAMEBUFFER, pass);
+      }
+      else if (pass.mKind == cResolve) {
+         const TargetDesc &desc = mResources[pass.mReads[0]].mDesc;
+         bool depth = desc.IsDepth();
+
+         glBindFramebuffer(GL_READ_FRAMEBUFFER, pass.mReadFbo); GLChkErr;
+         BindFbo(GL_DRAW_FRAMEBUFFER, pass.mFbo, desc, &pass.mStats);
+         glBlitFramebuffer(0, 0, desc.mWidth, desc.mHeight, 0, 0,
+          desc.mWidth, desc.mHeight, depth ? GL_DEPTH_BUFFER_BIT
+          : GL_COLOR_BUFFER_BIT, depth ? GL_NEAREST : GL_LINEAR); GLChkErr;
+         pass.mStats.mResolves++;
+         pass.mStats.mDiscards += Discard(GL_READ_FRAMEBUFFER, pass);
+
+         // the read binding now differs, so the next draw pass rebinds
+         glBindFramebuffer(GL_READ_FRAMEBUFFER, 0); GLChkErr;
+         bound = ~(GLuint)0;
+      }
+      else if (pass.mExec)
+         pass.mExec();
+   }
+
+   if (bound) {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0); GLChkErr;
+   }
+}
+
+/// one line per pass
+void FrameGraph::Report() {
+   if (mShownStats.empty())
+      return;
+
+   for (uint p = 0; p < mPasses.size(); p++) {
+      const PassData &pass = mPasses[p];
+
+      if (pass.mCulled || !(pass.mStats != mShownStats[p]))
+         continue;
+
+      printf("pass %-14s binds %u clears %u resolves %u discards %u\n",
+       pass.mName.c_str(), pass.mStats.mBinds, pass.mStats.mClears,
+       pass.mStats.mResolves, pass.mStats.mDiscards);
+      mShownStats[p] = pass.mStats;
+   }
+}
+
+/// passes Compile dropped
+uint FrameGraph::GetCulledCount() const {
+   uint rtn = 0;
+
+   for (auto &pass : mPasses)
+      rtn += pass.mCulled;
+   return rtn;
+}
+
+/// transients some live pass uses
+uint FrameGraph::GetTransientCount() const {
+   uint rtn = 0;
+
+   for (auto &res : mResources)
+      rtn += !res.mImported && res.mFirst >= 0;
+   return rtn;
+}
+
+/// video memory the live transients would need unaliased
+size_t FrameGraph::GetTransientBytes() const {
+   size_t rtn = 0;
+
+   for (auto &res : mResources)
+      if (!res.mImported && res.mFirst >= 0)
+         rtn += res.mDesc.Bytes();
+   return rtn;
+}
+
+/// video memory the compiled textures need
+size_t FrameGraph::GetTextureBytes() const {
+   size_t rtn = 0;
+
+   for (auto &desc : mTextureDescs)
+      rtn += desc.Bytes();
+   return rtn;
+}
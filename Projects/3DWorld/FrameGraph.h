@@ -0,0 +1,165 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/vec4.hpp>
+
+#include "Utility.h"
+
+// Size and format of a render target.  Depth formats attach as depth,
+// all others as color 0.  mSamples > 1 is a multisampled texture.
+struct TargetDesc {
+   uint mWidth, mHeight;
+   GLenum mFormat;
+   uint mSamples;
+
+   TargetDesc(uint wd, uint ht, GLenum fmt, uint samples = 1)
+    : mWidth(wd), mHeight(ht), mFormat(fmt), mSamples(samples) {}
+   bool operator==(const TargetDesc &d) const {return mWidth == d.mWidth
+    && mHeight == d.mHeight && mFormat == d.mFormat
+    && mSamples == d.mSamples;}
+
+   bool IsDepth() const;
+   size_t Bytes() const;
+};
+
+// GL work done for one pass in its last Execute
+struct PassStats {
+   uint mBinds;      // Framebuffer binds, with viewport
+   uint mClears;     // glClear calls, each covering all cleared targets
+   uint mResolves;   // Multisample resolve blits
+   uint mDiscards;   // glInvalidateFramebuffer calls
+
+   PassStats() : mBinds(0), mClears(0), mResolves(0), mDiscards(0) {}
+   bool operator!=(const PassStats &s) const {return mBinds != s.mBinds
+    || mClears != s.mClears || mResolves != s.mResolves
+    || mDiscards != s.mDiscards;}
+};
+
+// A frame's render passes, declared once with the targets each reads and
+// writes, then compiled into the GL work they need and executed per
+// frame.  Compiling culls passes whose output nothing uses, folds each
+// clear into its pass's own bind and drops clears of a target already
+// cleared and not since written, and gives transient targets whose
+// lifetimes don't overlap the same texture.  Executing binds a
+// framebuffer only when the target set changes, and discards transient
+// targets after their last use where GL 4.3 or ARB_invalidate_subdata
+// allows.  Passes run in declaration order, which must put each
+// target's writers before its readers.
+class FrameGraph {
+public:
+   typedef uint Target;
+   typedef uint Pass;
+
+private:
+   enum Kind {cDraw, cResolve, cOther};
+
+   // Most targets a pass attaches, and so discards: Compile allows one
+   // color and one depth
+   static constexpr uint cMaxAttachments = 2;
+
+   struct Resource {
+      std::string mName;
+      TargetDesc mDesc;
+      GLuint mImported;    // Texture if imported, else 0
+      int mLayer;          // Imported array layer, or -1 if 2D
+      int mFirst, mLast;   // Live passes using it, -1 if none
+      int mPhysical;       // Index in mTextures, or -1 if imported
+   };
+
+   struct Access {
+      Target mTarget;
+      bool mClear;         // Write wants cleared contents
+   };
+
+   struct PassData {
+      std::string mName;
+      Kind mKind;
+      std::function<void()> mExec;
+      std::vector<Target> mReads;
+      std::vector<Access> mWrites;
+      bool mSideEffect;    // Kept though nothing reads its writes
+      bool mCulled;
+      bool mSkipped;       // Left out of Execute, its result still valid
+      GLbitfield mClearMask;       // Compiled clears, if any
+      std::vector<Target> mDiscards;  // Attached transients last used here
+      GLuint mFbo, mReadFbo;       // Draw target, and resolve source
+      PassStats mStats;
+   };
+
+   std::vector<Resource> mResources;
+   std::vector<PassData> mPasses;
+   std::vector<TargetDesc> mTextureDescs;  // Per physical texture
+   std::vector<GLuint> mTextures;
+   std::vector<std::pair<std::vector<GLuint>, GLuint>> mFbos;
+   std::vector<PassStats> mShownStats;
+   glm::vec4 mClearColor;
+   bool mCompiled = false;
+
+   GLuint Texture(Target t) const;
+   GLuint GetFbo(const std::vector<Target> &attachments);
+   void BindFbo(GLenum bind, GLuint fbo, const TargetDesc &, PassStats *);
+   bool Discard(GLenum bind, const PassData &);
+
+public:
+   FrameGraph() : mClearColor(0.0f, 0.0f, 0.0f, 1.0f) {}
+
+   // A target owned by the graph, which may share its texture with
+   // transients not live at the same time
+   Target Create(const std::string &name, const TargetDesc &);
+
+   // An existing texture, or layer of a texture array, which the graph
+   // never aliases or discards, and whose writers are never culled
+   Target Import(const std::string &name, const TargetDesc &, GLuint tex,
+    int layer = -1);
+
+   // A pass drawing into the targets it writes, bound together as one
+   // framebuffer with a full-target viewport before exec runs
+   Pass AddPass(const std::string &name, const std::function<void()> &exec);
+
+   // A pass blitting multisampled src into single-sampled dst
+   Pass AddResolve(const std::string &name, Target src, Target dst);
+
+   // A pass with no framebuffer of its own, such as a compositor submit,
+   // which is never culled
+   Pass AddOutput(const std::string &name,
+    const std::function<void()> &exec);
+
+   void Read(Pass, Target);
+   void Write(Pass, Target, bool clear = false);
+   void SetClearColor(const glm::vec4 &clr) {mClearColor = clr;}
+
+   // Leave pass p out of Executes until unskipped, as when what it last
+   // rendered is still good.  Its stats stay those of its last run.
+   void Skip(Pass p, bool skip) {mPasses[p].mSkipped = skip;}
+
+   // Cull, order clears and discards, and assign textures, with no GL
+   // calls.  Call after every pass is declared.
+   void Compile();
+
+   // Create the compiled textures and framebuffers
+   void Realize();
+
+   // Run every live pass, leaving the default framebuffer bound
+   void Execute();
+
+   // Print each live pass's stats if any changed since the last report
+   void Report();
+
+   // Texture of t, once realized
+   GLuint GetTexture(Target t) const {return Texture(t);}
+
+   uint GetPassCount() const {return (uint)mPasses.size();}
+   uint GetCulledCount() const;
+   uint GetTransientCount() const;
+   uint GetTextureCount() const {return (uint)mTextureDescs.size();}
+   size_t GetTransientBytes() const;
+   size_t GetTextureBytes() const;
+   const PassStats &GetStats(Pass p) const {return mPasses[p].mStats;}
+
+   // Transients pass p discards, as last compiled
+   const std::vector<Target> &GetDiscards(Pass p) const {
+      return mPasses[p].mDiscards;
+   }
+};
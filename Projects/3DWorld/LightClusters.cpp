@@ -0,0 +1,358 @@
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define CLUSTER_SIMD 1
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+#include "LightClusters.h"
+#include "Parallel.h"
+
+using namespace std;
+using namespace glm;
+
+typedef LightClusters LC;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Kernels
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// signed distance of (x, y, z) from unit plane p, summed in the order
+/// the SIMD kernel sums it, so both compare alike
+static inline float Dist(const vec4 &p, float x, float y, float z) {
+   return p.x * x + p.y * y + p.z * z + p.w;
+}
+
+/// one light at a time.  Past each interior plane the sphere lies wholly
+/// beyond, its first tile or slice moves up one, and before each it lies
+/// wholly short of, its last moves down one.  A light entirely behind
+/// the eye gets empty ranges.
+static void RangesScalar(const LC::Planes &pl, const float *soa,
+ uint stride, uint lo, uint hi, LC::Range *out) {
+   const float *xs = soa, *ys = soa + stride, *zs = soa + 2 * stride;
+   const float *rs = soa + 3 * stride;
+
+   for (uint i = lo; i < hi; i++) {
+      float x = xs[i], y = ys[i], z = zs[i], r = rs[i], d;
+      float w = Dist(pl.mDepth, x, y, z);
+      LC::Range &rng = out[i];
+
+      if (w + r <= 0.0f) {
+         rng = {0, -1, 0, -1, 0, -1};
+         continue;
+      }
+
+      rng = {0, (int)LC::cTilesX - 1, 0, (int)LC::cTilesY - 1, 0,
+       (int)LC::cSlices - 1};
+      for (auto &p : pl.mCols) {
+         d = Dist(p, x, y, z);
+         rng.mX0 += d > r;
+         rng.mX1 -= d < -r;
+      }
+      for (auto &p : pl.mRows) {
+         d = Dist(p, x, y, z);
+         rng.mY0 += d > r;
+         rng.mY1 -= d < -r;
+      }
+      for (float split : pl.mSplits) {
+         rng.mZ0 += w - r > split;
+         rng.mZ1 -= w + r < split;
+      }
+   }
+}
+
+#ifdef CLUSTER_SIMD
+
+/// p's distances from four points, as Dist sums them
+static inline __m128 Dist4(const __m128 *p, __m128 x, __m128 y, __m128 z) {
+   return _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p[0], x),
+    _mm_mul_ps(p[1], y)), _mm_mul_ps(p[2], z)), p[3]);
+}
+
+/// adds 1 to each lane of count whose lane of mask is set, all ones
+static inline __m128i StepUp(__m128i count, __m128 mask) {
+   return _mm_sub_epi32(count, _mm_castps_si128(mask));
+}
+
+/// subtracts 1 from each lane of count whose lane of mask is set
+static inline __m128i StepDown(__m128i count, __m128 mask) {
+   return _mm_add_epi32(count, _mm_castps_si128(mask));
+}
+
+/// four lights per iteration, as RangesScalar, with every plane's
+/// coefficients splatted once up front.  Lanes past hi are computed from
+/// mSoA's zero padding and dropped.
+static void RangesSSE(const LC::Planes &pl, const float *soa, uint stride,
+ uint lo, uint hi, LC::Range *out) {
+   __m128 cols[LC::cTilesX - 1][4], rows[LC::cTilesY - 1][4], depth[4];
+   __m128 splits[LC::cSlices - 1], zero = _mm_setzero_ps();
+   alignas(16) int lanes[7][4];
+
+   for (uint k = 0; k < 4; k++) {
+      for (uint c = 0; c < LC::cTilesX - 1; c++)
+         cols[c][k] = _mm_set1_ps(pl.mCols[c][k]);
+      for (uint r = 0; r < LC::cTilesY - 1; r++)
+         rows[r][k] = _mm_set1_ps(pl.mRows[r][k]);
+      depth[k] = _mm_set1_ps(pl.mDepth[k]);
+   }
+   for (uint s = 0; s < LC::cSlices - 1; s++)
+      splits[s] = _mm_set1_ps(pl.mSplits[s]);
+
+   for (uint i = lo; i < hi; i += 4) {
+      __m128 x = _mm_loadu_ps(soa + i), y = _mm_loadu_ps(soa + stride + i);
+      __m128 z = _mm_loadu_ps(soa + 2 * stride + i);
+      __m128 r = _mm_loadu_ps(soa + 3 * stride + i);
+      __m128 nr = _mm_sub_ps(zero, r), w = Dist4(depth, x, y, z), d;
+      __m128 wLo = _mm_sub_ps(w, r), wHi = _mm_add_ps(w, r);
+      __m128i x0 = _mm_setzero_si128(), y0 = x0, z0 = x0;
+      __m128i x1 = _mm_set1_epi32(LC::cTilesX - 1);
+      __m128i y1 = _mm_set1_epi32(LC::cTilesY - 1);
+      __m128i z1 = _mm_set1_epi32(LC::cSlices - 1);
+
+      for (auto &p : cols) {
+         d = Dist4(p, x, y, z);
+         x0 = StepUp(x0, _mm_cmpgt_ps(d, r));
+         x1 = StepDown(x1, _mm_cmplt_ps(d, nr));
+      }
+      for (auto &p : rows) {
+         d = Dist4(p, x, y, z);
+         y0 = StepUp(y0, _mm_cmpgt_ps(d, r));
+         y1 = StepDown(y1, _mm_cmplt_ps(d, nr));
+      }
+      for (auto &split : splits) {
+         z0 = StepUp(z0, _mm_cmpgt_ps(wLo, split));
+         z1 = StepDown(z1, _mm_cmplt_ps(wHi, split));
+      }
+
+      _mm_store_si128((__m128i *)lanes[0], x0);
+      _mm_store_si128((__m128i *)lanes[1], x1);
+      _mm_store_si128((__m128i *)lanes[2], y0);
+      _mm_store_si128((__m128i *)lanes[3], y1);
+      _mm_store_si128((__m128i *)lanes[4], z0);
+      _mm_store_si128((__m128i *)lanes[5], z1);
+      _mm_store_si128((__m128i *)lanes[6],
+       _mm_castps_si128(_mm_cmple_ps(wHi, zero)));
+      for (uint k = 0; k < 4 && i + k < hi; k++)
+         out[i + k] = lanes[6][k] ? LC::Range{0, -1, 0, -1, 0, -1}
+          : LC::Range{lanes[0][k], lanes[1][k], lanes[2][k], lanes[3][k],
+          lanes[4][k], lanes[5][k]};
+   }
+}
+
+#endif
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+LightClusters Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// vp is scaled so that its w row, which is view depth for a perspective
+/// view, has a unit normal.  The tile boundary at NDC x = b is the plane
+/// where clip x - b * clip w is 0.
+void LightClusters::SetPlanes(const mat4 &vp) {
+   vec4 row[4];
+
+   for (int r = 0; r < 4; r++)
+      row[r] = vec4(vp[0][r], vp[1][r], vp[2][r], vp[3][r]);
+   mVP = vp * (1.0f / length(vec3(row[3])));
+   for (int r = 0; r < 4; r++)
+      row[r] = vec4(mVP[0][r], mVP[1][r], mVP[2][r], mVP[3][r]);
+
+   mPlanes.mDepth = row[3];
+   for (uint c = 1; c < cTilesX; c++) {
+      vec4 p = row[0] - (2.0f * c / cTilesX - 1.0f) * row[3];
+
+      mPlanes.mCols[c - 1] = p / length(vec3(p));
+   }
+   for (uint r = 1; r < cTilesY; r++) {
+      vec4 p = row[1] - (2.0f * r / cTilesY - 1.0f) * row[3];
+
+      mPlanes.mRows[r - 1] = p / length(vec3(p));
+   }
+   for (uint s = 1; s < cSlices; s++)
+      mPlanes.mSplits[s - 1] = mNear * pow(mFar / mNear, (float)s / cSlices);
+}
+
+/// count each cluster of slice s's lights, then list them, in light
+/// order, in mSliceLists[s], with each cluster's offset there and count
+/// in mGrid
+void LightClusters::ListSlice(uint s, uint lights) {
+   uint counts[cTilesX * cTilesY] = {}, base = s * cTilesX * cTilesY;
+   uint total = 0;
+   vector<uint> &list = mSliceLists[s];
+
+   for (uint i = 0; i < lights; i++) {
+      const Range &rng = mRanges[i];
+
+      if (rng.mZ0 <= (int)s && (int)s <= rng.mZ1)
+         for (int y = rng.mY0; y <= rng.mY1; y++)
+            for (int x = rng.mX0; x <= rng.mX1; x++)
+               counts[y * cTilesX + x]++;
+   }
+
+   for (uint t = 0; t < cTilesX * cTilesY; t++) {
+      mGrid[base + t] = uvec2(total, 0);
+      total += counts[t];
+   }
+   list.resize(total);
+
+   for (uint i = 0; i < lights; i++) {
+      const Range &rng = mRanges[i];
+
+      if (rng.mZ0 <= (int)s && (int)s <= rng.mZ1)
+         for (int y = rng.mY0; y <= rng.mY1; y++)
+            for (int x = rng.mX0; x <= rng.mX1; x++) {
+               uvec2 &cell = mGrid[base + y * cTilesX + x];
+
+               list[cell.x + cell.y++] = i;
+            }
+   }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+LightClusters Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// an empty grid, so a shader reading it before the first Bin finds no
+/// lights
+LightClusters::LightClusters(float nearD, float farD)
+ : mNear(nearD), mFar(farD), mVP(1.0f), mSliceLists(cSlices),
+ mGrid(cClusters, uvec2(0)) {
+   if (nearD <= 0.0f || farD <= nearD)
+      throw WorldException("Light clusters need 0 < near < far");
+}
+
+/// each light's tile and slice ranges, in groups of four so no thread
+/// splits a SIMD group, then each slice's lists, a slice per task, and
+/// last the slices' lists joined in order
+void LightClusters::Bin(const mat4 &vp, const vector<PointLight> &lights,
+ Kernel kernel, uint threads) {
+   static const RangeFtn kernels[NumKernels] = {RangesScalar,
+#ifdef CLUSTER_SIMD
+    RangesSSE
+#else
+    RangesScalar
+#endif
+   };
+   uint n = (uint)lights.size(), stride = (n + 3) & ~3u;
+   size_t total = 0;
+
+   if (!Supported(kernel))
+      throw WorldException(StringPrintf(
+       "%s light binning unsupported on this CPU", Name(kernel)));
+
+   if (!threads && n < cParallelLights)
+      threads = 1;
+   threads = Parallel::Threads(threads);
+   SetPlanes(vp);
+
+   mSoA.assign(4 * stride, 0.0f);
+   mLightData.resize(2 * n);
+   mRanges.resize(n);
+   for (uint i = 0; i < n; i++) {
+      mSoA[i] = lights[i].mPos.x;
+      mSoA[stride + i] = lights[i].mPos.y;
+      mSoA[2 * stride + i] = lights[i].mPos.z;
+      mSoA[3 * stride + i] = lights[i].mRadius;
+      mLightData[2 * i] = vec4(lights[i].mPos, lights[i].mRadius);
+      mLightData[2 * i + 1] = vec4(lights[i].mColor, 0.0f);
+   }
+
+   Parallel::For(stride / 4, threads, [&](uint lo, uint hi) {
+      kernels[kernel](mPlanes, mSoA.data(), stride, 4 * lo,
+       std::min(n, 4 * hi), mRanges.data());
+   });
+   Parallel::For(cSlices, threads, [&](uint lo, uint hi) {
+      for (uint s = lo; s < hi; s++)
+         ListSlice(s, n);
+   });
+
+   for (auto &list : mSliceLists)
+      total += list.size();
+   mLists.resize(total);
+   total = 0;
+   for (uint s = 0; s < cSlices; s++) {
+      for (uint t = 0; t < cTilesX * cTilesY; t++)
+         mGrid[s * cTilesX * cTilesY + t].x += (uint)total;
+      copy(mSliceLists[s].begin(), mSliceLists[s].end(),
+       mLists.begin() + total);
+      total += mSliceLists[s].size();
+   }
+}
+
+/// the tile from pt's NDC under the binned view and the slice from its
+/// view depth, each clamped to the grid, so points past its edges fall
+/// in the outer clusters that reach out to them
+uint LightClusters::ClusterOf(const vec3 &pt) const {
+   vec4 clip = mVP * vec4(pt, 1.0f);
+   float depth = std::max(clip.w, 1e-4f);
+   float x = floor((clip.x / depth * 0.5f + 0.5f) * cTilesX);
+   float y = floor((clip.y / depth * 0.5f + 0.5f) * cTilesY);
+   float z = floor(log(depth / mNear) * GetDepths().y);
+
+   x = std::min(std::max(x, 0.0f), cTilesX - 1.0f);
+   y = std::min(std::max(y, 0.0f), cTilesY - 1.0f);
+   z = std::min(std::max(z, 0.0f), cSlices - 1.0f);
+   return ((uint)z * cTilesY + (uint)y) * cTilesX + (uint)x;
+}
+
+/// uploads the empty grid, then attaches each buffer to its texture,
+/// leaving unit 0 active, as the Texture classes expect
+void LightClusters::Create() {
+   static const GLenum cFormats[3] = {GL_RG32UI, GL_R32UI, GL_RGBA32F};
+
+   glGenBuffers(3, mBuffers); GLChkErr;
+   glGenTextures(3, mTextures); GLChkErr;
+   Upload();
+   for (uint k = 0; k < 3; k++) {
+      glActiveTexture(GL_TEXTURE6 + k); GLChkErr;
+      glBindTexture(GL_TEXTURE_BUFFER, mTextures[k]); GLChkErr;
+      glTexBuffer(GL_TEXTURE_BUFFER, cFormats[k], mBuffers[k]); GLChkErr;
+   }
+   glActiveTexture(GL_TEXTURE0); GLChkErr;
+}
+
+/// reallocates each buffer whole, orphaning last frame's, and never
+/// empty, since a buffer texture needs storage
+void LightClusters::Upload() {
+   const void *data[3] = {mGrid.data(), mLists.data(), mLightData.data()};
+   size_t bytes[3] = {mGrid.size() * sizeof(uvec2),
+    mLists.size() * sizeof(uint), mLightData.size() * sizeof(vec4)};
+
+   for (uint k = 0; k < 3; k++) {
+      glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[k]); GLChkErr;
+      glBufferData(GL_TEXTURE_BUFFER, std::max(bytes[k], sizeof(vec4)),
+       NULL, GL_STREAM_DRAW); GLChkErr;
+      if (bytes[k]) {
+         glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes[k], data[k]);
+         GLChkErr;
+      }
+   }
+   glBindBuffer(GL_TEXTURE_BUFFER, 0); GLChkErr;
+}
+
+/// cTilesX, cTilesY and cSlices
+vec4 LightClusters::GetDims() const {
+   return vec4((float)cTilesX, (float)cTilesY, (float)cSlices, 0.0f);
+}
+
+/// slice s starts at depth mNear * exp(s / y)
+vec4 LightClusters::GetDepths() const {
+   return vec4(mNear, cSlices / log(mFar / mNear), 0.0f, 0.0f);
+}
+
+/// true if kernel was compiled in
+bool LightClusters::Supported(Kernel kernel) {
+#ifdef CLUSTER_SIMD
+   return kernel == Scalar || kernel == SSE;
+#else
+   return kernel == Scalar;
+#endif
+}
+
+/// printable kernel name
+const char *LightClusters::Name(Kernel kernel) {
+   static const char *names[NumKernels] = {"scalar", "sse"};
+
+   return names[kernel];
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Utility.h"
+
+// A small unshadowed light, fading to nothing at mRadius
+struct PointLight {
+   glm::vec3 mPos;
+   float mRadius;
+   glm::vec3 mColor;
+
+   PointLight(const glm::vec3 &pos, float radius, const glm::vec3 &clr)
+    : mPos(pos), mRadius(radius), mColor(clr) {}
+};
+
+// Point lights binned on the CPU into a grid of clusters over a view, for
+// clustered forward shading: each fragment finds its cluster from its
+// screen tile and view depth, and lights itself with just that cluster's
+// list.  Tiles split NDC evenly, cTilesX by cTilesY, and slices split view
+// depth exponentially from mNear to mFar.  The outer tiles and slices
+// reach on past the view's edges, so the grid covers every point in front
+// of the eye, as seen by any nearby view such as the other eye of a
+// stereo pair.  A light is listed in every cluster of the tile and slice
+// ranges its sphere touches, which may hold a corner cluster it misses,
+// but never leaves out one it reaches.
+class LightClusters {
+public:
+   static constexpr uint cTilesX = 16, cTilesY = 9, cSlices = 24;
+   static constexpr uint cClusters = cTilesX * cTilesY * cSlices;
+
+   // Fewest lights Bin spreads over every core when left to pick its
+   // threads.  Below this, a frame's binning takes well under a
+   // millisecond, less than starting and joining the threads would.
+   static constexpr uint cParallelLights = 2048;
+
+   enum Kernel {Scalar, SSE, NumKernels};
+
+   // Tiles and slices a light touches, each first to last inclusive, and
+   // empty if last is before first
+   struct Range {
+      int mX0, mX1, mY0, mY1, mZ0, mZ1;
+   };
+
+   // Unit-normal planes bounding the tiles and slices: the interior column
+   // and row planes, each facing toward higher tiles, the view depth
+   // plane, and each interior slice's starting depth
+   struct Planes {
+      glm::vec4 mCols[cTilesX - 1];
+      glm::vec4 mRows[cTilesY - 1];
+      glm::vec4 mDepth;
+      float mSplits[cSlices - 1];
+   };
+
+   // Kernel signature: planes, light centers and radii as four arrays of
+   // stride floats, and ranges for lights [lo, hi), lo a multiple of 4
+   typedef void (*RangeFtn)(const Planes &, const float *, uint stride,
+    uint lo, uint hi, Range *);
+
+private:
+   float mNear, mFar;
+   glm::mat4 mVP;                       // Last binned, w in view depth
+   Planes mPlanes;
+   std::vector<float> mSoA;             // x, y, z and radius, by light
+   std::vector<Range> mRanges;          // By light
+   std::vector<std::vector<uint>> mSliceLists;  // Scratch, by slice
+   std::vector<glm::uvec2> mGrid;       // Offset and count, by cluster
+   std::vector<uint> mLists;            // Every cluster's lights, in turn
+   std::vector<glm::vec4> mLightData;   // Position and radius, then color
+   GLuint mBuffers[3] = {}, mTextures[3] = {};
+
+   void SetPlanes(const glm::mat4 &vp);
+   void ListSlice(uint slice, uint lights);
+
+public:
+   LightClusters(float nearD = 0.1f, float farD = 100.0f);
+
+   // Bin lights into the clusters of view volume vp with the given
+   // kernel, on threads worker threads, or if 0 on one thread below
+   // cParallelLights and as many as the CPU has from there
+   void Bin(const glm::mat4 &vp, const std::vector<PointLight> &, Kernel,
+    uint threads = 0);
+   void Bin(const glm::mat4 &vp, const std::vector<PointLight> &lights) {
+      Bin(vp, lights, Best());
+   }
+
+   // Index of the cluster holding world point pt, as the shader finds it
+   uint ClusterOf(const glm::vec3 &pt) const;
+
+   // Create the grid, list and light buffer textures, bound to texture
+   // units 6, 7 and 8 for the main shader's clusterGrid, clusterLists and
+   // pointLights
+   void Create();
+
+   // Upload the last Bin's grid, lists and lights
+   void Upload();
+
+   // The binned view, tile and slice counts, and the near depth and
+   // slices per unit of log depth, as the shader's Lights block wants
+   const glm::mat4 &GetVP() const {return mVP;}
+   glm::vec4 GetDims() const;
+   glm::vec4 GetDepths() const;
+
+   const glm::uvec2 &GetCluster(uint c) const {return mGrid[c];}
+   const std::vector<uint> &GetLists() const {return mLists;}
+   const std::vector<Range> &GetRanges() const {return mRanges;}
+
+   // True if this build and CPU can run the kernel
+   static bool Supported(Kernel);
+
+   // Fastest supported kernel
+   static Kernel Best() {return Supported(SSE) ? SSE : Scalar;}
+
+   static const char *Name(Kernel);
+};
@@ -0,0 +1,67 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+using namespace std;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MappedFile Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// maps file copy-on-write, unmapping in the returned pointer's deleter
+shared_ptr<char> MappedFile::Map(const string &file, size_t *size) {
+#ifdef _WIN32
+   HANDLE hFile, hMap;
+   LARGE_INTEGER len;
+   void *data;
+
+   hFile = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (hFile == INVALID_HANDLE_VALUE)
+      return nullptr;
+   if (!GetFileSizeEx(hFile, &len) || !len.QuadPart) {
+      CloseHandle(hFile);
+      return nullptr;
+   }
+
+   hMap = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+   CloseHandle(hFile);
+   if (!hMap)
+      return nullptr;
+   data = MapViewOfFile(hMap, FILE_MAP_COPY, 0, 0, 0);
+   CloseHandle(hMap);
+   if (!data)
+      return nullptr;
+
+   *size = (size_t)len.QuadPart;
+   return shared_ptr<char>((char *)data, [](char *p) {UnmapViewOfFile(p);});
+#else
+   struct stat info;
+   void *data;
+   size_t len;
+   int fd = open(file.c_str(), O_RDONLY);
+
+   if (fd < 0)
+      return nullptr;
+   if (fstat(fd, &info) || !info.st_size) {
+      close(fd);
+      return nullptr;
+   }
+
+   len = (size_t)info.st_size;
+   data = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED)
+      return nullptr;
+
+   *size = len;
+   return shared_ptr<char>((char *)data, [len](char *p) {munmap(p, len);});
+#endif
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <memory>
+#include <string>
+
+// Whole-file memory mappings, via mmap on POSIX and MapViewOfFile on
+// Windows.  Mappings are copy-on-write: callers may modify the memory in
+// place without touching the file.
+class MappedFile {
+public:
+   // Map all of file, putting its length in *size.  Returns null if the
+   // file can't be opened or mapped, or is empty.  The mapping lasts until
+   // the last copy of the returned pointer is released.
+   static std::shared_ptr<char> Map(const std::string &file, size_t *size);
+};
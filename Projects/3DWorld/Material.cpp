@@ -0,0 +1,48 @@
+#include "Material.h"
+
+using namespace std;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MaterialRegistry Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// existing id of the pair, else the next one
+uint MaterialRegistry::Register(const shared_ptr<Texture> &tex,
+ const shared_ptr<Texture> &nT) {
+   auto found = mIds.find(make_pair(tex.get(), nT.get()));
+
+   if (found != mIds.end())
+      return found->second;
+
+   mIds[make_pair(tex.get(), nT.get())] = (uint)mMaterials.size();
+   mMaterials.push_back(Material(tex, nT));
+   return (uint)mMaterials.size() - 1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MaterialState Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// compares mat against the current bindings.  A plain material leaves
+/// any bound normal map in place, since the shader then ignores it.
+uint MaterialState::Apply(const Material &mat, DrawStats *stats) {
+   uint rtn = 0;
+
+   if (mVariant != mat.mVariant) {
+      rtn |= cShader;
+      mVariant = mat.mVariant;
+      stats->mShaderSwitches++;
+   }
+   if (mTex != mat.mTex.get()) {
+      rtn |= cTexture;
+      mTex = mat.mTex.get();
+      stats->mTextureBinds++;
+   }
+   if (mat.mTexNormal && mTexNormal != mat.mTexNormal.get()) {
+      rtn |= cNormal;
+      mTexNormal = mat.mTexNormal.get();
+      stats->mTextureBinds++;
+   }
+
+   return rtn;
+}
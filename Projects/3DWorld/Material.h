@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Textures.h"
+#include "Utility.h"
+
+// Everything a draw binds besides geometry and transforms: its diffuse
+// texture, its normal map if any, and the shader variant those need.  Each
+// variant is its own program, switched by Shader::UseVariant, so draws are
+// ordered to group them.
+struct Material {
+   enum Variant {cPlain, cNormalMapped, cNumVariants};
+
+   std::shared_ptr<Texture> mTex;
+   std::shared_ptr<Texture> mTexNormal;
+   Variant mVariant;
+
+   Material(std::shared_ptr<Texture> t, std::shared_ptr<Texture> nT)
+    : mTex(t), mTexNormal(nT), mVariant(nT ? cNormalMapped : cPlain) {}
+};
+
+// Dense ids for the distinct diffuse/normal pairs of a scene, numbered in
+// order of first registration, so ids and draw order are the same from
+// run to run.  Pointers are used only to find an existing id.
+class MaterialRegistry {
+   std::vector<Material> mMaterials;
+   std::map<std::pair<const Texture *, const Texture *>, uint> mIds;
+
+public:
+   // Id of the pair, registering it on first sight
+   uint Register(const std::shared_ptr<Texture> &tex,
+    const std::shared_ptr<Texture> &nT);
+
+   const Material &Get(uint id) const {return mMaterials[id];}
+   uint Size() const {return (uint)mMaterials.size();}
+};
+
+// GL state changes and draw calls made drawing one frame's draw list
+struct DrawStats {
+   uint mDraws;
+   uint mSubmits;          // GL draw calls issued for them
+   uint mShaderSwitches;   // Variant changes, each a UseVariant call
+   uint mTextureBinds;     // Diffuse and normal map binds
+
+   DrawStats() : mDraws(0), mSubmits(0), mShaderSwitches(0),
+    mTextureBinds(0) {}
+   bool operator!=(const DrawStats &s) const {return mDraws != s.mDraws
+    || mSubmits != s.mSubmits || mShaderSwitches != s.mShaderSwitches
+    || mTextureBinds != s.mTextureBinds;}
+};
+
+// What is currently bound, so consecutive draws of one material, or of
+// materials sharing a texture, bind nothing again.  Apply tallies the
+// changes it reports into *stats; counting draws is left to the caller.
+class MaterialState {
+   int mVariant = -1;
+   const Texture *mTex = nullptr;
+   const Texture *mTexNormal = nullptr;
+
+public:
+   enum Change {cShader = 1, cTexture = 2, cNormal = 4};
+
+   // Forget all bindings, as at the start of a pass
+   void Reset() {*this = MaterialState();}
+
+   // Bitmask of the Changes needed to draw with mat after what was bound,
+   // taking them as made
+   uint Apply(const Material &mat, DrawStats *stats);
+};
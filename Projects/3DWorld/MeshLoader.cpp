@@ -0,0 +1,925 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "MappedFile.h"
+#include "MeshLoader.h"
+#include "Parallel.h"
+
+using namespace std;
+using namespace glm;
+
+// One f-line corner.  Each index is 0-based into the whole file, or -1 if
+// absent.  A negative (relative) reference sets its bit of rel (1 for v,
+// 2 for t, 4 for n) and holds its index counted from the chunk's first
+// element, which is below 0 if it reaches back into an earlier chunk,
+// until the chunk's base is known.
+struct ObjCorner {
+   int v, t, n;
+   uchar rel;
+};
+
+// A run of triangles within a chunk, all of one MeshPart
+struct ObjRun {
+   uint mFirst;
+   uint mEnd;
+   uint mPart;
+};
+
+// Everything parsed from one chunk of an OBJ, in file order
+struct MeshLoader::ObjChunk {
+   vector<vec3> mPos, mNorm;
+   vector<vec2> mTex;
+   vector<ObjCorner> mCorners;         // Three per triangle
+   vector<pair<uint, string>> mUses;  // usemtl names, by first triangle
+   vector<string> mLibs;              // mtllib names
+   vector<ObjRun> mRuns;
+   string mError;                     // Set rather than thrown on threads
+};
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Helper Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// directory part of path, with its trailing separator
+static string DirOf(const string &path) {
+   size_t slash = path.find_last_of("/\\");
+
+   return slash == string::npos ? "" : path.substr(0, slash + 1);
+}
+
+/// true if path ends in ext, ignoring case
+static bool HasExtension(const string &path, const string &ext) {
+   if (path.size() < ext.size())
+      return false;
+   for (size_t i = 0; i < ext.size(); i++)
+      if (tolower(path[path.size() - ext.size() + i]) != ext[i])
+         return false;
+   return true;
+}
+
+static const char *SkipSpace(const char *p, const char *end) {
+   while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+      p++;
+   return p;
+}
+
+static const char *SkipLine(const char *p, const char *end) {
+   while (p < end && *p != '\n')
+      p++;
+   return p < end ? p + 1 : end;
+}
+
+/// true if p starts keyword followed by whitespace
+static bool IsKeyword(const char *p, const char *end, const char *keyword) {
+   size_t len = strlen(keyword);
+
+   return (size_t)(end - p) > len && !memcmp(p, keyword, len)
+    && (p[len] == ' ' || p[len] == '\t');
+}
+
+/// rest of the line from p, trimmed
+static string RestOfLine(const char *p, const char *end) {
+   const char *stop = p;
+
+   p = SkipSpace(p, end);
+   stop = p;
+   while (stop < end && *stop != '\n')
+      stop++;
+   while (stop > p && isspace((uchar)stop[-1]))
+      stop--;
+   return string(p, stop);
+}
+
+/// parses a decimal integer at p, returning the char after it, or null if
+/// there is none
+static const char *ParseInt(const char *p, const char *end, long *val) {
+   bool neg = false;
+   const char *start;
+   long rtn = 0;
+
+   if (p < end && (*p == '-' || *p == '+'))
+      neg = *p++ == '-';
+   for (start = p; p < end && *p >= '0' && *p <= '9'; p++)
+      rtn = rtn * 10 + (*p - '0');
+
+   *val = neg ? -rtn : rtn;
+   return p == start ? nullptr : p;
+}
+
+/// parses a decimal float at p, returning the char after it, or null if
+/// there is none.  Much faster than strtof, and within an ulp or so.
+static const char *ParseFloat(const char *p, const char *end, float *val) {
+   static const double cPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+    1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+    1e20, 1e21, 1e22};
+   unsigned long long mant = 0;
+   int exp = 0, digits = 0;
+   bool neg = false;
+   long expPart;
+   double rtn;
+
+   if (p < end && (*p == '-' || *p == '+'))
+      neg = *p++ == '-';
+   for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+      if (mant < 1000000000000000000ull)
+         mant = mant * 10 + (*p - '0');
+      else
+         exp++;
+   if (p < end && *p == '.')
+      for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+         if (mant < 1000000000000000000ull) {
+            mant = mant * 10 + (*p - '0');
+            exp--;
+         }
+   if (!digits)
+      return nullptr;
+   if (p < end && (*p == 'e' || *p == 'E')) {
+      p = ParseInt(p + 1, end, &expPart);
+      if (!p)
+         return nullptr;
+      exp += (int)std::max(-400L, std::min(400L, expPart));
+   }
+
+   rtn = (double)mant;
+   if (exp < 0)
+      rtn = exp >= -22 ? rtn / cPow10[-exp] : rtn * pow(10.0, exp);
+   else if (exp > 0)
+      rtn = exp <= 22 ? rtn * cPow10[exp] : rtn * pow(10.0, exp);
+   *val = (float)(neg ? -rtn : rtn);
+   return p;
+}
+
+/// parses n floats into vals, returning null on failure
+static const char *ParseFloats(const char *p, const char *end, float *vals,
+ int n) {
+   for (int i = 0; i < n && p; i++)
+      p = ParseFloat(SkipSpace(p, end), end, vals + i);
+   return p;
+}
+
+/// encodes OBJ index idx, 1-based or negative relative to count, as an
+/// ObjCorner index, setting bit of *rel if relative.  Returns false for 0.
+static bool EncodeIndex(long idx, size_t count, int *rtn, uchar *rel,
+ uchar bit) {
+   if (idx > 0)
+      *rtn = (int)(idx - 1);
+   else if (idx < 0) {
+      *rtn = (int)std::max(-(long)INT32_MAX, (long)count + idx);
+      *rel |= bit;
+   }
+   return idx != 0;
+}
+
+/// resolves an encoded ObjCorner index given its chunk's base, checking it
+/// lies in [0, limit).  Relative indices count from base, and may reach
+/// back into earlier chunks.  Absent (-1) indices stay absent.
+static bool ResolveIndex(int *idx, bool rel, size_t base, size_t limit) {
+   long long abs = rel ? (long long)base + *idx : *idx;
+
+   if (!rel && *idx == -1)
+      return true;
+   if (abs < 0 || (size_t)abs >= limit)
+      return false;
+   *idx = (int)abs;
+   return true;
+}
+
+/// true if v has a usable direction
+static bool IsDirection(const vec3 &v) {
+   float len2 = dot(v, v);
+
+   return len2 > 1e-20f && std::isfinite(len2);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+PLY Helpers
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+enum PlyType {PlyInt8, PlyUInt8, PlyInt16, PlyUInt16, PlyInt32, PlyUInt32,
+ PlyFloat32, PlyFloat64, PlyNone};
+
+// PLY type names, old and new, by PlyType
+static const map<string, PlyType> cPlyTypes = {
+   {"char", PlyInt8}, {"int8", PlyInt8}, {"uchar", PlyUInt8},
+   {"uint8", PlyUInt8}, {"short", PlyInt16}, {"int16", PlyInt16},
+   {"ushort", PlyUInt16}, {"uint16", PlyUInt16}, {"int", PlyInt32},
+   {"int32", PlyInt32}, {"uint", PlyUInt32}, {"uint32", PlyUInt32},
+   {"float", PlyFloat32}, {"float32", PlyFloat32}, {"double", PlyFloat64},
+   {"float64", PlyFloat64}};
+
+static const uint cPlySizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+struct PlyProp {
+   string mName;
+   PlyType mType;
+   PlyType mCountType;    // PlyNone unless a list
+};
+
+struct PlyElement {
+   string mName;
+   size_t mCount;
+   vector<PlyProp> mProps;
+};
+
+/// PLY scalar of type at p, byte-swapped if swap
+static double ReadPly(const char *p, PlyType type, bool swap) {
+   unsigned char buf[8];
+   uint size = cPlySizes[type];
+
+   memcpy(buf, p, size);
+   if (swap)
+      std::reverse(buf, buf + size);
+
+   switch (type) {
+   case PlyInt8:    {int8_t v; memcpy(&v, buf, 1); return v;}
+   case PlyUInt8:   {uint8_t v; memcpy(&v, buf, 1); return v;}
+   case PlyInt16:   {int16_t v; memcpy(&v, buf, 2); return v;}
+   case PlyUInt16:  {uint16_t v; memcpy(&v, buf, 2); return v;}
+   case PlyInt32:   {int32_t v; memcpy(&v, buf, 4); return v;}
+   case PlyUInt32:  {uint32_t v; memcpy(&v, buf, 4); return v;}
+   case PlyFloat32: {float v; memcpy(&v, buf, 4); return v;}
+   default:         {double v; memcpy(&v, buf, 8); return v;}
+   }
+}
+
+/// byte offset of property name within a fixed-size element, or -1
+static int PlyOffset(const PlyElement &elm, const vector<string> &names,
+ PlyType *type) {
+   int offset = 0;
+
+   for (auto &prop : elm.mProps) {
+      if (std::find(names.begin(), names.end(), prop.mName) != names.end()) {
+         *type = prop.mType;
+         return offset;
+      }
+      offset += cPlySizes[prop.mType];
+   }
+   return -1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MeshLoader Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// parses the lines starting in [p, end) into chunk, setting mError on
+/// malformed input rather than throwing
+void MeshLoader::ParseObjChunk(const char *p, const char *end,
+ ObjChunk *chunk) {
+   vector<ObjCorner> face;
+   ObjCorner corner;
+   vec3 v3;
+   vec2 v2;
+   long idx;
+   bool ok = true;
+
+   for (; p < end; p = SkipLine(p, end)) {
+      p = SkipSpace(p, end);
+      if (p + 1 >= end)
+         break;
+
+      if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+         if (!ParseFloats(p + 1, end, &v3.x, 3))
+            chunk->mError = "bad v";
+         chunk->mPos.push_back(v3);
+      }
+      else if (p[0] == 'v' && p[1] == 't') {
+         // v is optional
+         if (!(p = ParseFloats(p + 2, end, &v2.x, 1)))
+            chunk->mError = "bad vt";
+         else if (!ParseFloat(SkipSpace(p, end), end, &v2.y))
+            v2.y = 0.0f;
+         chunk->mTex.push_back(v2);
+      }
+      else if (p[0] == 'v' && p[1] == 'n') {
+         if (!ParseFloats(p + 2, end, &v3.x, 3))
+            chunk->mError = "bad vn";
+         chunk->mNorm.push_back(v3);
+      }
+      else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+         face.clear();
+         for (p = SkipSpace(p + 1, end); p < end && *p != '\n' && *p != '#';
+          p = SkipSpace(p, end)) {
+            corner.t = corner.n = -1;
+            corner.rel = 0;
+            ok = (p = ParseInt(p, end, &idx)) && EncodeIndex(idx,
+             chunk->mPos.size(), &corner.v, &corner.rel, 1);
+            if (ok && p < end && *p == '/' && ++p < end && *p != '/')
+               ok = (p = ParseInt(p, end, &idx)) && EncodeIndex(idx,
+                chunk->mTex.size(), &corner.t, &corner.rel, 2);
+            if (ok && p < end && *p == '/')
+               ok = (p = ParseInt(p + 1, end, &idx)) && EncodeIndex(idx,
+                chunk->mNorm.size(), &corner.n, &corner.rel, 4);
+            if (!ok)
+               break;
+            face.push_back(corner);
+         }
+         if (!ok || face.size() < 3) {
+            chunk->mError = "bad f";
+            return;
+         }
+
+         for (uint i = 2; i < face.size(); i++)
+            chunk->mCorners.insert(chunk->mCorners.end(),
+             {face[0], face[i - 1], face[i]});
+         p--;   // Back onto the newline for SkipLine
+      }
+      else if (IsKeyword(p, end, "usemtl"))
+         chunk->mUses.push_back(make_pair(
+          (uint)(chunk->mCorners.size() / 3), RestOfLine(p + 6, end)));
+      else if (IsKeyword(p, end, "mtllib"))
+         chunk->mLibs.push_back(RestOfLine(p + 6, end));
+
+      if (!chunk->mError.empty())
+         return;
+   }
+}
+
+/// appends each newmtl of MTL file to materials.  A missing library is
+/// ignored, so its materials fall back to defaults.
+void MeshLoader::LoadMtl(const string &file, vector<MeshMaterial> *materials) {
+   ifstream in(file);
+   string line, key, word, last;
+
+   while (getline(in, line)) {
+      istringstream words(line);
+
+      if (!(words >> key) || key[0] == '#')
+         continue;
+      if (key == "newmtl") {
+         materials->push_back(MeshMaterial(RestOfLine(line.c_str()
+          + line.find("newmtl") + 6, line.c_str() + line.size())));
+         continue;
+      }
+      if (materials->empty())
+         continue;
+
+      MeshMaterial &mtl = materials->back();
+      if (key == "Kd") {
+         words >> mtl.mDiffuse.x >> mtl.mDiffuse.y >> mtl.mDiffuse.z;
+         continue;
+      }
+
+      // Map statements may carry options first, so take the last word
+      for (last.clear(); words >> word; )
+         last = word;
+      if (last.empty())
+         continue;
+      if (key == "map_Kd")
+         mtl.mDiffuseMap = DirOf(file) + last;
+      else if (key == "map_Bump" || key == "map_bump" || key == "bump"
+       || key == "norm")
+         mtl.mNormalMap = DirOf(file) + last;
+   }
+}
+
+/// welds the corners of part into unique (position, uv, normal) vertices,
+/// using posNormals for corners without a normal.  Each thread takes a
+/// slice of position indices, so no locks are needed, and vertices come
+/// out ordered by position index, then first use.
+void MeshLoader::WeldObj(vector<ObjChunk> &chunks, uint part, uint threads,
+ const vector<vec3> &pos, const vector<vec2> &tex, const vector<vec3> &norm,
+ const vector<vec3> &posNormals, MeshPart *out) {
+   struct Entry {
+      int t, n, next;
+      uint rank;
+   };
+   vector<pair<const ObjCorner *, uint>> runs;  // Corners, count
+   vector<vector<int>> heads(threads);
+   vector<vector<Entry>> entries(threads);
+   vector<uint> counts(threads + 1, 0);
+   size_t numCorners = 0;
+   int lo = INT32_MAX, hi = 0;
+
+   for (auto &chunk : chunks)
+      for (auto &run : chunk.mRuns)
+         if (run.mPart == part) {
+            runs.push_back(make_pair(chunk.mCorners.data() + 3 * run.mFirst,
+             3 * (run.mEnd - run.mFirst)));
+            numCorners += runs.back().second;
+         }
+   for (auto &run : runs)
+      for (uint c = 0; c < run.second; c++) {
+         lo = std::min(lo, run.first[c].v);
+         hi = std::max(hi, run.first[c].v + 1);
+      }
+   if (!numCorners)
+      return;
+   out->mIndices.resize(numCorners);
+
+   // Pass 1: find or add each corner's entry in its thread's slice, noting
+   // the entry in place of the final index
+   auto slice = [&](uint k, int *sLo, int *sHi) {
+      int per = (hi - lo + (int)threads - 1) / (int)threads;
+
+      *sLo = std::min(hi, lo + (int)k * per);
+      *sHi = std::min(hi, *sLo + per);
+   };
+   Parallel::For(threads, threads, [&](uint kLo, uint kHi) {
+      int sLo, sHi, e, prev;
+      size_t outIdx;
+
+      for (uint k = kLo; k < kHi; k++) {
+         slice(k, &sLo, &sHi);
+         heads[k].assign(sHi - sLo, -1);
+         outIdx = 0;
+         for (auto &run : runs)
+            for (uint c = 0; c < run.second; c++, outIdx++) {
+               const ObjCorner &cnr = run.first[c];
+
+               if (cnr.v < sLo || cnr.v >= sHi)
+                  continue;
+               for (prev = -1, e = heads[k][cnr.v - sLo]; e >= 0
+                && (entries[k][e].t != cnr.t || entries[k][e].n != cnr.n);
+                e = entries[k][e].next)
+                  prev = e;
+               if (e < 0) {
+                  e = (int)entries[k].size();
+                  entries[k].push_back(Entry{cnr.t, cnr.n, -1, 0});
+                  if (prev < 0)
+                     heads[k][cnr.v - sLo] = e;
+                  else
+                     entries[k][prev].next = e;
+               }
+               out->mIndices[outIdx] = (uint)e;
+            }
+
+         // Rank entries by position, then by first use
+         counts[k + 1] = 0;
+         for (int v = sLo; v < sHi; v++)
+            for (e = heads[k][v - sLo]; e >= 0; e = entries[k][e].next)
+               entries[k][e].rank = counts[k + 1]++;
+      }
+   });
+
+   for (uint k = 0; k < threads; k++)
+      counts[k + 1] += counts[k];
+   out->mVerts.resize(counts[threads]);
+
+   // Pass 2: write vertices, and swap entries for their final indices
+   Parallel::For(threads, threads, [&](uint kLo, uint kHi) {
+      int sLo, sHi;
+      size_t outIdx;
+
+      for (uint k = kLo; k < kHi; k++) {
+         slice(k, &sLo, &sHi);
+         for (int v = sLo; v < sHi; v++)
+            for (int e = heads[k][v - sLo]; e >= 0; e = entries[k][e].next) {
+               Entry &ent = entries[k][e];
+               Vertex &vtx = out->mVerts[counts[k] + ent.rank];
+
+               vtx = Vertex(vec4(pos[v], 1.0f), ent.n >= 0 ? norm[ent.n]
+                : posNormals[v], ent.t >= 0 ? vec2(tex[ent.t].x,
+                1.0f - tex[ent.t].y) : vec2(0.0f));
+               vtx.tangent = vtx.biTangent = vec3(0.0f);
+            }
+
+         outIdx = 0;
+         for (auto &run : runs)
+            for (uint c = 0; c < run.second; c++, outIdx++)
+               if (run.first[c].v >= sLo && run.first[c].v < sHi)
+                  out->mIndices[outIdx] = counts[k]
+                   + entries[k][out->mIndices[outIdx]].rank;
+      }
+   });
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MeshLoader Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// dispatches on extension
+void MeshLoader::Load(const string &file, vector<MeshPart> *parts,
+ vector<MeshMaterial> *materials, uint threads) {
+   if (HasExtension(file, ".obj"))
+      LoadObj(file, parts, materials, threads);
+   else if (HasExtension(file, ".ply"))
+      LoadPly(file, parts, threads);
+   else
+      throw WorldException(StringPrintf("%s is not an OBJ or PLY file",
+       file.c_str()));
+}
+
+/// scans for mtllib lines a memchr per line, far cheaper than a parse,
+/// then reads each library for its maps
+vector<string> MeshLoader::GetDependencies(const string &file) {
+   vector<string> rtn;
+   vector<MeshMaterial> materials;
+   size_t size;
+   shared_ptr<char> data;
+   const char *p, *end;
+
+   if (!HasExtension(file, ".obj")
+    || !(data = MappedFile::Map(file, &size)))
+      return rtn;
+
+   for (p = data.get(), end = p + size; p < end; p++) {
+      p = SkipSpace(p, end);
+      if (IsKeyword(p, end, "mtllib")) {
+         string lib = DirOf(file) + RestOfLine(p + 6, end);
+
+         if (std::find(rtn.begin(), rtn.end(), lib) == rtn.end()) {
+            rtn.push_back(lib);
+            LoadMtl(lib, &materials);
+         }
+      }
+      if (!(p = (const char *)memchr(p, '\n', end - p)))
+         break;
+   }
+
+   for (auto &mtl : materials)
+      for (auto map : {&mtl.mDiffuseMap, &mtl.mNormalMap})
+         if (!map->empty()
+          && std::find(rtn.begin(), rtn.end(), *map) == rtn.end())
+            rtn.push_back(*map);
+
+   return rtn;
+}
+
+/// parse chunks in parallel, stitch their indices and materials together
+/// in order, then weld each material's corners into vertices
+void MeshLoader::LoadObj(const string &file, vector<MeshPart> *parts,
+ vector<MeshMaterial> *materials, uint threads) {
+   size_t size, numPos = 0, numTex = 0, numNorm = 0;
+   shared_ptr<char> data = MappedFile::Map(file, &size);
+   vector<size_t> starts, posBase, texBase, normBase;
+   vector<vec3> pos, norm, posNormals;
+   vector<vec2> tex;
+   vector<ObjChunk> chunks;
+   map<string, uint> partIdx;
+   uint current, firstPart = (uint)parts->size();
+   bool needNormals = false;
+
+   if (!data)
+      throw WorldException(StringPrintf("Can't read %s", file.c_str()));
+
+   threads = std::max(1u, std::min(Parallel::Threads(threads),
+    (uint)(size / cMinChunk)));
+   chunks.resize(threads);
+
+   // Chunks start just past a newline, so none splits a line
+   for (uint k = 0; k <= threads; k++) {
+      size_t start = k == threads ? size : k * (size / threads);
+
+      if (k && k < threads) {
+         start = std::max(start, starts.back());
+         while (start < size && data.get()[start - 1] != '\n')
+            start++;
+      }
+      starts.push_back(start);
+   }
+
+   Parallel::For(threads, threads, [&](uint lo, uint hi) {
+      for (uint k = lo; k < hi; k++)
+         ParseObjChunk(data.get() + starts[k], data.get() + starts[k + 1],
+          &chunks[k]);
+   });
+
+   for (auto &chunk : chunks) {
+      if (!chunk.mError.empty())
+         throw WorldException(StringPrintf("Malformed OBJ %s: %s",
+          file.c_str(), chunk.mError.c_str()));
+      posBase.push_back(numPos);
+      texBase.push_back(numTex);
+      normBase.push_back(numNorm);
+      numPos += chunk.mPos.size();
+      numTex += chunk.mTex.size();
+      numNorm += chunk.mNorm.size();
+   }
+   if (numPos >= INT32_MAX)
+      throw WorldException(StringPrintf("%s is too large", file.c_str()));
+
+   // Resolve relative indices, and range-check all of them
+   Parallel::For(threads, threads, [&](uint lo, uint hi) {
+      for (uint k = lo; k < hi; k++)
+         for (auto &cnr : chunks[k].mCorners)
+            if (!ResolveIndex(&cnr.v, cnr.rel & 1, posBase[k], numPos)
+             || !ResolveIndex(&cnr.t, cnr.rel & 2, texBase[k], numTex)
+             || !ResolveIndex(&cnr.n, cnr.rel & 4, normBase[k], numNorm)) {
+               chunks[k].mError = "index out of range";
+               break;
+            }
+   });
+
+   pos.reserve(numPos);
+   tex.reserve(numTex);
+   norm.reserve(numNorm);
+   for (auto &chunk : chunks) {
+      if (!chunk.mError.empty())
+         throw WorldException(StringPrintf("Malformed OBJ %s: %s",
+          file.c_str(), chunk.mError.c_str()));
+      pos.insert(pos.end(), chunk.mPos.begin(), chunk.mPos.end());
+      tex.insert(tex.end(), chunk.mTex.begin(), chunk.mTex.end());
+      norm.insert(norm.end(), chunk.mNorm.begin(), chunk.mNorm.end());
+      vector<vec3>().swap(chunk.mPos);
+      vector<vec2>().swap(chunk.mTex);
+      vector<vec3>().swap(chunk.mNorm);
+   }
+
+   // Split each chunk's triangles into runs by material, carrying the
+   // material in effect at the end of one chunk into the next
+   auto partFor = [&](const string &mtl) {
+      if (!partIdx.count(mtl)) {
+         partIdx[mtl] = (uint)parts->size();
+         parts->push_back(MeshPart(mtl));
+      }
+      return partIdx[mtl];
+   };
+   current = UINT32_MAX;
+   for (auto &chunk : chunks) {
+      uint numTris = (uint)(chunk.mCorners.size() / 3), first = 0;
+
+      for (auto &use : chunk.mUses) {
+         if (use.first > first) {
+            if (current == UINT32_MAX)
+               current = partFor("");
+            chunk.mRuns.push_back(ObjRun{first, use.first, current});
+         }
+         current = partFor(use.second);
+         first = use.first;
+      }
+      if (numTris > first) {
+         if (current == UINT32_MAX)
+            current = partFor("");
+         chunk.mRuns.push_back(ObjRun{first, numTris, current});
+      }
+      for (auto &lib : chunk.mLibs)
+         LoadMtl(DirOf(file) + lib, materials);
+   }
+
+   // Corners lacking normals share one smooth normal per position
+   for (auto &chunk : chunks)
+      for (auto &cnr : chunk.mCorners)
+         needNormals = needNormals || cnr.n < 0;
+   if (needNormals) {
+      posNormals.assign(numPos, vec3(0.0f));
+      for (auto &chunk : chunks)
+         for (size_t c = 0; c < chunk.mCorners.size(); c += 3) {
+            const ObjCorner *tri = &chunk.mCorners[c];
+            vec3 faceNrm = cross(pos[tri[1].v] - pos[tri[0].v],
+             pos[tri[2].v] - pos[tri[0].v]);
+
+            for (uint k = 0; k < 3; k++)
+               posNormals[tri[k].v] += faceNrm;
+         }
+      for (auto &nrm : posNormals)
+         nrm = IsDirection(nrm) ? normalize(nrm) : vec3(0, 0, 1);
+   }
+
+   for (uint p = firstPart; p < parts->size(); p++)
+      WeldObj(chunks, p, threads, pos, tex, norm, posNormals,
+       &(*parts)[p]);
+}
+
+/// header parsed serially; vertices decoded in parallel; faces skimmed
+/// once to find where each thread's share starts, then decoded in parallel
+void MeshLoader::LoadPly(const string &file, vector<MeshPart> *parts,
+ uint threads) {
+   size_t size, offset, faceStart, vertStart = 0, stride = 0;
+   shared_ptr<char> data = MappedFile::Map(file, &size);
+   const char *p, *end, *hdrEnd;
+   vector<PlyElement> elms;
+   const PlyElement *vertElm = nullptr, *faceElm = nullptr;
+   bool swap, hostLittle = true, fileLittle = false;
+   const uint one = 1;
+   string line, word;
+
+   if (!data)
+      throw WorldException(StringPrintf("Can't read %s", file.c_str()));
+   p = data.get();
+   end = p + size;
+   memcpy(&hostLittle, &one, 1);
+
+   if (size < 3 || memcmp(p, "ply", 3))
+      throw WorldException(StringPrintf("%s is not a PLY file",
+       file.c_str()));
+
+   // Header, up to and including end_header's newline
+   hdrEnd = p;
+   while (true) {
+      const char *next = SkipLine(hdrEnd, end);
+
+      line = string(hdrEnd, next);
+      hdrEnd = next;
+      if (line.compare(0, 10, "end_header") == 0)
+         break;
+      if (hdrEnd == end)
+         throw WorldException(StringPrintf("%s has no PLY header end",
+          file.c_str()));
+
+      istringstream words(line);
+      words >> word;
+      if (word == "format") {
+         words >> word;
+         if (word == "ascii")
+            throw WorldException(StringPrintf(
+             "%s: only binary PLY is supported", file.c_str()));
+         fileLittle = word == "binary_little_endian";
+      }
+      else if (word == "element") {
+         elms.push_back(PlyElement());
+         words >> elms.back().mName >> elms.back().mCount;
+      }
+      else if (word == "property" && !elms.empty()) {
+         PlyProp prop;
+         string type, countType;
+
+         words >> type;
+         prop.mCountType = PlyNone;
+         if (type == "list") {
+            words >> countType >> type;
+            if (!cPlyTypes.count(countType))
+               throw WorldException(StringPrintf("%s: bad PLY type %s",
+                file.c_str(), countType.c_str()));
+            prop.mCountType = cPlyTypes.at(countType);
+         }
+         if (!cPlyTypes.count(type))
+            throw WorldException(StringPrintf("%s: bad PLY type %s",
+             file.c_str(), type.c_str()));
+         prop.mType = cPlyTypes.at(type);
+         words >> prop.mName;
+         elms.back().mProps.push_back(prop);
+      }
+   }
+   swap = fileLittle != hostLittle;
+
+   // Locate vertex and face data; other elements must be fixed size
+   offset = hdrEnd - data.get();
+   faceStart = 0;
+   for (auto &elm : elms) {
+      size_t elmSize = 0;
+      bool hasList = false;
+
+      for (auto &prop : elm.mProps) {
+         hasList = hasList || prop.mCountType != PlyNone;
+         elmSize += prop.mCountType != PlyNone ? 0 : cPlySizes[prop.mType];
+      }
+      if (elm.mName == "vertex") {
+         if (hasList)
+            throw WorldException(StringPrintf("%s: PLY vertex lists are "
+             "unsupported", file.c_str()));
+         vertElm = &elm;
+         vertStart = offset;
+         stride = elmSize;
+      }
+      else if (elm.mName == "face") {
+         faceElm = &elm;
+         faceStart = offset;
+         break;     // Variable size, so it must be the last one read
+      }
+      else if (hasList)
+         throw WorldException(StringPrintf("%s: PLY element %s has a list "
+          "and precedes face", file.c_str(), elm.mName.c_str()));
+      offset += elmSize * elm.mCount;
+      if (offset > size)
+         throw WorldException(StringPrintf("%s is truncated", file.c_str()));
+   }
+   if (!vertElm || !faceElm)
+      throw WorldException(StringPrintf("%s lacks PLY vertex or face data",
+       file.c_str()));
+   if (vertElm->mCount >= INT32_MAX || faceElm->mCount >= INT32_MAX)
+      throw WorldException(StringPrintf("%s is too large", file.c_str()));
+
+   // Face layout: fixed bytes, the index list, more fixed bytes
+   size_t before = 0, after = 0;
+   const PlyProp *list = nullptr;
+   for (auto &prop : faceElm->mProps)
+      if (prop.mCountType != PlyNone) {
+         if (list || (prop.mName != "vertex_indices"
+          && prop.mName != "vertex_index"))
+            throw WorldException(StringPrintf("%s: unsupported PLY face "
+             "list %s", file.c_str(), prop.mName.c_str()));
+         list = &prop;
+      }
+      else
+         (list ? after : before) += cPlySizes[prop.mType];
+   if (!list)
+      throw WorldException(StringPrintf("%s: PLY faces lack vertex_indices",
+       file.c_str()));
+
+   uint numVerts = (uint)vertElm->mCount, numFaces = (uint)faceElm->mCount;
+   PlyType xType, yType, zType, nxType, nyType, nzType, uType, vType;
+   int xOff = PlyOffset(*vertElm, {"x"}, &xType);
+   int yOff = PlyOffset(*vertElm, {"y"}, &yType);
+   int zOff = PlyOffset(*vertElm, {"z"}, &zType);
+   int nxOff = PlyOffset(*vertElm, {"nx"}, &nxType);
+   int nyOff = PlyOffset(*vertElm, {"ny"}, &nyType);
+   int nzOff = PlyOffset(*vertElm, {"nz"}, &nzType);
+   int uOff = PlyOffset(*vertElm, {"u", "s", "texture_u", "texture_s"},
+    &uType);
+   int vOff = PlyOffset(*vertElm, {"v", "t", "texture_v", "texture_t"},
+    &vType);
+   bool hasNormals = nxOff >= 0 && nyOff >= 0 && nzOff >= 0;
+
+   if (xOff < 0 || yOff < 0 || zOff < 0)
+      throw WorldException(StringPrintf("%s: PLY vertices lack x, y or z",
+       file.c_str()));
+
+   threads = std::max(1u, std::min(Parallel::Threads(threads),
+    (uint)(size / cMinChunk)));
+   parts->push_back(MeshPart(""));
+   MeshPart &part = parts->back();
+   part.mVerts.resize(numVerts);
+
+   Parallel::For(numVerts, threads, [&](uint lo, uint hi) {
+      for (uint i = lo; i < hi; i++) {
+         const char *rec = data.get() + vertStart + i * stride;
+         Vertex &vtx = part.mVerts[i];
+
+         vtx.loc = vec4(ReadPly(rec + xOff, xType, swap),
+          ReadPly(rec + yOff, yType, swap), ReadPly(rec + zOff, zType, swap),
+          1.0f);
+         vtx.normal = hasNormals ? vec3(ReadPly(rec + nxOff, nxType, swap),
+          ReadPly(rec + nyOff, nyType, swap),
+          ReadPly(rec + nzOff, nzType, swap)) : vec3(0.0f);
+         vtx.texLoc = vec2(uOff >= 0 ? ReadPly(rec + uOff, uType, swap) : 0,
+          vOff >= 0 ? 1.0 - ReadPly(rec + vOff, vType, swap) : 0);
+         vtx.tangent = vtx.biTangent = vec3(0.0f);
+      }
+   });
+
+   // Skim counts to find each thread's first face and first triangle
+   uint per = (numFaces + threads - 1) / std::max(1u, threads);
+   uint countSize = cPlySizes[list->mCountType];
+   uint idxSize = cPlySizes[list->mType];
+   vector<size_t> faceOffs, triStarts;
+   size_t numTris = 0;
+   double count;
+
+   offset = faceStart;
+   for (uint f = 0; f < numFaces; f++) {
+      if (per && f % per == 0) {
+         faceOffs.push_back(offset);
+         triStarts.push_back(numTris);
+      }
+      if (offset + before + countSize > size)
+         throw WorldException(StringPrintf("%s is truncated", file.c_str()));
+      count = ReadPly(data.get() + offset + before, list->mCountType, swap);
+      if (count < 3)
+         throw WorldException(StringPrintf("%s: PLY face %u has %g corners",
+          file.c_str(), f, count));
+      numTris += (size_t)count - 2;
+      offset += before + countSize + (size_t)count * idxSize + after;
+   }
+   if (offset > size)
+      throw WorldException(StringPrintf("%s is truncated", file.c_str()));
+   if (3 * numTris >= UINT32_MAX)
+      throw WorldException(StringPrintf("%s is too large", file.c_str()));
+
+   part.mIndices.resize(3 * numTris);
+   vector<uint> bad(faceOffs.size(), 0);
+   Parallel::For((uint)faceOffs.size(), threads, [&](uint lo, uint hi) {
+      for (uint k = lo; k < hi; k++) {
+         const char *rec = data.get() + faceOffs[k];
+         uint *idxs = part.mIndices.data() + 3 * triStarts[k];
+         uint first = 0, prev = 0, idx, n;
+
+         for (uint f = k * per; f < std::min(numFaces, (k + 1) * per); f++) {
+            rec += before;
+            n = (uint)ReadPly(rec, list->mCountType, swap);
+            rec += countSize;
+            for (uint c = 0; c < n; c++, rec += idxSize) {
+               idx = (uint)ReadPly(rec, list->mType, swap);
+               bad[k] |= idx >= numVerts;
+               if (c == 0)
+                  first = idx;
+               else if (c >= 2) {
+                  *idxs++ = first;
+                  *idxs++ = prev;
+                  *idxs++ = idx;
+               }
+               prev = idx;
+            }
+            rec += after;
+         }
+      }
+   });
+   for (uint b : bad)
+      if (b)
+         throw WorldException(StringPrintf("%s: PLY index out of range",
+          file.c_str()));
+
+   if (!hasNormals)
+      SmoothNormals(part.mVerts, part.mIndices);
+}
+
+/// sums unnormalized face normals, whose length is twice the area
+void MeshLoader::SmoothNormals(vector<Vertex> &verts,
+ const vector<uint> &idxs) {
+   vec3 faceNrm;
+
+   for (auto &vtx : verts)
+      vtx.normal = vec3(0.0f);
+   for (size_t i = 0; i + 2 < idxs.size(); i += 3) {
+      faceNrm = cross(vec3(verts[idxs[i + 1]].loc - verts[idxs[i]].loc),
+       vec3(verts[idxs[i + 2]].loc - verts[idxs[i]].loc));
+      for (uint k = 0; k < 3; k++)
+         verts[idxs[i + k]].normal += faceNrm;
+   }
+   for (auto &vtx : verts)
+      vtx.normal = IsDirection(vtx.normal) ? normalize(vtx.normal)
+       : vec3(0, 0, 1);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Model.h"
+
+// One material's share of a loaded mesh: welded vertices with w = 1 and
+// zero tangents, and the triangles indexing them
+struct MeshPart {
+   std::string mMaterial;      // usemtl name, or empty for none
+   std::vector<Vertex> mVerts;
+   std::vector<uint> mIndices;
+
+   MeshPart(const std::string &m) : mMaterial(m) {}
+};
+
+// Surface of one newmtl entry in an OBJ's MTL libraries, with map paths
+// resolved relative to the library
+struct MeshMaterial {
+   std::string mName;
+   glm::vec3 mDiffuse;         // Kd
+   std::string mDiffuseMap;    // map_Kd, or empty
+   std::string mNormalMap;     // map_Bump, bump or norm, or empty
+
+   MeshMaterial(const std::string &n) : mName(n), mDiffuse(1.0f) {}
+};
+
+// Loads large triangle meshes from memory-mapped OBJ or binary PLY files.
+// Each file is split into one chunk per thread, parsed in parallel, and
+// the chunks stitched together in file order, so results are identical
+// for any thread count.  Faces of more than three corners are fanned into
+// triangles, texture v is flipped to this project's top-down convention,
+// and missing normals are filled in with area-weighted smooth normals.
+// Malformed input throws WorldException.
+class MeshLoader {
+   struct ObjChunk;
+
+   static void ParseObjChunk(const char *, const char *, ObjChunk *);
+   static void LoadMtl(const std::string &, std::vector<MeshMaterial> *);
+   static void WeldObj(std::vector<ObjChunk> &, uint part, uint threads,
+    const std::vector<glm::vec3> &, const std::vector<glm::vec2> &,
+    const std::vector<glm::vec3> &, const std::vector<glm::vec3> &,
+    MeshPart *);
+
+public:
+   // Files smaller than this per thread use fewer threads
+   static constexpr size_t cMinChunk = 1 << 20;
+
+   // Load file as OBJ or PLY by extension, using up to |threads| threads
+   // (0 for one per core).  Appends one MeshPart per material used, and
+   // for OBJ the materials of any MTL libraries it names.
+   static void Load(const std::string &file, std::vector<MeshPart> *parts,
+    std::vector<MeshMaterial> *materials, uint threads = 0);
+
+   // Files besides file that its load reads: for OBJ, each MTL library
+   // it names, whether or not present, and the images those reference
+   static std::vector<std::string> GetDependencies(const std::string &file);
+
+   static void LoadObj(const std::string &file, std::vector<MeshPart> *parts,
+    std::vector<MeshMaterial> *materials, uint threads = 0);
+
+   // Binary PLY, either endianness, as a single unnamed MeshPart
+   static void LoadPly(const std::string &file, std::vector<MeshPart> *parts,
+    uint threads = 0);
+
+   // Replace the normals of verts with area-weighted sums of the face
+   // normals of the triangles in idxs
+   static void SmoothNormals(std::vector<Vertex> &verts,
+    const std::vector<uint> &idxs);
+};
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cstring>
+
+#include "MeshOptimizer.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Helper Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// FNV-1a over the vertex's bytes, so equal hashes follow from bit equality
+static uint HashVertex(const Vertex &vtx) {
+   const unsigned char *byte = (const unsigned char *)&vtx;
+   uint hash = 2166136261u;
+
+   for (size_t i = 0; i < sizeof(Vertex); i++)
+      hash = (hash ^ byte[i]) * 16777619u;
+
+   return hash;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MeshOptimizer Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// numbers the distinct vertices of idxs 0.. in first-use order, filling
+/// mLocalIdxs with local ids and mGlobal with the reverse map.  Returns the
+/// number of distinct vertices.
+uint MeshOptimizer::Localize(const uint *idxs, uint numIdxs, uint numVerts) {
+   if (mLocal.size() < numVerts)
+      mLocal.resize(numVerts, -1);
+
+   mGlobal.clear();
+   mLocalIdxs.resize(numIdxs);
+   for (uint i = 0; i < numIdxs; i++) {
+      if (mLocal[idxs[i]] < 0) {
+         mLocal[idxs[i]] = (int)mGlobal.size();
+         mGlobal.push_back(idxs[i]);
+      }
+      mLocalIdxs[i] = mLocal[idxs[i]];
+   }
+
+   // Leave mLocal all -1 again, touching only what was set
+   for (uint vtx : mGlobal)
+      mLocal[vtx] = -1;
+
+   return (uint)mGlobal.size();
+}
+
+/// Tipsify's choice of the next vertex to fan around: the candidate that
+/// is still live and will still be cached after emitting its remaining
+/// triangles, preferring the oldest.  On a dead end, falls back to the
+/// most recent live vertex of those emitted, then to the next live vertex
+/// in input order, starting a new cluster.  Returns -1 when all are done.
+int MeshOptimizer::NextVertex(uint time, uint cacheSize, uint *cursor) {
+   int best = -1, bestPri = -1, pri;
+   uint vtx;
+
+   for (uint cand : mCands)
+      if (mLive[cand] > 0) {
+         pri = 0;
+         if (time - mStamp[cand] + 2 * mLive[cand] <= cacheSize)
+            pri = (int)(time - mStamp[cand]);
+         if (pri > bestPri) {
+            best = (int)cand;
+            bestPri = pri;
+         }
+      }
+
+   if (best >= 0)
+      return best;
+
+   while (!mDeadEnds.empty()) {
+      vtx = mDeadEnds.back();
+      mDeadEnds.pop_back();
+      if (mLive[vtx] > 0) {
+         mClusters.push_back((uint)mOrder.size());
+         return (int)vtx;
+      }
+   }
+
+   for (; *cursor < mLive.size(); (*cursor)++)
+      if (mLive[*cursor] > 0) {
+         mClusters.push_back((uint)mOrder.size());
+         return (int)(*cursor)++;
+      }
+
+   return -1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MeshOptimizer Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// replays idxs through a FIFO, in which a vertex stamped at miss count m
+/// is still cached while fewer than cacheSize misses have followed
+CacheStats MeshOptimizer::Measure(const uint *idxs, uint numIdxs,
+ uint numVerts, uint cacheSize) {
+   vector<uint> stamp(numVerts, 0);
+   CacheStats rtn;
+   uint time = cacheSize + 1;
+
+   rtn.mTriangles = numIdxs / 3;
+   rtn.mVertices = numVerts;
+   for (uint i = 0; i < numIdxs; i++)
+      if (time - stamp[idxs[i]] > cacheSize) {
+         stamp[idxs[i]] = time++;
+         rtn.mMisses++;
+      }
+
+   return rtn;
+}
+
+/// open-addressed table of first occurrences, compacting in place since
+/// each survivor moves only toward the front
+uint MeshOptimizer::Weld(Vertex *verts, uint numVerts, uint *idxs,
+ uint numIdxs) {
+   uint size = 16, mask, slot, count = 0;
+
+   while (size < 2 * numVerts)
+      size *= 2;
+   mask = size - 1;
+   mTable.assign(size, 0);
+   mRemap.resize(numVerts);
+
+   for (uint v = 0; v < numVerts; v++) {
+      for (slot = HashVertex(verts[v]) & mask; mTable[slot];
+       slot = (slot + 1) & mask)
+         if (!memcmp(&verts[mTable[slot] - 1], &verts[v], sizeof(Vertex)))
+            break;
+
+      if (!mTable[slot]) {
+         verts[count] = verts[v];
+         mTable[slot] = ++count;
+      }
+      mRemap[v] = mTable[slot] - 1;
+   }
+
+   for (uint i = 0; i < numIdxs; i++)
+      idxs[i] = mRemap[idxs[i]];
+
+   return count;
+}
+
+/// Tipsify (Sander, Nehab and Barczak 2007): fan out from one vertex at a
+/// time, emitting all its remaining triangles, then move to a neighbor
+/// likely to still be cached.  Runs in time linear in the triangles.
+void MeshOptimizer::OrderForCache(uint *idxs, uint numIdxs, uint numVerts,
+ uint cacheSize) {
+   uint nv = Localize(idxs, numIdxs, numVerts), nt = numIdxs / 3;
+   uint time = cacheSize + 1, cursor = 0, vtx;
+   int fan = 0;
+
+   mOrder.clear();
+   mClusters.assign(1, 0);
+   if (!nt)
+      return;
+
+   // Triangles around each vertex, as one array sliced by mAdjStart
+   mAdjStart.assign(nv + 1, 0);
+   for (uint i = 0; i < 3 * nt; i++)
+      mAdjStart[mLocalIdxs[i] + 1]++;
+   for (uint v = 0; v < nv; v++)
+      mAdjStart[v + 1] += mAdjStart[v];
+   mLive.assign(nv, 0);
+   mAdjTris.resize(3 * nt);
+   for (uint i = 0; i < 3 * nt; i++) {
+      vtx = mLocalIdxs[i];
+      mAdjTris[mAdjStart[vtx] + mLive[vtx]++] = i / 3;
+   }
+
+   mStamp.assign(nv, 0);
+   mEmitted.assign(nt, false);
+   mDeadEnds.clear();
+   while (fan >= 0) {
+      mCands.clear();
+      for (uint a = mAdjStart[fan]; a < mAdjStart[fan + 1]; a++) {
+         uint tri = mAdjTris[a];
+
+         if (mEmitted[tri])
+            continue;
+         for (uint k = 0; k < 3; k++) {
+            vtx = mLocalIdxs[3*tri + k];
+            mDeadEnds.push_back(vtx);
+            mCands.push_back(vtx);
+            mLive[vtx]--;
+            if (time - mStamp[vtx] > cacheSize)
+               mStamp[vtx] = time++;
+         }
+         mEmitted[tri] = true;
+         mOrder.push_back(tri);
+      }
+      fan = NextVertex(time, cacheSize, &cursor);
+   }
+
+   mCopy.assign(idxs, idxs + 3 * nt);
+   for (uint t = 0; t < nt; t++)
+      for (uint k = 0; k < 3; k++)
+         idxs[3*t + k] = mCopy[3*mOrder[t] + k];
+}
+
+/// sorts clusters by how far their area-weighted centroid lies out from
+/// the mesh's along their mean normal, outermost first (Sander et al.)
+void MeshOptimizer::OrderForOverdraw(uint *idxs, uint numIdxs,
+ const Vertex *verts) {
+   uint nt = numIdxs / 3, nc = (uint)mClusters.size(), dst = 0;
+   vector<vec3> centers(nc, vec3(0.0f)), normals(nc, vec3(0.0f));
+   vector<float> areas(nc, 0.0f), keys(nc);
+   vector<uint> order(nc);
+   vec3 pts[3], meshCenter(0.0f), normal;
+   float meshArea = 0.0f, area;
+
+   if (nc < 2 || mOrder.size() != nt)
+      return;
+
+   for (uint c = 0; c < nc; c++) {
+      uint end = c + 1 < nc ? mClusters[c + 1] : nt;
+
+      for (uint t = mClusters[c]; t < end; t++) {
+         for (uint k = 0; k < 3; k++)
+            pts[k] = vec3(verts[idxs[3*t + k]].loc)
+             / verts[idxs[3*t + k]].loc.w;
+         normal = cross(pts[1] - pts[0], pts[2] - pts[0]);
+         area = length(normal);
+         centers[c] += area * (pts[0] + pts[1] + pts[2]) / 3.0f;
+         normals[c] += normal;
+         areas[c] += area;
+      }
+      meshCenter += centers[c];
+      meshArea += areas[c];
+   }
+   if (meshArea <= 0.0f)
+      return;
+   meshCenter /= meshArea;
+
+   for (uint c = 0; c < nc; c++) {
+      order[c] = c;
+      keys[c] = areas[c] > 0.0f && dot(normals[c], normals[c]) > 0.0f
+       ? dot(centers[c] / areas[c] - meshCenter, normalize(normals[c]))
+       : 0.0f;
+   }
+   stable_sort(order.begin(), order.end(),
+    [&keys](uint a, uint b) {return keys[a] > keys[b];});
+
+   mCopy.assign(idxs, idxs + 3 * nt);
+   for (uint c : order) {
+      uint end = c + 1 < nc ? mClusters[c + 1] : nt;
+
+      for (uint i = 3 * mClusters[c]; i < 3 * end; i++)
+         idxs[dst++] = mCopy[i];
+   }
+}
+
+/// gathers vertices in first-use order into scratch, then copies back
+uint MeshOptimizer::OrderForFetch(Vertex *verts, uint numVerts, uint *idxs,
+ uint numIdxs) {
+   uint count = Localize(idxs, numIdxs, numVerts);
+
+   mVertScratch.resize(count);
+   for (uint v = 0; v < count; v++)
+      mVertScratch[v] = verts[mGlobal[v]];
+   copy(mVertScratch.begin(), mVertScratch.end(), verts);
+   copy(mLocalIdxs.begin(), mLocalIdxs.end(), idxs);
+
+   return count;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Model.h"
+
+// Post-transform vertex cache behavior of an index list, from a simulated
+// FIFO cache.  Each miss is one vertex shader invocation.
+struct CacheStats {
+   uint mTriangles;
+   uint mVertices;   // Vertices in the buffer the indices refer to
+   uint mMisses;
+
+   CacheStats() : mTriangles(0), mVertices(0), mMisses(0) {}
+
+   // Average cache miss ratio: shaded vertices per triangle, 0.5 at best
+   float Acmr() const {return mTriangles ? (float)mMisses / mTriangles : 0;}
+
+   // Average transformed vertex ratio: shadings per vertex, 1.0 at best
+   float Atvr() const {return mVertices ? (float)mMisses / mVertices : 0;}
+};
+
+// One batch's vertex count and cache behavior before and after
+// MeshOptimizer, as collected by SceneCompiler::Optimize
+struct MeshReport {
+   std::string mName;    // Batch texture
+   uint mInstances;      // Draws of the batch per frame, 1 unless instanced
+   uint mVertsBefore;
+   uint mVertsAfter;
+   CacheStats mBefore;
+   CacheStats mAfter;
+
+   MeshReport(const std::string &n, uint i)
+    : mName(n), mInstances(i), mVertsBefore(0), mVertsAfter(0) {}
+};
+
+// Offline cleanup of flattened geometry, between SceneCompiler and upload:
+// weld bit-identical vertices, order triangles for the post-transform
+// cache (Tipsify), optionally order the resulting clusters for overdraw,
+// then renumber vertices in first-use order for fetch locality.  Triangle
+// orders only permute the indices they are given, so callers can keep
+// index ranges (e.g. per culled leaf) intact by ordering each separately.
+// Scratch space is kept between calls, so reuse one optimizer for many
+// meshes.
+class MeshOptimizer {
+   std::vector<int> mLocal;        // Mesh vertex -> local id, or -1
+   std::vector<uint> mGlobal;      // Local id -> mesh vertex
+   std::vector<uint> mLocalIdxs;   // Indices as local ids
+   std::vector<uint> mAdjStart, mAdjTris, mLive, mStamp, mDeadEnds, mCands;
+   std::vector<bool> mEmitted;
+   std::vector<uint> mOrder;       // Triangles in OrderForCache's order
+   std::vector<uint> mClusters;    // First triangle of each cluster
+   std::vector<uint> mCopy, mTable, mRemap;
+   std::vector<Vertex> mVertScratch;
+
+   uint Localize(const uint *idxs, uint numIdxs, uint numVerts);
+   int NextVertex(uint time, uint cacheSize, uint *cursor);
+
+public:
+   // Simulated FIFO size used for ordering and for reports
+   static constexpr uint cCacheSize = 16;
+
+   static CacheStats Measure(const uint *idxs, uint numIdxs, uint numVerts,
+    uint cacheSize = cCacheSize);
+
+   // Collapse bit-identical vertices to their first occurrence, compacting
+   // verts and rewriting idxs.  Returns the new vertex count.
+   uint Weld(Vertex *verts, uint numVerts, uint *idxs, uint numIdxs);
+
+   // Reorder the triangles of idxs for a FIFO of cacheSize.  The indices
+   // may refer to any of numVerts vertices.
+   void OrderForCache(uint *idxs, uint numIdxs, uint numVerts,
+    uint cacheSize = cCacheSize);
+
+   // Reorder the clusters the last OrderForCache produced, each a run of
+   // triangles begun by a jump to a fresh vertex, so clusters facing away
+   // from the mesh center draw first and occlude what lies behind them.
+   // idxs and numIdxs must be those OrderForCache was given.
+   void OrderForOverdraw(uint *idxs, uint numIdxs, const Vertex *verts);
+
+   // Renumber vertices by first use in idxs, dropping unreferenced ones.
+   // Returns the new vertex count.
+   uint OrderForFetch(Vertex *verts, uint numVerts, uint *idxs,
+    uint numIdxs);
+};
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cmath>
+
+#include "MeshSimplifier.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Quadric Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// the zero quadric, measuring nothing
+MeshSimplifier::Quadric::Quadric() {
+   fill(mA, mA + 10, 0.0);
+}
+
+/// squared distance to the plane dot(n, p) + d = 0, for unit n
+MeshSimplifier::Quadric::Quadric(const dvec3 &n, double d) {
+   mA[0] = n.x * n.x; mA[1] = n.x * n.y; mA[2] = n.x * n.z; mA[3] = n.x * d;
+   mA[4] = n.y * n.y; mA[5] = n.y * n.z; mA[6] = n.y * d;
+   mA[7] = n.z * n.z; mA[8] = n.z * d;
+   mA[9] = d * d;
+}
+
+/// sums another quadric into this one
+void MeshSimplifier::Quadric::Add(const Quadric &q) {
+   for (int i = 0; i < 10; i++)
+      mA[i] += q.mA[i];
+}
+
+/// evaluates [p 1] A [p 1]^T
+double MeshSimplifier::Quadric::Eval(const dvec3 &p) const {
+   return mA[0] * p.x * p.x + 2 * mA[1] * p.x * p.y + 2 * mA[2] * p.x * p.z
+    + 2 * mA[3] * p.x + mA[4] * p.y * p.y + 2 * mA[5] * p.y * p.z
+    + 2 * mA[6] * p.y + mA[7] * p.z * p.z + 2 * mA[8] * p.z + mA[9];
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MeshSimplifier Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// builds vertex-triangle adjacency and face quadrics, then locks split
+/// vertices and those on edges of one face, or of three or more
+void MeshSimplifier::Classify(uint numVerts, uint numTris) {
+   vector<uint> order(numVerts);
+   vector<uint64_t> edges;
+   dvec3 norm;
+   uint a, b, run;
+
+   // Vertices sharing a position with another are split by UV or normal
+   for (uint v = 0; v < numVerts; v++)
+      order[v] = v;
+   sort(order.begin(), order.end(), [&](uint l, uint r) {
+      return mPos[l].x != mPos[r].x ? mPos[l].x < mPos[r].x
+       : mPos[l].y != mPos[r].y ? mPos[l].y < mPos[r].y : mPos[l].z < mPos[r].z;
+   });
+   for (uint i = 1; i < numVerts; i++)
+      if (mPos[order[i]] == mPos[order[i - 1]])
+         mLocked[order[i]] = mLocked[order[i - 1]] = true;
+
+   for (uint t = 0; t < numTris; t++) {
+      const uint *tri = &mTris[3 * t];
+
+      norm = cross(mPos[tri[1]] - mPos[tri[0]], mPos[tri[2]] - mPos[tri[0]]);
+      if (length(norm) > 0.0) {
+         Quadric q(normalize(norm), -dot(normalize(norm), mPos[tri[0]]));
+
+         for (int c = 0; c < 3; c++)
+            mQuads[tri[c]].Add(q);
+      }
+
+      for (int c = 0; c < 3; c++) {
+         mVertTris[tri[c]].push_back(t);
+         a = std::min(tri[c], tri[(c + 1) % 3]);
+         b = std::max(tri[c], tri[(c + 1) % 3]);
+         edges.push_back((uint64_t)a << 32 | b);
+      }
+   }
+
+   sort(edges.begin(), edges.end());
+   for (uint i = 0; i < edges.size(); i += run) {
+      for (run = 1; i + run < edges.size()
+       && edges[i + run] == edges[i]; run++)
+         ;
+      a = (uint)(edges[i] >> 32);
+      b = (uint)edges[i];
+
+      if (run != 2)
+         mLocked[a] = mLocked[b] = true;
+   }
+}
+
+/// finds from's cheapest fold into a neighbor, at the cost of their merged
+/// quadric at the neighbor.  False if from is locked or isolated.
+bool MeshSimplifier::BestFold(uint from, Fold *best) {
+   double error, cost;
+
+   best->mFrom = from;
+   best->mTo = ~0u;
+   if (mLocked[from] || mDead[from])
+      return false;
+
+   for (uint t : mVertTris[from])
+      for (int c = 0; c < 3 && !mTriDead[t]; c++) {
+         uint to = mTris[3 * t + c];
+
+         if (to == from)
+            continue;
+         error = std::max(0.0, mQuads[from].Eval(mPos[to])
+          + mQuads[to].Eval(mPos[to]));
+         cost = error + cLengthWeight * dot(mPos[to] - mPos[from],
+          mPos[to] - mPos[from]);
+         if (best->mTo == ~0u || cost < best->mCost) {
+            best->mCost = (float)cost;
+            best->mError = (float)error;
+            best->mTo = to;
+         }
+      }
+
+   return best->mTo != ~0u;
+}
+
+/// true if folding from into to keeps the mesh manifold and turns no
+/// surviving triangle over
+bool MeshSimplifier::CanFold(uint from, uint to) {
+   uint shared = 0, common = 0, mark = 0;
+   dvec3 before, after, p[3];
+
+   // From is never on a border, so its edges each have two triangles
+   for (uint t : mVertTris[from])
+      if (!mTriDead[t] && (mTris[3 * t] == to || mTris[3 * t + 1] == to
+       || mTris[3 * t + 2] == to))
+         shared++;
+   if (shared != 2)
+      return false;
+
+   // Link condition: the ends share exactly the edge triangles' apexes.
+   // mRemap is all ~0 until output, so it serves as scratch marks here.
+   for (uint t : mVertTris[from])
+      if (!mTriDead[t])
+         for (int c = 0; c < 3; c++)
+            if (mRemap[mTris[3 * t + c]] != mark) {
+               mRemap[mTris[3 * t + c]] = mark;
+               mLink.push_back(mTris[3 * t + c]);
+            }
+   for (uint t : mVertTris[to])
+      if (!mTriDead[t])
+         for (int c = 0; c < 3; c++) {
+            uint v = mTris[3 * t + c];
+
+            if (v != from && v != to && mRemap[v] == mark) {
+               mRemap[v] = ~0u;
+               common++;
+            }
+         }
+   for (uint v : mLink)
+      mRemap[v] = ~0u;
+   mLink.clear();
+   if (common != shared)
+      return false;
+
+   // No triangle that survives may flip or collapse
+   for (uint t : mVertTris[from]) {
+      const uint *tri = &mTris[3 * t];
+
+      if (mTriDead[t] || tri[0] == to || tri[1] == to || tri[2] == to)
+         continue;
+      for (int c = 0; c < 3; c++)
+         p[c] = mPos[tri[c]];
+      before = cross(p[1] - p[0], p[2] - p[0]);
+      for (int c = 0; c < 3; c++)
+         if (tri[c] == from)
+            p[c] = mPos[to];
+      after = cross(p[1] - p[0], p[2] - p[0]);
+      if (dot(before, after) <= 0.2 * length(before) * length(after))
+         return false;
+   }
+
+   return true;
+}
+
+/// folds from into to: drops the edge's triangles, hands the rest to to,
+/// and merges quadrics.  Marks from, to and every neighbor of from with
+/// pass, as their best folds may have changed.
+void MeshSimplifier::DoFold(uint from, uint to, uint pass) {
+   vector<uint> &toTris = mVertTris[to];
+   uint kept = 0;
+
+   for (uint t : mVertTris[from]) {
+      uint *tri = &mTris[3 * t];
+
+      if (mTriDead[t])
+         continue;
+      for (int c = 0; c < 3; c++)
+         mStamps[tri[c]] = pass;
+      if (tri[0] == to || tri[1] == to || tri[2] == to)
+         mTriDead[t] = true;
+      else {
+         for (int c = 0; c < 3; c++)
+            if (tri[c] == from)
+               tri[c] = to;
+         toTris.push_back(t);
+      }
+   }
+   mVertTris[from].clear();
+
+   for (uint t : toTris)
+      if (!mTriDead[t])
+         toTris[kept++] = t;
+   toTris.resize(kept);
+
+   mQuads[to].Add(mQuads[from]);
+   mDead[from] = true;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+MeshSimplifier Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// folds in passes: each pass finds every vertex's best fold, sorts them
+/// by cost, and makes those that are still valid cheapest first, skipping
+/// any touching a vertex an earlier fold of the pass marked.  Sorting once
+/// per pass, rather than keeping a heap current, keeps large meshes fast.
+float MeshSimplifier::Simplify(const vector<Vertex> &verts,
+ const vector<uint> &idxs, uint targetIdxs, vector<Vertex> *outVerts,
+ vector<uint> *outIdxs) {
+   uint numVerts = (uint)verts.size(), numTris = (uint)idxs.size() / 3;
+   uint liveIdxs = 3 * numTris, pass = 0, folded = 1;
+   double worst = 0.0;
+   Fold fold;
+
+   mPos.resize(numVerts);
+   for (uint v = 0; v < numVerts; v++)
+      mPos[v] = dvec3(vec3(verts[v].loc) / verts[v].loc.w);
+   mTris.assign(idxs.begin(), idxs.begin() + 3 * numTris);
+   mQuads.assign(numVerts, Quadric());
+   mVertTris.assign(numVerts, vector<uint>());
+   mStamps.assign(numVerts, 0);
+   mRemap.assign(numVerts, ~0u);
+   mDead.assign(numVerts, false);
+   mLocked.assign(numVerts, false);
+   mTriDead.assign(numTris, false);
+   mLink.clear();
+
+   Classify(numVerts, numTris);
+
+   while (liveIdxs > targetIdxs && folded) {
+      mFolds.clear();
+      for (uint v = 0; v < numVerts; v++)
+         if (BestFold(v, &fold))
+            mFolds.push_back(fold);
+      sort(mFolds.begin(), mFolds.end());
+
+      pass++;
+      folded = 0;
+      for (auto &f : mFolds) {
+         if (liveIdxs <= targetIdxs)
+            break;
+         if (mStamps[f.mFrom] == pass || mStamps[f.mTo] == pass
+          || !CanFold(f.mFrom, f.mTo))
+            continue;
+
+         for (uint t : mVertTris[f.mFrom])
+            if (!mTriDead[t] && (mTris[3 * t] == f.mTo
+             || mTris[3 * t + 1] == f.mTo || mTris[3 * t + 2] == f.mTo))
+               liveIdxs -= 3;
+         DoFold(f.mFrom, f.mTo, pass);
+         worst = std::max(worst, (double)f.mError);
+         folded++;
+      }
+   }
+
+   // Keep the live triangles, renumbering their vertices by first use
+   outVerts->clear();
+   outIdxs->clear();
+   for (uint t = 0; t < numTris; t++)
+      if (!mTriDead[t])
+         for (int c = 0; c < 3; c++) {
+            uint v = mTris[3 * t + c];
+
+            if (mRemap[v] == ~0u) {
+               mRemap[v] = (uint)outVerts->size();
+               outVerts->push_back(verts[v]);
+            }
+            outIdxs->push_back(mRemap[v]);
+         }
+
+   return (float)sqrt(worst);
+}
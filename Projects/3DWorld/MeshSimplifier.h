@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+
+#include "Model.h"
+
+// Quadric error metric simplification (Garland and Heckbert) by half-edge
+// collapse: each step folds one vertex into a neighbor, choosing the fold
+// whose merged quadric, the summed squared distances to the planes of the
+// original triangles around both, is least at the surviving vertex.  No
+// vertex is ever moved or blended, so surviving vertices keep their exact
+// attributes.  Vertices on an open edge are never folded away, nor are
+// those sharing a position with another vertex, so UV seams and hard
+// normal creases (where the mesh is split), the borders between parts
+// simplified separately, and true mesh borders all survive exactly, and
+// no cracks open between the pieces.  Folds that would flip a triangle or
+// pinch the mesh non-manifold are skipped.  Tangents are not carried
+// over; regenerate them (TangentGen) from the simplified triangles.
+// Scratch space is kept between calls, so reuse one simplifier for many
+// meshes, one per thread.
+class MeshSimplifier {
+   struct Quadric {
+      double mA[10];   // Upper triangle of the symmetric 4x4 matrix
+
+      Quadric();
+      Quadric(const glm::dvec3 &n, double d);
+      void Add(const Quadric &);
+      double Eval(const glm::dvec3 &) const;
+   };
+
+   // A vertex's cheapest fold
+   struct Fold {
+      float mCost;     // Quadric error plus the edge length term
+      float mError;    // Quadric error alone
+      uint mFrom, mTo;
+
+      bool operator<(const Fold &f) const {return mCost < f.mCost;}
+   };
+
+   std::vector<glm::dvec3> mPos;
+   std::vector<Quadric> mQuads;
+   std::vector<std::vector<uint>> mVertTris;
+   std::vector<uint> mTris, mRemap, mLink;
+   std::vector<uint> mStamps;   // Per vertex, the last pass that changed it
+   std::vector<bool> mDead, mLocked, mTriDead;
+   std::vector<Fold> mFolds;
+
+   void Classify(uint numVerts, uint numTris);
+   bool BestFold(uint from, Fold *);
+   bool CanFold(uint from, uint to);
+   void DoFold(uint from, uint to, uint pass);
+
+public:
+   // Weight of squared edge length added to each fold's cost.  Flat and
+   // evenly curved regions cost nearly nothing to fold anywhere, and
+   // without a tiebreak fold repeatedly into the same vertices, building
+   // slivers and stars; this prefers short edges there instead.
+   static constexpr double cLengthWeight = 1e-3;
+
+   // Simplify the triangles of idxs, indexing verts, until at most
+   // targetIdxs indices remain or no fold is allowed.  The result replaces
+   // *outVerts and *outIdxs, holding only the vertices still used, in
+   // first-use order.  Returns an estimate of the largest object-space
+   // distance between the result and the input: the square root of the
+   // worst fold's quadric error.
+   float Simplify(const std::vector<Vertex> &verts,
+    const std::vector<uint> &idxs, uint targetIdxs,
+    std::vector<Vertex> *outVerts, std::vector<uint> *outIdxs);
+};
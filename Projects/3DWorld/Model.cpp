@@ -1,7 +1,13 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <algorithm>
+#include <typeinfo>
+#include "MeshLoader.h"
+#include "MeshSimplifier.h"
 #include "Model.h"
+#include "Parallel.h"
+#include "SceneCompiler.h"
+#include "VertexXform.h"
 #include <glm/gtx/matrix_transform_2d.hpp>
 
 using namespace std;
@@ -14,9 +20,14 @@ Vertex Functions
 /// applies passed-in transformation to single vertex
 void Vertex::ApplyXForm(
  const mat4 &locXfm, const mat3 &normXFm, const mat4 &texXfm) {
+   mat3 dirXfm = mat3(locXfm);
+
    loc = locXfm * loc;
    normal = normXFm * normal;
-   texLoc = vec2(texXfm * vec4(texLoc.x, texLoc.y, 0, 1));
+   tangent = dirXfm * tangent;
+   biTangent = dirXfm * biTangent;
+   texLoc = vec2(texXfm[0]) * texLoc.x + vec2(texXfm[1]) * texLoc.y
+    + vec2(texXfm[3]);
 }
 
 
@@ -35,6 +46,65 @@ vector<uint> TriangleSet::MakeRangeVec(int lo, int hi) {
    return rtn;
 }
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Model Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+// reserves compiler space per texture using the map-returning interface,
+// for models with no direct compile path
+void Model::CountGeometry(SceneCompiler &sc) const {
+   IMap numVerts = GetNumVertices();
+   NMap normals = GetNormal();
+   uint numIdxs;
+
+   for (auto &pair : GetTriangles()) {
+      numIdxs = 0;
+      for (auto &tSet : pair.second)
+         numIdxs += (uint)tSet.mIndices.size();
+      sc.Reserve(pair.first, normals[pair.first], numVerts[pair.first],
+       numIdxs);
+   }
+}
+
+// copies GetVertices/GetTriangles output into the compiler, for models with
+// no direct compile path
+void Model::CompileGeometry(SceneCompiler &sc, const mat4x4 &xfm,
+ const mat4x4 &texXfm) const {
+   VMap verts = GetVertices(xfm, texXfm);
+   TMap tris = GetTriangles();
+   uint base, numVerts;
+   Vertex *vDst;
+   uint *iDst;
+
+   for (auto &pair : verts) {
+      numVerts = 0;
+      for (auto &vec : pair.second)
+         numVerts += (uint)vec.size();
+
+      vDst = sc.AddVertices(pair.first, numVerts, &base);
+      for (auto &vec : pair.second)
+         vDst = std::copy(vec.begin(), vec.end(), vDst);
+
+      for (auto &tSet : tris[pair.first]) {
+         iDst = sc.AddIndices(pair.first, (uint)tSet.mIndices.size());
+         for (auto idx : tSet.mIndices)
+            *iDst++ = base + idx;
+      }
+   }
+}
+
+// bounds of every untransformed vertex, in homogeneous-divided space
+Aabb Model::GetBounds() const {
+   Aabb rtn;
+
+   for (auto &pair : GetVertices(mat4(1.0f), mat4(1.0f)))
+      for (auto &vec : pair.second)
+         for (auto &v : vec)
+            rtn.Grow(vec3(v.loc) / v.loc.w);
+
+   return rtn;
+}
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
 CpmModel Functions
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
@@ -104,50 +174,140 @@ NMap CmpModel::GetNormal() const {
    return rtn;
 }
 
+// counts geometry of every child, letting the compiler group repeats
+void CmpModel::CountGeometry(SceneCompiler &sc) const {
+   for (auto &cr : mChildren)
+      sc.CountChild(*cr.mdl);
+}
+
+// compiles every child, composing its transforms with ours
+void CmpModel::CompileGeometry(SceneCompiler &sc, const mat4x4 &tfm,
+ const mat4x4 &texXfm) const {
+   for (auto &cr : mChildren)
+      sc.CompileChild(cr, tfm * cr.xform, texXfm * cr.texXfm);
+}
+
+// moves child idx, leaving its geometry alone until the next refresh
+void CmpModel::SetXform(uint idx, const mat4x4 &xf) {
+   if (idx >= mChildren.size())
+      throw WorldException(StringPrintf(
+       "%s has no child %u", mName.c_str(), idx));
+
+   mChildren[idx].xform = xf;
+   if (!mChildren[idx].dirty)
+      mMoved.push_back(idx);
+   mChildren[idx].dirty = true;
+}
+
+// forgets the moves since the last ClearMoved, once a compiler has seen them
+void CmpModel::ClearMoved() const {
+   for (uint idx : mMoved)
+      mChildren[idx].dirty = false;
+   mMoved.clear();
+}
+
+// union of the children's bounds, each under its xform
+Aabb CmpModel::GetBounds() const {
+   Aabb rtn;
+
+   for (auto &cr : mChildren)
+      rtn.Grow(cr.mdl->GetBounds().Transform(cr.xform));
+
+   return rtn;
+}
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
 CylinderModel Functions
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-// returns the transformed vertices for the model
-VMap CylinderModel::GetVertices(
- const mat4x4 &xfm, const mat4x4 &texXfm) const {
-   uint nPts = (uint) mSamplePts.size();
-   vector<Vertex> vtxs(nPts * 4);
+constexpr uint CylinderModel::cSampleChunk;
+
+// polarDist, cos and sin of each angle, one virtual call per angle
+void CylinderModel::SampleProfile(const float *angles, uint n, float *dists,
+ float *coss, float *sins) const {
+   for (uint i = 0; i < n; i++) {
+      dists[i] = polarDist(angles[i]);
+      coss[i] = cos(angles[i]);
+      sins[i] = sin(angles[i]);
+   }
+}
+
+// fills vtxs with 4 * nPts vertices for samples pts, transformed by xfm
+void CylinderModel::WriteVertices(Vertex *vtxs, const mat4x4 &xfm,
+ const mat4x4 &texXfm, const vector<float> &pts) const {
+   uint nPts = (uint)pts.size(), idx, count;
+   float dists[cSampleChunk], coss[cSampleChunk], sins[cSampleChunk];
    vec4 loc;
    vec3 norm;
    vec2 sideTexLoc;
-   int idx = 0;
-   float distance;
-   VMap rtn;
+   float angle;
    mat3 normXfm = inverse(transpose(mat3(xfm)));
 
-   for (float angle : mSamplePts) {
-      distance = polarDist(angle);
-      loc = vec4(distance*cos(angle), distance*sin(angle), 1.0f, 1.0f);
-      sideTexLoc = vec2(mUReps * std::min<float>(angle, M_PI-angle)
-       / (2*M_PI), 0.0f);
-
-      // Top
-      vtxs[idx] = Vertex(loc, vec3(0, 0, 1),
-       vec2((loc.x + 1.0)/2.0, (loc.y + 1.0)/2.0));
-
-      // Side Top
-      norm = vec3(cos(angle), sin(angle), 0);
-      vtxs[nPts + 2*idx] = Vertex(loc, norm, sideTexLoc);
+   for (uint first = 0; first < nPts; first += cSampleChunk) {
+      count = std::min(cSampleChunk, nPts - first);
+      SampleProfile(pts.data() + first, count, dists, coss, sins);
+
+      for (uint s = 0; s < count; s++) {
+         idx = first + s;
+         angle = pts[idx];
+         loc = vec4(dists[s]*coss[s], dists[s]*sins[s], 1.0f, 1.0f);
+         sideTexLoc = vec2(mUReps * std::min<float>(angle, M_PI-angle)
+          / (2*M_PI), 0.0f);
+
+         // Top
+         vtxs[idx] = Vertex(loc, vec3(0, 0, 1),
+          vec2((loc.x + 1.0)/2.0, (loc.y + 1.0)/2.0));
+
+         // Side Top
+         norm = vec3(coss[s], sins[s], 0);
+         vtxs[nPts + 2*idx] = Vertex(loc, norm, sideTexLoc);
+
+         // Move to bottom
+         sideTexLoc[1] = mVReps;
+         loc[2] = -1.0;
+         vtxs[nPts + 2*idx + 1] = Vertex(loc, norm, sideTexLoc);
+
+         // Bottom
+         vtxs[3*nPts + idx] = Vertex(loc, vec3(0, 0, -1),
+          vec2((loc.x + 1.0)/2.0, (loc.y + 1.0)/2.0));
+      }
+   }
 
-      // Move to bottom
-      sideTexLoc[1] = mVReps;
-      loc[2] = -1.0;
-      vtxs[nPts + 2*idx + 1] = Vertex(loc, norm, sideTexLoc);
+   VertexXform::Apply(vtxs, 4*nPts, xfm, normXfm, texXfm);
+}
 
-      // Bottom
-      vtxs[3*nPts + idx++] = Vertex(loc, vec3(0, 0, -1),
-       vec2((loc.x + 1.0)/2.0, (loc.y + 1.0)/2.0));
-   }
+// fills idxs with 12 * nPts indices for samples pts, each offset by base
+void CylinderModel::WriteIndices(uint *idxs, uint base,
+ const vector<float> &pts) const {
+   uint numPts = (uint)pts.size();
+
+   // Top, zig-zagging across the cap: 0, 1, n-1, 2, n-2, ...
+   auto topIdx = [numPts](uint k) {
+      return k == 0 ? 0 : k % 2 ? (k + 1) / 2 : numPts - k / 2;
+   };
+
+   // Top and bottom caps walk topIdx, sides walk [numPts, 3*numPts), each
+   // as overlapping triples that wrap at the end
+   for (uint i = 0; i < numPts; i++)
+      for (uint k = 0; k < 3; k++)
+         *idxs++ = base + topIdx((i + k) % numPts);
+
+   for (uint i = 0; i < 2*numPts; i++)
+      for (uint k = 0; k < 3; k++)
+         *idxs++ = base + numPts + (i + k) % (2*numPts);
+
+   for (uint i = 0; i < numPts; i++)
+      for (uint k = 0; k < 3; k++)
+         *idxs++ = base + 3*numPts + topIdx((i + k) % numPts);
+}
 
-   for (Vertex &v: vtxs)
-      v.ApplyXForm(xfm, normXfm, texXfm);
+// returns the transformed vertices for the model
+VMap CylinderModel::GetVertices(
+ const mat4x4 &xfm, const mat4x4 &texXfm) const {
+   vector<Vertex> vtxs(mSamplePts.size() * 4);
+   VMap rtn;
 
+   WriteVertices(vtxs.data(), xfm, texXfm, mSamplePts);
    rtn[mTex].push_back(vtxs);
 
    return rtn;
@@ -155,61 +315,10 @@ VMap CylinderModel::GetVertices(
 
 // returns the indices for model
 TMap CylinderModel::GetTriangles() const {
-   uint numPts = (uint)mSamplePts.size();
-   vector<uint> topIdxs, btmIdxs, sideIdxs, fullIdxs;
+   vector<uint> fullIdxs(mSamplePts.size() * 12);
    TMap rtn;
 
-   // Top
-   topIdxs.push_back(0);
-   for (uint x = 1; x <= numPts / 2; x++) {
-
-      topIdxs.push_back(x);
-      if (numPts - x > x)
-         topIdxs.push_back(numPts - x);
-   }
-
-   // Bottom
-   for (auto idx : topIdxs)
-      btmIdxs.push_back(3*numPts + idx);
-
-   sideIdxs = TriangleSet::MakeRangeVec(numPts, 3*numPts);
-
-   for (int i = 0; i < numPts; i++) {
-      fullIdxs.push_back(topIdxs[i]);
-      if (i+1 < numPts)
-         fullIdxs.push_back(topIdxs[i+1]);
-      else
-         fullIdxs.push_back(topIdxs[(i+1)-(numPts)]);
-      if (i+2 < numPts)
-         fullIdxs.push_back(topIdxs[i+2]);
-      else
-         fullIdxs.push_back(topIdxs[(i+2)-(numPts)]);
-   }
-
-   for (int i = 0; i < numPts*2; i++) {
-      fullIdxs.push_back(sideIdxs[i]);
-      if (i+1 < numPts*2)
-         fullIdxs.push_back(sideIdxs[i+1]);
-      else
-         fullIdxs.push_back(sideIdxs[(i+1)-(numPts*2)]);
-      if (i+2 < numPts*2)
-         fullIdxs.push_back(sideIdxs[i+2]);
-      else
-         fullIdxs.push_back(sideIdxs[(i+2)-(numPts*2)]);
-   }
-
-   for (int i = 0; i < numPts; i++) {
-      fullIdxs.push_back(btmIdxs[i]);
-      if (i+1 < numPts)
-         fullIdxs.push_back(btmIdxs[i+1]);
-      else
-         fullIdxs.push_back(btmIdxs[(i+1)-(numPts)]);
-      if (i+2 < numPts)
-         fullIdxs.push_back(btmIdxs[i+2]);
-      else
-         fullIdxs.push_back(btmIdxs[(i+2)-(numPts)]);
-   }
-
+   WriteIndices(fullIdxs.data(), 0, mSamplePts);
    rtn[mTex].push_back(TriangleSet("triangles", mTex, fullIdxs));
 
    return rtn;
@@ -233,40 +342,222 @@ NMap CylinderModel::GetNormal() const {
    return rtn;
 }
 
+// reserves room for 4 * nPts vertices and 12 * nPts indices
+void CylinderModel::CountGeometry(SceneCompiler &sc) const {
+   uint nPts = (uint)mSamplePts.size();
+
+   sc.Reserve(mTex, mTexNormal, 4 * nPts, 12 * nPts);
+}
+
+// writes vertices and indices straight into the compiler arenas
+void CylinderModel::CompileGeometry(SceneCompiler &sc, const mat4x4 &xfm,
+ const mat4x4 &texXfm) const {
+   uint nPts = (uint)mSamplePts.size(), base;
+
+   WriteVertices(sc.AddVertices(mTex, 4 * nPts, &base), xfm, texXfm,
+    mSamplePts);
+   WriteIndices(sc.AddIndices(mTex, 12 * nPts), base, mSamplePts);
+}
+
+// same profile type, textures, repeats, LODs and exact sample points
+string CylinderModel::GetGeometryKey() const {
+   return StringPrintf("%s %p %p %d %f %u %u ", typeid(*this).name(),
+    mTex.get(), mTexNormal.get(), mUReps, mVReps, mLodMin, mLodMax) + string(
+    (const char *)mSamplePts.data(), mSamplePts.size() * sizeof(float));
+}
+
+// outline of the profile sampled at pts, from z = -1 to 1
+Aabb CylinderModel::ProfileBounds(const vector<float> &pts) const {
+   uint nPts = (uint)pts.size(), count;
+   float dists[cSampleChunk], coss[cSampleChunk], sins[cSampleChunk];
+   Aabb rtn;
+
+   for (uint first = 0; first < nPts; first += cSampleChunk) {
+      count = std::min(cSampleChunk, nPts - first);
+      SampleProfile(pts.data() + first, count, dists, coss, sins);
+      for (uint s = 0; s < count; s++) {
+         rtn.Grow(vec3(dists[s] * coss[s], dists[s] * sins[s], 1.0f));
+         rtn.Grow(vec3(dists[s] * coss[s], dists[s] * sins[s], -1.0f));
+      }
+   }
+
+   return rtn;
+}
+
+// outline of the sampled profile, from z = -1 to 1
+Aabb CylinderModel::GetBounds() const {
+   return ProfileBounds(mSamplePts);
+}
+
+// samples each span between neighboring pts at a few interior angles,
+// measuring from the true profile to the chord across the span
+float CylinderModel::ProfileError(const vector<float> &pts) const {
+   const uint cSteps = 4;
+   uint nPts = (uint)pts.size(), nAngles = cSteps * nPts, at, next;
+   vector<float> angles(nAngles), samples(3 * nAngles);
+   float *dists = samples.data(), *coss = dists + nAngles;
+   float *sins = coss + nAngles, rtn = 0.0f, a1, t;
+   vec2 p0, p1, chord, pt;
+
+   // Each span's start, then its interior angles, all sampled at once
+   for (uint i = 0; i < nPts; i++) {
+      a1 = i + 1 < nPts ? pts[i + 1] : pts[0] + 2 * (float)M_PI;
+      for (uint s = 0; s < cSteps; s++)
+         angles[cSteps * i + s] = pts[i] + (a1 - pts[i]) * s / cSteps;
+   }
+   SampleProfile(angles.data(), nAngles, dists, coss, sins);
+
+   for (uint i = 0; i < nPts; i++) {
+      at = cSteps * i;
+      next = cSteps * ((i + 1) % nPts);
+      p0 = dists[at] * vec2(coss[at], sins[at]);
+      p1 = dists[next] * vec2(coss[next], sins[next]);
+      chord = p1 - p0;
+
+      for (uint s = 1; s < cSteps; s++) {
+         pt = dists[at + s] * vec2(coss[at + s], sins[at + s]);
+         t = dot(chord, chord) > 0.0f ? clamp(dot(pt - p0, chord)
+          / dot(chord, chord), 0.0f, 1.0f) : 0.0f;
+         rtn = std::max(rtn, length(pt - (p0 + t * chord)));
+      }
+   }
+
+   return rtn;
+}
+
+// A CylinderModel's profile at other sample points, sharing its textures
+// and repeats.  The base model must outlive it.
+class CylinderLod : public Model {
+   const CylinderModel *mBase;
+   vector<float> mPts;
+
+public:
+   CylinderLod(const CylinderModel *base, const vector<float> &pts)
+    : Model(base->getName() + " lod"), mBase(base), mPts(pts) {}
+
+   IMap GetNumVertices() const override {
+      IMap rtn;
+
+      rtn[mBase->mTex] = 4 * (int)mPts.size();
+      return rtn;
+   }
+
+   VMap GetVertices(const mat4x4 &xfm, const mat4x4 &texXfm) const override {
+      vector<Vertex> vtxs(4 * mPts.size());
+      VMap rtn;
+
+      mBase->WriteVertices(vtxs.data(), xfm, texXfm, mPts);
+      rtn[mBase->mTex].push_back(vtxs);
+      return rtn;
+   }
+
+   TMap GetTriangles() const override {
+      vector<uint> idxs(12 * mPts.size());
+      TMap rtn;
+
+      mBase->WriteIndices(idxs.data(), 0, mPts);
+      rtn[mBase->mTex].push_back(TriangleSet("triangles", mBase->mTex, idxs));
+      return rtn;
+   }
+
+   NMap GetNormal() const override {return mBase->GetNormal();}
+
+   void CountGeometry(SceneCompiler &sc) const override {
+      sc.Reserve(mBase->mTex, mBase->mTexNormal, 4 * (uint)mPts.size(),
+       12 * (uint)mPts.size());
+   }
+
+   void CompileGeometry(SceneCompiler &sc, const mat4x4 &xfm,
+    const mat4x4 &texXfm) const override {
+      uint nPts = (uint)mPts.size(), base;
+
+      mBase->WriteVertices(sc.AddVertices(mBase->mTex, 4 * nPts, &base), xfm,
+       texXfm, mPts);
+      mBase->WriteIndices(sc.AddIndices(mBase->mTex, 12 * nPts), base, mPts);
+   }
+
+   Aabb GetBounds() const override {return mBase->ProfileBounds(mPts);}
+};
+
+// evenly spaced samples, halving from mLodMax while at least mLodMin
+vector<LodLevel> CylinderModel::GetLods() const {
+   vector<LodLevel> rtn;
+   vector<float> pts;
+
+   for (uint n = mLodMax; n >= std::max(3u, mLodMin) && n; n /= 2) {
+      pts.resize(n);
+      for (uint i = 0; i < n; i++)
+         pts[i] = (float)(2 * M_PI * i / n);
+      rtn.push_back(LodLevel{make_shared<CylinderLod>(this, pts),
+       ProfileError(pts)});
+   }
+
+   return rtn;
+}
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
 PlaneModel Functions
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-// creates 1x1 vertical model
-PlaneModel::PlaneModel(string n, shared_ptr<Texture> t,
-   shared_ptr<Texture> nT) : Model(n), mTex(t), mTexNormal(nT) {
-   vector<vec4> locs = {{.5,.5,0,1},{.5,-.5,0,1},{-.5,.5,0,1},{-.5,-.5,0,1}};
-   vector<vec3> norms = {{0,0,1},{0,0,1},{0,0,1},{0,0,1}};
-   vector<vec2> texLocs = {{1,0},{1,1},{0,0},{0,1}};
+// One corner of a primitive as plain floats, so whole tables can be
+// constexpr; Vertex itself isn't a literal type
+struct PrimCorner {
+   float loc[4];
+   float norm[3];
+   float texLoc[2];
+};
+
+// builds a primitive's Vertex table once, at static init, without the heap
+template <size_t N>
+static array<Vertex, N> MakeVertices(const array<PrimCorner, N> &corners) {
+   array<Vertex, N> rtn;
+
+   for (size_t i = 0; i < N; i++) {
+      const PrimCorner &c = corners[i];
 
-   for (int i = 0; i < 4; i++)
-      mVerts.push_back(Vertex(locs[i], norms[i], texLocs[i]));
+      rtn[i] = Vertex(vec4(c.loc[0], c.loc[1], c.loc[2], c.loc[3]),
+       vec3(c.norm[0], c.norm[1], c.norm[2]), vec2(c.texLoc[0], c.texLoc[1]));
+   }
+
+   return rtn;
+}
+
+// 1x1 vertical plane facing +z
+static constexpr array<PrimCorner, 4> cPlaneCorners = {{
+ {{.5,.5,0,1},{0,0,1},{1,0}},{{.5,-.5,0,1},{0,0,1},{1,1}},
+ {{-.5,.5,0,1},{0,0,1},{0,0}},{{-.5,-.5,0,1},{0,0,1},{0,1}}}};
+
+// fixed indices for plane
+static constexpr array<uint, 6> cPlaneIdxs = {{0,1,2,1,2,3}};
+
+static const array<Vertex, 4> cPlaneVerts = MakeVertices(cPlaneCorners);
+
+// the shared plane vertices
+Span<Vertex> PlaneModel::Vertices() {
+   return cPlaneVerts;
+}
+
+// the shared plane indices
+Span<uint> PlaneModel::Indices() {
+   return cPlaneIdxs;
 }
 
 // returns indices for plane
 TMap PlaneModel::GetTriangles() const {
    TMap rtn;
-   vector<uint> inds = {0,1,2,1,2,3};
-   rtn[mTex].push_back(TriangleSet("trinagles", mTex, inds));
+   rtn[mTex].push_back(TriangleSet("trinagles", mTex,
+    vector<uint>(Indices().begin(), Indices().end())));
 
    return rtn;
 }
 
 // returns vertices for plane
 VMap PlaneModel::GetVertices(const mat4x4 &xfm, const mat4x4 &texXfm) const {
-   vector<Vertex> verts;
+   vector<Vertex> verts(Vertices().begin(), Vertices().end());
    mat3 normXfm = inverse(transpose(mat3(xfm)));
    VMap rtn;
 
-   for (Vertex v : mVerts) {
-      v.ApplyXForm(xfm, normXfm, texXfm);
-      verts.push_back(v);
-   }
+   VertexXform::Apply(verts.data(), verts.size(), xfm, normXfm, texXfm);
 
    rtn[mTex].push_back(verts);
    
@@ -277,7 +568,7 @@ VMap PlaneModel::GetVertices(const mat4x4 &xfm, const mat4x4 &texXfm) const {
 IMap PlaneModel::GetNumVertices() const {
    IMap rtn;
 
-   rtn[mTex] = 4;
+   rtn[mTex] = (int)Vertices().size();
 
    return rtn;
 }
@@ -291,97 +582,112 @@ NMap PlaneModel::GetNormal() const {
    return rtn;
 }
 
+// reserves room for plane's 4 vertices and 6 indices
+void PlaneModel::CountGeometry(SceneCompiler &sc) const {
+   sc.Reserve(mTex, mTexNormal, (uint)Vertices().size(),
+    (uint)Indices().size());
+}
+
+// writes transformed plane straight into the compiler arenas
+void PlaneModel::CompileGeometry(SceneCompiler &sc, const mat4x4 &xfm,
+ const mat4x4 &texXfm) const {
+   mat3 normXfm = inverse(transpose(mat3(xfm)));
+   uint base;
+   Vertex *verts = sc.AddVertices(mTex, (uint)Vertices().size(), &base);
+   uint *idxs = sc.AddIndices(mTex, (uint)Indices().size());
+
+   copy(Vertices().begin(), Vertices().end(), verts);
+   VertexXform::Apply(verts, Vertices().size(), xfm, normXfm, texXfm);
+
+   for (uint idx : Indices())
+      *idxs++ = base + idx;
+}
+
+// all planes with the same textures are identical
+string PlaneModel::GetGeometryKey() const {
+   return StringPrintf("plane %p %p", mTex.get(), mTexNormal.get());
+}
+
+// bounds of the plane's vertices
+Aabb PlaneModel::GetBounds() const {
+   Aabb rtn;
+
+   for (auto &v : Vertices())
+      rtn.Grow(vec3(v.loc) / v.loc.w);
+
+   return rtn;
+}
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
 CubeModel Functions
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-// creates a six sided perfect normal cube.
-CubeModel::CubeModel(string n, shared_ptr<Texture> t,
-   shared_ptr<Texture> nT) : Model(n), mTex(t), mTexNormal(nT) {
-   vector<vec4> locs = {
-      // z
-    {-0.5,-0.5,0.5,0.5},{0.5,-0.5,0.5,0.5},
-    {-0.5,0.5,0.5,0.5},{0.5,0.5,0.5,0.5},
-      // -x
-    {-0.5,-0.5,0.5,0.5},{-0.5,-0.5,-0.5,0.5},
-    {-0.5,0.5,0.5,0.5},{-0.5,0.5,-0.5,0.5}, 
-      // y
-    {-0.5,0.5,0.5,0.5},{-0.5,0.5,-0.5,0.5},
-    {0.5,0.5,0.5,0.5},{0.5,0.5,-0.5,0.5}, 
-      // x
-    {0.5,0.5,0.5,0.5},{0.5,0.5,-0.5,0.5},
-    {0.5,-0.5,0.5,0.5},{0.5,-0.5,-0.5,0.5},
-      // -y
-    {0.5,-0.5,0.5,0.5},{0.5,-0.5,-0.5,0.5},
-    {-0.5,-0.5,0.5,0.5},{-0.5,-0.5,-0.5,0.5}, 
-      // -z
-    {-0.5,-0.5,-0.5,0.5},{0.5,-0.5,-0.5,0.5},
-    {-0.5,0.5,-0.5,0.5},{0.5,0.5,-0.5,0.5}};
-
-   vector<vec3> norms = {
-      // z
-    {0,0,1},{0,0,1},{0,0,1},{0,0,1},
-      // -x
-    {-1,0,0},{-1,0,0},{-1,0,0},{-1,0,0},
-      // y
-    {0,1,0},{0,1,0},{0,1,0},{0,1,0},
-      // x
-    {1,0,0},{1,0,0},{1,0,0},{1,0,0},
-      // -y
-    {0,-1,0},{0,-1,0},{0,-1,0},{0,-1,0},
-      // -z
-    {0,0,-1},{0,0,-1},{0,0,-1},{0,0,-1}};
-
-   vector<vec2> texLocs = {
-      // z
-    {1,0},{1,1},{0,0},{0,1},
-      // -x
-    {1,0},{1,1},{0,0},{0,1},
-      // y
-    {1,0},{1,1},{0,0},{0,1},
-      // x
-    {1,0},{1,1},{0,0},{0,1},
-      // -y
-    {1,0},{1,1},{0,0},{0,1},
-      // -z
-    {1,0},{1,1},{0,0},{0,1},};
-
-   for (int i = 0; i < 24; i++)
-      mVerts.push_back(Vertex(locs[i], norms[i], texLocs[i]));
+// six sided perfect normal cube, four corners per face, homogeneous w 0.5
+// putting the faces at +-1
+static constexpr array<PrimCorner, 24> cCubeCorners = {{
+   // z
+ {{-0.5,-0.5,0.5,0.5},{0,0,1},{1,0}},{{0.5,-0.5,0.5,0.5},{0,0,1},{1,1}},
+ {{-0.5,0.5,0.5,0.5},{0,0,1},{0,0}},{{0.5,0.5,0.5,0.5},{0,0,1},{0,1}},
+   // -x
+ {{-0.5,-0.5,0.5,0.5},{-1,0,0},{1,0}},{{-0.5,-0.5,-0.5,0.5},{-1,0,0},{1,1}},
+ {{-0.5,0.5,0.5,0.5},{-1,0,0},{0,0}},{{-0.5,0.5,-0.5,0.5},{-1,0,0},{0,1}},
+   // y
+ {{-0.5,0.5,0.5,0.5},{0,1,0},{1,0}},{{-0.5,0.5,-0.5,0.5},{0,1,0},{1,1}},
+ {{0.5,0.5,0.5,0.5},{0,1,0},{0,0}},{{0.5,0.5,-0.5,0.5},{0,1,0},{0,1}},
+   // x
+ {{0.5,0.5,0.5,0.5},{1,0,0},{1,0}},{{0.5,0.5,-0.5,0.5},{1,0,0},{1,1}},
+ {{0.5,-0.5,0.5,0.5},{1,0,0},{0,0}},{{0.5,-0.5,-0.5,0.5},{1,0,0},{0,1}},
+   // -y
+ {{0.5,-0.5,0.5,0.5},{0,-1,0},{1,0}},{{0.5,-0.5,-0.5,0.5},{0,-1,0},{1,1}},
+ {{-0.5,-0.5,0.5,0.5},{0,-1,0},{0,0}},{{-0.5,-0.5,-0.5,0.5},{0,-1,0},{0,1}},
+   // -z
+ {{-0.5,-0.5,-0.5,0.5},{0,0,-1},{1,0}},{{0.5,-0.5,-0.5,0.5},{0,0,-1},{1,1}},
+ {{-0.5,0.5,-0.5,0.5},{0,0,-1},{0,0}},{{0.5,0.5,-0.5,0.5},{0,0,-1},{0,1}}}};
+
+// fixed indices for cube, two triangles per face
+static constexpr array<uint, 36> cCubeIdxs = {{
+   // z
+ 0,1,2, 1,2,3,
+   // -x
+ 4,5,6, 5,6,7,
+   // y
+ 8,9,10, 9,10,11,
+   // x
+ 12,13,14, 13,14,15,
+   // -y
+ 16,17,18, 17,18,19,
+   // -z
+ 20,21,22, 21,22,23}};
+
+static const array<Vertex, 24> cCubeVerts = MakeVertices(cCubeCorners);
+
+// the shared cube vertices
+Span<Vertex> CubeModel::Vertices() {
+   return cCubeVerts;
+}
+
+// the shared cube indices
+Span<uint> CubeModel::Indices() {
+   return cCubeIdxs;
 }
 
 // returns indices for cube model
 TMap CubeModel::GetTriangles() const {
    TMap rtn;
-   vector<uint> inds = {
-      // z
-    0,1,2, 1,2,3,
-      // -x
-    4,5,6, 5,6,7,
-      // y
-    8,9,10, 9,10,11,
-      // x
-    12,13,14, 13,14,15,
-      // -y
-    16,17,18, 17,18,19,
-      // -z
-    20,21,22, 21,22,23};
-
-   rtn[mTex].push_back(TriangleSet("trinagles", mTex, inds));
+
+   rtn[mTex].push_back(TriangleSet("trinagles", mTex,
+    vector<uint>(Indices().begin(), Indices().end())));
 
    return rtn;
 }
 
 // returns vertices for cube model
 VMap CubeModel::GetVertices(const mat4x4 &xfm, const mat4x4 &texXfm) const {
-   vector<Vertex> verts;
+   vector<Vertex> verts(Vertices().begin(), Vertices().end());
    mat3 normXfm = inverse(transpose(mat3(xfm)));
    VMap rtn;
 
-   for (Vertex v : mVerts) {
-      v.ApplyXForm(xfm, normXfm, texXfm);
-      verts.push_back(v);
-   }
+   VertexXform::Apply(verts.data(), verts.size(), xfm, normXfm, texXfm);
 
    rtn[mTex].push_back(verts);
 
@@ -392,7 +698,7 @@ VMap CubeModel::GetVertices(const mat4x4 &xfm, const mat4x4 &texXfm) const {
 IMap CubeModel::GetNumVertices() const {
    IMap rtn;
 
-   rtn[mTex] = 24;
+   rtn[mTex] = (int)Vertices().size();
 
    return rtn;
 }
@@ -405,3 +711,312 @@ NMap CubeModel::GetNormal() const {
 
    return rtn;
 }
+
+// reserves room for cube's 24 vertices and 36 indices
+void CubeModel::CountGeometry(SceneCompiler &sc) const {
+   sc.Reserve(mTex, mTexNormal, (uint)Vertices().size(),
+    (uint)Indices().size());
+}
+
+// writes transformed cube straight into the compiler arenas
+void CubeModel::CompileGeometry(SceneCompiler &sc, const mat4x4 &xfm,
+ const mat4x4 &texXfm) const {
+   mat3 normXfm = inverse(transpose(mat3(xfm)));
+   uint base;
+   Vertex *verts = sc.AddVertices(mTex, (uint)Vertices().size(), &base);
+   uint *idxs = sc.AddIndices(mTex, (uint)Indices().size());
+
+   copy(Vertices().begin(), Vertices().end(), verts);
+   VertexXform::Apply(verts, Vertices().size(), xfm, normXfm, texXfm);
+
+   for (uint idx : Indices())
+      *idxs++ = base + idx;
+}
+
+// all cubes with the same textures are identical
+string CubeModel::GetGeometryKey() const {
+   return StringPrintf("cube %p %p", mTex.get(), mTexNormal.get());
+}
+
+// bounds of the cube's vertices
+Aabb CubeModel::GetBounds() const {
+   Aabb rtn;
+
+   for (auto &v : Vertices())
+      rtn.Grow(vec3(v.loc) / v.loc.w);
+
+   return rtn;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+DirectModel Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+// groups meshes by texture, in order of first use, copying into each
+// texture's part only the vertices its meshes reference
+DirectModel::DirectModel(string n, vector<Vertex> vertices,
+ vector<TriangleSet> meshes) : Model(n) {
+   vector<shared_ptr<Texture>> texs;
+   vector<int> remap(vertices.size(), -1);
+   vector<uint> used;
+
+   for (auto &mesh : meshes)
+      if (std::find(texs.begin(), texs.end(), mesh.mTex) == texs.end())
+         texs.push_back(mesh.mTex);
+
+   for (auto &tex : texs) {
+      vector<Vertex> verts;
+      vector<TriangleSet> sets;
+
+      for (auto &mesh : meshes) {
+         if (mesh.mTex != tex)
+            continue;
+         sets.push_back(TriangleSet(mesh.mDescription, tex, {}));
+         for (uint idx : mesh.mIndices) {
+            if (idx >= vertices.size())
+               throw WorldException(StringPrintf("%s: index %u of %s is out "
+                "of range", n.c_str(), idx, mesh.mDescription.c_str()));
+            if (remap[idx] < 0) {
+               remap[idx] = (int)verts.size();
+               verts.push_back(vertices[idx]);
+               used.push_back(idx);
+            }
+            sets.back().mIndices.push_back(remap[idx]);
+         }
+      }
+
+      for (uint idx : used)
+         remap[idx] = -1;
+      used.clear();
+      AddPart(tex, nullptr, verts, sets);
+   }
+}
+
+// appends to tex's part, offsetting the new indices past its vertices
+void DirectModel::AddPart(shared_ptr<Texture> tex, shared_ptr<Texture> nT,
+ vector<Vertex> &verts, vector<TriangleSet> &sets) {
+   auto part = std::find_if(mParts.begin(), mParts.end(),
+    [&](const Part &p) {return p.mTex == tex;});
+   uint base;
+
+   if (part == mParts.end()) {
+      mParts.push_back(Part{tex, nT, {}, {}, 0});
+      part = mParts.end() - 1;
+   }
+   base = (uint)part->mVerts.size();
+
+   for (auto &v : verts)
+      mBounds.Grow(vec3(v.loc) / v.loc.w);
+   if (base)
+      part->mVerts.insert(part->mVerts.end(), verts.begin(), verts.end());
+   else
+      part->mVerts.swap(verts);
+
+   for (auto &set : sets) {
+      if (base)
+         for (auto &idx : set.mIndices)
+            idx += base;
+      part->mNumIdxs += (uint)set.mIndices.size();
+      part->mSets.push_back(TriangleSet(set.mDescription, tex, {}));
+      part->mSets.back().mIndices.swap(set.mIndices);
+   }
+}
+
+// returns vertex count per texture
+IMap DirectModel::GetNumVertices() const {
+   IMap rtn;
+
+   for (auto &part : mParts)
+      rtn[part.mTex] = (int)part.mVerts.size();
+
+   return rtn;
+}
+
+// returns transformed copies of each texture's vertices
+VMap DirectModel::GetVertices(const mat4x4 &xfm, const mat4x4 &texXfm) const {
+   mat3 normXfm = inverse(transpose(mat3(xfm)));
+   VMap rtn;
+
+   for (auto &part : mParts) {
+      rtn[part.mTex].push_back(part.mVerts);
+      VertexXform::Apply(rtn[part.mTex].back().data(), part.mVerts.size(),
+       xfm, normXfm, texXfm);
+   }
+
+   return rtn;
+}
+
+// returns each texture's triangle sets
+TMap DirectModel::GetTriangles() const {
+   TMap rtn;
+
+   for (auto &part : mParts)
+      rtn[part.mTex].assign(part.mSets.begin(), part.mSets.end());
+
+   return rtn;
+}
+
+// returns the normal map for each texture
+NMap DirectModel::GetNormal() const {
+   NMap rtn;
+
+   for (auto &part : mParts)
+      rtn[part.mTex] = part.mTexNormal;
+
+   return rtn;
+}
+
+// reserves each part's vertices and indices
+void DirectModel::CountGeometry(SceneCompiler &sc) const {
+   for (auto &part : mParts)
+      sc.Reserve(part.mTex, part.mTexNormal, (uint)part.mVerts.size(),
+       part.mNumIdxs);
+}
+
+// copies each part straight into the compiler arenas, then transforms it
+// there
+void DirectModel::CompileGeometry(SceneCompiler &sc, const mat4x4 &xfm,
+ const mat4x4 &texXfm) const {
+   mat3 normXfm = inverse(transpose(mat3(xfm)));
+   Vertex *verts;
+   uint *idxs, base;
+
+   for (auto &part : mParts) {
+      verts = sc.AddVertices(part.mTex, (uint)part.mVerts.size(), &base);
+      copy(part.mVerts.begin(), part.mVerts.end(), verts);
+      VertexXform::Apply(verts, part.mVerts.size(), xfm, normXfm, texXfm);
+
+      for (auto &set : part.mSets) {
+         idxs = sc.AddIndices(part.mTex, (uint)set.mIndices.size());
+         for (uint idx : set.mIndices)
+            *idxs++ = base + idx;
+      }
+   }
+}
+
+// only the same object, placed several times, shares a mesh
+string DirectModel::GetGeometryKey() const {
+   return StringPrintf("direct %p", this);
+}
+
+// simplifies each level from the one before, its parts spread over
+// threads with one MeshSimplifier apiece; errors accumulate down the chain
+void DirectModel::SetLod(uint levels, float ratio, uint threads) {
+   const DirectModel *prev = this;
+   float error = 0.0f;
+   uint prevTris, tris;
+
+   mLods.clear();
+   for (uint level = 1; level <= levels; level++) {
+      shared_ptr<DirectModel> lod(new DirectModel(
+       StringPrintf("%s lod %u", getName().c_str(), level)));
+      vector<vector<Vertex>> verts(prev->mParts.size());
+      vector<vector<uint>> idxs(prev->mParts.size());
+      vector<float> errors(prev->mParts.size(), 0.0f);
+
+      Parallel::For((uint)prev->mParts.size(), Parallel::Threads(threads),
+       [&](uint lo, uint hi) {
+         MeshSimplifier simplifier;
+         vector<uint> all;
+
+         for (uint p = lo; p < hi; p++) {
+            const Part &part = prev->mParts[p];
+
+            all.clear();
+            for (auto &set : part.mSets)
+               all.insert(all.end(), set.mIndices.begin(), set.mIndices.end());
+            errors[p] = simplifier.Simplify(part.mVerts, all,
+             (uint)(all.size() * ratio), &verts[p], &idxs[p]);
+         }
+      });
+
+      prevTris = tris = 0;
+      for (uint p = 0; p < prev->mParts.size(); p++) {
+         prevTris += prev->mParts[p].mNumIdxs / 3;
+         tris += (uint)idxs[p].size() / 3;
+      }
+      if (tris < cMinLodTris || tris > prevTris * (1.0f + ratio) / 2)
+         break;
+
+      for (uint p = 0; p < prev->mParts.size(); p++) {
+         vector<TriangleSet> sets(1, TriangleSet("lod",
+          prev->mParts[p].mTex, {}));
+
+         sets[0].mIndices.swap(idxs[p]);
+         lod->AddPart(prev->mParts[p].mTex, prev->mParts[p].mTexNormal,
+          verts[p], sets);
+      }
+      error += *std::max_element(errors.begin(), errors.end());
+
+      // Simplified levels are nested in the full mesh's bounds, for culling
+      lod->mBounds = mBounds;
+      mLods.push_back(LodLevel{lod, error});
+      prev = lod.get();
+   }
+}
+
+// the full mesh as level 0, then the simplified levels
+vector<LodLevel> DirectModel::GetLods() const {
+   vector<LodLevel> rtn;
+
+   if (!mLods.empty()) {
+      rtn.push_back(LodLevel{nullptr, 0.0f});
+      rtn.insert(rtn.end(), mLods.begin(), mLods.end());
+   }
+
+   return rtn;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+FileModel Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+// loads fN, then gives each material's part its textures, creating each
+// distinct image or color once
+FileModel::FileModel(string n, string fN) : DirectModel(n) {
+   vector<MeshPart> meshes;
+   vector<MeshMaterial> materials;
+   map<string, const MeshMaterial *> byName;
+   map<string, shared_ptr<Texture>> texs;
+   shared_ptr<Texture> tex, texNormal;
+   string key;
+
+   MeshLoader::Load(fN, &meshes, &materials);
+   for (auto &mtl : materials)
+      byName.insert(make_pair(mtl.mName, &mtl));
+
+   for (auto &mesh : meshes) {
+      MeshMaterial mtl = byName.count(mesh.mMaterial)
+       ? *byName[mesh.mMaterial] : MeshMaterial(mesh.mMaterial);
+
+      if (!mtl.mDiffuseMap.empty())
+         key = "png " + mtl.mDiffuseMap;
+      else
+         key = StringPrintf("color %a %a %a", mtl.mDiffuse.x, mtl.mDiffuse.y,
+          mtl.mDiffuse.z);
+      if (!texs.count(key)) {
+         uchar clr[4] = {(uchar)(255 * clamp(mtl.mDiffuse.x, 0.0f, 1.0f)),
+          (uchar)(255 * clamp(mtl.mDiffuse.y, 0.0f, 1.0f)),
+          (uchar)(255 * clamp(mtl.mDiffuse.z, 0.0f, 1.0f)), 255};
+
+         texs[key] = mtl.mDiffuseMap.empty()
+          ? shared_ptr<Texture>(new TextureClr(n + " " + mtl.mName, clr))
+          : shared_ptr<Texture>(new TexturePng(n + " " + mtl.mName,
+          mtl.mDiffuseMap, true));
+      }
+      tex = texs[key];
+
+      texNormal = nullptr;
+      if (!mtl.mNormalMap.empty()) {
+         key = "normal " + mtl.mNormalMap;
+         if (!texs.count(key))
+            texs[key] = shared_ptr<Texture>(new TextureNormal(n + " "
+             + mtl.mName + " normal", mtl.mNormalMap, true));
+         texNormal = texs[key];
+      }
+
+      vector<TriangleSet> sets(1, TriangleSet(mesh.mMaterial, tex, {}));
+      sets[0].mIndices.swap(mesh.mIndices);
+      AddPart(tex, texNormal, mesh.mVerts, sets);
+   }
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <vector>
 #include <GL/glew.h>
+#include "Bounds.h"
 #include "Textures.h"
 #include "Utility.h"
 #include <glm/mat4x4.hpp>
@@ -12,6 +15,8 @@
 #include <list>
 #include <map>
 
+class SceneCompiler;
+
 // all information for individual vertex6
 struct Vertex {
    glm::vec4 loc;    // Location vector in NDC
@@ -25,7 +30,9 @@ struct Vertex {
     glm::vec4 nT = glm::vec4(0, 0, 0,0), glm::vec4 nBT = glm::vec4(0, 0, 0,0))
     : loc(lc), normal(n), texLoc(t), tangent(nT), biTangent(nBT) {}
 
-   // Transform loc by lXfm and normal by nXfm
+   // Transform loc by lXfm, normal by nXfm, tangents by lXfm's upper 3x3
+   // and texLoc by the 2-D affine part of texXfm.  VertexXform::Apply does
+   // the same for whole arrays.
    void ApplyXForm(const glm::mat4 &, const glm::mat3 &, const glm::mat4 &);
 };
 
@@ -45,6 +52,25 @@ struct TriangleSet {
    static std::vector<uint> MakeRangeVec(int lo, int hi);
 };
 
+// Read-only view of a fixed run of Ts owned elsewhere, as C++20's
+// std::span, for handing out tables without copying or allocating
+template <class T>
+class Span {
+   const T *mData;
+   size_t mSize;
+
+public:
+   constexpr Span(const T *data, size_t size) : mData(data), mSize(size) {}
+   template <size_t N>
+   constexpr Span(const std::array<T, N> &a) : mData(a.data()), mSize(N) {}
+
+   constexpr const T *begin() const {return mData;}
+   constexpr const T *end() const {return mData + mSize;}
+   constexpr const T *data() const {return mData;}
+   constexpr size_t size() const {return mSize;}
+   constexpr const T &operator[](size_t i) const {return mData[i];}
+};
+
 // Map from Texture pointers to lists of vectors of Vertexes.  
 typedef std::map<std::shared_ptr<Texture>,
    std::list<std::vector<Vertex>>> VMap;
@@ -57,6 +83,16 @@ typedef std::map<std::shared_ptr<Texture>, int> IMap;
 
 typedef std::map<std::shared_ptr<Texture>, std::shared_ptr<Texture>> NMap;
 
+class Model;
+
+// One tessellation of a parametric or simplified model, and the largest
+// object-space distance between it and the true surface.  A null mMdl
+// stands for the model offering the level, at full detail.
+struct LodLevel {
+   std::shared_ptr<Model> mMdl;
+   float mError;
+};
+
 // Abstract interface for all model scenetree nodes
 class Model {
 protected:
@@ -78,6 +114,33 @@ public:
 
    // return the normal for the texture
    virtual NMap GetNormal() const = 0;
+
+   // Reserve space in the SceneCompiler for all vertices and indices of
+   // the model, per texture.  Default uses GetNumVertices/GetTriangles.
+   virtual void CountGeometry(SceneCompiler &) const;
+
+   // Write all vertices, transformed by tfm, and all indices of the model
+   // directly into the SceneCompiler's per-texture arenas.  Default copies
+   // out of GetVertices/GetTriangles.
+   virtual void CompileGeometry(SceneCompiler &, const glm::mat4x4 &,
+    const glm::mat4x4 &) const;
+
+   // Key that is equal for any two models with identical untransformed
+   // geometry and textures, so they can share one instanced mesh.  Empty
+   // for models that can't be instanced.
+   virtual std::string GetGeometryKey() const {return "";}
+
+   // Tessellations of a parametric model, finest first, for per-frame LOD
+   // selection.  Empty for models with one fixed tessellation, which is
+   // the default.  Models with LODs are always instanced.
+   virtual std::vector<LodLevel> GetLods() const {return {};}
+
+   // True if GetLods is nonempty, without building the levels
+   virtual bool HasLods() const {return false;}
+
+   // Bounds of the untransformed model, taking loc.w into account.  Default
+   // scans GetVertices.
+   virtual Aabb GetBounds() const;
 };
 
 // holds pointers to multiple models.
@@ -88,10 +151,11 @@ public:
       glm::mat4x4 xform;
       glm::mat4x4 texXfm;
       std::shared_ptr<Model> mdl;
+      mutable bool dirty;  // xform changed since last compiled or refreshed
 
       Child(const glm::mat4x4 &xf, 
        const glm::mat4x4 &texXfm, std::shared_ptr<Model> m)
-       : xform(xf),texXfm(texXfm), mdl(std::move(m)) {}
+       : xform(xf),texXfm(texXfm), mdl(std::move(m)), dirty(false) {}
    };
 
    CmpModel(std::string n, const std::vector<Child> &refs)
@@ -102,24 +166,87 @@ public:
       mChildren.push_back(Child(xf, texXfm, m));
    };
 
+   // Replace the xform of child idx and mark it dirty, so a dynamic
+   // SceneCompiler can refresh just the instances below it
+   void SetXform(uint idx, const glm::mat4x4 &xf);
+
+   // Indices of the dirty children, each listed once, in the order moved.
+   // ClearMoved empties the list and clears their dirty flags.
+   const std::vector<uint> &GetMoved() const {return mMoved;}
+   void ClearMoved() const;
+   const Child &GetChild(uint idx) const {return mChildren[idx];}
+
    IMap GetNumVertices() const override;
    VMap GetVertices(const glm::mat4x4 &, const glm::mat4x4 &) const override;
    TMap GetTriangles() const override;
    NMap GetNormal() const override;
+   void CountGeometry(SceneCompiler &) const override;
+   void CompileGeometry(SceneCompiler &, const glm::mat4x4 &,
+    const glm::mat4x4 &) const override;
+   Aabb GetBounds() const override;
 
 protected:
    std::vector<Child> mChildren = std::vector<Child>();
+   mutable std::vector<uint> mMoved;
 };
 
-// Model initialized via constructor-passed information
+// Model initialized via constructor-passed information.  Triangles are
+// regrouped by texture at construction, each texture keeping just the
+// vertices its triangles use, renumbered from 0.
 class DirectModel : public Model {
+protected:
+   // One texture's share of the model
+   struct Part {
+      std::shared_ptr<Texture> mTex;
+      std::shared_ptr<Texture> mTexNormal;
+      std::vector<Vertex> mVerts;
+      std::vector<TriangleSet> mSets;   // Indexing mVerts
+      uint mNumIdxs;
+   };
+
+   std::vector<Part> mParts;
+   Aabb mBounds;
+   std::vector<LodLevel> mLods;   // Simplified levels, coarsest last
+
+   DirectModel(std::string n) : Model(n) {}
+
+   // Add verts and sets, indexing them, to tex's part, creating it if
+   // needed.  Moves from both.
+   void AddPart(std::shared_ptr<Texture> tex, std::shared_ptr<Texture> nT,
+    std::vector<Vertex> &verts, std::vector<TriangleSet> &sets);
+
 public:
    DirectModel(std::string n, std::vector<Vertex> vertices,
     std::vector<TriangleSet> meshes);
+
+   // Generate up to |levels| LODs with MeshSimplifier, each with about
+   // |ratio| of the triangles of the one before, simplifying the parts of
+   // each level in parallel on up to |threads| threads (0 for one per
+   // core).  The chain stops early once a level would drop below
+   // cMinLodTris triangles or barely shrink.
+   void SetLod(uint levels, float ratio = 0.5f, uint threads = 0);
+
+   static constexpr uint cMinLodTris = 64;
+
+   IMap GetNumVertices() const override;
+   VMap GetVertices(const glm::mat4x4 &, const glm::mat4x4 &) const override;
+   TMap GetTriangles() const override;
+   NMap GetNormal() const override;
+   void CountGeometry(SceneCompiler &) const override;
+   void CompileGeometry(SceneCompiler &, const glm::mat4x4 &,
+    const glm::mat4x4 &) const override;
+   std::string GetGeometryKey() const override;
+   std::vector<LodLevel> GetLods() const override;
+   bool HasLods() const override {return !mLods.empty();}
+   Aabb GetBounds() const override {return mBounds;}
 };
 
-// Model initialized by file contents
-class FileModel : public Model {
+// Model initialized by file contents: OBJ, with the MTL libraries it
+// names, or binary PLY, as loaded by MeshLoader.  Each material's textures
+// are resolved once at load, with materials naming the same image sharing
+// one Texture, and materials without a diffuse map getting a TextureClr
+// of their diffuse color.
+class FileModel : public DirectModel {
 public:
    FileModel(std::string n, std::string fN);
 };
@@ -137,18 +264,55 @@ protected:
    std::shared_ptr<Texture> mTexNormal;
    int mUReps;      // Number of tex repeats around cylinder (int to avoid seam)
    float mVReps;    // Number of tex repeats down cylinder
+   uint mLodMin = 0, mLodMax = 0;  // Sample counts of LODs, if any
+
+   friend class CylinderLod;
 
    virtual float polarDist(float x) const = 0;
+
+   // Profile distance, cosine and sine at each of n angles.  By default
+   // polarDist, cos and sin once per angle; ProfiledCylinderModel batches
+   // them.
+   virtual void SampleProfile(const float *angles, uint n, float *dists,
+    float *coss, float *sins) const;
+
+   // Most samples WriteVertices and ProfileBounds take per SampleProfile
+   // call, into stack buffers
+   static constexpr uint cSampleChunk = 256;
+
+   // Fill 4 * pts.size() vertices and 12 * pts.size() indices (offset by
+   // base) for samples pts into caller-provided storage
+   void WriteVertices(Vertex *, const glm::mat4x4 &, const glm::mat4x4 &,
+    const std::vector<float> &pts) const;
+   void WriteIndices(uint *, uint base, const std::vector<float> &pts) const;
+
+   // Largest distance between the profile and its polygon through pts
+   float ProfileError(const std::vector<float> &pts) const;
+
+   // Outline of the profile sampled at pts, from z = -1 to 1
+   Aabb ProfileBounds(const std::vector<float> &pts) const;
 public:
    CylinderModel(std::string n, std::shared_ptr<Texture> t, int uReps,
     float vReps, const std::vector<float> &pts,
     std::shared_ptr<Texture> nT) : Model(n), mTex(t),
     mUReps(uReps), mVReps(vReps), mSamplePts(pts), mTexNormal(nT) {}
 
+   // Offer LODs of maxPts, maxPts / 2, ... down to no fewer than minPts
+   // evenly spaced samples, in place of mSamplePts.  Off by default, since
+   // sparse samples may be deliberate (e.g. 4 for a box).
+   void SetLod(uint minPts, uint maxPts) {mLodMin = minPts; mLodMax = maxPts;}
+
    IMap GetNumVertices() const override;
    VMap GetVertices(const glm::mat4x4 &, const glm::mat4x4 &) const override;
    TMap GetTriangles() const override;
    NMap GetNormal() const override;
+   void CountGeometry(SceneCompiler &) const override;
+   void CompileGeometry(SceneCompiler &, const glm::mat4x4 &,
+    const glm::mat4x4 &) const override;
+   std::string GetGeometryKey() const override;
+   std::vector<LodLevel> GetLods() const override;
+   bool HasLods() const override {return mLodMax >= 3 && mLodMax >= mLodMin;}
+   Aabb GetBounds() const override;
 };
 
 class CircleCylinderModel : public CylinderModel {
@@ -166,15 +330,25 @@ class PlaneModel : public Model {
    // member data
    std::shared_ptr<Texture> mTex;
    std::shared_ptr<Texture> mTexNormal;
-   std::vector<Vertex> mVerts;
 
 public:
    PlaneModel(std::string n, std::shared_ptr<Texture> t,
-    std::shared_ptr<Texture> nT);
+    std::shared_ptr<Texture> nT) : Model(n), mTex(t), mTexNormal(nT) {}
+
+   // The canonical 1x1 plane, untransformed, shared by every PlaneModel.
+   // Neither allocates; the map-returning queries below are built on them.
+   static Span<Vertex> Vertices();
+   static Span<uint> Indices();
+
    IMap GetNumVertices() const override;
    VMap GetVertices(const glm::mat4x4 &, const glm::mat4x4 &) const override;
    TMap GetTriangles() const override;
    NMap GetNormal() const override;
+   void CountGeometry(SceneCompiler &) const override;
+   void CompileGeometry(SceneCompiler &, const glm::mat4x4 &,
+    const glm::mat4x4 &) const override;
+   std::string GetGeometryKey() const override;
+   Aabb GetBounds() const override;
 };
 
 // perfect cube model, all sides have individual vertices for correct normals
@@ -182,13 +356,23 @@ class CubeModel : public Model {
    // member data
    std::shared_ptr<Texture> mTex;
    std::shared_ptr<Texture> mTexNormal;
-   std::vector<Vertex> mVerts;
 
 public:
    CubeModel(std::string n, std::shared_ptr<Texture> t,
-    std::shared_ptr<Texture> nT);
+    std::shared_ptr<Texture> nT) : Model(n), mTex(t), mTexNormal(nT) {}
+
+   // The canonical unit cube, untransformed, shared by every CubeModel.
+   // Neither allocates; the map-returning queries below are built on them.
+   static Span<Vertex> Vertices();
+   static Span<uint> Indices();
+
    IMap GetNumVertices() const override;
    VMap GetVertices(const glm::mat4x4 &, const glm::mat4x4 &) const override;
    TMap GetTriangles() const override;
    NMap GetNormal() const override;
+   void CountGeometry(SceneCompiler &) const override;
+   void CompileGeometry(SceneCompiler &, const glm::mat4x4 &,
+    const glm::mat4x4 &) const override;
+   std::string GetGeometryKey() const override;
+   Aabb GetBounds() const override;
 };
\ No newline at end of file
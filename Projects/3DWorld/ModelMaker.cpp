@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <memory>
 #include <glm/gtc/matrix_transform.hpp>
+#include "MeshLoader.h"
 #include "ModelMaker.h"
 
 #define M_PI 3.1415926535897
@@ -194,4 +196,179 @@ shared_ptr<Model> TableMaker::MakeModel() {
    }));
 
    return table;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Grid Model
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+shared_ptr<Model> GridMaker::MakeModel() {
+   const int cCylPts = 64;
+   const float cSpacing = 1.5f;
+   vector<float> angles;
+   float offset = (mGridSize - 1) * cSpacing / 2;
+
+   for (int i = 0; i < cCylPts; i++)
+      angles.push_back((float)(2 * M_PI * i / cCylPts));
+
+   // textures/normal Maps
+   shared_ptr<Texture> texCyl(new TexturePng("CylTex", mCylTex, true));
+
+   // shared cell contents
+   shared_ptr<Model> table = TableMaker(0.5f, 0.5f, 0.4f).MakeModel();
+   shared_ptr<Model> cyl(
+    new CircleCylinderModel("vase", texCyl, 4, 1.0f, angles, nullptr));
+
+   // individual transformations
+   mat4 cylXfm = translate(mat4(1.0f), vec3(0, 1.0f, 0))
+    * rotate(mat4(1.0f), (float)-(M_PI / 2), vec3(1, 0, 0))
+    * scale(mat4(1.0f), vec3(0.1f, 0.1f, 0.2f));
+
+   // model hierarchy
+   shared_ptr<CmpModel> grid(new CmpModel(string("grid"), vector<Chd>()));
+   for (int x = 0; x < mGridSize; x++)
+      for (int z = 0; z < mGridSize; z++) {
+         mat4 cell = translate(mat4(1.0f),
+          vec3(x * cSpacing - offset, 0, z * cSpacing - offset));
+
+         grid->addChild(cell, mat4(1.0f), table);
+         grid->addChild(cell * cylXfm, mat4(1.0f), cyl);
+      }
+
+   return grid;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Cylinder Field Model
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+shared_ptr<Model> CylinderFieldMaker::MakeModel() {
+   const uint cMinPts = 8, cMaxPts = 256;
+   const float cSpacing = 1.0f;
+   vector<float> angles;
+   float offset = (mFieldSize - 1) * cSpacing / 2;
+
+   for (uint i = 0; i < cMaxPts; i++)
+      angles.push_back((float)(2 * M_PI * i / cMaxPts));
+
+   // textures/normal Maps
+   shared_ptr<Texture> texCyl(new TexturePng("CylTex", mCylTex, true));
+
+   // one shared column, LODs from cMaxPts down to cMinPts samples
+   shared_ptr<CircleCylinderModel> cyl(
+    new CircleCylinderModel("column", texCyl, 4, 1.0f, angles, nullptr));
+   cyl->SetLod(cMinPts, cMaxPts);
+
+   // stand columns upright, starting just beyond the near plane
+   mat4 cylXfm = rotate(mat4(1.0f), (float)-(M_PI / 2), vec3(1, 0, 0))
+    * scale(mat4(1.0f), vec3(0.2f, 0.2f, 1.0f));
+
+   // model hierarchy
+   shared_ptr<CmpModel> field(new CmpModel(string("field"), vector<Chd>()));
+   for (int x = 0; x < mFieldSize; x++)
+      for (int z = 0; z < mFieldSize; z++) {
+         mat4 cell = translate(mat4(1.0f),
+          vec3(x * cSpacing - offset, 0, 2.0f + z * cSpacing));
+
+         field->addChild(cell * cylXfm, mat4(1.0f), cyl);
+      }
+
+   return field;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+File Model
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+shared_ptr<Model> FileMaker::MakeModel() {
+   shared_ptr<FileModel> mesh(new FileModel("file", mFile));
+   Aabb bounds = mesh->GetBounds();
+   vec3 extent = bounds.mMax - bounds.mMin;
+   float size = std::max(extent.x, std::max(extent.y, extent.z));
+
+   if (mLodLevels)
+      mesh->SetLod(mLodLevels);
+
+   // largest side becomes 2, centered where the cube scenes sit
+   mat4 fit = translate(mat4(1.0f), vec3(0, 0, 5))
+    * scale(mat4(1.0f), vec3(size > 0.0f ? 2.0f / size : 1.0f))
+    * translate(mat4(1.0f), -0.5f * (bounds.mMin + bounds.mMax));
+
+   return shared_ptr<Model>(new CmpModel(string("file"), vector<Chd>{
+    Chd(fit, mat4(1.0f), mesh)}));
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Cache Keys
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+string CubeMaker::GetParams() const {
+   return StringPrintf("CubeMaker %a", mSize);
+}
+
+vector<string> CubeMaker::GetAssets() const {
+   return {mTexPath};
+}
+
+string MultiCubeMaker::GetParams() const {
+   return StringPrintf("MultiCubeMaker %a", mSize);
+}
+
+vector<string> MultiCubeMaker::GetAssets() const {
+   return {mTexPath1, mTexPath2};
+}
+
+string RoomMaker::GetParams() const {
+   return StringPrintf("RoomMaker %d", mRoomSize);
+}
+
+// the room's own textures, and those of the table it holds
+vector<string> RoomMaker::GetAssets() const {
+   vector<string> rtn = {mFloor, mWall, mCeiling, mFloor_N, mCeiling_N,
+    mWallNormal};
+   vector<string> table = TableMaker(0.5f, 0.5f, 0.4f).GetAssets();
+
+   rtn.insert(rtn.end(), table.begin(), table.end());
+   return rtn;
+}
+
+string TableMaker::GetParams() const {
+   return StringPrintf("TableMaker %a %a %a", mWidth, mLength, mHeight);
+}
+
+vector<string> TableMaker::GetAssets() const {
+   return {mTop, mLegs, mTopN, mLegsN};
+}
+
+string GridMaker::GetParams() const {
+   return StringPrintf("GridMaker %d", mGridSize);
+}
+
+// the vase texture, and those of the tables
+vector<string> GridMaker::GetAssets() const {
+   vector<string> rtn = {mCylTex};
+   vector<string> table = TableMaker(0.5f, 0.5f, 0.4f).GetAssets();
+
+   rtn.insert(rtn.end(), table.begin(), table.end());
+   return rtn;
+}
+
+string CylinderFieldMaker::GetParams() const {
+   return StringPrintf("CylinderFieldMaker %d", mFieldSize);
+}
+
+vector<string> CylinderFieldMaker::GetAssets() const {
+   return {mCylTex};
+}
+
+string FileMaker::GetParams() const {
+   return StringPrintf("FileMaker %u ", mLodLevels) + mFile;
+}
+
+// the mesh, its MTL libraries, and their images
+vector<string> FileMaker::GetAssets() const {
+   vector<string> rtn = MeshLoader::GetDependencies(mFile);
+
+   rtn.insert(rtn.begin(), mFile);
+   return rtn;
 }
\ No newline at end of file
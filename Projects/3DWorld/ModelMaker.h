@@ -1,5 +1,7 @@
 #pragma once
 #include <memory>
+#include <string>
+#include <vector>
 #include "Model.h"
 
 // Subclasses of ModelMaker make a scenegraph (Model) and return it via
@@ -11,6 +13,12 @@ public:
    virtual ~ModelMaker() {};
 
    virtual std::shared_ptr<Model> MakeModel() = 0;
+
+   // Maker type and parameters, identifying the model MakeModel returns,
+   // and the files it reads.  Together with the files' timestamps these
+   // key baked scenes (see SceneCache).
+   virtual std::string GetParams() const = 0;
+   virtual std::vector<std::string> GetAssets() const = 0;
 };
 
 class CubeMaker : public ModelMaker {
@@ -23,6 +31,8 @@ class CubeMaker : public ModelMaker {
 public:
    CubeMaker(float size) : mSize(size) {}
    std::shared_ptr<Model> MakeModel() override;
+   std::string GetParams() const override;
+   std::vector<std::string> GetAssets() const override;
 };
 
 class MultiCubeMaker : public ModelMaker {
@@ -36,6 +46,8 @@ class MultiCubeMaker : public ModelMaker {
 public:
    MultiCubeMaker(float size) : mSize(size) {}
    std::shared_ptr<Model> MakeModel() override;
+   std::string GetParams() const override;
+   std::vector<std::string> GetAssets() const override;
 };
 
 class RoomMaker : public ModelMaker {
@@ -53,6 +65,8 @@ class RoomMaker : public ModelMaker {
 public:
    RoomMaker(int r) : mRoomSize(r) {};
    std::shared_ptr<Model> MakeModel() override;
+   std::string GetParams() const override;
+   std::vector<std::string> GetAssets() const override;
 };
 
 class TableMaker : public ModelMaker {
@@ -71,4 +85,58 @@ public:
    TableMaker(float x, float y, float z) 
     : mWidth(x), mHeight(z), mLength(y) {};
    std::shared_ptr<Model> MakeModel() override;
+   std::string GetParams() const override;
+   std::vector<std::string> GetAssets() const override;
+};
+
+// Synthetic stress scene: an n x n grid of tables, each with a finely
+// sampled cylinder on top.  All cells share one table and one cylinder
+// model, so the scene graph stays small while the flattened scene is large.
+class GridMaker : public ModelMaker {
+   // member data
+   int mGridSize;
+
+   // texture location constants
+   const char *mCylTex = "Resource/white_texture.png";
+
+public:
+   GridMaker(int n) : mGridSize(n) {};
+   std::shared_ptr<Model> MakeModel() override;
+   std::string GetParams() const override;
+   std::vector<std::string> GetAssets() const override;
+};
+
+// LOD test scene: an n x n field of upright cylinders receding from the
+// viewer, all one CircleCylinderModel with LODs on, so near ones are drawn
+// finely and far ones coarsely (see SceneCompiler::SelectLods)
+class CylinderFieldMaker : public ModelMaker {
+   // member data
+   int mFieldSize;
+
+   // texture location constants
+   const char *mCylTex = "Resource/white_texture.png";
+
+public:
+   CylinderFieldMaker(int n) : mFieldSize(n) {};
+   std::shared_ptr<Model> MakeModel() override;
+   std::string GetParams() const override;
+   std::vector<std::string> GetAssets() const override;
+};
+
+// A mesh file (see FileModel), scaled and centered to fit in the same
+// 2-unit space in front of the viewer that the other scenes use, with up
+// to lodLevels simplified LODs (see DirectModel::SetLod)
+class FileMaker : public ModelMaker {
+   // member data
+   std::string mFile;
+   uint mLodLevels;
+
+public:
+   static constexpr uint cLodLevels = 4;
+
+   FileMaker(const std::string &file, uint lodLevels = cLodLevels)
+    : mFile(file), mLodLevels(lodLevels) {};
+   std::shared_ptr<Model> MakeModel() override;
+   std::string GetParams() const override;
+   std::vector<std::string> GetAssets() const override;
 };
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include <cmath>
+
+#include "Bounds.h"
+#include "PackedVertex.h"
+
+using namespace std;
+using namespace glm;
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex is not packed");
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Helper Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// maps unit vector v onto the octahedron, then folds the lower half over
+/// the upper, giving a point in [-1, 1]^2
+static vec2 OctEncode(vec3 v) {
+   vec2 rtn;
+
+   v /= std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+   rtn = vec2(v.x, v.y);
+   if (v.z < 0)
+      rtn = vec2((1 - std::abs(v.y)) * (v.x >= 0 ? 1 : -1),
+       (1 - std::abs(v.x)) * (v.y >= 0 ? 1 : -1));
+
+   return rtn;
+}
+
+/// true if v has a usable direction
+static bool IsDirection(const vec3 &v) {
+   float len2 = dot(v, v);
+
+   return len2 > 1e-12f && std::isfinite(len2);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+PackedVertex Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// quantizes to the joint bounds, then encodes each vertex's frame
+void PackedVertex::PackAll(const Vertex *src, uint n, PackedVertex *dst,
+ vec3 *scale, vec3 *bias) {
+   Aabb bounds;
+   vec3 pos, nrm, tan, quant;
+   float sgn;
+
+   for (uint i = 0; i < n; i++)
+      bounds.Grow(vec3(src[i].loc) / src[i].loc.w);
+
+   *bias = n ? bounds.Center() : vec3(0.0f);
+   *scale = n ? glm::max(bounds.Extent(), vec3(1e-6f)) : vec3(1.0f);
+
+   for (uint i = 0; i < n; i++, src++, dst++) {
+      pos = vec3(src->loc) / src->loc.w;
+      quant = (pos - *bias) / *scale;
+      nrm = IsDirection(src->normal) ? normalize(src->normal) : vec3(0, 0, 1);
+
+      // Orthogonalize the tangent, or invent one if it's degenerate
+      tan = src->tangent - nrm * dot(nrm, src->tangent);
+      if (!IsDirection(tan))
+         tan = cross(nrm, std::abs(nrm.x) < 0.9f ? vec3(1, 0, 0)
+          : vec3(0, 1, 0));
+      tan = normalize(tan);
+      sgn = dot(cross(nrm, tan), src->biTangent) < 0 ? -1.0f : 1.0f;
+
+      dst->posXY = packSnorm2x16(vec2(quant.x, quant.y));
+      dst->posZW = packSnorm2x16(vec2(quant.z, sgn));
+      dst->normal = packSnorm2x16(OctEncode(nrm));
+      dst->tangent = packSnorm2x16(OctEncode(tan));
+      dst->texLoc = packHalf2x16(src->texLoc);
+   }
+}
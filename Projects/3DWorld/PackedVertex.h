@@ -0,0 +1,25 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+
+#include "Model.h"
+
+// 20-byte alternative to the 60-byte Vertex.  Positions are snorm16,
+// quantized to the bounds of the vertices packed with them, and decoded
+// in the shader by a per-draw scale and bias.  The tangent frame is an
+// octahedral normal and tangent, with the bitangent rebuilt as
+// cross(normal, tangent) times the sign kept in position w.  Texture
+// coordinates are half floats.
+struct PackedVertex {
+   uint posXY;    // snorm16 x, y
+   uint posZW;    // snorm16 z, bitangent sign
+   uint normal;   // octahedral snorm16 x, y
+   uint tangent;  // octahedral snorm16 x, y
+   uint texLoc;   // half u, v
+
+   // Pack n vertices into dst.  Positions are quantized to the vertices'
+   // joint bounds, returned as the scale and bias that map snorm [-1, 1]
+   // back to model coordinates.  loc.w is folded into xyz.
+   static void PackAll(const Vertex *src, uint n, PackedVertex *dst,
+    glm::vec3 *scale, glm::vec3 *bias);
+};
@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "Parallel.h"
+
+using namespace std;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Parallel Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// hardware_concurrency may report 0, so never less than one
+uint Parallel::Threads(uint threads) {
+   return threads ? threads : std::max(1u, thread::hardware_concurrency());
+}
+
+/// splits [0, n) evenly, starting threads for all but the first piece
+void Parallel::For(uint n, uint threads,
+ const function<void(uint, uint)> &ftn) {
+   vector<thread> pool;
+   uint per;
+
+   if (threads <= 1 || n < 2) {
+      ftn(0, n);
+      return;
+   }
+
+   per = (n + threads - 1) / threads;
+   for (uint t = 1; t < threads && t * per < n; t++)
+      pool.push_back(thread(ftn, t * per, std::min(n, (t + 1) * per)));
+   ftn(0, std::min(n, per));
+   for (auto &worker : pool)
+      worker.join();
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <functional>
+
+#include "Utility.h"
+
+// Minimal fork-join helpers for the CPU scene pipeline
+class Parallel {
+public:
+   // Threads to use for a request of |threads|: one per core if 0
+   static uint Threads(uint threads);
+
+   // Run ftn(lo, hi) over [0, n) split into one contiguous piece per
+   // thread, the first on the calling thread, and wait for all of them
+   static void For(uint n, uint threads,
+    const std::function<void(uint, uint)> &ftn);
+};
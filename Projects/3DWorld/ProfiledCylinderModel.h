@@ -0,0 +1,134 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <type_traits>
+
+#include "Model.h"
+#include "SinCos.h"
+
+// Profiles for ProfiledCylinderModel.  Each is a small constexpr-constructible
+// functor giving the outline's polar distance along the unit direction
+// (c, s) = (cos angle, sin angle), so batches need only one SinCos pass
+// and no further trig.  Outlines stay within -1 to 1 in X and Y.  Profiles
+// with cConstant set have the same distance at every angle, known at
+// compile time, and are never evaluated per sample.
+
+// Unit circle, as CircleCylinderModel
+struct CircleProfile {
+   static constexpr bool cConstant = true;
+
+   constexpr float operator()(float, float) const {return 1.0f;}
+};
+
+// Ellipse with semi-axes a along X and b along Y
+struct EllipseProfile {
+   static constexpr bool cConstant = false;
+   float mA, mB;
+
+   constexpr EllipseProfile(float a = 1.0f, float b = 0.5f) : mA(a), mB(b) {}
+
+   float operator()(float c, float s) const {
+      return mA * mB / std::sqrt(mB * mB * c * c + mA * mA * s * s);
+   }
+};
+
+// Smooth star of points arms, pulled in by depth between arms.  The
+// arms' cos(points * angle) comes from c by the Chebyshev recurrence.
+struct StarProfile {
+   static constexpr bool cConstant = false;
+   int mPoints;
+   float mDepth;
+
+   constexpr StarProfile(int points = 5, float depth = 0.5f)
+    : mPoints(points), mDepth(depth) {}
+
+   float operator()(float c, float) const {
+      float prev = 1.0f, cur = c, next;
+
+      for (int k = 1; k < mPoints; k++) {
+         next = 2.0f * c * cur - prev;
+         prev = cur;
+         cur = next;
+      }
+      return 1.0f - mDepth * 0.5f * (1.0f - cur);
+   }
+};
+
+// Gear of teeth flat-topped teeth, depth deep; sharpness above 1 squares
+// them off
+struct GearProfile {
+   static constexpr bool cConstant = false;
+   int mTeeth;
+   float mDepth, mSharpness;
+
+   constexpr GearProfile(int teeth = 16, float depth = 0.15f,
+    float sharpness = 4.0f)
+    : mTeeth(teeth), mDepth(depth), mSharpness(sharpness) {}
+
+   float operator()(float c, float) const {
+      float prev = 1.0f, cur = c, next;
+
+      for (int k = 1; k < mTeeth; k++) {
+         next = 2.0f * c * cur - prev;
+         prev = cur;
+         cur = next;
+      }
+      cur = std::min(1.0f, std::max(-1.0f, mSharpness * cur));
+      return 1.0f - mDepth * 0.5f * (1.0f - cur);
+   }
+};
+
+// Superellipse |x|^p + |y|^p = 1: a circle at p = 2, a diamond at 1,
+// and nearing a square as p grows
+struct SuperellipseProfile {
+   static constexpr bool cConstant = false;
+   float mPower;
+
+   constexpr SuperellipseProfile(float power = 4.0f) : mPower(power) {}
+
+   float operator()(float c, float s) const {
+      return std::pow(std::pow(std::abs(c), mPower)
+       + std::pow(std::abs(s), mPower), -1.0f / mPower);
+   }
+};
+
+// CylinderModel whose profile is a compile-time functor rather than a
+// virtual polarDist.  Samples go through SinCos in one batch, then the
+// inlined profile over the resulting arrays, which the compiler can
+// vectorize; a cConstant profile skips that second loop entirely.
+template <class Profile>
+class ProfiledCylinderModel : public CylinderModel {
+   // Keyed by its bytes in GetGeometryKey
+   static_assert(std::is_trivially_copyable<Profile>::value,
+    "Profile must be trivially copyable");
+
+   Profile mProfile;
+
+protected:
+   float polarDist(float x) const override {
+      return mProfile(std::cos(x), std::sin(x));
+   }
+
+   void SampleProfile(const float *angles, uint n, float *dists,
+    float *coss, float *sins) const override {
+      SinCos::Batch(angles, n, sins, coss);
+      if (Profile::cConstant)
+         std::fill(dists, dists + n, mProfile(1.0f, 0.0f));
+      else
+         for (uint i = 0; i < n; i++)
+            dists[i] = mProfile(coss[i], sins[i]);
+   }
+
+public:
+   ProfiledCylinderModel(std::string n, std::shared_ptr<Texture> t,
+    int uReps, float vReps, const std::vector<float> &pts,
+    std::shared_ptr<Texture> nT, const Profile &profile = Profile())
+    : CylinderModel(n, t, uReps, vReps, pts, nT), mProfile(profile) {}
+
+   // As CylinderModel's, plus the profile's parameters
+   std::string GetGeometryKey() const override {
+      return CylinderModel::GetGeometryKey()
+       + std::string((const char *)&mProfile, sizeof(Profile));
+   }
+};
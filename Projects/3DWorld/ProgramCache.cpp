@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstring>
+
+#include "MappedFile.h"
+#include "ProgramCache.h"
+#include "Utility.h"
+
+using namespace std;
+
+// Layout: ProgramHeader, the key, then the binary
+static const char cMagic[8] = "3DWPROG";
+static constexpr uint cVersion = 1;
+
+struct ProgramHeader {
+   char magic[8];
+   uint version;
+   uint keyLen;
+   GLenum format;     // As glGetProgramBinary returned it
+   uint binaryLen;
+};
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+ProgramCache Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// checked once, on the first call, which must have a GL context
+bool ProgramCache::Enabled() {
+   static int enabled = -1;
+   GLint formats = 0;
+
+   if (enabled < 0) {
+      if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+         glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats); GLChkErr;
+      }
+      enabled = formats > 0;
+   }
+   return enabled != 0;
+}
+
+/// format version, driver strings, and a hash of each source
+string ProgramCache::MakeKey(const vector<string> &sources) {
+   string key = StringPrintf("v%u %s|%s|%s", cVersion,
+    (const char *)glGetString(GL_VENDOR),
+    (const char *)glGetString(GL_RENDERER),
+    (const char *)glGetString(GL_VERSION));
+
+   for (auto &src : sources)
+      key += StringPrintf(" %016llx", HashString(src));
+
+   return key;
+}
+
+/// hash of key, under Resource
+string ProgramCache::FileName(const string &key) {
+   return StringPrintf("Resource/program_%016llx.bin", HashString(key));
+}
+
+/// maps the file, checks its key, and hands the binary to the driver
+bool ProgramCache::Load(const string &key, GLuint prog) {
+   size_t size = 0;
+   shared_ptr<char> data;
+   const ProgramHeader *hdr;
+   GLint ok;
+
+   if (!Enabled())
+      return false;
+
+   data = MappedFile::Map(FileName(key), &size);
+   hdr = (const ProgramHeader *)data.get();
+   if (!data || size < sizeof(ProgramHeader)
+    || memcmp(hdr->magic, cMagic, sizeof(cMagic))
+    || hdr->version != cVersion || hdr->keyLen != key.size()
+    || size < sizeof(ProgramHeader) + hdr->keyLen + hdr->binaryLen
+    || memcmp(data.get() + sizeof(ProgramHeader), key.data(), key.size()))
+      return false;
+
+   glProgramBinary(prog, hdr->format, data.get() + sizeof(ProgramHeader)
+    + hdr->keyLen, (GLsizei)hdr->binaryLen); GLChkErr;
+   glGetProgramiv(prog, GL_LINK_STATUS, &ok); GLChkErr;
+   return ok != 0;
+}
+
+/// header, key and binary, written whole or not at all
+void ProgramCache::Save(const string &key, GLuint prog) {
+   string file = FileName(key);
+   ProgramHeader hdr;
+   vector<char> binary;
+   GLint len = 0;
+   GLsizei got = 0;
+   FILE *out;
+   bool ok;
+
+   if (!Enabled())
+      return;
+
+   glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len); GLChkErr;
+   if (len <= 0)
+      return;
+
+   memset(&hdr, 0, sizeof(hdr));
+   binary.resize(len);
+   glGetProgramBinary(prog, len, &got, &hdr.format, binary.data());
+   GLChkErr;
+   memcpy(hdr.magic, cMagic, sizeof(cMagic));
+   hdr.version = cVersion;
+   hdr.keyLen = (uint)key.size();
+   hdr.binaryLen = (uint)got;
+
+   out = fopen(file.c_str(), "wb");
+   if (!out)
+      return;
+   ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1
+    && fwrite(key.data(), 1, key.size(), out) == key.size()
+    && fwrite(binary.data(), 1, got, out) == (size_t)got;
+   ok = !fclose(out) && ok;
+   if (!ok)
+      remove(file.c_str());
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// Linked program binaries, saved with glGetProgramBinary and reloaded with
+// glProgramBinary, so a warm start neither compiles nor links.  Files are
+// keyed by the program's full sources, variant #defines included, and the
+// GL vendor, renderer and version strings, since a binary is good only on
+// the driver that wrote it.  A driver may still reject one, which Load
+// reports as a miss.  Needs GL 4.1 or ARB_get_program_binary and at least
+// one binary format; otherwise every Load misses and Save does nothing.
+class ProgramCache {
+public:
+   // True if binaries can be read and written
+   static bool Enabled();
+
+   // Key of a program linked from sources, on this driver
+   static std::string MakeKey(const std::vector<std::string> &sources);
+
+   // File a program with this key is saved to
+   static std::string FileName(const std::string &key);
+
+   // Load the binary saved under key into prog, a new program object.
+   // Returns false, leaving prog unlinked, if there is none or the driver
+   // refuses it.
+   static bool Load(const std::string &key, GLuint prog);
+
+   // Save linked program prog under key, if it was linked with
+   // GL_PROGRAM_BINARY_RETRIEVABLE_HINT.  Failures only skip the save.
+   static void Save(const std::string &key, GLuint prog);
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+
+// Commandline-selectable ways of building and drawing the scene
+struct RenderOptions {
+   // Every leaf is drawn as an instance, and each frame uploads only the
+   // transforms of children moved since the last
+   bool dynamic = false;
+
+   // Upload PackedVertex rather than Vertex, and 16-bit indices for
+   // batches of fewer than 65536 vertices
+   bool packed = false;
+
+   // Merge every draw's vertices and indices into one VBO/IBO pair and
+   // submit each pass as glMultiDrawElementsIndirect commands, rather than
+   // binding a VAO per draw.  Needs GL 4.3 level multi-draw-indirect and
+   // shader draw parameters.
+   bool indirect = false;
+
+   // With indirect, sample from TextureArrays layers chosen per draw, so
+   // a pass binds once per array rather than once per texture
+   bool textureArrays = false;
+
+   // Run SceneCompiler::Optimize before upload, with overdraw ordering if
+   // overdraw is also set, printing each batch's MeshReport
+   bool optimize = false;
+   bool overdraw = false;
+
+   // Hardware depth compares per shadow lookup: 1 for plain 2x2 bilinear,
+   // 4 for a rotated Poisson disk, or 9 for a 3x3 grid
+   unsigned shadowTaps = 9;
+
+   // Small unshadowed point lights scattered over the scene, binned into
+   // LightClusters each frame so each fragment shades only those near it
+   unsigned pointLights = 0;
+
+   // Largest projected LOD error, in pixels, before SceneCompiler picks a
+   // finer level.  0 draws every LOD model at its finest.
+   float lodPixels = 1.0f;
+
+   // Print culling and draw counts to the console when they change, at
+   // most once a second, and setup details such as texture array counts
+   bool stats = false;
+
+   // SceneCache key of the model, if caching.  With no model, the scene
+   // is loaded from the file baked under this key.
+   std::string cacheKey;
+};
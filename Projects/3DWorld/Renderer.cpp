@@ -1,9 +1,14 @@
+#include <cmath>
+#include <cstddef>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Renderer.h"
 #include "Model.h"
+#include "PackedVertex.h"
+#include "SceneCache.h"
 #include "Utility.h"
 #include "HMDInput.h"
+#include "SceneCompiler.h"
 
 using namespace std;
 using namespace glm;
@@ -17,23 +22,30 @@ Renderer Private Functions
 void Renderer::RenderDisplay(shared_ptr<Display> dsp, 
  shared_ptr<HMDInput> inp) {
    dsp->PrepareWindow(mSdr, inp);
-   if (mTexs.size() == mVAOs.size() && mTexs.size() == mElmBuffs.size()){
-      for (int i = 0; i < mTexs.size(); i++) {
-
-         // set texture and normal map, if exists
-         mTexs[i]->UseTexture();
-         if (mTexsNormal[i]) {
-            mTexsNormal[i]->UseTexture();
-            mSdr->SetNMap(true);
-         }
-         else
-            mSdr->SetNMap(false);
-
-         // render for specific display
-         glBindVertexArray(mVAOs[i]); GLChkErr;
-         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mElmBuffs[i]); GLChkErr;
-         dsp->Redraw(mSdr, mIndSizes[i]);
-      }
+   if (mDrawMaterials.size() == mVAOs.size()
+    && mDrawMaterials.size() == mElmBuffs.size()) {
+      dsp->GetLodViews(&mViews);
+      SetPassViews(dsp->GetPassViews());
+      UpdateShadows();
+      if (!mPointLights.empty())
+         UpdateClusters();
+
+      // LOD levels for this display's eyes, which culling then buckets by
+      if (mOptions.lodPixels > 0.0f)
+         mScene.SelectLods(mViews, mOptions.lodPixels);
+
+      // one culling pass per display, covering both eyes if stereo
+      mCullStats = CullStats();
+      mScene.Cull(dsp->GetFrustum(), &mCullStats);
+
+      // one sorted draw list too, ordered by depth from the first eye
+      BuildDrawList(mViews.front().mVP);
+
+      // render for specific display
+      mDrawStats = DrawStats();
+      dsp->Redraw(mSdr, [this]() {DrawVisible();});
+      if (mOptions.stats)
+         ReportStats();
    }
    else
       throw WorldException("Texture/VAO mismatch");
@@ -42,19 +54,284 @@ void Renderer::RenderDisplay(shared_ptr<Display> dsp,
    dsp->SwapWindows();
 }
 
-/// single pass render of shadows
-void Renderer::RenderShadowMap() {
-   glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   if (mTexs.size() == mVAOs.size() && mTexs.size() == mElmBuffs.size()) {
-      for (int i = 0; i < mTexs.size(); i++) {
-         glBindVertexArray(mVAOs[i]); GLChkErr;
-         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mElmBuffs[i]); GLChkErr;
-         glDrawElements(GL_TRIANGLES, mIndSizes[i], GL_UNSIGNED_INT, (void*)0);
+/// print the last cull's and draw's counts if they changed, at most once a
+/// second so the console stays off the per-frame path
+void Renderer::ReportStats() {
+   Uint32 now = SDL_GetTicks();
+
+   if (now - mStatsTicks < 1000)
+      return;
+   mStatsTicks = now;
+   if (mCullStats.mVisible != mShownStats.mVisible
+    || mCullStats.mCulled != mShownStats.mCulled) {
+      printf("visible %u culled %u\n", mCullStats.mVisible,
+       mCullStats.mCulled);
+      mShownStats = mCullStats;
+   }
+   if (mDrawStats != mShownDraws) {
+      printf("draws %u submits %u shader switches %u texture binds %u\n",
+       mDrawStats.mDraws, mDrawStats.mSubmits,
+       mDrawStats.mShaderSwitches, mDrawStats.mTextureBinds);
+      mShownDraws = mDrawStats;
+   }
+}
+
+/// main program variant features for batches of material mat
+static uint Features(const Material &mat) {
+   return mat.mVariant == Material::cNormalMapped ? Shader::cNormalMapped : 0;
+}
+
+/// bytes per index of GL index type |type|
+static size_t IndexSize(GLenum type) {
+   return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(uint);
+}
+
+/// bind VAO and indices of one draw, and its position decode if packed
+void Renderer::BindDraw(uint draw) {
+   glBindVertexArray(mVAOs[draw]); GLChkErr;
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mElmBuffs[draw]); GLChkErr;
+   if (mOptions.packed)
+      mSdr->SetPosDecode(mPosScales[draw], mPosBiases[draw]);
+}
+
+/// key every draw the last cull left anything of, by its material and
+/// the view depth of its bounds' center under vp, and sort them.  If
+/// indirect, the variant is a per-command parameter rather than a shader
+/// switch, so it is left out of the key, and the sorted list is recorded
+/// as commands, one per visible run, and uploaded.
+void Renderer::BuildDrawList(const mat4 &vp) {
+   MaterialState state;
+   TextureArrayState arrayState;
+   DrawStats scratch;
+
+   mDrawList.Clear();
+   for (uint i = 0; i < mDrawMaterials.size(); i++) {
+      const vector<DrawRange> &runs = mDrawGroups[i] < 0
+       ? mScene.GetVisibleBatch(mDrawBatches[i])
+       : mScene.GetVisibleGroup(mDrawGroups[i], mDrawLods[i]);
+      const Material &mat = mMaterials.Get(mDrawMaterials[i]);
+
+      if (!runs.empty())
+         mDrawList.Add(DrawList::MakeKey(mOptions.indirect ? 0
+          : mat.mVariant, mDrawMaterials[i],
+          (vp * vec4(mDrawBounds[i].Center(), 1.0f)).w, i));
+   }
+   mDrawList.Sort();
+
+   if (!mOptions.indirect)
+      return;
+
+   // a new command run wherever a texture, or array, must be rebound
+   mCommands.clear();
+   mDrawParams.clear();
+   mCommandRuns.clear();
+   for (uint64_t key : mDrawList.GetKeys()) {
+      uint i = DrawList::GetDraw(key);
+      const vector<DrawRange> &runs = mDrawGroups[i] < 0
+       ? mScene.GetVisibleBatch(mDrawBatches[i])
+       : mScene.GetVisibleGroup(mDrawGroups[i], mDrawLods[i]);
+      const Material &mat = mMaterials.Get(mDrawMaterials[i]);
+
+      if ((mOptions.textureArrays ? arrayState.Apply(mTexArrays, mat,
+       &scratch) : state.Apply(mat, &scratch))
+       & (MaterialState::cTexture | MaterialState::cNormal))
+         mCommandRuns.push_back(CommandRun(mDrawMaterials[i],
+          (uint)mCommands.size()));
+      for (auto &run : runs)
+         AddCommand(i, run);
+      mCommandRuns.back().mCount = (uint)mCommands.size()
+       - mCommandRuns.back().mFirst;
+   }
+   UploadCommands();
+}
+
+/// record one indirect command drawing run of draw: a range of indices
+/// of a baked batch, or a range of instances of a group's mesh, each
+/// instance once per pass view, with the draw's position decode, texture
+/// layers (0 for a bound texture, -1 for no normal map), diffuse
+/// coordinate transform and material as its parameters
+void Renderer::AddCommand(uint draw, const DrawRange &run) {
+   const Material &mat = mMaterials.Get(mDrawMaterials[draw]);
+   float layer = 0.0f, normLayer = mat.mTexNormal ? 0.0f : -1.0f;
+   vec3 uvXfm(0.0f, 0.0f, 1.0f);
+   DrawCommand cmd;
+
+   cmd.mBaseVertex = (GLint)mBaseVerts[draw];
+   if (mDrawGroups[draw] < 0) {
+      cmd.mCount = run.mCount;
+      cmd.mInstances = mPassViews;
+      cmd.mFirstIndex = mFirstIndices[draw] + run.mFirst;
+      cmd.mBaseInstance = 0;
+   }
+   else {
+      cmd.mCount = mIndSizes[draw];
+      cmd.mInstances = run.mCount * mPassViews;
+      cmd.mFirstIndex = mFirstIndices[draw];
+      cmd.mBaseInstance = mGroupBases[mDrawGroups[draw]] + run.mFirst;
+   }
+   mCommands.push_back(cmd);
+
+   if (mOptions.textureArrays) {
+      const TextureArrays::Slot &slot = mTexArrays.Get(mat.mTex.get());
+
+      layer = (float)slot.mLayer;
+      uvXfm = slot.mUVXfm;
+      if (mat.mTexNormal)
+         normLayer = (float)mTexArrays.Get(mat.mTexNormal.get()).mLayer;
+   }
+   mDrawParams.push_back(vec4(mPosScales[draw], normLayer));
+   mDrawParams.push_back(vec4(mPosBiases[draw], layer));
+   mDrawParams.push_back(vec4(uvXfm, (float)mDrawMaterials[draw]));
+}
+
+/// upload the recorded commands and their parameters, replacing the last
+/// pass's
+void Renderer::UploadCommands() {
+   glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCmdBuffer); GLChkErr;
+   glBufferData(GL_DRAW_INDIRECT_BUFFER, mCommands.size()
+      * sizeof(DrawCommand), mCommands.data(), GL_STREAM_DRAW); GLChkErr;
+   glBindBuffer(GL_TEXTURE_BUFFER, mParamBuffer); GLChkErr;
+   glBufferData(GL_TEXTURE_BUFFER, mDrawParams.size() * sizeof(vec4),
+      mDrawParams.data(), GL_STREAM_DRAW); GLChkErr;
+}
+
+/// submit the uploaded commands: one multi-draw per command run, binding
+/// the run's textures, or arrays, if they differ from the last run's
+void Renderer::DrawIndirect() {
+   MaterialState state;
+   TextureArrayState arrayState;
+   DrawStats scratch;
+
+   // one variant serves all, each command choosing its own normal map
+   mSdr->UseVariant(Shader::cNormalMapped);
+   glBindVertexArray(mMergedVAO); GLChkErr;
+   glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCmdBuffer); GLChkErr;
+   for (auto &run : mCommandRuns) {
+      const Material &mat = mMaterials.Get(run.mMaterial);
+
+      if (mOptions.textureArrays) {
+         uint changes = arrayState.Apply(mTexArrays, mat, &scratch);
+
+         if (changes & MaterialState::cTexture)
+            mTexArrays.Use(mTexArrays.Get(mat.mTex.get()).mArray, false);
+         if (changes & MaterialState::cNormal)
+            mTexArrays.Use(mTexArrays.Get(mat.mTexNormal.get()).mArray,
+             true);
       }
+      else {
+         uint changes = state.Apply(mat, &scratch);
+
+         if (changes & MaterialState::cTexture)
+            mat.mTex->UseTexture();
+         if (changes & MaterialState::cNormal)
+            mat.mTexNormal->UseTexture();
+      }
+
+      mSdr->SetDrawBase(run.mFirst);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+         (void*)(run.mFirst * sizeof(DrawCommand)), run.mCount, 0);
+      GLChkErr;
+      mDrawStats.mSubmits++;
    }
-   else
+   mDrawStats.mDraws += (uint)mDrawList.GetKeys().size();
+   mDrawStats.mTextureBinds += scratch.mTextureBinds;
+}
+
+/// draw the sorted draw list: each baked batch as one multi-draw of its
+/// visible index ranges, each instanced mesh as one instanced draw per
+/// run of visible instances.  Textures and the shader variant are set
+/// only when they differ from the previous draw's.  For single-pass
+/// stereo every instance is drawn once per eye, so baked ranges, having
+/// no instanced multi-draw short of indirect, are drawn one at a time.
+void Renderer::DrawVisible() {
+   MaterialState state;
+
+   if (mOptions.indirect) {
+      DrawIndirect();
+      return;
+   }
+
+   for (uint64_t key : mDrawList.GetKeys()) {
+      uint i = DrawList::GetDraw(key);
+      const Material &mat = mMaterials.Get(mDrawMaterials[i]);
+      const vector<DrawRange> &runs = mDrawGroups[i] < 0
+       ? mScene.GetVisibleBatch(mDrawBatches[i])
+       : mScene.GetVisibleGroup(mDrawGroups[i], mDrawLods[i]);
+      uint changes = state.Apply(mat, &mDrawStats);
+
+      // set texture and normal map, if exists
+      if (changes & MaterialState::cTexture)
+         mat.mTex->UseTexture();
+      if (changes & MaterialState::cNormal)
+         mat.mTexNormal->UseTexture();
+      if (changes & MaterialState::cShader)
+         mSdr->UseVariant(Features(mat));
+
+      BindDraw(i);
+      mDrawStats.mDraws++;
+
+      if (mDrawGroups[i] < 0 && mPassViews > 1)
+         for (auto &run : runs) {
+            glDrawElementsInstanced(GL_TRIANGLES, run.mCount, mIdxTypes[i],
+             (const void *)(run.mFirst * IndexSize(mIdxTypes[i])),
+             mPassViews); GLChkErr;
+            mDrawStats.mSubmits++;
+         }
+      else if (mDrawGroups[i] < 0) {
+         mRunCounts.clear();
+         mRunOffsets.clear();
+         for (auto &run : runs) {
+            mRunCounts.push_back(run.mCount);
+            mRunOffsets.push_back((const void *)(run.mFirst
+             * IndexSize(mIdxTypes[i])));
+         }
+         glMultiDrawElements(GL_TRIANGLES, mRunCounts.data(), mIdxTypes[i],
+          mRunOffsets.data(), (GLsizei)runs.size()); GLChkErr;
+         mDrawStats.mSubmits++;
+      }
+      else
+         for (auto &run : runs) {
+            BindInstances(mGroupVBOs[mDrawGroups[i]], run.mFirst);
+            glDrawElementsInstanced(GL_TRIANGLES, mIndSizes[i],
+             mIdxTypes[i], (void*)0, run.mCount * mPassViews); GLChkErr;
+            mDrawStats.mSubmits++;
+         }
+   }
+}
+
+/// render every caster into the bound, cleared cascade layer, if
+/// indirect as one multi-draw of every instance of every finest-level draw
+void Renderer::RenderShadowMap() {
+   if (mDrawMaterials.size() != mVAOs.size()
+    || mDrawMaterials.size() != mElmBuffs.size())
       throw WorldException("Texture/VAO mismatch");
+
+   // shadows use the finest level of LOD models throughout
+   if (mOptions.indirect) {
+      mCommands.clear();
+      mDrawParams.clear();
+      for (uint i = 0; i < mDrawMaterials.size(); i++)
+         if (mDrawLods[i] == 0)
+            AddCommand(i, DrawRange(0, mDrawGroups[i] < 0 ? mIndSizes[i]
+             : mInstCounts[i]));
+      UploadCommands();
+
+      glBindVertexArray(mMergedVAO); GLChkErr;
+      mSdr->SetDrawBase(0);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0,
+         (GLsizei)mCommands.size(), 0); GLChkErr;
+   }
+   else
+      for (int i = 0; i < mDrawMaterials.size(); i++) {
+         if (mDrawLods[i] > 0)
+            continue;
+
+         BindDraw(i);
+         if (mDrawGroups[i] >= 0)
+            BindInstances(mGroupVBOs[mDrawGroups[i]], 0);
+         glDrawElementsInstanced(GL_TRIANGLES, mIndSizes[i], mIdxTypes[i],
+          (void*)0, mInstCounts[i]);
+      }
 }
 
 /// collect input from whatever is being used
@@ -63,128 +340,376 @@ int Renderer::HandleInput(shared_ptr<HMDInput> input, SDL_Event *event) {
    return input->FieldEvent(*event);
 }
 
-/// create usable buffers from models
-void Renderer::CreateBuffers() {
+/// point the bound VAO's attributes 0-4 at a VBO of full Vertex
+static void BindFullVertices() {
+   glVertexAttribPointer
+   (0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0); GLChkErr;
 
-   mat4 temp = translate(mat4(1.0f), vec3(1, 1, 1));
-   VMap vertMap = mMdl->GetVertices(mat4(1.0f), temp);
-   TMap trngMap = mMdl->GetTriangles();
-   NMap normMap = mMdl->GetNormal();
-   vector<vector<Vertex>> vertices;
-   vector<vector<uint>> indices;
-   int texIdx = 0;
-
-   // build Vertex and Indice vectors from Vmap and TMap
-   for (VMap::iterator it = vertMap.begin(); it != vertMap.end(); it++) {
-      mTexs.push_back(it->first);
-      mTexsNormal.push_back(normMap[it->first]);
-      vector<Vertex> verts;
-      vector<uint> inds;
-      list<vector<Vertex>> v = vertMap.at(it->first);
-      list<TriangleSet> t = trngMap.at(it->first);
-
-      if (vertMap.at(it->first).size() == trngMap.at(it->first).size()) {
-         while (v.size()) {
-            inds.insert(inds.end(),
-               t.front().mIndices.begin(), t.front().mIndices.end());
-            verts.insert(verts.end(), v.front().begin(), v.front().end());
-            v.pop_front();
-            t.pop_front();
-         }
-         vertices.push_back(verts);
-         indices.push_back(inds);
-         mIndSizes.push_back(inds.size());
-      }
-      else
-         throw WorldException("Triangle Mesh and Vertex count are different!");
+   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      (void*)(4 * sizeof(float))); GLChkErr;
+
+   glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      (void*)(7 * sizeof(float))); GLChkErr;
+
+   glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      (void*)(9 * sizeof(float))); GLChkErr;
+
+   glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      (void*)(12 * sizeof(float))); GLChkErr;
+
+   // use the attributes for each array
+   glEnableVertexAttribArray(0); GLChkErr;
+   glEnableVertexAttribArray(1); GLChkErr;
+   glEnableVertexAttribArray(2); GLChkErr;
+   glEnableVertexAttribArray(3); GLChkErr;
+   glEnableVertexAttribArray(4); GLChkErr;
+}
+
+/// point the bound VAO's attributes at a VBO of PackedVertex: position and
+/// bitangent sign in 0, both octahedral directions in 1, and half-float
+/// texture coordinates in 2.  The shader rebuilds what 3 and 4 held.
+static void BindPackedVertices() {
+   glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+      (void*)offsetof(PackedVertex, posXY)); GLChkErr;
+
+   glVertexAttribPointer(1, 4, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+      (void*)offsetof(PackedVertex, normal)); GLChkErr;
+
+   glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+      (void*)offsetof(PackedVertex, texLoc)); GLChkErr;
+
+   glEnableVertexAttribArray(0); GLChkErr;
+   glEnableVertexAttribArray(1); GLChkErr;
+   glEnableVertexAttribArray(2); GLChkErr;
+}
+
+/// upload one batch into its own VAO, drawing numInst instances whose
+/// transforms come from instVBO
+void Renderer::UploadBatch(Batch &batch, GLuint instVBO, uint numInst) {
+   GLuint vao, vbo, elmBuff;
+   vector<PackedVertex> packed;
+   vector<GLushort> shortInds;
+   vec3 scale(1.0f), bias(0.0f);
+   bool useShorts = mOptions.packed && batch.mNumVerts < 65536;
+
+   glGenVertexArrays(1, &vao); GLChkErr;
+   glGenBuffers(1, &vbo); GLChkErr;
+   glGenBuffers(1, &elmBuff); GLChkErr;
+
+   mDrawMaterials.push_back(mMaterials.Register(batch.mTex,
+    batch.mTexNormal));
+   mIndSizes.push_back(batch.mNumIndices);
+   mInstCounts.push_back(numInst);
+   mVAOs.push_back(vao);
+   mVBOs.push_back(vbo);
+   mElmBuffs.push_back(elmBuff);
+   mIdxTypes.push_back(useShorts ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+
+   // Bind the VAO
+   glBindVertexArray(vao); GLChkErr;
+
+   glBindBuffer(GL_ARRAY_BUFFER, vbo); GLChkErr;
+   if (mOptions.packed) {
+      packed.resize(batch.mNumVerts);
+      PackedVertex::PackAll(batch.mVerts, batch.mNumVerts, packed.data(),
+       &scale, &bias);
+      glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex),
+         packed.data(), GL_STATIC_DRAW); GLChkErr;
+      BindPackedVertices();
+   }
+   else {
+      glBufferData(GL_ARRAY_BUFFER, batch.mNumVerts * sizeof(Vertex),
+         batch.mVerts, GL_STATIC_DRAW); GLChkErr;
+      BindFullVertices();
    }
+   mPosScales.push_back(scale);
+   mPosBiases.push_back(bias);
 
-   //tangent/bitanget calculation
-   for (int i = 0; i < mTexs.size(); i++) {
-      for (int x = 0; x < indices[i].size(); x++) {
-         Vertex v1 = vertices[i][indices[i][x]];
-         Vertex v2 = vertices[i][indices[i][x+1]];
-         Vertex v3 = vertices[i][indices[i][x+2]];
+   BindInstances(instVBO, 0);
 
-         vec3 DP1 = vec3(v2.loc - v1.loc);
-         vec3 DP2 = vec3(v3.loc - v1.loc);
-         vec2 DT1 = v2.texLoc - v1.texLoc;
-         vec2 DT2 = v3.texLoc - v1.texLoc;
+   // create indice array
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elmBuff); GLChkErr;
+   if (useShorts) {
+      shortInds.assign(batch.mIndices, batch.mIndices + batch.mNumIndices);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+         shortInds.size() * sizeof(GLushort), shortInds.data(),
+         GL_STATIC_DRAW); GLChkErr;
+   }
+   else {
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, batch.mNumIndices * sizeof(uint),
+         batch.mIndices, GL_STATIC_DRAW); GLChkErr;
+   }
 
-         float r = 1.0f / (DT1.x * DT2.y - DT1.y * DT2.x);
-         vec3 tangent = (DP1 * DT2.y - DP2 * DT1.y)*r;
-         vec3 biTangent = (DT1.x * DP2 - DP1 * DT2.x)*r;
+   glBindVertexArray(0); GLChkErr;
+}
+
+/// append one batch to the merged vertex and index staging, as a draw of
+/// numInst instances sharing the merged VAO.  Indices stay 32-bit, as
+/// they are offset by firstIndex into one buffer.
+void Renderer::AppendBatch(Batch &batch, uint numInst) {
+   vector<PackedVertex> packed;
+   vec3 scale(1.0f), bias(0.0f);
+   const uchar *src = (const uchar *)batch.mVerts;
+   size_t stride = sizeof(Vertex);
+
+   mDrawMaterials.push_back(mMaterials.Register(batch.mTex,
+    batch.mTexNormal));
+   mIndSizes.push_back(batch.mNumIndices);
+   mInstCounts.push_back(numInst);
+   mVAOs.push_back(mMergedVAO);
+   mVBOs.push_back(mMergedVBO);
+   mElmBuffs.push_back(mMergedIBO);
+   mIdxTypes.push_back(GL_UNSIGNED_INT);
+
+   if (mOptions.packed) {
+      packed.resize(batch.mNumVerts);
+      PackedVertex::PackAll(batch.mVerts, batch.mNumVerts, packed.data(),
+       &scale, &bias);
+      src = (const uchar *)packed.data();
+      stride = sizeof(PackedVertex);
+   }
+   mPosScales.push_back(scale);
+   mPosBiases.push_back(bias);
+
+   mBaseVerts.push_back((uint)(mMergedVerts.size() / stride));
+   mMergedVerts.insert(mMergedVerts.end(), src,
+    src + batch.mNumVerts * stride);
+   mFirstIndices.push_back((uint)mMergedIdxs.size());
+   mMergedIdxs.insert(mMergedIdxs.end(), batch.mIndices,
+    batch.mIndices + batch.mNumIndices);
+}
+
+/// point the bound VAO's per-instance xform, texXfm and normXfm attributes,
+/// one vec4 column each, at instVBO starting from instance |first|,
+/// advancing once per mPassViews instances drawn
+void Renderer::BindInstances(GLuint instVBO, uint first) {
+   glBindBuffer(GL_ARRAY_BUFFER, instVBO); GLChkErr;
+   for (uint col = 0; col < cInstCols; col++) {
+      glVertexAttribPointer(cInstAttrib + col, 4, GL_FLOAT, GL_FALSE,
+         sizeof(Instance), (void*)(first * sizeof(Instance)
+         + col * sizeof(vec4))); GLChkErr;
+      glEnableVertexAttribArray(cInstAttrib + col); GLChkErr;
+      glVertexAttribDivisor(cInstAttrib + col, mPassViews); GLChkErr;
+   }
+}
 
-         vertices[i][indices[i][x]].tangent = tangent;
-         vertices[i][indices[i][x+1]].tangent = tangent;
-         vertices[i][indices[i][x+2]].tangent = tangent;
+/// draw each instance views times, by setting every VAO's instance
+/// divisor to views.  Nothing is rebound unless views changes, as it
+/// does only between displays of differing passes.
+void Renderer::SetPassViews(uint views) {
+   GLuint last = 0;
 
-         vertices[i][indices[i][x++]].biTangent = biTangent;
-         vertices[i][indices[i][x++]].biTangent = biTangent;
-         vertices[i][indices[i][x]].biTangent = biTangent;
+   if (views == mPassViews)
+      return;
 
+   mPassViews = views;
+   for (GLuint vao : mVAOs) {
+      if (vao == last)
+         continue;
+
+      last = vao;
+      glBindVertexArray(vao); GLChkErr;
+      for (uint col = 0; col < cInstCols; col++) {
+         glVertexAttribDivisor(cInstAttrib + col, views); GLChkErr;
       }
    }
+   glBindVertexArray(0); GLChkErr;
+}
 
-   mVAOs = vector<GLuint>(indices.size());
-   mElmBuffs = vector<GLuint>(indices.size());
-   mVBOs = vector<GLuint>(indices.size());
+/// upload a per-instance transform buffer, returning its id
+GLuint Renderer::UploadInstances(const vector<Instance> &insts) {
+   GLuint instVBO;
 
-   glGenVertexArrays(indices.size(), &mVAOs[0]); GLChkErr;
-   glGenBuffers(indices.size(), &mElmBuffs[0]); GLChkErr;
-   glGenBuffers(mVBOs.size(), &mVBOs[0]); GLChkErr;
+   glGenBuffers(1, &instVBO); GLChkErr;
+   glBindBuffer(GL_ARRAY_BUFFER, instVBO); GLChkErr;
+   glBufferData(GL_ARRAY_BUFFER, insts.size() * sizeof(Instance),
+      insts.data(), mOptions.dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+   GLChkErr;
+   mInstVBOs.push_back(instVBO);
 
-   texIdx = 0; // Current texture, as we progress through the Vertex vectors
-   for (vector<Vertex> vec : vertices) {
+   return instVBO;
+}
 
-      // Bind the VAO
-      glBindVertexArray(mVAOs[texIdx]); GLChkErr;
+/// add a group's instances: in indirect mode to the merged staging, with
+/// *base their first slot there, else as their own buffer from slot 0.
+/// Returns the buffer they will be drawn from.
+GLuint Renderer::AddInstances(const vector<Instance> &insts, uint *base) {
+   if (!mOptions.indirect) {
+      *base = 0;
+      return UploadInstances(insts);
+   }
 
-      glBindBuffer(GL_ARRAY_BUFFER, mVBOs[(texIdx)]); GLChkErr;
-      glBufferData(GL_ARRAY_BUFFER, vec.size() * sizeof(Vertex),
-         vec.data(), GL_STATIC_DRAW); GLChkErr;
+   *base = (uint)mMergedInsts.size();
+   mMergedInsts.insert(mMergedInsts.end(), insts.begin(), insts.end());
+   return mMergedInstVBO;
+}
 
-      glVertexAttribPointer
-      (0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0); GLChkErr;
+/// upload the merged staging, point the merged VAO at it, and attach the
+/// parameter buffer to texture unit 3
+void Renderer::FinishMerged() {
+   glBindVertexArray(mMergedVAO); GLChkErr;
 
-      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-         (void*)(4 * sizeof(float))); GLChkErr;
+   glBindBuffer(GL_ARRAY_BUFFER, mMergedVBO); GLChkErr;
+   glBufferData(GL_ARRAY_BUFFER, mMergedVerts.size(), mMergedVerts.data(),
+      GL_STATIC_DRAW); GLChkErr;
+   if (mOptions.packed)
+      BindPackedVertices();
+   else
+      BindFullVertices();
+
+   glBindBuffer(GL_ARRAY_BUFFER, mMergedInstVBO); GLChkErr;
+   glBufferData(GL_ARRAY_BUFFER, mMergedInsts.size() * sizeof(Instance),
+      mMergedInsts.data(), mOptions.dynamic ? GL_DYNAMIC_DRAW
+      : GL_STATIC_DRAW); GLChkErr;
+   BindInstances(mMergedInstVBO, 0);
+
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMergedIBO); GLChkErr;
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, mMergedIdxs.size() * sizeof(uint),
+      mMergedIdxs.data(), GL_STATIC_DRAW); GLChkErr;
+
+   glBindVertexArray(0); GLChkErr;
+
+   glBindBuffer(GL_TEXTURE_BUFFER, mParamBuffer); GLChkErr;
+   glBufferData(GL_TEXTURE_BUFFER, cParamTexels * sizeof(vec4), NULL,
+      GL_STREAM_DRAW);
+   GLChkErr;
+   glActiveTexture(GL_TEXTURE3); GLChkErr;
+   glBindTexture(GL_TEXTURE_BUFFER, mParamTex); GLChkErr;
+   glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mParamBuffer); GLChkErr;
+   glActiveTexture(GL_TEXTURE0); GLChkErr;
+
+   vector<uchar>().swap(mMergedVerts);
+   vector<uint>().swap(mMergedIdxs);
+   vector<Instance>().swap(mMergedInsts);
+}
 
-      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-         (void*)(7 * sizeof(float))); GLChkErr;
+/// upload just the instances moved since the last frame, and
+/// dirty the shadow cascades it left or entered
+void Renderer::UpdateInstances() {
+   auto &groups = mScene.GetGroups();
+
+   for (auto &slot : mScene.Refresh()) {
+      uint node = mSlotNodes[slot.first][slot.second];
+
+      glBindBuffer(GL_ARRAY_BUFFER, mGroupVBOs[slot.first]); GLChkErr;
+      glBufferSubData(GL_ARRAY_BUFFER,
+         (mGroupBases[slot.first] + slot.second) * sizeof(Instance),
+         sizeof(Instance), &groups[slot.first].mInstances[slot.second]);
+      GLChkErr;
+
+      // its shadow leaves the cascades it was in and enters those it's in
+      mShadows.Invalidate(mCasterBounds[node]);
+      mCasterBounds[node] = mScene.GetNodes()[node].mBounds;
+      mShadows.Invalidate(mCasterBounds[node]);
+      mSceneBounds.Grow(mCasterBounds[node]);
+   }
+}
 
-      glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-         (void*)(9 * sizeof(float))); GLChkErr;
+/// create usable buffers from models, or from a baked scene if there is
+/// no model, with each draw's material and world bounds.  If indirect,
+/// every draw shares the merged buffers instead.
+void Renderer::CreateBuffers() {
+   GLuint identity, instVBO;
+   vector<Aabb> groupBounds;
+   uint base;
+
+   if (mOptions.textureArrays && !mOptions.indirect)
+      throw WorldException("-T arrays requires -U indirect");
+   if (mOptions.indirect) {
+      if (!GLEW_ARB_multi_draw_indirect || !GLEW_ARB_base_instance
+       || !GLEW_ARB_shader_draw_parameters)
+         throw WorldException("-U indirect requires multi-draw-indirect, "
+          "base instance and shader draw parameters");
+      glGenVertexArrays(1, &mMergedVAO); GLChkErr;
+      glGenBuffers(1, &mMergedVBO); GLChkErr;
+      glGenBuffers(1, &mMergedIBO); GLChkErr;
+      glGenBuffers(1, &mMergedInstVBO); GLChkErr;
+      glGenBuffers(1, &mCmdBuffer); GLChkErr;
+      glGenBuffers(1, &mParamBuffer); GLChkErr;
+      glGenTextures(1, &mParamTex); GLChkErr;
+   }
 
-      glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-         (void*)(12 * sizeof(float))); GLChkErr;
+   if (mMdl)
+      SceneCache::Build(*mMdl, mOptions, &mScene);
+   else if (!SceneCache::Load(mOptions.cacheKey, &mScene))
+      throw WorldException(StringPrintf("No valid baked scene %s",
+       SceneCache::FileName(mOptions.cacheKey).c_str()));
 
-      // use the attributes for each array
-      glEnableVertexAttribArray(0); GLChkErr;
-      glEnableVertexAttribArray(1); GLChkErr;
-      glEnableVertexAttribArray(2); GLChkErr;
-      glEnableVertexAttribArray(3); GLChkErr;
-      glEnableVertexAttribArray(4); GLChkErr;
+   // baked batches are drawn as a single identity instance
+   identity = AddInstances({Instance(mat4(1.0f), mat4(1.0f))}, &base);
+   for (uint b = 0; b < mScene.GetBatches().size(); b++) {
+      Batch &batch = mScene.GetBatches()[b];
+      Aabb bounds;
 
-      glBindVertexArray(mVAOs[texIdx++]); GLChkErr;
+      if (mOptions.indirect)
+         AppendBatch(batch, 1);
+      else
+         UploadBatch(batch, identity, 1);
+      mDrawBatches.push_back(b);
+      mDrawGroups.push_back(-1);
+      mDrawLods.push_back(0);
+      for (uint v = 0; v < batch.mNumVerts; v++)
+         bounds.Grow(vec3(batch.mVerts[v].loc) / batch.mVerts[v].loc.w);
+      mDrawBounds.push_back(bounds);
    }
 
-   texIdx = 0;
-   for (vector<uint> inds : indices) {
+   // an instanced draw spans every instance of its group
+   groupBounds.resize(mScene.GetGroups().size());
+   mSlotNodes.resize(mScene.GetGroups().size());
+   for (uint n = 0; n < mScene.GetNodes().size(); n++) {
+      const SceneNode &node = mScene.GetNodes()[n];
+
+      mCasterBounds.push_back(node.mBounds);
+      if (node.mGroup >= 0) {
+         groupBounds[node.mGroup].Grow(node.mBounds);
+         if (mSlotNodes[node.mGroup].size() <= (uint)node.mSlot)
+            mSlotNodes[node.mGroup].resize(node.mSlot + 1);
+         mSlotNodes[node.mGroup][node.mSlot] = n;
+      }
+   }
 
-      // create indice array
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mElmBuffs[texIdx]); GLChkErr;
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-         inds.size() * sizeof(uint), inds.data(), GL_STATIC_DRAW); GLChkErr;
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mElmBuffs[texIdx]); GLChkErr;
+   for (uint g = 0; g < mScene.GetGroups().size(); g++) {
+      InstanceGroup &group = mScene.GetGroups()[g];
+
+      instVBO = base = 0;
+      if (group.mMesh) {
+         // every LOD level draws from the one instance buffer
+         instVBO = AddInstances(group.mInstances, &base);
+         for (uint l = 0; l <= group.mLods.size(); l++) {
+            SceneCompiler &mesh = l ? *group.mLods[l - 1] : *group.mMesh;
+
+            for (uint b = 0; b < mesh.GetBatches().size(); b++) {
+               if (mOptions.indirect)
+                  AppendBatch(mesh.GetBatches()[b],
+                   (uint)group.mInstances.size());
+               else
+                  UploadBatch(mesh.GetBatches()[b], instVBO,
+                   (uint)group.mInstances.size());
+               mDrawBatches.push_back(b);
+               mDrawGroups.push_back(g);
+               mDrawLods.push_back(l);
+               mDrawBounds.push_back(groupBounds[g]);
+            }
+         }
+      }
+      mGroupVBOs.push_back(instVBO);
+      mGroupBases.push_back(base);
+   }
 
-      glBindVertexArray(mVAOs[texIdx++]); GLChkErr;
+   if (mOptions.indirect)
+      FinishMerged();
+   if (mOptions.textureArrays) {
+      mTexArrays.Plan(mMaterials);
+      mTexArrays.Upload();
+      if (mOptions.stats)
+         printf("%u materials in %u texture arrays\n", mMaterials.Size(),
+          mTexArrays.Size());
    }
 }
 
 /// create single instance of shader
 void Renderer::CreateShader() {
-   mSdr = shared_ptr<Shader>(new Shader());
+   mSdr = shared_ptr<Shader>(new Shader(mOptions.shadowTaps));
 
    // create multiple light sources (up to five)
    vec4 pos(0, 1, 0, 1);
@@ -192,60 +717,120 @@ void Renderer::CreateShader() {
    LightSource light(pos, clr);
 
    mLightSources.push_back(light);
+   mSdr->SetFeature(Shader::cPacked, mOptions.packed);
+   mSdr->SetFeature(Shader::cIndirect, mOptions.indirect);
+   mSdr->SetFeature(Shader::cTexArrays, mOptions.textureArrays);
+}
+
+/// create the cascade array, and a shadow graph pass per cascade
+/// rendering its layer through the cascade's matrix
+void Renderer::CreateShadows() {
+   TargetDesc desc(ShadowMaps::cSize, ShadowMaps::cSize,
+    GL_DEPTH_COMPONENT24);
+
+   for (auto &bounds : mDrawBounds)
+      mSceneBounds.Grow(bounds);
+   mShadows.Setup(mLightSources, mSceneBounds);
+   mShadows.Create();
+   mSdr->SetShadowMap();
+
+   for (uint layer = 0; layer < mShadows.GetLayers(); layer++) {
+      FrameGraph::Target map = mShadowGraph.Import(
+       StringPrintf("cascade %u", layer), desc, mShadows.GetTexture(),
+       (int)layer);
+      FrameGraph::Pass pass = mShadowGraph.AddPass(
+       StringPrintf("shadow %u", layer), [this, layer]() {
+         mSdr->SetShadowView(mShadows.GetCascade(layer).mVP);
+         RenderShadowMap();
+         mShadows.MarkRendered(layer);
+      });
+
+      mShadowGraph.Write(pass, map, true);
+   }
+   mShadowGraph.Compile();
+   mShadowGraph.Realize();
+}
+
+/// scatter mOptions.pointLights lights of random hue through the scene
+/// bounds, each reaching a little past its share of their volume, taking
+/// every side as at least 1 so flat scenes still get some reach, and
+/// have every variant shade with them
+void Renderer::CreateClusters() {
+   vec3 size = mSceneBounds.Empty() ? vec3(2.0f)
+    : 2.0f * mSceneBounds.Extent();
+   vec3 low = mSceneBounds.Empty() ? vec3(-1.0f) : mSceneBounds.mMin;
+   vec3 reach = glm::max(size, vec3(1.0f));
+   float radius = 1.5f * cbrt(reach.x * reach.y * reach.z
+    / mOptions.pointLights);
+   uint seed = 1;
+   auto rnd = [&seed]() {
+      seed = seed * 1664525u + 1013904223u;
+      return (seed >> 8) / 16777216.0f;
+   };
+
+   for (uint l = 0; l < mOptions.pointLights; l++) {
+      vec3 pos = low + size * vec3(rnd(), rnd(), rnd());
+      vec3 clr = 0.5f * vec3(rnd(), rnd(), rnd());
+
+      mPointLights.push_back(PointLight(pos, radius, clr));
+   }
+   mClusters.Create();
+   mSdr->SetFeature(Shader::cClustered, true);
+}
+
+/// build the main program variants the draws' materials need, for the
+/// configured lights, and the shadow program, all together before the
+/// first frame rather than as each is first drawn.  Indirect draws all
+/// use the one normal-mapping variant.
+void Renderer::CreateVariants() {
+   vector<uint> features;
+
+   mShadows.GetMatrices(&mLightVPs);
+   mSdr->Configure(mLightSources, mLightVPs, mShadows.GetSplits());
+   if (mOptions.indirect)
+      features.push_back(Shader::cNormalMapped);
+   else
+      for (uint mat : mDrawMaterials)
+         features.push_back(Features(mMaterials.Get(mat)));
+   mSdr->Precompile(features);
+}
+
+/// refit the cascades to this display's first eye, and render those whose
+/// maps are out of date, one instance per object, keeping the display's
+/// viewport.  Then hand the lights and cascades to the main program.
+void Renderer::UpdateShadows() {
+   uint views = mPassViews;
+   GLint viewport[4];
+   bool dirty = false;
+
+   mShadows.Setup(mLightSources, mSceneBounds);
+   mShadows.Fit(mViews.front().mVP);
+   for (uint layer = 0; layer < mShadows.GetLayers(); layer++) {
+      mShadowGraph.Skip(layer, !mShadows.GetCascade(layer).mDirty);
+      dirty = dirty || mShadows.GetCascade(layer).mDirty;
+   }
+
+   if (dirty) {
+      glGetIntegerv(GL_VIEWPORT, viewport); GLChkErr;
+      SetPassViews(1);
+      mShadowGraph.Execute();
+      mShadowGraph.Report();
+      SetPassViews(views);
+      glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+      GLChkErr;
+   }
+
+   mShadows.GetMatrices(&mLightVPs);
+   mSdr->Configure(mLightSources, mLightVPs, mShadows.GetSplits());
 }
 
-/// render single pass shadow map
-void Renderer::CreateShadowMap() {
-
-   glGenFramebuffers(1, &mShadowMap);
-
-   uint shdSize = 1024;
-   GLuint depthMap;
-
-   // set parameters for output texture
-   glGenTextures(1, &depthMap);
-   glBindTexture(GL_TEXTURE_2D, depthMap);
-   glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-      shdSize, shdSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-   // create frame buffer 
-   glBindFramebuffer(GL_FRAMEBUFFER, mShadowMap);
-   glFramebufferTexture2D(
-    GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-   glDrawBuffer(GL_NONE);
-   glReadBuffer(GL_NONE);
-   glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-   // bind and set viewport
-   glViewport(0, 0, shdSize, shdSize);
-   glBindFramebuffer(GL_FRAMEBUFFER, mShadowMap);
-   glClear(GL_DEPTH_BUFFER_BIT);
-
-   // create camera transformation matrix
-   float near_plane = 1.0f, far_plane = 10.0f;
-   mat4 lightProjection = ortho(
-    -10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-
-   mat4 lightView = glm::lookAt(
-    vec3(0 , 5, 2),
-    vec3(0.0f, 0.0f, 0.0f),
-    vec3(0.0f, 1.0f, 0.0f));
-
-   mLSM = lightProjection * lightView;
-   mSdr->SetShadowMap(mLSM);
-   mTexs[0]->UseTexture();
-
-   // create shadow map
-   RenderShadowMap();
-
-   glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-   // create texture from framebuffer rendering
-   mDepthTex = shared_ptr<Texture>(new TextureShadow(depthMap, "Shadows"));
+/// bin the point lights under this display's first eye, whose grid also
+/// serves a second eye, and upload them for the main program
+void Renderer::UpdateClusters() {
+   mClusters.Bin(mViews.front().mVP, mPointLights);
+   mClusters.Upload();
+   mSdr->SetClusters(mClusters.GetVP(), mClusters.GetDims(),
+    mClusters.GetDepths());
 }
 
 
@@ -255,11 +840,14 @@ Renderer Public Functions
 
 /// set up renderer (buffers, shadow map, shader)
 Renderer::Renderer(shared_ptr<Model> mdl, vector<shared_ptr<Display>> displays,
- vector<shared_ptr<HMDInput>>input) : mDisplays(displays), mInputs(input),
- mMdl(mdl) {
+ vector<shared_ptr<HMDInput>>input, const RenderOptions &opts)
+ : mDisplays(displays), mInputs(input), mMdl(mdl), mOptions(opts) {
    CreateShader();
    CreateBuffers();
-   CreateShadowMap();
+   CreateShadows();
+   if (mOptions.pointLights)
+      CreateClusters();
+   CreateVariants();
 }
 
 /// game loop, untied from input and FPS
@@ -268,14 +856,15 @@ void Renderer::Run() {
    SDL_PollEvent(event);
    bool breakESC = true;
 
-   mSdr->Configure(mLightSources, mLSM);
-   mDepthTex->UseTexture();
+   mShadows.Use();
 
    while (breakESC) {
       if (mDisplays.size() == mInputs.size()) {
          for (int i = 0; i < mDisplays.size(); i++) {
             while (SDL_PollEvent(event))
                breakESC = !mInputs[0]->FieldEvent(*event);
+            if (mOptions.dynamic)
+               UpdateInstances();
             RenderDisplay(mDisplays[i], mInputs[i]);
          }
       }
@@ -3,43 +3,151 @@
 #include <glm/mat4x4.hpp>
 
 #include "Display.h"
+#include "DrawList.h"
+#include "FrameGraph.h"
+#include "LightClusters.h"
+#include "Material.h"
 #include "Model.h"
+#include "RenderOptions.h"
 #include "Shader.h"
+#include "SceneCompiler.h"
+#include "ShadowMaps.h"
+#include "TextureArrays.h"
+
+// GL's DrawElementsIndirectCommand, one per run of an indirect pass
+struct DrawCommand {
+   GLuint mCount;
+   GLuint mInstances;
+   GLuint mFirstIndex;
+   GLint mBaseVertex;
+   GLuint mBaseInstance;
+};
+
+// Commands [mFirst, mFirst + mCount) of an indirect pass, all drawn with
+// the textures, or texture arrays, of material mMaterial by one
+// glMultiDrawElementsIndirect
+struct CommandRun {
+   uint mMaterial;
+   uint mFirst;
+   uint mCount;
+
+   CommandRun(uint m, uint f) : mMaterial(m), mFirst(f), mCount(0) {}
+};
 
 class Renderer {
 protected:
    // Member Data
    std::vector<std::shared_ptr<Display>> mDisplays;
    std::vector<std::shared_ptr<HMDInput>> mInputs;
-   std::vector<std::shared_ptr<Texture>> mTexs;
-   std::vector<std::shared_ptr<Texture>> mTexsNormal;
+   MaterialRegistry mMaterials;
+   std::vector<uint> mDrawMaterials; // Per draw, its id in mMaterials
+   std::vector<Aabb> mDrawBounds;    // Per draw, world bounds of all of it
    std::vector<uint> mIndSizes;
-   std::vector<GLuint> mVAOs, mElmBuffs, mVBOs;
+   std::vector<uint> mInstCounts;
+   std::vector<GLuint> mVAOs, mElmBuffs, mVBOs, mInstVBOs;
+   std::vector<GLuint> mGroupVBOs;  // Instance VBO per InstanceGroup, or 0
+   std::vector<int> mDrawBatches;   // Per draw, its batch in its compiler
+   std::vector<int> mDrawGroups;    // Per draw, its InstanceGroup, or -1
+   std::vector<uint> mDrawLods;     // Per draw, its group's LOD level
+   std::vector<GLsizei> mRunCounts; // Scratch for glMultiDrawElements
+   std::vector<const void *> mRunOffsets;
+   std::vector<GLenum> mIdxTypes;   // Per draw, GL_UNSIGNED_SHORT or _INT
+   std::vector<glm::vec3> mPosScales, mPosBiases;  // Per draw, if packed
    std::vector<LightSource> mLightSources;
 
-   std::shared_ptr<Texture> mDepthTex;
-   glm::mat4 mLSM;
    std::shared_ptr<Model> mMdl;
    std::shared_ptr<Shader> mSdr;
    std::shared_ptr<Shader> mShadowShader;
    SDL_GLContext *mContext;
-   uint mShadowMap;
+   // Shadows: a pass of mShadowGraph per cascade, skipped while cached,
+   // and what casts them, each moving instance's node by group and slot
+   // and its bounds when its cascades were last dirtied
+   ShadowMaps mShadows;
+   FrameGraph mShadowGraph;
+   Aabb mSceneBounds;
+   std::vector<std::vector<uint>> mSlotNodes;
+   std::vector<Aabb> mCasterBounds;
+   std::vector<glm::mat4> mLightVPs;
+   // Point lights, if mOptions.pointLights, binned per display
+   std::vector<PointLight> mPointLights;
+   LightClusters mClusters;
+   SceneCompiler mScene;
+   RenderOptions mOptions;
+   CullStats mCullStats, mShownStats;  // Last cull, and last one printed
+   Uint32 mStatsTicks = 0;             // SDL_GetTicks of the last report
+   DrawList mDrawList;                 // This display's visible draws
+   DrawStats mDrawStats, mShownDraws;  // Last frame, and last one printed
+   std::vector<LodView> mViews;        // This display's eyes
+   uint mPassViews = 1;                // Eyes per draw, the divisor
+
+   // Indirect submission: every draw's vertices and indices in one VBO/IBO
+   // pair and every instance in one instance VBO, all behind one VAO.
+   // Each pass is recorded as DrawCommands in mCmdBuffer, with
+   // cParamTexels texels of per-command parameters (position decode,
+   // texture layers, diffuse coordinate transform and material id) in
+   // mParamTex, read by the shaders through their draw index.
+   GLuint mMergedVAO = 0, mMergedVBO = 0, mMergedIBO = 0, mMergedInstVBO = 0;
+   GLuint mCmdBuffer = 0, mParamBuffer = 0, mParamTex = 0;
+   std::vector<uchar> mMergedVerts;     // Staged until FinishMerged
+   std::vector<uint> mMergedIdxs;
+   std::vector<Instance> mMergedInsts;
+   std::vector<uint> mFirstIndices;     // Per draw, in mMergedIBO
+   std::vector<uint> mBaseVerts;        // Per draw, in mMergedVBO
+   std::vector<uint> mGroupBases;       // Per group, first slot in its VBO
+   std::vector<DrawCommand> mCommands;  // This display's pass
+   std::vector<glm::vec4> mDrawParams;
+   std::vector<CommandRun> mCommandRuns;
+   TextureArrays mTexArrays;            // If mOptions.textureArrays
+
+   // First of cInstCols vec4 attribute locations holding Instance per
+   // instance: xform, texXfm, then normXfm
+   static constexpr uint cInstAttrib = 5;
+   static constexpr uint cInstCols = sizeof(Instance) / sizeof(glm::vec4);
+
+   // vec4s of parameters per indirect command, as the shaders read them
+   static constexpr uint cParamTexels = 3;
 
    // Private Functions
    void RenderDisplay(std::shared_ptr<Display>, std::shared_ptr<HMDInput>);
+   void ReportStats();
+   void BuildDrawList(const glm::mat4 &vp);
+   void DrawVisible();
    void RenderShadowMap();
+   void BindDraw(uint draw);
    int HandleInput(std::shared_ptr<HMDInput>, SDL_Event*);
    void CreateBuffers();
+   void UploadBatch(Batch &, GLuint instVBO, uint numInst);
+   void AppendBatch(Batch &, uint numInst);
+   void BindInstances(GLuint instVBO, uint first);
+   void SetPassViews(uint views);
+   GLuint UploadInstances(const std::vector<Instance> &);
+   GLuint AddInstances(const std::vector<Instance> &, uint *base);
+   void FinishMerged();
+   void AddCommand(uint draw, const DrawRange &run);
+   void UploadCommands();
+   void DrawIndirect();
+   void UpdateInstances();
    void CreateShader();
-   void CreateShadowMap();
+   void CreateShadows();
+   void UpdateShadows();
+   void CreateClusters();
+   void UpdateClusters();
+   void CreateVariants();
 
 public:
    // Configure Renderer to use indicated model, displays, and HMDInput.
    // Initialize shader automatically since we have only one type.
    Renderer(std::shared_ptr<Model>, std::vector<std::shared_ptr<Display>>,
-    std::vector<std::shared_ptr<HMDInput>>);
+    std::vector<std::shared_ptr<HMDInput>>,
+    const RenderOptions &opts = RenderOptions());
 
    // Immediately draw current image.  Respond to perspective-change events
    // from HMDInput by adjusting mvp, reconfiguring the Shader, and redrawing.
    void Run();
+
+   // Counts from the last display's cull
+   const CullStats &GetCullStats() const {return mCullStats;}
+
+   // Draws, submits and state changes of the last display's draw
+   const DrawStats &GetDrawStats() const {return mDrawStats;}
 };
\ No newline at end of file
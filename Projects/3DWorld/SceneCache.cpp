@@ -0,0 +1,424 @@
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sys/stat.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "MappedFile.h"
+#include "SceneCache.h"
+
+using namespace std;
+using namespace glm;
+
+// Layout: BakedHeader and key, BakedTexture records, then the root
+// compiler.  Each compiler is BakedCounts, per batch a BakedBatch with its
+// vertices and indices, per group a BakedGroup with its instances, any
+// mesh compiler, and any LOD errors and coarser LOD compilers, then its
+// nodes and ranges.  Every piece starts on a
+// cAlign boundary so mapped arrays are aligned.
+static const char cMagic[8] = "3DWBAKE";
+static constexpr uint cVersion = 4;
+static constexpr size_t cAlign = 16;
+
+struct BakedHeader {
+   char magic[8];
+   uint version;
+   uint keyLen;
+   uint numTextures;
+   uint pad[3];
+};
+
+struct BakedTexture {
+   enum Kind {cPng, cNormal, cColor};
+
+   uint kind;      // TexturePng, TextureNormal, or TextureClr of clr
+   uint repeat;
+   uint nameLen;
+   uint fileLen;
+   uchar clr[4];
+};
+
+struct BakedCounts {
+   uint numBatches;
+   uint numGroups;
+   uint numNodes;
+   uint numRanges;
+};
+
+struct BakedBatch {
+   int tex;        // Index into the texture records
+   int normalTex;  // Or -1 for none
+   uint numVerts;
+   uint numIdxs;
+};
+
+struct BakedGroup {
+   uint numInstances;
+   uint hasMesh;
+   uint numErrors;  // LOD levels, including mMesh, or 0 for no LODs
+   uint numLods;    // Coarser LOD compilers following mMesh
+   Aabb local;
+};
+
+// Appends aligned pieces to a file, collecting texture records first
+struct SceneCache::Writer {
+   FILE *mFile;
+   size_t mPos;
+   map<const Texture *, int> mTexIdx;
+   vector<Texture *> mTexs;
+
+   Writer(FILE *f) : mFile(f), mPos(0) {}
+
+   void Write(const void *data, size_t bytes) {
+      static const char zeros[cAlign] = {0};
+
+      if (bytes && fwrite(data, 1, bytes, mFile) != bytes)
+         throw WorldException("Error writing baked scene");
+      mPos += bytes;
+      if (mPos % cAlign) {
+         fwrite(zeros, 1, cAlign - mPos % cAlign, mFile);
+         mPos += cAlign - mPos % cAlign;
+      }
+   }
+
+   // Index of tex in the texture records, adding it if new
+   int TexIndex(const shared_ptr<Texture> &tex) {
+      if (!tex)
+         return -1;
+      if (!mTexIdx.count(tex.get())) {
+         mTexIdx[tex.get()] = (int)mTexs.size();
+         mTexs.push_back(tex.get());
+      }
+      return mTexIdx[tex.get()];
+   }
+
+   // Give every texture of sc, and its meshes, a record index
+   void CollectTextures(SceneCompiler &sc) {
+      for (auto &batch : sc.GetBatches()) {
+         TexIndex(batch.mTex);
+         TexIndex(batch.mTexNormal);
+      }
+      for (auto &group : sc.GetGroups())
+         if (group.mMesh) {
+            CollectTextures(*group.mMesh);
+            for (auto &lod : group.mLods)
+               CollectTextures(*lod);
+         }
+   }
+};
+
+// Hands out aligned pieces of a mapped file, throwing on truncation
+struct SceneCache::Reader {
+   const char *mPos;
+   const char *mEnd;
+   shared_ptr<void> mBacking;
+   vector<shared_ptr<Texture>> mTexs;
+
+   const void *Take(size_t bytes) {
+      const char *rtn = mPos;
+      size_t padded = (bytes + cAlign - 1) / cAlign * cAlign;
+
+      if ((size_t)(mEnd - mPos) < padded)
+         throw WorldException("Baked scene is truncated");
+      mPos += padded;
+      return rtn;
+   }
+
+   string TakeString(uint len) {
+      return string((const char *)Take(len), len);
+   }
+
+   shared_ptr<Texture> Tex(int idx) {
+      if (idx < 0)
+         return nullptr;
+      if ((size_t)idx >= mTexs.size())
+         throw WorldException("Baked scene has a bad texture index");
+      return mTexs[idx];
+   }
+};
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Helper Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// last modification time of file, or -1 if missing
+static long long FileTime(const string &file) {
+   struct stat info;
+
+   return stat(file.c_str(), &info) ? -1 : (long long)info.st_mtime;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+SceneCache Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// writes one compiler and, recursively, its instanced meshes
+void SceneCache::SaveCompiler(Writer &wtr, const SceneCompiler &sc) {
+   BakedCounts counts = {(uint)sc.mBatches.size(), (uint)sc.mGroups.size(),
+    (uint)sc.mNodes.size(), (uint)sc.mRanges.size()};
+   vector<SceneNode> nodes(sc.mNodes);
+
+   wtr.Write(&counts, sizeof(counts));
+
+   for (auto &batch : sc.mBatches) {
+      BakedBatch rec = {wtr.TexIndex(batch.mTex),
+       wtr.TexIndex(batch.mTexNormal), batch.mNumVerts, batch.mNumIndices};
+
+      wtr.Write(&rec, sizeof(rec));
+      wtr.Write(batch.mVerts, batch.mNumVerts * sizeof(Vertex));
+      wtr.Write(batch.mIndices, batch.mNumIndices * sizeof(uint));
+   }
+
+   for (auto &group : sc.mGroups) {
+      BakedGroup rec = {(uint)group.mInstances.size(),
+       group.mMesh ? 1u : 0u, (uint)group.mLodErrors.size(),
+       (uint)group.mLods.size(), group.mLocal};
+
+      wtr.Write(&rec, sizeof(rec));
+      wtr.Write(group.mInstances.data(),
+       group.mInstances.size() * sizeof(Instance));
+      if (group.mMesh)
+         SaveCompiler(wtr, *group.mMesh);
+      wtr.Write(group.mLodErrors.data(),
+       group.mLodErrors.size() * sizeof(float));
+      for (auto &lod : group.mLods)
+         SaveCompiler(wtr, *lod);
+   }
+
+   // Child pointers are meaningless in another process
+   for (auto &node : nodes)
+      node.mChild = nullptr;
+   wtr.Write(nodes.data(), nodes.size() * sizeof(SceneNode));
+   wtr.Write(sc.mRanges.data(), sc.mRanges.size() * sizeof(BatchRange));
+}
+
+/// rebuilds one compiler, its batches pointing into the mapping
+void SceneCache::LoadCompiler(Reader &rdr, SceneCompiler *sc) {
+   BakedCounts counts = *(const BakedCounts *)rdr.Take(sizeof(BakedCounts));
+
+   sc->mBatches.clear();
+   sc->mBatchIdx.clear();
+   sc->mVertArena.clear();
+   sc->mIdxArena.clear();
+   sc->mGroups.clear();
+   sc->mGroupIdx.clear();
+   sc->mBacking = rdr.mBacking;
+
+   for (uint b = 0; b < counts.numBatches; b++) {
+      BakedBatch rec = *(const BakedBatch *)rdr.Take(sizeof(BakedBatch));
+      Batch batch(rdr.Tex(rec.tex), rdr.Tex(rec.normalTex));
+
+      batch.mVerts = (Vertex *)rdr.Take(rec.numVerts * sizeof(Vertex));
+      batch.mIndices = (uint *)rdr.Take(rec.numIdxs * sizeof(uint));
+      batch.mNumVerts = batch.mMaxVerts = rec.numVerts;
+      batch.mNumIndices = batch.mMaxIndices = rec.numIdxs;
+      for (uint i = 0; i < rec.numIdxs; i++)
+         if (batch.mIndices[i] >= rec.numVerts)
+            throw WorldException("Baked scene has a bad index");
+
+      sc->mBatchIdx[batch.mTex.get()] = b;
+      sc->mBatches.push_back(batch);
+   }
+
+   for (uint g = 0; g < counts.numGroups; g++) {
+      BakedGroup rec = *(const BakedGroup *)rdr.Take(sizeof(BakedGroup));
+      const Instance *insts = (const Instance *)rdr.Take(rec.numInstances
+       * sizeof(Instance));
+
+      sc->mGroups.push_back(InstanceGroup(nullptr));
+      InstanceGroup &group = sc->mGroups.back();
+      group.mCount = rec.numInstances;
+      group.mLocal = rec.local;
+      group.mInstances.assign(insts, insts + rec.numInstances);
+      if (rec.hasMesh) {
+         group.mMesh = make_shared<SceneCompiler>();
+         LoadCompiler(rdr, group.mMesh.get());
+      }
+
+      // LOD levels all start at the finest, as after a Compile
+      if ((rec.numErrors || rec.numLods)
+       && (rec.numErrors != rec.numLods + 1 || !rec.hasMesh))
+         throw WorldException("Baked scene has bad LOD counts");
+      auto errs = (const float *)rdr.Take(rec.numErrors * sizeof(float));
+      group.mLodErrors.assign(errs, errs + rec.numErrors);
+      for (uint l = 0; l < rec.numLods; l++) {
+         group.mLods.push_back(make_shared<SceneCompiler>());
+         LoadCompiler(rdr, group.mLods.back().get());
+      }
+      if (rec.numLods)
+         group.mLevels.assign(rec.numInstances, 0);
+   }
+
+   auto nodes = (const SceneNode *)rdr.Take(counts.numNodes
+    * sizeof(SceneNode));
+   auto ranges = (const BatchRange *)rdr.Take(counts.numRanges
+    * sizeof(BatchRange));
+   sc->mNodes.assign(nodes, nodes + counts.numNodes);
+   sc->mRanges.assign(ranges, ranges + counts.numRanges);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+SceneCache Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// versions, maker identity, options that change the compiled output, and
+/// each asset with its timestamp
+string SceneCache::MakeKey(const ModelMaker &maker,
+ const RenderOptions &opts) {
+   string key = StringPrintf("v%u vertex %u node %u %s optimize %d %d",
+    cVersion, (uint)sizeof(Vertex), (uint)sizeof(SceneNode),
+    maker.GetParams().c_str(), opts.optimize, opts.overdraw);
+
+   for (auto &asset : maker.GetAssets())
+      key += StringPrintf(" %s@%lld", asset.c_str(), FileTime(asset));
+
+   return key;
+}
+
+/// hash of key, under Resource
+string SceneCache::FileName(const string &key) {
+   return StringPrintf("Resource/scene_%016llx.bake", HashString(key));
+}
+
+/// compile, then optimize and tangents, as Renderer::CreateBuffers needs
+void SceneCache::Build(const Model &mdl, const RenderOptions &opts,
+ SceneCompiler *sc) {
+   mat4 temp = translate(mat4(1.0f), vec3(1, 1, 1));
+   vector<MeshReport> reports;
+
+   // flatten model into one arena slice per texture, with repeated
+   // primitives (or, if dynamic, all of them) pulled out as instanced meshes
+   sc->SetInstancing(true);
+   sc->SetDynamic(opts.dynamic);
+   sc->Compile(mdl, mat4(1.0f), temp);
+
+   if (opts.optimize) {
+      sc->Optimize(opts.overdraw, &reports);
+      for (auto &rpt : reports)
+         printf("mesh %s x%u: %u -> %u verts, ACMR %.3f -> %.3f, "
+          "ATVR %.3f -> %.3f\n", rpt.mName.c_str(), rpt.mInstances,
+          rpt.mVertsBefore, rpt.mVertsAfter, rpt.mBefore.Acmr(),
+          rpt.mAfter.Acmr(), rpt.mBefore.Atvr(), rpt.mAfter.Atvr());
+   }
+
+   sc->GenerateTangents();
+}
+
+/// header and key, texture records, then the compilers
+void SceneCache::Save(const string &key, const SceneCompiler &sc) {
+   string file = FileName(key);
+   BakedHeader hdr;
+   FILE *out;
+
+   if (sc.mDynamic)
+      throw WorldException("Dynamic scenes can't be baked");
+
+   out = fopen(file.c_str(), "wb");
+   if (!out)
+      throw WorldException(StringPrintf("Can't write %s", file.c_str()));
+
+   try {
+      Writer wtr(out);
+
+      wtr.CollectTextures(const_cast<SceneCompiler &>(sc));
+      memset(&hdr, 0, sizeof(hdr));
+      memcpy(hdr.magic, cMagic, sizeof(cMagic));
+      hdr.version = cVersion;
+      hdr.keyLen = (uint)key.size();
+      hdr.numTextures = (uint)wtr.mTexs.size();
+      wtr.Write(&hdr, sizeof(hdr));
+      wtr.Write(key.data(), key.size());
+
+      for (auto tex : wtr.mTexs) {
+         auto clrTex = dynamic_cast<TextureClr *>(tex);
+         BakedTexture rec = {dynamic_cast<TextureNormal *>(tex)
+          ? BakedTexture::cNormal : clrTex ? BakedTexture::cColor
+          : BakedTexture::cPng, tex->GetRepeat(),
+          (uint)tex->GetName().size(), (uint)tex->GetFile().size(), {}};
+
+         // Untextured materials bake as their color
+         if (clrTex)
+            memcpy(rec.clr, clrTex->GetColor(), sizeof(rec.clr));
+         else if (tex->GetFile().empty())
+            throw WorldException(StringPrintf(
+             "Can't bake texture %s, which has no image file",
+             tex->GetName().c_str()));
+         wtr.Write(&rec, sizeof(rec));
+         wtr.Write(tex->GetName().data(), rec.nameLen);
+         wtr.Write(tex->GetFile().data(), rec.fileLen);
+      }
+
+      SaveCompiler(wtr, sc);
+   }
+   catch (...) {
+      fclose(out);
+      remove(file.c_str());
+      throw;
+   }
+
+   if (fclose(out))
+      throw WorldException(StringPrintf("Error writing %s", file.c_str()));
+}
+
+/// reads just the header and key
+bool SceneCache::Valid(const string &key) {
+   FILE *in = fopen(FileName(key).c_str(), "rb");
+   BakedHeader hdr;
+   string fileKey;
+   bool rtn = false;
+
+   if (!in)
+      return false;
+
+   if (fread(&hdr, sizeof(hdr), 1, in) == 1
+    && !memcmp(hdr.magic, cMagic, sizeof(cMagic)) && hdr.version == cVersion
+    && hdr.keyLen == key.size()) {
+      fileKey.resize(key.size());
+      rtn = fread(&fileKey[0], 1, key.size(), in) == key.size()
+       && fileKey == key;
+   }
+
+   fclose(in);
+   return rtn;
+}
+
+/// maps the file, checks its key, reloads textures, then the compilers
+bool SceneCache::Load(const string &key, SceneCompiler *sc) {
+   Reader rdr;
+   size_t size;
+   shared_ptr<char> data = MappedFile::Map(FileName(key), &size);
+   const BakedHeader *hdr;
+
+   if (!data || size < sizeof(BakedHeader))
+      return false;
+   rdr.mBacking = data;
+   rdr.mPos = data.get();
+   rdr.mEnd = data.get() + size;
+
+   hdr = (const BakedHeader *)rdr.Take(sizeof(BakedHeader));
+   if (memcmp(hdr->magic, cMagic, sizeof(cMagic)) || hdr->version != cVersion
+    || hdr->keyLen != key.size() || rdr.TakeString(hdr->keyLen) != key)
+      return false;
+
+   for (uint t = 0; t < hdr->numTextures; t++) {
+      BakedTexture rec = *(const BakedTexture *)rdr.Take(sizeof(rec));
+      string name = rdr.TakeString(rec.nameLen);
+      string file = rdr.TakeString(rec.fileLen);
+
+      if (rec.kind == BakedTexture::cNormal)
+         rdr.mTexs.push_back(shared_ptr<Texture>(
+          new TextureNormal(name, file, rec.repeat != 0)));
+      else if (rec.kind == BakedTexture::cColor)
+         rdr.mTexs.push_back(shared_ptr<Texture>(
+          new TextureClr(name, rec.clr)));
+      else
+         rdr.mTexs.push_back(shared_ptr<Texture>(
+          new TexturePng(name, file, rec.repeat != 0)));
+   }
+
+   sc->SetInstancing(true);
+   sc->SetDynamic(false);
+   LoadCompiler(rdr, sc);
+
+   return true;
+}
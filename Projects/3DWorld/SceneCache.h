@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+
+#include "Model.h"
+#include "ModelMaker.h"
+#include "RenderOptions.h"
+#include "SceneCompiler.h"
+
+// Baked scenes: the output of the CPU scene pipeline (ModelMaker,
+// SceneCompiler, MeshOptimizer, TangentGen), saved as one binary file of
+// per-texture vertex and index blobs, texture references, instances and
+// BVH nodes.  Loading maps the file and points the batches straight into
+// the mapping, so a cache hit costs only texture loads and GL upload.
+// Files are native-endian and keyed by everything that shapes them, so
+// they are a local cache, not an interchange format.
+class SceneCache {
+   struct Writer;
+   struct Reader;
+
+   static void SaveCompiler(Writer &, const SceneCompiler &);
+   static void LoadCompiler(Reader &, SceneCompiler *);
+
+public:
+   // Key of the scene maker would produce under opts: format version,
+   // maker type and parameters, and the timestamps of its assets
+   static std::string MakeKey(const ModelMaker &maker,
+    const RenderOptions &opts);
+
+   // File a scene with this key is baked to
+   static std::string FileName(const std::string &key);
+
+   // Run the CPU pipeline Renderer needs over mdl, into sc: compile,
+   // optionally optimize (printing a MeshReport per batch), and generate
+   // tangents.  This is what a baked scene stands in for.
+   static void Build(const Model &mdl, const RenderOptions &opts,
+    SceneCompiler *sc);
+
+   // Write sc, which must not be dynamic, under key.  Throws on I/O errors.
+   static void Save(const std::string &key, const SceneCompiler &sc);
+
+   // True if a baked file for key exists and was baked under that key
+   static bool Valid(const std::string &key);
+
+   // Map the baked file for key into sc, replacing any prior contents and
+   // reloading its textures.  Returns false if there is no valid file;
+   // throws if a valid one is truncated.
+   static bool Load(const std::string &key, SceneCompiler *sc);
+};
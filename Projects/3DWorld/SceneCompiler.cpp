@@ -0,0 +1,532 @@
+#include <algorithm>
+
+#include "SceneCompiler.h"
+#include "TangentGen.h"
+#include "Utility.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+SceneCompiler Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// finds the batch for |tex|, creating it on first sight
+Batch &SceneCompiler::GetBatch(const shared_ptr<Texture> &tex) {
+   auto found = mBatchIdx.find(tex.get());
+
+   if (found != mBatchIdx.end())
+      return mBatches[found->second];
+
+   mBatchIdx[tex.get()] = (uint)mBatches.size();
+   mBatches.push_back(Batch(tex, nullptr));
+   return mBatches.back();
+}
+
+/// closes node once its subtree is compiled, giving a leaf its index
+/// ranges and model bounds, and crediting its leaves to its parent
+void SceneCompiler::FinishNode(uint idx, const Model &mdl) {
+   SceneNode &node = mNodes[idx];
+
+   node.mEnd = (uint)mNodes.size();
+   if (node.mEnd == idx + 1) {
+      node.mLeaves = 1;
+      node.mRangeEnd = (uint)mRanges.size();
+      if (node.mSlot < 0)
+         node.mLocal = mdl.GetBounds();
+   }
+
+   if (node.mParent >= 0)
+      mNodes[node.mParent].mLeaves += node.mLeaves;
+}
+
+/// recomputes leaf world bounds, then interior bounds bottom-up
+void SceneCompiler::UpdateBounds() {
+   for (uint i = 0; i < mNodes.size(); i++)
+      mNodes[i].mBounds = mNodes[i].mEnd == i + 1
+       ? mNodes[i].mLocal.Transform(mNodes[i].mWorld) : Aabb();
+
+   for (uint i = (uint)mNodes.size(); i-- > 1;)
+      mNodes[mNodes[i].mParent].mBounds.Grow(mNodes[i].mBounds);
+}
+
+/// indexes the nodes Refresh may move by their child, and notes the
+/// models owning those children.  Baked leaves are left out, as is the
+/// root, which no CmpModel owns.  Moves made before this compile are
+/// already reflected, so every owner's list of them is cleared.
+void SceneCompiler::IndexMovers(const Model &mdl) {
+   mChildNodes.clear();
+   mMovers.clear();
+   for (uint i = 1; i < mNodes.size(); i++) {
+      const SceneNode &node = mNodes[i];
+      int parent = node.mParent;
+
+      if (node.mSlot < 0 && node.mEnd == i + 1)
+         continue;
+
+      // Only CmpModels compile children, so each parent node holds one
+      mChildNodes.push_back(make_pair(node.mChild, i));
+      mMovers.push_back(static_cast<const CmpModel *>(parent == 0 ? &mdl
+       : mNodes[parent].mChild->mdl.get()));
+   }
+   sort(mChildNodes.begin(), mChildNodes.end());
+   sort(mMovers.begin(), mMovers.end());
+   mMovers.erase(unique(mMovers.begin(), mMovers.end()), mMovers.end());
+
+   for (uint i = 0; i < mNodes.size(); i++)
+      if (mNodes[i].mEnd != i + 1)
+         static_cast<const CmpModel &>(i == 0 ? mdl
+          : *mNodes[i].mChild->mdl).ClearMoved();
+
+   mTouchedNode.assign(mNodes.size(), false);
+}
+
+/// appends run [first, first+count) to ranges, merging with the last run
+static void AddRun(vector<DrawRange> &ranges, uint first, uint count) {
+   if (!ranges.empty() && ranges.back().mFirst + ranges.back().mCount == first)
+      ranges.back().mCount += count;
+   else
+      ranges.push_back(DrawRange(first, count));
+}
+
+/// marks one leaf visible
+void SceneCompiler::Emit(const SceneNode &node) {
+   if (node.mSlot >= 0) {
+      const InstanceGroup &group = mGroups[node.mGroup];
+      uint level = group.mLevels.empty() ? 0 : group.mLevels[node.mSlot];
+
+      AddRun(mVisGroups[node.mGroup][level], node.mSlot, 1);
+   }
+
+   for (uint r = node.mRangeBegin; r < node.mRangeEnd; r++)
+      AddRun(mVisBatches[mRanges[r].mBatch], mRanges[r].mRange.mFirst,
+       mRanges[r].mRange.mCount);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+SceneCompiler Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// grows the capacity of |tex|'s batch during the counting pass
+void SceneCompiler::Reserve(const shared_ptr<Texture> &tex,
+ const shared_ptr<Texture> &nT, uint numVerts, uint numIdxs) {
+   Batch &batch = GetBatch(tex);
+
+   if (nT)
+      batch.mTexNormal = nT;
+   batch.mMaxVerts += numVerts;
+   batch.mMaxIndices += numIdxs;
+}
+
+/// hands out the next numVerts vertices of |tex|'s arena slice
+Vertex *SceneCompiler::AddVertices(const shared_ptr<Texture> &tex,
+ uint numVerts, uint *base) {
+   Batch &batch = GetBatch(tex);
+
+   if (batch.mNumVerts + numVerts > batch.mMaxVerts)
+      throw WorldException(StringPrintf(
+       "Vertex overflow compiling %s", tex->GetName().c_str()));
+
+   *base = batch.mNumVerts;
+   batch.mNumVerts += numVerts;
+   return batch.mVerts + *base;
+}
+
+/// hands out the next numIdxs indices of |tex|'s arena slice
+uint *SceneCompiler::AddIndices(const shared_ptr<Texture> &tex, uint numIdxs) {
+   Batch &batch = GetBatch(tex);
+   uint *rtn = batch.mIndices + batch.mNumIndices;
+   uint b = (uint)(&batch - mBatches.data());
+
+   if (batch.mNumIndices + numIdxs > batch.mMaxIndices)
+      throw WorldException(StringPrintf(
+       "Index overflow compiling %s", tex->GetName().c_str()));
+
+   // Credit the indices to the leaf being compiled, for culling
+   if (!mRanges.empty() && mRanges.back().mBatch == b
+    && mNodes.back().mRangeBegin < mRanges.size())
+      mRanges.back().mRange.mCount += numIdxs;
+   else
+      mRanges.push_back(BatchRange(b, batch.mNumIndices, numIdxs));
+
+   batch.mNumIndices += numIdxs;
+   return rtn;
+}
+
+/// counts a child directly, or tallies it against its geometry key
+void SceneCompiler::CountChild(const Model &mdl) {
+   string key = mInstancing || mDynamic || mdl.HasLods()
+    ? mdl.GetGeometryKey() : "";
+
+   if (key.empty()) {
+      mdl.CountGeometry(*this);
+      return;
+   }
+
+   auto found = mGroupIdx.find(key);
+   if (found == mGroupIdx.end()) {
+      mGroupIdx[key] = (uint)mGroups.size();
+      mGroups.push_back(InstanceGroup(&mdl));
+      mGroups.back().mCount = 1;
+   }
+   else
+      mGroups[found->second].mCount++;
+}
+
+/// records child as an instance if its group has a mesh, else bakes it,
+/// noting the child's node and bounds either way
+void SceneCompiler::CompileChild(const CmpModel::Child &cr, const mat4x4 &xfm,
+ const mat4x4 &texXfm) {
+   string key = mInstancing || mDynamic || cr.mdl->HasLods()
+    ? cr.mdl->GetGeometryKey() : "";
+   InstanceGroup *group = nullptr;
+   int node = (int)mNodes.size(), parent = mParent;
+
+   if (!key.empty())
+      group = &mGroups[mGroupIdx.at(key)];
+
+   mNodes.push_back(SceneNode(&cr, mParent, xfm, (uint)mRanges.size()));
+
+   if (group && group->mMesh) {
+      mNodes[node].mGroup = mGroupIdx.at(key);
+      mNodes[node].mSlot = (int)group->mInstances.size();
+      mNodes[node].mLocal = group->mLocal;
+      group->mInstances.push_back(Instance(xfm, texXfm));
+      if (!group->mLods.empty())
+         group->mLevels.push_back(0);
+   }
+   else {
+      mParent = node;
+      cr.mdl->CompileGeometry(*this, xfm, texXfm);
+      mParent = parent;
+   }
+
+   FinishNode(node, *cr.mdl);
+}
+
+/// counts, allocates, then writes the whole of |mdl| in one walk
+void SceneCompiler::Compile(const Model &mdl, const mat4x4 &xfm,
+ const mat4x4 &texXfm) {
+   size_t totalVerts = 0, totalIdxs = 0;
+
+   mBatches.clear();
+   mBatchIdx.clear();
+   mGroups.clear();
+   mGroupIdx.clear();
+   mNodes.clear();
+   mRanges.clear();
+   mBacking.reset();
+   mParent = -1;
+
+   mdl.CountGeometry(*this);
+
+   // Repeated geometry gets one untransformed mesh; the rest is baked.
+   // Dynamic mode needs a slot per leaf, so instances even singletons, as
+   // do LODs, which are chosen per instance.
+   for (auto &group : mGroups) {
+      vector<LodLevel> lods = group.mMdl->GetLods();
+
+      if (!lods.empty()) {
+         const Model &finest = lods[0].mMdl ? *lods[0].mMdl : *group.mMdl;
+
+         group.mMesh = make_shared<SceneCompiler>();
+         group.mMesh->Compile(finest, mat4(1.0f), mat4(1.0f));
+         group.mLodErrors.push_back(lods[0].mError);
+         for (uint l = 1; l < lods.size(); l++) {
+            group.mLods.push_back(make_shared<SceneCompiler>());
+            group.mLods.back()->Compile(*lods[l].mMdl, mat4(1.0f),
+             mat4(1.0f));
+            group.mLodErrors.push_back(lods[l].mError);
+         }
+         group.mInstances.reserve(group.mCount);
+         group.mLevels.reserve(group.mCount);
+         group.mLocal = finest.GetBounds();
+      }
+      else if (group.mCount >= (mDynamic ? 1 : cMinInstances)) {
+         group.mMesh = make_shared<SceneCompiler>();
+         group.mMesh->Compile(*group.mMdl, mat4(1.0f), mat4(1.0f));
+         group.mInstances.reserve(group.mCount);
+         group.mLocal = group.mMdl->GetBounds();
+      }
+      else
+         for (uint i = 0; i < group.mCount; i++)
+            group.mMdl->CountGeometry(*this);
+   }
+
+   for (auto &batch : mBatches) {
+      totalVerts += batch.mMaxVerts;
+      totalIdxs += batch.mMaxIndices;
+   }
+
+   // One allocation each for all vertices and all indices; batches are
+   // contiguous slices, in first-seen texture order.
+   mVertArena.resize(totalVerts);
+   mIdxArena.resize(totalIdxs);
+   totalVerts = totalIdxs = 0;
+   for (auto &batch : mBatches) {
+      batch.mVerts = mVertArena.data() + totalVerts;
+      batch.mIndices = mIdxArena.data() + totalIdxs;
+      totalVerts += batch.mMaxVerts;
+      totalIdxs += batch.mMaxIndices;
+   }
+
+   // The root is node 0, parent of the top level children
+   mNodes.push_back(SceneNode(nullptr, -1, xfm, 0));
+   mParent = 0;
+   mdl.CompileGeometry(*this, xfm, texXfm);
+   mParent = -1;
+   FinishNode(0, mdl);
+   UpdateBounds();
+
+   for (auto &batch : mBatches)
+      if (batch.mNumVerts != batch.mMaxVerts
+       || batch.mNumIndices != batch.mMaxIndices)
+         throw WorldException(StringPrintf(
+          "Compiled size of %s differs from its count",
+          batch.mTex->GetName().c_str()));
+
+   IndexMovers(mdl);
+}
+
+/// recomposes transforms below children moved since the last refresh, in
+/// preorder per moved subtree, then refits just the nodes it moved and
+/// their ancestors, children before parents
+const vector<pair<uint, uint>> &SceneCompiler::Refresh() {
+   uint end = 0;
+
+   mMoved.clear();
+   mDirtyNodes.clear();
+   for (const CmpModel *owner : mMovers) {
+      for (uint idx : owner->GetMoved()) {
+         const CmpModel::Child *child = &owner->GetChild(idx);
+         auto it = lower_bound(mChildNodes.begin(), mChildNodes.end(),
+          make_pair(child, 0u));
+
+         for (; it != mChildNodes.end() && it->first == child; it++)
+            mDirtyNodes.push_back(it->second);
+      }
+      owner->ClearMoved();
+   }
+   if (mDirtyNodes.empty())
+      return mMoved;
+
+   // A dirty node inside an earlier dirty subtree moves with that subtree
+   mTouched.clear();
+   sort(mDirtyNodes.begin(), mDirtyNodes.end());
+   for (uint top : mDirtyNodes) {
+      if (top < end)
+         continue;
+
+      end = mNodes[top].mEnd;
+      for (uint i = top; i < end; i++) {
+         SceneNode &node = mNodes[i];
+
+         // Baked leaves keep the transform their vertices were written with
+         if (node.mSlot < 0 && node.mEnd == i + 1)
+            continue;
+
+         node.mWorld = mNodes[node.mParent].mWorld * node.mChild->xform;
+         mTouchedNode[i] = true;
+         mTouched.push_back(i);
+         if (node.mEnd == i + 1)
+            node.mBounds = node.mLocal.Transform(node.mWorld);
+
+         if (node.mSlot >= 0) {
+            mGroups[node.mGroup].mInstances[node.mSlot].SetXform(node.mWorld);
+            mMoved.push_back(pair<uint, uint>(node.mGroup, node.mSlot));
+         }
+      }
+
+      for (int p = mNodes[top].mParent; p >= 0 && !mTouchedNode[p];
+       p = mNodes[p].mParent) {
+         mTouchedNode[p] = true;
+         mTouched.push_back(p);
+      }
+   }
+
+   // Later nodes are never ancestors of earlier ones, so refit backward
+   sort(mTouched.begin(), mTouched.end());
+   for (auto it = mTouched.rbegin(); it != mTouched.rend(); it++) {
+      SceneNode &node = mNodes[*it];
+
+      mTouchedNode[*it] = false;
+      if (node.mEnd == *it + 1)
+         continue;
+
+      node.mBounds = Aabb();
+      for (uint c = *it + 1; c < node.mEnd; c = mNodes[c].mEnd)
+         node.mBounds.Grow(mNodes[c].mBounds);
+   }
+
+   return mMoved;
+}
+
+/// optimizes each batch, reordering within the BatchRanges of each leaf,
+/// then recurses into instanced meshes
+void SceneCompiler::Optimize(bool overdraw, vector<MeshReport> *reports) {
+   vector<vector<DrawRange>> ranges(mBatches.size());
+   MeshOptimizer opt;
+
+   for (auto &range : mRanges)
+      ranges[range.mBatch].push_back(range.mRange);
+
+   for (uint b = 0; b < mBatches.size(); b++) {
+      Batch &batch = mBatches[b];
+      MeshReport rpt(batch.mTex->GetName(), 1);
+
+      rpt.mVertsBefore = batch.mNumVerts;
+      rpt.mBefore = MeshOptimizer::Measure(batch.mIndices, batch.mNumIndices,
+       batch.mNumVerts);
+
+      batch.mNumVerts = opt.Weld(batch.mVerts, batch.mNumVerts,
+       batch.mIndices, batch.mNumIndices);
+      for (auto &range : ranges[b]) {
+         opt.OrderForCache(batch.mIndices + range.mFirst, range.mCount,
+          batch.mNumVerts);
+         if (overdraw)
+            opt.OrderForOverdraw(batch.mIndices + range.mFirst, range.mCount,
+             batch.mVerts);
+      }
+      batch.mNumVerts = opt.OrderForFetch(batch.mVerts, batch.mNumVerts,
+       batch.mIndices, batch.mNumIndices);
+
+      rpt.mVertsAfter = batch.mNumVerts;
+      rpt.mAfter = MeshOptimizer::Measure(batch.mIndices, batch.mNumIndices,
+       batch.mNumVerts);
+      reports->push_back(rpt);
+   }
+
+   for (auto &group : mGroups)
+      if (group.mMesh) {
+         size_t first = reports->size();
+
+         group.mMesh->Optimize(overdraw, reports);
+         for (auto &lod : group.mLods)
+            lod->Optimize(overdraw, reports);
+         for (size_t r = first; r < reports->size(); r++)
+            (*reports)[r].mInstances = (uint)group.mInstances.size();
+      }
+}
+
+/// fills in tangent frames for each batch, then for instanced meshes
+void SceneCompiler::GenerateTangents() {
+   for (auto &batch : mBatches)
+      TangentGen::Generate(batch.mVerts, batch.mNumVerts, batch.mIndices,
+       batch.mNumIndices);
+
+   for (auto &group : mGroups)
+      if (group.mMesh) {
+         group.mMesh->GenerateTangents();
+         for (auto &lod : group.mLods)
+            lod->GenerateTangents();
+      }
+}
+
+/// walks the BVH, skipping subtrees outside frustum and testing no further
+/// below those fully inside
+void SceneCompiler::Cull(const Frustum &frustum, CullStats *stats) {
+   uint i = 0, j;
+
+   mVisBatches.resize(mBatches.size());
+   for (auto &ranges : mVisBatches)
+      ranges.clear();
+   mVisGroups.resize(mGroups.size());
+   for (uint g = 0; g < mGroups.size(); g++) {
+      mVisGroups[g].resize(1 + mGroups[g].mLods.size());
+      for (auto &ranges : mVisGroups[g])
+         ranges.clear();
+   }
+
+   while (i < mNodes.size()) {
+      const SceneNode &node = mNodes[i];
+
+      switch (frustum.Classify(node.mBounds)) {
+      case Frustum::cOutside:
+         stats->mCulled += node.mLeaves;
+         i = node.mEnd;
+         break;
+      case Frustum::cInside:
+         for (j = i; j < node.mEnd; j++)
+            if (mNodes[j].mEnd == j + 1)
+               Emit(mNodes[j]);
+         stats->mVisible += node.mLeaves;
+         i = node.mEnd;
+         break;
+      default:
+         if (node.mEnd == i + 1) {
+            Emit(node);
+            stats->mVisible++;
+         }
+         i++;
+      }
+   }
+}
+
+/// projected size in pixels of one object-space unit of an instance at xfm,
+/// scaled by the instance, at its nearest point to the eye in any view
+static float PixelsPerUnit(const vector<LodView> &views, const Aabb &local,
+ const mat4 &xfm) {
+   float scale = std::max(length(vec3(xfm[0])), std::max(length(vec3(xfm[1])),
+    length(vec3(xfm[2])))), radius = length(local.Extent()) * scale;
+   vec4 center = xfm * vec4(local.Center(), 1.0f);
+   float rtn = 0.0f, depth, focal;
+
+   for (auto &view : views) {
+      // clip w is eye-space depth; row 1 of VP scales eye y by the focal
+      depth = (view.mVP * center).w - radius;
+      if (depth <= 1e-4f)
+         return 1e30f;
+      focal = length(vec3(view.mVP[0][1], view.mVP[1][1], view.mVP[2][1]));
+      rtn = std::max(rtn, scale * focal * 0.5f * view.mHeight / depth);
+   }
+
+   return rtn;
+}
+
+/// refines each LOD instance while its level's error exceeds pixels, and
+/// coarsens it while the next level's error is under the hysteresis band
+uint SceneCompiler::SelectLods(const vector<LodView> &views, float pixels) {
+   uint changes = 0, level, old, last;
+   float ppu;
+
+   for (auto &group : mGroups) {
+      if (group.mLods.empty())
+         continue;
+
+      last = (uint)group.mLods.size();
+      for (uint i = 0; i < group.mInstances.size(); i++) {
+         ppu = PixelsPerUnit(views, group.mLocal, group.mInstances[i].xform);
+         level = old = group.mLevels[i];
+
+         while (level > 0 && group.mLodErrors[level] * ppu > pixels)
+            level--;
+         while (level < last && group.mLodErrors[level + 1] * ppu
+          < pixels * cLodHysteresis)
+            level++;
+
+         if (level != old) {
+            group.mLevels[i] = (uint8_t)level;
+            changes++;
+         }
+      }
+   }
+
+   return changes;
+}
+
+/// returns the memory held by the vertex and index arenas, including
+/// instanced meshes and their per-instance transforms
+size_t SceneCompiler::GetArenaBytes() const {
+   size_t bytes = mVertArena.size() * sizeof(Vertex)
+    + mIdxArena.size() * sizeof(uint);
+
+   for (auto &group : mGroups)
+      if (group.mMesh) {
+         bytes += group.mMesh->GetArenaBytes()
+          + group.mInstances.size() * sizeof(Instance);
+         for (auto &lod : group.mLods)
+            bytes += lod->GetArenaBytes();
+      }
+
+   return bytes;
+}
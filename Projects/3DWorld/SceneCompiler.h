@@ -0,0 +1,238 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <glm/mat3x4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Bounds.h"
+#include "MeshOptimizer.h"
+#include "Model.h"
+#include "Textures.h"
+
+// One texture's worth of compiled geometry.  Vertices and indices are
+// slices of the SceneCompiler arenas, with indices already offset to be
+// relative to the start of the batch's vertices.
+struct Batch {
+   std::shared_ptr<Texture> mTex;
+   std::shared_ptr<Texture> mTexNormal;
+   Vertex *mVerts;
+   uint *mIndices;
+   uint mNumVerts;     // Vertices written so far
+   uint mNumIndices;   // Indices written so far
+   uint mMaxVerts;     // Vertex capacity from the counting pass
+   uint mMaxIndices;   // Index capacity from the counting pass
+
+   Batch(std::shared_ptr<Texture> t, std::shared_ptr<Texture> nT)
+    : mTex(t), mTexNormal(nT), mVerts(nullptr), mIndices(nullptr),
+    mNumVerts(0), mNumIndices(0), mMaxVerts(0), mMaxIndices(0) {}
+};
+
+// Per-instance transforms of an instanced mesh, uploaded as instanced
+// vertex attributes in this exact layout.  The normal transform is derived
+// from xform here, once per move, rather than per vertex by the shader,
+// and padded to vec4 columns as attributes read them.
+struct Instance {
+   glm::mat4x4 xform;
+   glm::mat4x4 texXfm;
+   glm::mat3x4 normXfm;
+
+   Instance(const glm::mat4x4 &xf, const glm::mat4x4 &tXf)
+    : texXfm(tXf) {SetXform(xf);}
+
+   void SetXform(const glm::mat4x4 &xf) {
+      xform = xf;
+      normXfm = glm::mat3x4(glm::transpose(glm::inverse(glm::mat3(xf))));
+   }
+};
+
+class SceneCompiler;
+
+// Leaf models sharing one geometry key.  If repeated often enough, their
+// geometry is compiled once, untransformed, into mMesh, and each
+// occurrence becomes an Instance instead of baked vertices.  Models with
+// LODs are always instanced, with mMesh the finest level and mLods the
+// coarser ones, and each instance drawn at its own level.
+struct InstanceGroup {
+   const Model *mMdl;                     // First model seen with the key
+   uint mCount;                           // Occurrences in counting pass
+   std::shared_ptr<SceneCompiler> mMesh;  // Null if baked instead
+   std::vector<Instance> mInstances;
+   Aabb mLocal;                           // Bounds of mMdl, if instanced
+   std::vector<std::shared_ptr<SceneCompiler>> mLods;  // Levels 1 and up
+   std::vector<float> mLodErrors;         // Per level, object-space error
+   std::vector<uint8_t> mLevels;          // Per instance, its current level
+
+   InstanceGroup(const Model *m) : mMdl(m), mCount(0) {}
+};
+
+// A run of indices within one batch, or of instances within one group
+struct DrawRange {
+   uint mFirst;
+   uint mCount;
+
+   DrawRange(uint f, uint c) : mFirst(f), mCount(c) {}
+};
+
+// Indices a baked leaf wrote into batch mBatch
+struct BatchRange {
+   uint mBatch;
+   DrawRange mRange;
+
+   BatchRange(uint b, uint f, uint c) : mBatch(b), mRange(f, c) {}
+};
+
+// One CmpModel child along one path through the scene, or the root model
+// itself with a null mChild.  Shared submodels appear once per path.  Nodes
+// are stored in preorder, so a parent precedes its children and a subtree
+// is the span [node, mEnd).  With world bounds per node, the array is a
+// BVH shaped by the CmpModel hierarchy.
+struct SceneNode {
+   const CmpModel::Child *mChild;
+   int mParent;          // Index of parent node, or -1 for the root
+   uint mEnd;            // One past the last node of this subtree
+   uint mLeaves;         // Leaves in this subtree
+   glm::mat4x4 mWorld;   // Root xfm composed with every xform down to mChild
+   Aabb mLocal;          // Untransformed model bounds, for leaves
+   Aabb mBounds;         // World bounds of the subtree
+   int mGroup;           // InstanceGroup holding this leaf, or -1
+   int mSlot;            // Index into that group's mInstances, or -1
+   uint mRangeBegin;     // Span of this leaf's BatchRanges, if baked
+   uint mRangeEnd;
+
+   SceneNode(const CmpModel::Child *c, int p, const glm::mat4x4 &w, uint r)
+    : mChild(c), mParent(p), mEnd(0), mLeaves(0), mWorld(w), mGroup(-1),
+    mSlot(-1), mRangeBegin(r), mRangeEnd(r) {}
+};
+
+// Objects (leaf nodes) kept and dropped by the last SceneCompiler::Cull
+struct CullStats {
+   uint mVisible;
+   uint mCulled;
+
+   CullStats() : mVisible(0), mCulled(0) {}
+};
+
+// Flattens a Model hierarchy into one contiguous vertex/index range per
+// texture in a single walk.  A counting pass (Model::CountGeometry) sizes
+// the arenas exactly, then Model::CompileGeometry writes transformed
+// vertices and pre-offset indices straight into them, so no per-node maps,
+// lists or intermediate copies are made.
+class SceneCompiler {
+   friend class SceneCache;
+
+   std::vector<Batch> mBatches;
+   std::unordered_map<const Texture *, uint> mBatchIdx;
+   std::vector<Vertex> mVertArena;
+   std::vector<uint> mIdxArena;
+   std::vector<InstanceGroup> mGroups;
+   std::unordered_map<std::string, uint> mGroupIdx;
+   std::vector<SceneNode> mNodes;
+   std::vector<BatchRange> mRanges;
+   std::vector<std::pair<uint, uint>> mMoved;
+   // Nodes of each child Refresh can move, sorted by child, and the
+   // distinct CmpModels owning those children, whose moves it polls
+   std::vector<std::pair<const CmpModel::Child *, uint>> mChildNodes;
+   std::vector<const CmpModel *> mMovers;
+   std::vector<uint> mDirtyNodes;   // Refresh scratch, kept to reuse
+   std::vector<uint> mTouched;      // storage between frames
+   std::vector<bool> mTouchedNode;  // Per node, all false between calls
+   std::vector<std::vector<DrawRange>> mVisBatches;
+   std::vector<std::vector<std::vector<DrawRange>>> mVisGroups; // Per level
+   std::shared_ptr<void> mBacking;   // Mapped file batches point into, if any
+   int mParent = -1;
+   bool mInstancing = false;
+   bool mDynamic = false;
+
+   static constexpr uint cMinInstances = 2;  // Fewer than this are baked
+
+   // A coarser LOD is taken only once its error falls below this fraction
+   // of the threshold, so instances near a switch distance don't flicker
+   static constexpr float cLodHysteresis = 0.5f;
+
+   Batch &GetBatch(const std::shared_ptr<Texture> &);
+   void FinishNode(uint, const Model &);
+   void UpdateBounds();
+   void IndexMovers(const Model &);
+   void Emit(const SceneNode &);
+
+public:
+   SceneCompiler() {}
+
+   // Counting pass: note that |tex| needs room for numVerts more vertices
+   // and numIdxs more indices, and that its normal map is nT.
+   void Reserve(const std::shared_ptr<Texture> &tex,
+    const std::shared_ptr<Texture> &nT, uint numVerts, uint numIdxs);
+
+   // Writing pass: claim numVerts vertices and numIdxs indices of |tex|'s
+   // batch.  |base| receives the batch-relative index of the first vertex,
+   // which the caller adds to each index it writes.
+   Vertex *AddVertices(const std::shared_ptr<Texture> &tex, uint numVerts,
+    uint *base);
+   uint *AddIndices(const std::shared_ptr<Texture> &tex, uint numIdxs);
+
+   // With instancing on, children that CmpModel passes through CountChild
+   // and CompileChild are grouped by Model::GetGeometryKey, and repeated
+   // geometry becomes InstanceGroups rather than baked batches.
+   void SetInstancing(bool on) {mInstancing = on;}
+
+   // Dynamic mode instances every keyed leaf, even unrepeated ones, so
+   // that Refresh can follow CmpModel::SetXform without recompiling.
+   // Models lacking a geometry key are still baked, and can't move.  The
+   // Model must outlive the compiler, and adding children to it requires a
+   // new Compile.
+   void SetDynamic(bool on) {mDynamic = on;}
+
+   // Count or compile a CmpModel child, or defer it to an InstanceGroup
+   void CountChild(const Model &);
+   void CompileChild(const CmpModel::Child &, const glm::mat4x4 &xfm,
+    const glm::mat4x4 &texXfm);
+
+   // Run both passes over |mdl|, replacing any prior contents
+   void Compile(const Model &mdl, const glm::mat4x4 &xfm,
+    const glm::mat4x4 &texXfm);
+
+   // Dynamic mode: recompose world transforms below every dirty child,
+   // writing them into their instance slots, refitting the bounds above
+   // them and clearing the dirty flags.  Baked leaves keep their compiled
+   // transform and bounds, since their vertices don't move.  Returns the
+   // (group, slot) pairs whose xform changed.  Only the moved subtrees
+   // and their ancestors are visited, so a frame with no moves costs a
+   // check per CmpModel with movable children, not per node.
+   const std::vector<std::pair<uint, uint>> &Refresh();
+
+   // Run MeshOptimizer over every batch, including instanced meshes: weld,
+   // order each leaf's triangles for the vertex cache (and, if overdraw,
+   // for overdraw) within that leaf's own index range so culling still
+   // works, then renumber vertices.  Appends one MeshReport per batch.
+   void Optimize(bool overdraw, std::vector<MeshReport> *reports);
+
+   // Run TangentGen over every batch, including instanced meshes
+   void GenerateTangents();
+
+   // Walk the node BVH once against |frustum|, skipping whole subtrees that
+   // lie outside it, and collect the visible leaves as merged index ranges
+   // per batch and instance runs per group.  Adds to *stats.
+   void Cull(const Frustum &frustum, CullStats *stats);
+
+   // Pick each LOD instance's level for views: the coarsest whose
+   // object-space error, scaled by the instance and projected at its
+   // nearest point, is within |pixels| in every view.  Levels move toward
+   // coarser only past cLodHysteresis.  Returns the number of instances
+   // whose level changed.  Call before Cull, which buckets by level.
+   uint SelectLods(const std::vector<LodView> &views, float pixels);
+
+   // Ranges visible at the last Cull, per batch and per InstanceGroup and
+   // LOD level (0 for groups without LODs)
+   const std::vector<DrawRange> &GetVisibleBatch(uint b) const
+    {return mVisBatches[b];}
+   const std::vector<DrawRange> &GetVisibleGroup(uint g, uint level = 0)
+    const {return mVisGroups[g][level];}
+
+   std::vector<Batch> &GetBatches() {return mBatches;}
+   std::vector<InstanceGroup> &GetGroups() {return mGroups;}
+   const std::vector<SceneNode> &GetNodes() const {return mNodes;}
+   size_t GetArenaBytes() const;
+};
@@ -1,181 +1,256 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "ProgramCache.h"
 #include "Shader.h"
 
 
 using namespace std;
 using namespace glm;
 
-// Compile |source| as a shader program of the indicated type.  Throw
-// any compile errors as an exception.  Return shaderId on success.
-GLuint Shader::CompileShader(const char *source, GLenum shdType) {
-   int ok;
-   constexpr int cMaxLogLen = 1000;
-   char logBuf[cMaxLogLen + 1];
-
-   // Create an empty vertex shader handle
-   int shdId = glCreateShader(shdType);
-    
-   // Send the vertex shader source code to OpenGL
-   glShaderSource(shdId, (GLsizei)1, &source, NULL);
-
-   glCompileShader(shdId);
-
-   // check shader for errors
-   glGetShaderiv(shdId, GL_COMPILE_STATUS, &ok);
-   if (!ok) {
-      glGetShaderInfoLog(shdId, cMaxLogLen, NULL, logBuf);
-      throw WorldException(logBuf);
-   }
-
-   return shdId;
-}
-
-// Link all shaderIds in |shaders| into a shader program, returning the new
-// program's ID on success.  Throw any link errors as an exception.
-GLuint Shader::LinkShaders(std::vector<GLuint> shds) {
-   int ok;
-   constexpr int cMaxLogLen = 1000;
-   char logBuf[cMaxLogLen + 1];
+// Uniform buffer binding points of the Camera and Lights blocks
+static constexpr GLuint cCameraBinding = 0;
+static constexpr GLuint cLightsBinding = 1;
 
-   mProgramID = glCreateProgram();
-
-   for (auto shdId: shds)
-      glAttachShader(mProgramID, shdId);
-
-   // combines all different shader programs
-   glLinkProgram(mProgramID);
-
-   // check for shader errors after linking
-   glGetProgramiv(mProgramID, GL_LINK_STATUS, &ok);
-   if (!ok) {
-      glGetProgramInfoLog(mProgramID, cMaxLogLen, NULL, logBuf); GLChkErr;
-      throw WorldException(logBuf);
-   }
-
-   glUseProgram(mProgramID);
-
-   // set the active texture values for each texture
-   glUniform1i(glGetUniformLocation(mProgramID, "tex"), 0);
-   glUniform1i(glGetUniformLocation(mProgramID, "normalMap"), 1);
-   glUniform1i(glGetUniformLocation(mProgramID, "shadowMap"), 2);
-
-   return mProgramID;
-}
-
-Shader::Shader() {
-   vector<GLuint> shaders;
-
-   // Vertex shader
-   const char * vertShader = R"(
-#version 330
+// The main and shadow programs' sources, less their #version lines and
+// the #defines selecting a variant, which VariantDefines supplies
+static const char *const cMainVert = R"(
+#extension GL_ARB_shader_draw_parameters : enable
 
 layout(location = 0) in vec4 in_Position;
-layout(location = 1) in vec3 in_Normal;
+layout(location = 1) in vec4 in_Normal;
 layout(location = 2) in vec2 tex_Coord;
 layout(location = 3) in vec3 in_Tan;
 layout(location = 4) in vec3 in_BiTan;
+layout(location = 5) in mat4 inst_Xfm;
+layout(location = 9) in mat4 inst_TexXfm;
+layout(location = 13) in mat3 inst_NormXfm;   // Inverse transpose of Xfm
+
+layout(std140) uniform Camera {
+   mat4 eyeMvp[2];   // Second used only if stereo
+   mat4 eyeNvp[2];   // mat3 normal transforms, widened
+   vec4 absPos;
+   int stereo;
+};
 
-uniform mat4 mvp;
-uniform mat4 LSM;
+uniform vec3 posScale;
+uniform vec3 posBias;
+uniform samplerBuffer drawParams;
+uniform int drawBase;
 
 out vec4 fragPos;
 out vec3 fragNormal;
 out vec2 fragTexCoord;
 out vec3 fragVPos;
-out vec4 fragLSM;
 out mat3 TBN;
+flat out int fragEye;
+flat out vec2 fragLayers;   // Diffuse and normal layers, normal -1 if none
+flat out vec3 fragUVXfm;    // Diffuse coordinate offset and scale
+
+// unit vector from its octahedral encoding
+vec3 OctDecode(vec2 e) {
+   vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+
+   if (v.z < 0.0)
+      v.xy = (1.0 - abs(v.yx))
+       * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+   return normalize(v);
+}
 
 void main(void) {
-   gl_Position = fragPos = mvp * in_Position;
-  
-   fragVPos = vec3(in_Position);
-   fragNormal = in_Normal;
-   fragTexCoord = tex_Coord;
-   fragLSM = LSM * in_Position;
+   vec4 pos = in_Position;
+   vec3 normal = in_Normal.xyz, tangent = in_Tan, biTangent = in_BiTan;
+   vec4 scale = vec4(posScale, 0.0), bias = vec4(posBias, 0.0);
+   vec4 uvXfm = vec4(0.0, 0.0, 1.0, 0.0);
+
+#if defined(INDIRECT) && defined(GL_ARB_shader_draw_parameters)
+   int param = 3 * (drawBase + gl_DrawIDARB);
+
+   scale = texelFetch(drawParams, param);
+   bias = texelFetch(drawParams, param + 1);
+   uvXfm = texelFetch(drawParams, param + 2);
+#endif
+   fragLayers = vec2(bias.w, scale.w);
+   fragUVXfm = uvXfm.xyz;
+
+#ifdef PACKED
+   pos = vec4(in_Position.xyz * scale.xyz + bias.xyz, 1.0);
+   normal = OctDecode(in_Normal.xy);
+   tangent = OctDecode(in_Normal.zw);
+   biTangent = in_Position.w * cross(normal, tangent);
+#endif
+
+   vec4 worldPos = inst_Xfm * pos;
+
+   // In stereo, instances alternate eyes, each clipped to and squeezed
+   // into its half of the double-wide viewport
+   int eye = stereo != 0 ? gl_InstanceID % 2 : 0;
+   vec4 clip = eyeMvp[eye] * worldPos;
+
+   gl_Position = fragPos = clip;
+   fragEye = eye;
+   if (stereo != 0) {
+      gl_ClipDistance[0] = eye == 0 ? clip.w - clip.x : clip.w + clip.x;
+      gl_Position.x = 0.5 * clip.x + (eye == 0 ? -0.5 : 0.5) * clip.w;
+   }
+
+   fragVPos = vec3(worldPos);
+   fragNormal = inst_NormXfm * normal;
+   fragTexCoord = vec2(inst_TexXfm * vec4(tex_Coord, 0, 1));
    TBN = transpose(mat3(
-      normalize(in_Tan),
-      normalize(in_BiTan),
-      normalize(in_Normal)
+      normalize(mat3(inst_Xfm) * tangent),
+      normalize(mat3(inst_Xfm) * biTangent),
+      normalize(fragNormal)
    ));
 }
 
 )";
 
-   // fragment shader
-   const char * fragShader = R"(
-#version 330
-
+static const char *const cMainFrag = R"(
 precision highp float;
- 
-struct Light 
-{
-   vec4 lPos;
-   vec3 lColor;
+
+layout(std140) uniform Camera {
+   mat4 eyeMvp[2];   // Second used only if stereo
+   mat4 eyeNvp[2];   // mat3 normal transforms, widened
+   vec4 absPos;
+   int stereo;
 };
- 
+
+layout(std140) uniform Lights {
+   mat4 lightVP[15];     // 3 shadow cascades per light
+   vec4 lightPos[5];
+   vec4 lightColor[5];
+   vec4 cascadeSplits;   // View depth at which each cascade ends
+   int numLights;
+   mat4 clusterVP;       // View the point lights were binned under
+   vec4 clusterDims;     // Tiles across and down, and depth slices
+   vec4 clusterDepths;   // Near depth, and slices per unit of log depth
+};
+
 uniform sampler2D tex;
 uniform sampler2D normalMap;
-uniform sampler2D shadowMap;
-uniform mat3 nvp;
-uniform mat4 mvp;
-uniform int numLights;
-uniform Light lights[5];
-uniform bool normMap;
-uniform vec3 absPos;
+uniform sampler2DArrayShadow shadowMaps;
+uniform sampler2DArray texArray;
+uniform sampler2DArray normalArray;
+#ifdef CLUSTERED
+uniform usamplerBuffer clusterGrid;    // Offset and count, by cluster
+uniform usamplerBuffer clusterLists;   // Light indices, cluster by cluster
+uniform samplerBuffer pointLights;     // Position and radius, then color
+#endif
 
 in vec4 fragPos;
-in vec4 fragLSM;
 in vec3 fragNormal;
 in vec3 fragVPos;
 in vec2 fragTexCoord;
 in mat3 TBN;
+flat in int fragEye;
+flat in vec2 fragLayers;
+flat in vec3 fragUVXfm;
 
 out vec4 fragColor;
 
-float ShadowCalculation(vec4 PLS, vec3 lightPos)
+// indirect draws choose their normal maps per draw
+#if !defined(NORMAL_MAP)
+#define NORMAL_MAPPED false
+#elif defined(INDIRECT)
+#define NORMAL_MAPPED (fragLayers.y >= 0.0)
+#else
+#define NORMAL_MAPPED true
+#endif
+
+float ShadowCalculation(int light, vec3 lightPos)
 {
-   // perform perspective divide
-   vec3 projCoords = PLS.xyz / PLS.w;
+#ifndef SHADOWS
+   return 0.0;
+#else
+   // pick the cascade by view depth, which is clip w; past the last,
+   // there is no shadow
+   float depth = fragPos.w;
+   int cascade = depth < cascadeSplits.x ? 0
+    : depth < cascadeSplits.y ? 1 : 2;
 
-   // transform to [0,1] range
-   projCoords = projCoords * 0.5 + 0.5;
+   if (depth >= cascadeSplits.z)
+      return 0.0;
 
-   // get closest depth value from light's perspective 
-   // (using [0,1] range fragPosLight as coords)
-   float closestDepth = texture(shadowMap, projCoords.xy).r; 
+   int layer = 3 * light + cascade;
+   vec4 PLS = lightVP[layer] * vec4(fragVPos, 1.0);
 
-   // get depth of current fragment from light's perspective
-   float currentDepth = projCoords.z;
+   // perform perspective divide, and transform to [0,1] range
+   vec3 projCoords = PLS.xyz / PLS.w * 0.5 + 0.5;
+
+   // keep the shadow at 0.0 when outside the 
+   // far_plane region of the light's frustum.
+   if (projCoords.z > 1.0)
+      return 0.0;
 
    // calculate bias (based on depth map resolution and slope)
    vec3 normal = normalize(fragNormal);
    vec3 lightDir = normalize(lightPos - vec3(fragPos));
    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+   vec4 coord = vec4(projCoords.xy, layer, projCoords.z - bias);
+   vec2 texelSize = 1.0 / textureSize(shadowMaps, 0).xy;
+   float lit = 0.0;
+
+   // each tap is a hardware compare, filtered over its 2x2 texels
+#if SHADOW_TAPS == 1
+   lit = texture(shadowMaps, coord);
+#elif SHADOW_TAPS == 4
+   // Poisson disk, turned by a per-pixel angle so banding becomes noise
+   const vec2 disk[4] = vec2[](vec2(-0.942, -0.399), vec2(0.946, -0.769),
+    vec2(-0.094, -0.929), vec2(0.345, 0.294));
+   float angle = 6.2831853 * fract(sin(dot(gl_FragCoord.xy,
+    vec2(12.9898, 78.233))) * 43758.5453);
+   mat2 turn = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+   for (int i = 0; i < 4; i++)
+      lit += texture(shadowMaps, vec4(coord.xy + 1.5 * turn * disk[i]
+       * texelSize, coord.zw));
+   lit /= 4.0;
+#else
+   for (int x = -1; x <= 1; ++x)
+      for (int y = -1; y <= 1; ++y)
+         lit += texture(shadowMaps, vec4(coord.xy + vec2(x, y) * texelSize,
+          coord.zw));
+   lit /= 9.0;
+#endif
+
+   return 1.0 - lit;
+#endif
+}  
 
-   // check whether current frag pos is in shadow
-   // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-   // PCF
-   float shadow = 0.0;
-   vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-   for(int x = -1; x <= 1; ++x)
-   {
-      for(int y = -1; y <= 1; ++y)
-      {
-         float pcfDepth = texture(
-         shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-         shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
-      }    
+#ifdef CLUSTERED
+// diffuse light of the point lights listed for the fragment's cluster,
+// found from its tile and view depth under the binned view as
+// LightClusters::ClusterOf finds it.  Each light fades smoothly to
+// nothing at its radius, past which binning leaves it out.
+vec3 ClusterLighting(vec3 normal)
+{
+   vec4 clip = clusterVP * vec4(fragVPos, 1.0);
+   float depth = max(clip.w, 1e-4);
+   vec3 cell = floor(vec3((clip.xy / depth * 0.5 + 0.5) * clusterDims.xy,
+    log(depth / clusterDepths.x) * clusterDepths.y));
+   ivec3 c = ivec3(clamp(cell, vec3(0.0), clusterDims.xyz - 1.0));
+   int cluster = (c.z * int(clusterDims.y) + c.y) * int(clusterDims.x)
+    + c.x;
+   uvec2 list = texelFetch(clusterGrid, cluster).xy;
+   vec3 sum = vec3(0.0);
+
+   for (uint i = 0u; i < list.y; i++) {
+      int light = int(texelFetch(clusterLists, int(list.x + i)).x);
+      vec4 posRadius = texelFetch(pointLights, 2 * light);
+      vec3 toLight = posRadius.xyz - fragVPos;
+      float fade = clamp(1.0 - dot(toLight, toLight)
+       / (posRadius.w * posRadius.w), 0.0, 1.0);
+
+      sum += fade * fade * max(dot(normal, normalize(toLight)), 0.0)
+       * texelFetch(pointLights, 2 * light + 1).rgb;
    }
-   shadow /= 9.0;
-    
-   // keep the shadow at 0.0 when outside the 
-   // far_plane region of the light's frustum.
-   if(projCoords.z > 1.0)
-      shadow = 0.0;
-        
-   return shadow;
-}  
+   return sum;
+}
+#endif
 
  
 void main(void) {
@@ -184,172 +259,525 @@ void main(void) {
    vec3 specular = vec3(0.0, 0.0, 0.0);
    vec3 lighting = vec3(0, 0, 0);
 
-   vec3 tempClr = texture(tex, fragTexCoord).rgb;
+   vec2 uv = fragTexCoord * fragUVXfm.z + fragUVXfm.xy;
+#ifdef TEX_ARRAYS
+   vec3 tempClr = texture(texArray, vec3(uv, fragLayers.x)).rgb;
+#else
+   vec3 tempClr = texture(tex, uv).rgb;
+#endif
    ambient = tempClr * .2;
 
-   for (int i = 0; i < numLights; i++) {
-      if (normMap) {
+   for (int i = 0; i < NUM_LIGHTS; i++) {
+      if (NORMAL_MAPPED) {
+#ifdef TEX_ARRAYS
+         vec3 normal = texture(normalArray,
+          vec3(fragTexCoord, fragLayers.y)).rgb;
+#else
          vec3 normal = texture(normalMap, fragTexCoord).rgb;
+#endif
          normal =  normalize(normal * 2.0 - 1.0);
 
          vec3 lightDir = normalize(
-          TBN * vec3(lights[i].lPos) - TBN * fragVPos);
+          TBN * vec3(lightPos[i]) - TBN * fragVPos);
          float diff = max(dot(lightDir, normal), 0.0);
          diffuse = diffuse + (diff * tempClr);
 
-         vec3 viewDir = normalize(TBN * absPos - TBN * fragVPos);
+         vec3 viewDir = normalize(TBN * absPos.xyz - TBN * fragVPos);
          vec3 reflectDir = reflect(-lightDir, normal);
          vec3 halfwayDir = normalize(lightDir + viewDir);  
          float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
          specular = specular + (vec3(0.2) * spec);
 
-         float shadow = ShadowCalculation(fragLSM, lights[i].lPos.xyz);       
+         float shadow = ShadowCalculation(i, lightPos[i].xyz);
          lighting = lighting +
           (ambient + (1.0 - shadow) * (diffuse + specular)) * tempClr; 
       }
       else {
-         vec3 normal = normalize(nvp * fragNormal);
-         vec3 lightVec = normalize(vec3(mvp * lights[i].lPos) - vec3(fragPos));
+         vec3 normal = normalize(mat3(eyeNvp[fragEye]) * fragNormal);
+         vec3 lightVec = normalize(vec3(eyeMvp[fragEye] * lightPos[i])
+          - vec3(fragPos));
 
          float dfsBright = dot(normal, lightVec); 
 	
-         lighting = (dfsBright * lights[i].lColor) * tempClr;
+         float shadow = ShadowCalculation(i, lightPos[i].xyz);
+
+         lighting = (1.0 - shadow) * (dfsBright * lightColor[i].rgb)
+          * tempClr;
       }
    }
+#ifdef CLUSTERED
+   // point lights shade by the surface normal, without normal maps
+   lighting += ClusterLighting(normalize(fragNormal)) * tempClr;
+#endif
    fragColor = vec4(lighting, 1);
 }
 
 )";
 
-   // combine both files into single shader program
-   shaders.push_back(CompileShader(fragShader, GL_FRAGMENT_SHADER));
-   shaders.push_back(CompileShader(vertShader, GL_VERTEX_SHADER));
+static const char *const cShadowVert = R"(
+#extension GL_ARB_shader_draw_parameters : enable
+layout (location = 0) in vec4 aPos;
+layout (location = 5) in mat4 inst_Xfm;
+
+uniform mat4 lightSpaceMatrix;
+uniform vec3 posScale;
+uniform vec3 posBias;
+uniform samplerBuffer drawParams;
+uniform int drawBase;
+
+void main() {
+    vec3 scale = posScale, bias = posBias;
+
+#if defined(INDIRECT) && defined(GL_ARB_shader_draw_parameters)
+    scale = texelFetch(drawParams, 3 * (drawBase + gl_DrawIDARB)).xyz;
+    bias = texelFetch(drawParams, 3 * (drawBase + gl_DrawIDARB) + 1).xyz;
+#endif
+#ifdef PACKED
+    vec4 pos = vec4(aPos.xyz * scale + bias, 1.0);
+#else
+    vec4 pos = aPos;
+#endif
+
+    gl_Position = lightSpaceMatrix * inst_Xfm * pos;
+}  
+
+)";
+
+static const char *const cShadowFrag = R"(
+void main() {             
+}  
+)";
+
+const char *const Shader::cUniformNames[cNumUniforms] = {"tex", "normalMap",
+ "shadowMaps", "drawParams", "texArray", "normalArray", "clusterGrid",
+ "clusterLists", "pointLights", "posScale", "posBias", "drawBase",
+ "lightSpaceMatrix"};
+
+// Start compiling |source| as a shader of the indicated type, leaving
+// its status to CheckShader, so that several compile at once where the
+// driver allows.  Return shaderId.
+GLuint Shader::CompileShader(const char *source, GLenum shdType) {
+   GLuint shdId = glCreateShader(shdType);
+
+   glShaderSource(shdId, (GLsizei)1, &source, NULL);
+   glCompileShader(shdId);
+   GLChkErr;
+   return shdId;
+}
+
+// Throw shader shdId's compile errors, if any, as an exception
+void Shader::CheckShader(GLuint shdId) {
+   int ok;
+   constexpr int cMaxLogLen = 1000;
+   char logBuf[cMaxLogLen + 1];
+
+   glGetShaderiv(shdId, GL_COMPILE_STATUS, &ok);
+   if (!ok) {
+      glGetShaderInfoLog(shdId, cMaxLogLen, NULL, logBuf);
+      throw WorldException(logBuf);
+   }
+}
+
+// Load *prog from the ProgramCache and set it up, returning false, or
+// failing that start compiling vert and frag and linking them into it,
+// returning true with *build filled in for FinishPrograms
+bool Shader::StartProgram(const string &vert, const string &frag,
+ Program *prog, Build *build) {
+   build->mProg = prog;
+   build->mKey = ProgramCache::MakeKey({vert, frag});
+   prog->mId = glCreateProgram(); GLChkErr;
+   if (ProgramCache::Load(build->mKey, prog->mId)) {
+      SetupProgram(prog);
+      return false;
+   }
 
-   mProgramID = LinkShaders(shaders);
+   build->mShaders.push_back(CompileShader(frag.c_str(),
+    GL_FRAGMENT_SHADER));
+   build->mShaders.push_back(CompileShader(vert.c_str(), GL_VERTEX_SHADER));
+   for (auto shdId : build->mShaders)
+      glAttachShader(prog->mId, shdId);
+   if (ProgramCache::Enabled())
+      glProgramParameteri(prog->mId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+       GL_TRUE);
+   glLinkProgram(prog->mId);
+   GLChkErr;
+   return true;
 }
 
-/// set up shader lightsources and large ambient light
-void Shader::Configure(vector<LightSource> lights, mat4 LSM) {
+// Finish each build as the driver completes it, polling completion where
+// KHR_parallel_shader_compile runs compiles on its own threads, or else
+// in order, each status check waiting for its program
+void Shader::FinishPrograms(vector<Build> *builds) {
+   while (!builds->empty()) {
+      for (uint b = 0; b < builds->size();) {
+         GLint done = GL_TRUE;
+
+         if (GLEW_KHR_parallel_shader_compile)
+            glGetProgramiv((*builds)[b].mProg->mId, GL_COMPLETION_STATUS_KHR,
+             &done);
+         if (done) {
+            FinishProgram((*builds)[b]);
+            builds->erase(builds->begin() + b);
+         }
+         else
+            b++;
+      }
+      if (!builds->empty())
+         this_thread::yield();
+   }
+}
 
-   glUseProgram(mProgramID);   GLChkErr;
+// Check a build's link, or failing that its compiles, throwing any errors
+// as an exception, then set its program up and save it to the cache
+void Shader::FinishProgram(const Build &build) {
+   int ok;
+   constexpr int cMaxLogLen = 1000;
+   char logBuf[cMaxLogLen + 1];
+   GLuint id = build.mProg->mId;
 
-   // passes Ambient light source
-   glUniformMatrix4fv(glGetUniformLocation(mProgramID, "LSM"),
-      1, GL_FALSE ,&(LSM)[0][0]); GLChkErr;
+   glGetProgramiv(id, GL_LINK_STATUS, &ok);
+   if (!ok) {
+      for (auto shdId : build.mShaders)
+         CheckShader(shdId);
+      glGetProgramInfoLog(id, cMaxLogLen, NULL, logBuf); GLChkErr;
+      throw WorldException(logBuf);
+   }
 
-   glUniform1i(glGetUniformLocation(mProgramID, "numLights"), lights.size());
+   for (auto shdId : build.mShaders) {
+      glDetachShader(id, shdId);
+      glDeleteShader(shdId);
+   }
    GLChkErr;
+   SetupProgram(build.mProg);
+   ProgramCache::Save(build.mKey, id);
+}
 
-   // passes loc and intesity of all point lights in scene
-   for (int i = 0; i < lights.size(); i++) {
-      glUniform4fv(
-       glGetUniformLocation(mProgramID,
-       StringPrintf("lights[%d].lPos", i).c_str()), 
-       1, value_ptr(lights[i].location)); GLChkErr;
-
-      glUniform3fv(
-       glGetUniformLocation(mProgramID,
-       StringPrintf("lights[%d].lColor", i).c_str()),
-       1, value_ptr(lights[i].intensity)); GLChkErr;
+// Reflect linked program *prog's uniforms, bind its uniform blocks and
+// point its samplers at their texture units
+void Shader::SetupProgram(Program *prog) {
+   GLuint block;
+
+   Reflect(prog);
+
+   // GLSL 330 has no binding layout, so blocks are bound here
+   block = glGetUniformBlockIndex(prog->mId, "Camera"); GLChkErr;
+   if (block != GL_INVALID_INDEX)
+      glUniformBlockBinding(prog->mId, block, cCameraBinding);
+   block = glGetUniformBlockIndex(prog->mId, "Lights"); GLChkErr;
+   if (block != GL_INVALID_INDEX)
+      glUniformBlockBinding(prog->mId, block, cLightsBinding);
+
+   UseProgram(*prog);
+
+   // set the active texture values for each texture
+   glUniform1i(prog->mLocs[cTex], 0);
+   glUniform1i(prog->mLocs[cNormalMap], 1);
+   glUniform1i(prog->mLocs[cShadowMap], 2);
+   glUniform1i(prog->mLocs[cDrawParams], 3);
+   glUniform1i(prog->mLocs[cTexArray], 4);
+   glUniform1i(prog->mLocs[cNormalArray], 5);
+   glUniform1i(prog->mLocs[cClusterGrid], 6);
+   glUniform1i(prog->mLocs[cClusterLists], 7);
+   glUniform1i(prog->mLocs[cPointLights], 8);
+   GLChkErr;
+}
+
+// Locate each uniform of cUniformNames the program has, by walking its
+// active uniforms, so that nothing looks a uniform up by name after link
+void Shader::Reflect(Program *prog) {
+   constexpr int cMaxNameLen = 256;
+   char name[cMaxNameLen];
+   GLint count, size;
+   GLenum type;
+
+   fill(prog->mLocs, prog->mLocs + cNumUniforms, -1);
+   glGetProgramiv(prog->mId, GL_ACTIVE_UNIFORMS, &count); GLChkErr;
+   for (GLint i = 0; i < count; i++) {
+      glGetActiveUniform(prog->mId, i, cMaxNameLen, NULL, &size, &type,
+       name); GLChkErr;
+      for (uint u = 0; u < cNumUniforms; u++)
+         if (!strcmp(name, cUniformNames[u]))
+            prog->mLocs[u] = glGetUniformLocation(prog->mId, name);
    }
 }
 
-/// passes values for current render to shader
-void Shader::Run(const glm::mat4x4 &xfm, vec3 absPos) {
-   glUseProgram(mProgramID); GLChkErr;
+// Make prog current, if it isn't already
+void Shader::UseProgram(Program &prog) {
+   if (mCurrent != &prog) {
+      glUseProgram(prog.mId); GLChkErr;
+      mCurrent = &prog;
+   }
+}
+
+// Create the Camera buffer, with room for cCameraSlots views at the
+// implementation's binding alignment, and the Lights buffer, bound whole
+void Shader::CreateBlocks() {
+   GLint align;
 
-   glUniform3fv(
-    glGetUniformLocation(mProgramID, "absPos"), 1, &absPos[0]); GLChkErr;
+   glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align); GLChkErr;
+   mCameraStride = ((GLint)sizeof(CameraBlock) + align - 1) / align * align;
 
-   glUniformMatrix4fv(glGetUniformLocation(mProgramID, "mvp"), 1,
-    GL_FALSE, &(xfm)[0][0]); GLChkErr;
+   glGenBuffers(1, &mCameraUBO); GLChkErr;
+   glBindBuffer(GL_UNIFORM_BUFFER, mCameraUBO); GLChkErr;
+   glBufferData(GL_UNIFORM_BUFFER, cCameraSlots * mCameraStride, NULL,
+      GL_DYNAMIC_DRAW); GLChkErr;
 
-   mat3 nvp = transpose(inverse(mat3(xfm)));
-   glUniformMatrix3fv(glGetUniformLocation(mProgramID, "nvp"), 1, GL_FALSE,
-    &nvp[0][0]); GLChkErr;
+   glGenBuffers(1, &mLightsUBO); GLChkErr;
+   glBindBuffer(GL_UNIFORM_BUFFER, mLightsUBO); GLChkErr;
+   glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), NULL,
+      GL_DYNAMIC_DRAW); GLChkErr;
+   glBindBufferBase(GL_UNIFORM_BUFFER, cLightsBinding, mLightsUBO);
+   GLChkErr;
 }
 
-/// tells the shader if a normal map is in use.
-void Shader::SetNMap(bool nMap) {
-   glUniform1i(glGetUniformLocation(mProgramID, "normMap"), nMap); GLChkErr;
+// The #defines selecting variant key's features, after the #version line
+static string VariantDefines(uint key, uint shadowTaps) {
+   string defs = StringPrintf("#version 330\n#define NUM_LIGHTS %u\n"
+    "#define SHADOW_TAPS %u\n", key >> Shader::cLightsShift, shadowTaps);
+
+   if (key & Shader::cNormalMapped)
+      defs += "#define NORMAL_MAP\n";
+   if (key & Shader::cShadows)
+      defs += "#define SHADOWS\n";
+   if (key & Shader::cPacked)
+      defs += "#define PACKED\n";
+   if (key & Shader::cIndirect)
+      defs += "#define INDIRECT\n";
+   if (key & Shader::cTexArrays)
+      defs += "#define TEX_ARRAYS\n";
+   if (key & Shader::cClustered)
+      defs += "#define CLUSTERED\n";
+   return defs;
 }
 
-/// Sets up and creates single pass render shadow map
-void Shader::SetShadowMap(mat4 lightSpaceMatrix) {
-   vector<GLuint> shaders;
+// Start building the variant of key, adding it to *builds if not cached
+void Shader::StartVariant(uint key, vector<Build> *builds) {
+   string defs = VariantDefines(key, mShadowTaps);
+   Build build;
 
-   // vertex shader
-   const char * vertShader = R"(
-#version 330
-layout (location = 0) in vec4 aPos;
+   if (StartProgram(defs + cMainVert, defs + cMainFrag, &mVariants[key],
+    &build))
+      builds->push_back(build);
+}
 
-uniform mat4 lightSpaceMatrix;
+// Start building the shadow program, decoding vertices as the packed and
+// indirect features ask, adding it to *builds if not cached
+void Shader::StartShadow(vector<Build> *builds) {
+   string defs = VariantDefines(mFeatures & (cPacked | cIndirect),
+    mShadowTaps);
+   Build build;
 
-void main() {
-    gl_Position = lightSpaceMatrix * aPos;
-}  
+   if (StartProgram(defs + cShadowVert, defs + cShadowFrag, &mShadow,
+    &build))
+      builds->push_back(build);
+}
 
-)";
+// The variant of key, built now if need be.  This may be mid-frame, so it
+// reports nothing; Precompile reports setup.
+Shader::Program &Shader::Variant(uint key) {
+   auto found = mVariants.find(key);
+   vector<Build> builds;
 
-   // fragment shader
-   const char * fragShader = R"(
-#version 330
-void main() {             
-}  
-)";
+   if (found != mVariants.end())
+      return found->second;
 
-   int ok;
-   constexpr int cMaxLogLen = 1000;
-   char logBuf[cMaxLogLen + 1];
+   StartVariant(key, &builds);
+   FinishPrograms(&builds);
+   return mVariants[key];
+}
 
-   // Create an empty vertex shader handle
-   int SSVertID = glCreateShader(GL_FRAGMENT_SHADER);
+/// compiles nothing; each variant is built on first use, or by Precompile.
+/// Where the driver can compile on threads of its own, it may use as many
+/// as it likes.
+Shader::Shader(uint shadowTaps) : mShadowTaps(shadowTaps) {
+   if (shadowTaps != 1 && shadowTaps != 4 && shadowTaps != 9)
+      throw WorldException("Shadow kernels have 1, 4 or 9 taps");
 
-   // Send the vertex shader source code to OpenGL
-   glShaderSource(SSVertID, (GLsizei)1, &fragShader, NULL);
+   if (GLEW_KHR_parallel_shader_compile) {
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); GLChkErr;
+   }
+   CreateBlocks();
+}
 
-   GL_TRUE;
+/// the settings' features, those given, and the configured light count
+uint Shader::MakeKey(uint features) const {
+   return mFeatures | features | (uint)mLights.size() << cLightsShift;
+}
 
-   glCompileShader(SSVertID);
-   glGetShaderiv(SSVertID, GL_COMPILE_STATUS, &ok);
-   if (!ok) {
-      glGetShaderInfoLog(SSVertID, cMaxLogLen, NULL, logBuf);
-      throw WorldException(logBuf);
+/// the main program variant for a batch with these features
+void Shader::UseVariant(uint features) {
+   UseProgram(Variant(MakeKey(features)));
+}
+
+/// starts every program not yet built, loading what it can from the
+/// ProgramCache, then finishes the rest as their compiles complete
+void Shader::Precompile(const vector<uint> &features) {
+   auto start = chrono::high_resolution_clock::now();
+   vector<Build> builds;
+   uint programs = 0, compiles;
+
+   for (uint f : features)
+      if (!mVariants.count(MakeKey(f))) {
+         StartVariant(MakeKey(f), &builds);
+         programs++;
+      }
+   if ((mFeatures & cShadows) && !mShadow.mId) {
+      StartShadow(&builds);
+      programs++;
    }
+   compiles = (uint)builds.size();
+   FinishPrograms(&builds);
 
+   chrono::duration<double, milli> elapsed =
+    chrono::high_resolution_clock::now() - start;
+   printf("shader setup %u programs, %u from cache, %.1f ms\n", programs,
+    programs - compiles, elapsed.count());
+}
 
-   // Create an empty vertex shader handle
-   int SSFragID = glCreateShader(GL_VERTEX_SHADER);
+/// as "normalmap shadows packed 5 lights"
+string Shader::VariantName(uint key) {
+   static const char *const cNames[] = {"normalmap", "shadows", "packed",
+    "indirect", "texarrays", "clustered"};
+   string name;
+
+   for (uint f = 0; f < sizeof(cNames) / sizeof(*cNames); f++)
+      if (key & 1u << f)
+         name += string(cNames[f]) + " ";
+   return name + StringPrintf("%u light%s", key >> cLightsShift,
+    key >> cLightsShift == 1 ? "" : "s");
+}
 
-   // Send the vertex shader source code to OpenGL
-   glShaderSource(SSFragID, (GLsizei)1, &vertShader, NULL);
+/// uploads the Lights block, if it changed since the last upload
+void Shader::UploadLights(const LightsBlock &block) {
+   if (!mLightsValid || memcmp(&block, &mLightsData, sizeof(block))) {
+      mLightsData = block;
+      mLightsValid = true;
+      glBindBuffer(GL_UNIFORM_BUFFER, mLightsUBO); GLChkErr;
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+      GLChkErr;
+   }
+}
 
-   GL_TRUE;
+/// set up shader lightsources and shadow cascades, keeping the clusters
+/// last set, uploading the Lights block only if any changed
+void Shader::Configure(const vector<LightSource> &lights,
+ const vector<mat4> &lightVPs, const vec4 &splits) {
+   LightsBlock block{};
+
+   if (lights.size() > cMaxLights)
+      throw WorldException("Shader supports at most 5 lights");
+   if (lightVPs.size() > cMaxLights * cCascades)
+      throw WorldException("Too many shadow cascades");
+
+   // value-initialized, padding fields included, so blocks compare
+   // bytewise
+   copy(lightVPs.begin(), lightVPs.end(), block.mLightVP);
+   block.mSplits = splits;
+   for (uint i = 0; i < lights.size(); i++) {
+      block.mPos[i] = lights[i].location;
+      block.mColor[i] = vec4(lights[i].intensity, 1.0f);
+   }
+   block.mNumLights = (GLint)lights.size();
+   if (mLightsValid) {
+      block.mClusterVP = mLightsData.mClusterVP;
+      block.mClusterDims = mLightsData.mClusterDims;
+      block.mClusterDepths = mLightsData.mClusterDepths;
+   }
+   mLights = lights;
+   UploadLights(block);
+}
 
-   glCompileShader(SSFragID);
-   glGetShaderiv(SSFragID, GL_COMPILE_STATUS, &ok);
+/// replaces just the cluster fields of the Lights block, uploading it
+/// only if they changed
+void Shader::SetClusters(const mat4 &vp, const vec4 &dims,
+ const vec4 &depths) {
+   LightsBlock block{};
+
+   if (mLightsValid)
+      block = mLightsData;
+   block.mClusterVP = vp;
+   block.mClusterDims = dims;
+   block.mClusterDepths = depths;
+   UploadLights(block);
+}
 
-   if (!ok) {
-      glGetShaderInfoLog(SSFragID, cMaxLogLen, NULL, logBuf);
-      throw WorldException(logBuf);
+/// passes values for current render to shader.  A view already in a
+/// camera slot is only bound; a new one replaces the oldest slot.  The
+/// block is value-initialized so unused eyes and padding compare equal.
+void Shader::RunViews(const glm::mat4x4 *xfms, uint views, vec3 absPos) {
+   CameraBlock cam{};
+   uint slot;
+
+   for (uint v = 0; v < views; v++) {
+      cam.mMvp[v] = xfms[v];
+      cam.mNvp[v] = mat4(transpose(inverse(mat3(xfms[v]))));
    }
-   
-   mShdwPID = glCreateProgram();
+   cam.mAbsPos = vec4(absPos, 1.0f);
+   cam.mStereo = views > 1;
+
+   for (slot = 0; slot < cCameraSlots; slot++)
+      if (mCameraValid[slot] && !memcmp(&cam, &mCameras[slot], sizeof(cam)))
+         break;
+
+   if (slot == cCameraSlots) {
+      slot = mNextCamera;
+      mNextCamera = (mNextCamera + 1) % cCameraSlots;
+      mCameras[slot] = cam;
+      mCameraValid[slot] = true;
+      glBindBuffer(GL_UNIFORM_BUFFER, mCameraUBO); GLChkErr;
+      glBufferSubData(GL_UNIFORM_BUFFER, slot * mCameraStride, sizeof(cam),
+         &cam); GLChkErr;
+   }
+   glBindBufferRange(GL_UNIFORM_BUFFER, cCameraBinding, mCameraUBO,
+      slot * mCameraStride, sizeof(cam)); GLChkErr;
+}
 
-   glAttachShader(mShdwPID, SSVertID);
-   glAttachShader(mShdwPID, SSFragID);
+/// a single view
+void Shader::Run(const glm::mat4x4 &xfm, vec3 absPos) {
+   RunViews(&xfm, 1, absPos);
+}
 
-   glLinkProgram(mShdwPID);
-   glGetProgramiv(mShdwPID, GL_LINK_STATUS, &ok);
+/// both eyes, for single-pass instanced stereo
+void Shader::RunStereo(const glm::mat4x4 &left, const glm::mat4x4 &right,
+ vec3 absPos) {
+   mat4 xfms[2] = {left, right};
 
-   if (!ok) {
-      glGetProgramInfoLog(mShdwPID, cMaxLogLen, NULL, logBuf); GLChkErr;
-      throw WorldException(logBuf);
+   RunViews(xfms, 2, absPos);
+}
+
+/// shadow every later variant; the shadow program is built with the
+/// next Precompile, or on first use
+void Shader::SetShadowMap() {
+   mFeatures |= cShadows;
+}
+
+/// sets the shadow program's light space matrix, for one cascade
+void Shader::SetShadowView(const mat4 &lightVP) {
+   vector<Build> builds;
+
+   if (!mShadow.mId) {
+      StartShadow(&builds);
+      FinishPrograms(&builds);
    }
+   UseProgram(mShadow);
+   glUniformMatrix4fv(mShadow.mLocs[cLightSpaceMatrix], 1, GL_FALSE,
+    glm::value_ptr(lightVP)); GLChkErr;
+}
 
-   glUseProgram(mShdwPID);
+/// sets or clears feature f in every later variant
+void Shader::SetFeature(Feature f, bool on) {
+   mFeatures = on ? mFeatures | f : mFeatures & ~f;
+}
+
+/// scale and bias mapping packed snorm positions to model coordinates, for
+/// whichever of the main or shadow programs is in use
+void Shader::SetPosDecode(const vec3 &scale, const vec3 &bias) {
+   glUniform3fv(mCurrent->mLocs[cPosScale], 1, &scale[0]); GLChkErr;
+   glUniform3fv(mCurrent->mLocs[cPosBias], 1, &bias[0]); GLChkErr;
+}
 
-   // pass in transformation matrix
-   glUniformMatrix4fv(glGetUniformLocation(mProgramID, "lightSpaceMatrix"),
-    1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+/// first command of the next multi-draw, for whichever of the main or
+/// shadow programs is in use
+void Shader::SetDrawBase(int base) {
+   glUniform1i(mCurrent->mLocs[cDrawBase], base); GLChkErr;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <map>
+#include <string>
 #include <vector>
 #include <GL/glew.h>
 
@@ -15,22 +17,166 @@ struct LightSource {
 
 /// single instance shader class
 class Shader {
+public:
+   // Every uniform outside a block that either program reads, each located
+   // once at link time.  Names are in cUniformNames.
+   enum Uniform {cTex, cNormalMap, cShadowMap, cDrawParams, cTexArray,
+    cNormalArray, cClusterGrid, cClusterLists, cPointLights, cPosScale,
+    cPosBias, cDrawBase, cLightSpaceMatrix, cNumUniforms};
+
+   // Features of a main program variant, each a #define of the one
+   // source, so its fragment path has no branches on them.  A variant's
+   // key adds its light count, shifted by cLightsShift.
+   enum Feature {cNormalMapped = 1, cShadows = 2, cPacked = 4, cIndirect = 8,
+    cTexArrays = 16, cClustered = 32};
+   static constexpr uint cLightsShift = 6;
+
+   static constexpr uint cMaxLights = 5;
+   static constexpr uint cCascades = 3;      // Shadow cascades per light
+   static constexpr uint cCameraSlots = 4;   // Distinct views kept resident
+
 protected:
+   // A linked program and its uniform locations, -1 for any it lacks
+   struct Program {
+      GLuint mId = 0;
+      GLint mLocs[cNumUniforms];
+   };
+
+   // std140 mirrors of the Camera and Lights uniform blocks.  nvp is a
+   // mat3 widened to mat4, which std140 pads it to anyway.  A mono view
+   // fills only the first eye; a stereo one sets mStereo and both.  The
+   // cluster fields are as LightClusters' GetVP, GetDims and GetDepths.
+   struct CameraBlock {
+      glm::mat4 mMvp[2];
+      glm::mat4 mNvp[2];
+      glm::vec4 mAbsPos;
+      GLint mStereo;
+      GLint mPad[3];
+   };
+   struct LightsBlock {
+      glm::mat4 mLightVP[cMaxLights * cCascades];
+      glm::vec4 mPos[cMaxLights];
+      glm::vec4 mColor[cMaxLights];
+      glm::vec4 mSplits;
+      GLint mNumLights;
+      GLint mPad[3];
+      glm::mat4 mClusterVP;
+      glm::vec4 mClusterDims;
+      glm::vec4 mClusterDepths;
+   };
+
+   // A program whose compile and link were started but not checked, and
+   // its ProgramCache key
+   struct Build {
+      Program *mProg;
+      std::vector<GLuint> mShaders;
+      std::string mKey;
+   };
+
+   static const char *const cUniformNames[cNumUniforms];
+
    std::vector<LightSource> mLights;
-   GLuint mProgramID;
-   GLuint mShdwPID;
-   GLuint mTexLoc;
-   GLuint mNormalMap;
+   std::map<uint, Program> mVariants;   // Main program variants, by key
+   Program mShadow;
+   Program *mCurrent = nullptr;   // Last passed to UseProgram
+   uint mFeatures = 0;            // Set for every variant
+   uint mShadowTaps;
+
+   // Camera blocks live in cCameraSlots slots of mCameraUBO, mCameraStride
+   // bytes apart, so each eye of a stereo display keeps its own and an
+   // unmoved view uploads nothing.  The Lights block is uploaded only
+   // when Configure changes it.
+   GLuint mCameraUBO = 0, mLightsUBO = 0;
+   GLint mCameraStride = 0;
+   CameraBlock mCameras[cCameraSlots];
+   bool mCameraValid[cCameraSlots] = {};
+   uint mNextCamera = 0;
+   LightsBlock mLightsData;
+   bool mLightsValid = false;
 
    static GLuint CompileShader(const char *, GLenum);
-   GLuint LinkShaders(std::vector<GLuint>);
+   static void CheckShader(GLuint);
+   bool StartProgram(const std::string &vert, const std::string &frag,
+    Program *, Build *);
+   void FinishPrograms(std::vector<Build> *);
+   void FinishProgram(const Build &);
+   void SetupProgram(Program *);
+   static void Reflect(Program *);
+   void UseProgram(Program &);
+   void StartVariant(uint key, std::vector<Build> *);
+   void StartShadow(std::vector<Build> *);
+   Program &Variant(uint key);
+   uint MakeKey(uint features) const;
+   void CreateBlocks();
+   void UploadLights(const LightsBlock &);
+   void RunViews(const glm::mat4x4 *xfms, uint views, glm::vec3 absPos);
 
 public:
-   Shader();
+   // Variants will use a shadow kernel of shadowTaps hardware compares,
+   // each filtered over 2x2 texels: 1, a rotated 4-tap Poisson disk, or a
+   // 3x3 grid
+   Shader(uint shadowTaps = 9);
+
+   // Use the main program variant for a batch with features, usually just
+   // cNormalMapped or not, plus those set by SetFeature and SetShadowMap and
+   // the light count from Configure.  Variants are built on first use.
+   void UseVariant(uint features);
+
+   // Build the variants for each of features, and the shadow program if
+   // shadowing, ahead of their first use: loaded from the ProgramCache
+   // where it has them, and otherwise all compiled at once, in parallel
+   // where the driver has KHR_parallel_shader_compile
+   void Precompile(const std::vector<uint> &features);
+
+   static std::string VariantName(uint key);
+   uint GetVariantCount() const {return (uint)mVariants.size();}
+
+   // Set the lights, at most cMaxLights, with each light's cCascades
+   // shadow cascade matrices in turn, and the view depth at which each
+   // cascade ends
+   void Configure(const std::vector<LightSource> &,
+    const std::vector<glm::mat4> &lightVPs, const glm::vec4 &splits);
+
+   // Set the view, grid size and depth slicing of the light clusters that
+   // cClustered variants find their point lights in, as LightClusters
+   // reports them
+   void SetClusters(const glm::mat4 &vp, const glm::vec4 &dims,
+    const glm::vec4 &depths);
+
+   // View through xfm from absPos, in whichever variant draws next
+   void Run(const glm::mat4x4 &xfm, glm::vec3 absPos);
+
+   // As Run, but for both eyes in one pass: each instance is drawn twice,
+   // even instances through left into the left half of the viewport, and
+   // odd ones through right into the right half.  Draws must use twice
+   // the instances, with instance attributes advancing every two, and
+   // GL_CLIP_DISTANCE0 enabled.
+   void RunStereo(const glm::mat4x4 &left, const glm::mat4x4 &right,
+    glm::vec3 absPos);
+
+   // Shadow every later variant, and have the next Precompile, or else
+   // the first SetShadowView, build the shadow program
+   void SetShadowMap();
+
+   // Use the shadow program, rendering depth through lightVP
+   void SetShadowView(const glm::mat4 &lightVP);
+
+   // Set a feature of every later variant: cPacked for PackedVertex
+   // decoding, cIndirect for indirect submission, in which each draw's
+   // position decode, texture layers and diffuse coordinate transform
+   // come from the three texels at 3 * (drawBase + gl_DrawIDARB) of the
+   // buffer texture on unit 3, or cTexArrays to sample diffuse and normal
+   // maps from the texture arrays on units 4 and 5, at each draw's
+   // layers, which needs cIndirect, or cClustered to add the point
+   // lights of each fragment's cluster, from the LightClusters buffer
+   // textures on units 6 to 8.  Set cPacked and cIndirect before
+   // SetShadowMap, which reads them for the shadow program.
+   void SetFeature(Feature, bool);
+
+   // Set the current program's scale and bias for packed positions
+   void SetPosDecode(const glm::vec3 &scale, const glm::vec3 &bias);
 
-   void UseShader() {glUseProgram(mProgramID);}
-   void Configure(std::vector<LightSource>, glm::mat4);
-   void Run(const glm::mat4x4 &, glm::vec3);
-   void SetNMap(bool);
-   void SetShadowMap(glm::mat4);
+   // Set the current program's index of the first command of the next
+   // multi-draw among those uploaded
+   void SetDrawBase(int);
 };
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ShadowMaps.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+ShadowMaps Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// light l's view, from outside the scene bounds looking through their
+/// center, and the depth range holding them
+void ShadowMaps::FitLight(uint l) {
+   vec3 center = mScene.Empty() ? vec3(0.0f) : mScene.Center();
+   float radius = mScene.Empty() ? 1.0f : length(mScene.Extent()) + 1.0f;
+   vec3 dir = mLights[l].w == 0.0f ? -vec3(mLights[l])
+    : center - vec3(mLights[l]);
+   vec3 up(0.0f, 1.0f, 0.0f);
+   Aabb box;
+
+   dir = length(dir) > 1e-4f ? normalize(dir) : vec3(0.0f, -1.0f, 0.0f);
+   if (fabs(dir.y) > 0.99f)
+      up = vec3(0.0f, 0.0f, 1.0f);
+
+   mViews[l] = lookAt(center - dir * radius, center, up);
+   box = mScene.Empty() ? Aabb(vec3(-1.0f), vec3(1.0f))
+    : mScene.Transform(mViews[l]);
+
+   // the light looks down -z
+   mDepths[l] = vec2(-box.mMax.z - 0.1f, -box.mMin.z + 0.1f);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+ShadowMaps Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// compares lights and bounds against the last Setup's
+void ShadowMaps::Setup(const vector<LightSource> &lights, const Aabb &scene) {
+   bool sceneMoved = scene.mMin != mScene.mMin || scene.mMax != mScene.mMax;
+
+   if (lights.size() > Shader::cMaxLights)
+      throw WorldException("ShadowMaps supports at most 5 lights");
+
+   mScene = scene;
+   mLights.resize(lights.size(), vec4(NAN));
+   mViews.resize(lights.size());
+   mDepths.resize(lights.size());
+   mCascades.resize(lights.size() * cCascades,
+    {mat4(1.0f), vec2(0.0f), 0.0f, true});
+
+   for (uint l = 0; l < lights.size(); l++) {
+      if (!sceneMoved && lights[l].location == mLights[l])
+         continue;
+
+      mLights[l] = lights[l].location;
+      FitLight(l);
+      for (uint c = 0; c < cCascades; c++) {
+         mCascades[l * cCascades + c].mHalf = 0.0f;
+         mCascades[l * cCascades + c].mDirty = true;
+      }
+   }
+}
+
+/// splits view depth between the near plane and the shadow distance
+/// mostly logarithmically, so near cascades are small and sharp.  The
+/// slices' corners run along the volume's edges, found by inverting vp,
+/// and the eye's distance to the near plane comes from how much wider
+/// the far plane is.  Each slice's bounding sphere, in light space, must
+/// lie within its cascade's square, which otherwise recenters on it
+/// with a cSlack margin, snapped to whole texels so edges don't shimmer.
+/// Square sizes are rounded up to eighths of an octave, so the slight
+/// wobble of a moving view's radii doesn't resize them.
+void ShadowMaps::Fit(const mat4 &vp) {
+   mat4 inv = inverse(vp);
+   vec3 nearPts[4], farPts[4], nearCtr(0.0f), farCtr(0.0f);
+   float nearD, farD, widen, splits[cCascades + 1];
+
+   for (uint k = 0; k < 4; k++) {
+      vec4 n = inv * vec4(k & 1 ? 1.0f : -1.0f, k & 2 ? 1.0f : -1.0f,
+       -1.0f, 1.0f);
+      vec4 f = inv * vec4(k & 1 ? 1.0f : -1.0f, k & 2 ? 1.0f : -1.0f,
+       1.0f, 1.0f);
+
+      nearPts[k] = vec3(n) / n.w;
+      farPts[k] = vec3(f) / f.w;
+      nearCtr += 0.25f * nearPts[k];
+      farCtr += 0.25f * farPts[k];
+   }
+   widen = length(farPts[0] - farCtr) / length(nearPts[0] - nearCtr);
+   farD = length(farCtr - nearCtr);
+   nearD = widen > 1.001f ? farD / (widen - 1.0f) : 0.0f;
+   farD += nearD;
+
+   splits[0] = nearD;
+   for (uint c = 1; c <= cCascades; c++) {
+      float reach = std::min(farD, mDistance), frac = (float)c / cCascades;
+      float lin = nearD + (reach - nearD) * frac;
+      float lg = std::max(nearD, 0.01f) * pow(reach / std::max(nearD,
+       0.01f), frac);
+
+      splits[c] = cSplitBlend * lg + (1.0f - cSplitBlend) * lin;
+      mSplits[c - 1] = splits[c];
+   }
+
+   for (uint c = 0; c < cCascades; c++) {
+      vec3 pts[8], ctr(0.0f);
+      float radius = 0.0f;
+
+      for (uint k = 0; k < 4; k++)
+         for (uint e = 0; e < 2; e++) {
+            float t = (splits[c + e] - nearD) / (farD - nearD);
+
+            pts[2 * k + e] = mix(nearPts[k], farPts[k], t);
+            ctr += 0.125f * pts[2 * k + e];
+         }
+      for (auto &pt : pts)
+         radius = std::max(radius, length(pt - ctr));
+
+      for (uint l = 0; l < mViews.size(); l++) {
+         Cascade &cas = mCascades[l * cCascades + c];
+         vec2 lc = vec2(mViews[l] * vec4(ctr, 1.0f));
+         float half = exp2(ceil(8.0f * log2(radius * (1.0f + cSlack)))
+          / 8.0f), texel;
+
+         if (cas.mHalf == half && fabs(lc.x - cas.mCenter.x) <= half - radius
+          && fabs(lc.y - cas.mCenter.y) <= half - radius)
+            continue;
+
+         texel = 2.0f * half / cSize;
+         cas.mCenter = floor(lc / texel + 0.5f) * texel;
+         cas.mHalf = half;
+         cas.mVP = ortho(cas.mCenter.x - half, cas.mCenter.x + half,
+          cas.mCenter.y - half, cas.mCenter.y + half, mDepths[l].x,
+          mDepths[l].y) * mViews[l];
+         cas.mDirty = true;
+      }
+   }
+}
+
+/// tests bounds in each light's view against each square and depth range
+void ShadowMaps::Invalidate(const Aabb &bounds) {
+   if (bounds.Empty())
+      return;
+
+   for (uint l = 0; l < mViews.size(); l++) {
+      Aabb box = bounds.Transform(mViews[l]);
+
+      if (-box.mMin.z < mDepths[l].x || -box.mMax.z > mDepths[l].y)
+         continue;
+      for (uint c = 0; c < cCascades; c++) {
+         Cascade &cas = mCascades[l * cCascades + c];
+
+         if (box.mMax.x >= cas.mCenter.x - cas.mHalf
+          && box.mMin.x <= cas.mCenter.x + cas.mHalf
+          && box.mMax.y >= cas.mCenter.y - cas.mHalf
+          && box.mMin.y <= cas.mCenter.y + cas.mHalf)
+            cas.mDirty = true;
+      }
+   }
+}
+
+/// depth 1 beyond the edges, so what no cascade covers is lit.  Sampled
+/// as sampler2DArrayShadow, so each lookup compares, and linear filtering
+/// blends the compares of its 2x2 texels.
+void ShadowMaps::Create() {
+   GLfloat border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+
+   glGenTextures(1, &mTexture); GLChkErr;
+   glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture); GLChkErr;
+   glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, cSize, cSize,
+    std::max(1u, GetLayers()), 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+   GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+    GL_COMPARE_REF_TO_TEXTURE); GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+   GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S,
+    GL_CLAMP_TO_BORDER); GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T,
+    GL_CLAMP_TO_BORDER); GLChkErr;
+   glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+   GLChkErr;
+   glBindTexture(GL_TEXTURE_2D_ARRAY, 0); GLChkErr;
+}
+
+/// leaves unit 0 active, as the Texture classes expect
+void ShadowMaps::Use() const {
+   glActiveTexture(GL_TEXTURE2); GLChkErr;
+   glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture); GLChkErr;
+   glActiveTexture(GL_TEXTURE0); GLChkErr;
+}
+
+/// the layer's map now matches its cascade
+void ShadowMaps::MarkRendered(uint layer) {
+   mCascades[layer].mDirty = false;
+   mRenders++;
+}
+
+/// replaces *vps
+void ShadowMaps::GetMatrices(vector<mat4> *vps) const {
+   vps->clear();
+   for (auto &cas : mCascades)
+      vps->push_back(cas.mVP);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+
+#include "Bounds.h"
+#include "Shader.h"
+
+// Cascaded shadow maps for each light, every cascade a layer of one depth
+// texture array: light l's cascade c is layer l * cCascades + c.  Each
+// light is treated as directional, shining from its position toward the
+// scene center, or along -xyz if its w is 0, with an orthographic square
+// per cascade around one slice of the view volume.  Squares are fitted
+// with cSlack to spare and keep their place while their slice stays
+// inside, so a cascade's map stays valid, and is rendered again only
+// when its light, the scene bounds or a caster inside it changes.
+class ShadowMaps {
+public:
+   static constexpr uint cCascades = Shader::cCascades;
+   static constexpr uint cSize = 1024;        // Texels per side, per layer
+   static constexpr float cSlack = 0.25f;     // Of a slice's radius
+   static constexpr float cSplitBlend = 0.75f; // Log vs. linear splits
+
+   struct Cascade {
+      glm::mat4 mVP;        // World to the cascade's clip space
+      glm::vec2 mCenter;    // Of its square, in light view space
+      float mHalf;          // Half side of its square, 0 until fitted
+      bool mDirty;          // To be rendered
+   };
+
+private:
+   std::vector<Cascade> mCascades;     // cCascades per light
+   std::vector<glm::vec4> mLights;     // Positions Setup was given
+   std::vector<glm::mat4> mViews;      // Per light, world to light view
+   std::vector<glm::vec2> mDepths;     // Per light, near and far
+   Aabb mScene;
+   glm::vec4 mSplits;                  // Far view depth of each cascade
+   float mDistance;                    // View depth shadows reach
+   GLuint mTexture = 0;
+   uint mRenders = 0;                  // Cascades marked rendered
+
+   void FitLight(uint l);
+
+public:
+   ShadowMaps(float distance = 40.0f) : mSplits(0.0f), mDistance(distance)
+    {}
+
+   // Set the lights, at most Shader::cMaxLights, and the bounds of every
+   // caster.  A light that moved, or any change of scene bounds, dirties
+   // the cascades it affects.
+   void Setup(const std::vector<LightSource> &lights, const Aabb &scene);
+
+   // Fit every light's cascades to the slices of view volume vp nearer
+   // than the shadow distance, moving, and so dirtying, only cascades
+   // whose slice left their square
+   void Fit(const glm::mat4 &vp);
+
+   // Dirty every cascade whose volume holds part of bounds, as when a
+   // caster moved out of or into it
+   void Invalidate(const Aabb &bounds);
+
+   // Create the depth texture array, one layer per cascade
+   void Create();
+
+   // Bind the array to texture unit 2, for the main shader's shadowMaps
+   void Use() const;
+
+   void MarkRendered(uint layer);
+
+   uint GetLayers() const {return (uint)mCascades.size();}
+   const Cascade &GetCascade(uint layer) const {return mCascades[layer];}
+   const glm::vec4 &GetSplits() const {return mSplits;}
+   GLuint GetTexture() const {return mTexture;}
+   uint GetRenders() const {return mRenders;}
+
+   // Every cascade's mVP, by layer, as the shader's lightVP array
+   void GetMatrices(std::vector<glm::mat4> *vps) const;
+};
@@ -0,0 +1,101 @@
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SINCOS_SIMD 1
+#include <emmintrin.h>
+#endif
+
+#include <cmath>
+
+#include "SinCos.h"
+
+using namespace std;
+
+#ifdef SINCOS_SIMD
+
+// Cephes constants: 4/pi, pi/4 split in three for exact reduction, and
+// the sine and cosine polynomials on [-pi/4, pi/4]
+static const float cFourOverPi = 1.27323954473516f;
+static const float cDP1 = -0.78515625f;
+static const float cDP2 = -2.4187564849853515625e-4f;
+static const float cDP3 = -3.77489497744594108e-8f;
+static const float cSin0 = -1.9515295891e-4f, cSin1 = 8.3321608736e-3f;
+static const float cSin2 = -1.6666654611e-1f;
+static const float cCos0 = 2.443315711809948e-5f;
+static const float cCos1 = -1.388731625493765e-3f;
+static const float cCos2 = 4.166664568298827e-2f;
+
+/// four angles per iteration; the last n % 4 are left to the caller
+static size_t SinCosSSE(const float *angles, size_t n, float *sins,
+ float *coss) {
+   const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+   const __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+   const __m128i four = _mm_set1_epi32(4), notOne = _mm_set1_epi32(~1);
+   __m128 x, y, z, signSin, signCos, polyMask, ySin, yCos;
+   __m128i j;
+   size_t i;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      x = _mm_loadu_ps(angles + i);
+      signSin = _mm_and_ps(x, signMask);
+      x = _mm_andnot_ps(signMask, x);
+
+      // Octant j, rounded up to even, so x - j * pi/4 is in [-pi/4, pi/4]
+      j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(cFourOverPi)));
+      j = _mm_and_si128(_mm_add_epi32(j, one), notOne);
+      y = _mm_cvtepi32_ps(j);
+
+      // Octants 2, 3, 6 and 7 swap the polynomials; 4 to 7 negate sine,
+      // and 2 to 5 negate cosine
+      polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, two),
+       _mm_setzero_si128()));
+      signSin = _mm_xor_ps(signSin,
+       _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, four), 29)));
+      signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(
+       _mm_sub_epi32(j, two), four), 29));
+
+      x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(cDP1)));
+      x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(cDP2)));
+      x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(cDP3)));
+      z = _mm_mul_ps(x, x);
+
+      // cos(x) = 1 - z/2 + z^2 (c2 + z (c1 + z c0))
+      yCos = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cCos0), z),
+       _mm_set1_ps(cCos1));
+      yCos = _mm_add_ps(_mm_mul_ps(yCos, z), _mm_set1_ps(cCos2));
+      yCos = _mm_mul_ps(_mm_mul_ps(yCos, z), z);
+      yCos = _mm_sub_ps(yCos, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+      yCos = _mm_add_ps(yCos, _mm_set1_ps(1.0f));
+
+      // sin(x) = x + x z (s2 + z (s1 + z s0))
+      ySin = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cSin0), z),
+       _mm_set1_ps(cSin1));
+      ySin = _mm_add_ps(_mm_mul_ps(ySin, z), _mm_set1_ps(cSin2));
+      ySin = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ySin, z), x), x);
+
+      _mm_storeu_ps(sins + i, _mm_xor_ps(signSin, _mm_or_ps(
+       _mm_and_ps(polyMask, ySin), _mm_andnot_ps(polyMask, yCos))));
+      _mm_storeu_ps(coss + i, _mm_xor_ps(signCos, _mm_or_ps(
+       _mm_and_ps(polyMask, yCos), _mm_andnot_ps(polyMask, ySin))));
+   }
+
+   return i;
+}
+
+#endif
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+SinCos Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// whole groups of four by SSE where built in, the rest by std::sin/cos
+void SinCos::Batch(const float *angles, size_t n, float *sins,
+ float *coss) {
+   size_t i = 0;
+
+#ifdef SINCOS_SIMD
+   i = SinCosSSE(angles, n, sins, coss);
+#endif
+   for (; i < n; i++) {
+      sins[i] = sin(angles[i]);
+      coss[i] = cos(angles[i]);
+   }
+}
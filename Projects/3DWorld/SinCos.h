@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+
+// Sine and cosine of many angles at once.  The SSE kernel is the Cephes
+// single-precision sincos, four angles per iteration: one shared range
+// reduction to [-pi/4, pi/4] in three steps, then both minimax polynomials,
+// swapped and negated by octant.  It agrees with std::sin and std::cos to
+// within a few float ulps for angles of moderate size, such as the [0, 2pi)
+// samples of a CylinderModel profile.
+class SinCos {
+public:
+   // sins[i] = sin(angles[i]) and coss[i] = cos(angles[i]) for i < n
+   static void Batch(const float *angles, size_t n, float *sins,
+    float *coss);
+};
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Parallel.h"
+#include "TangentGen.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Helper Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// true if v has a usable direction
+static bool IsDirection(const vec3 &v) {
+   float len2 = dot(v, v);
+
+   return len2 > 1e-20f && std::isfinite(len2);
+}
+
+/// interior angle between edges u and v of a triangle whose edge cross
+/// product has length |twiceArea|
+static float CornerAngle(const vec3 &u, const vec3 &v, float twiceArea) {
+   return std::atan2(twiceArea, dot(u, v));
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+TangentGen Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// per-triangle frames in parallel, then a vertex-to-corner table, then
+/// per-vertex sums in parallel.  Each vertex sums its corners in index
+/// order, whatever thread does it, so results don't vary with threads.
+void TangentGen::Generate(Vertex *verts, uint numVerts, const uint *idxs,
+ uint numIdxs, uint threads) {
+   uint nt = numIdxs / 3;
+   vector<vec3> triTans(nt), triBiTans(nt);
+   vector<float> weights(3 * nt);
+   vector<uint> adjStart(numVerts + 1, 0), adjCorners(3 * nt), fill;
+
+   threads = nt < cMinParallel ? 1 : Parallel::Threads(threads);
+
+   // Unit tangent and bitangent of each triangle's UV mapping, and the
+   // weight of each corner, or zero weights if the mapping is degenerate
+   Parallel::For(nt, threads, [&](uint lo, uint hi) {
+      vec3 pts[3], dp1, dp2, tan, biTan;
+      vec2 dt1, dt2;
+      float det, area, angle0, angle1;
+
+      for (uint t = lo; t < hi; t++) {
+         const uint *tri = idxs + 3 * t;
+
+         for (uint k = 0; k < 3; k++)
+            pts[k] = vec3(verts[tri[k]].loc) / verts[tri[k]].loc.w;
+         dp1 = pts[1] - pts[0];
+         dp2 = pts[2] - pts[0];
+         dt1 = verts[tri[1]].texLoc - verts[tri[0]].texLoc;
+         dt2 = verts[tri[2]].texLoc - verts[tri[0]].texLoc;
+         det = dt1.x * dt2.y - dt1.y * dt2.x;
+         area = 0.5f * length(cross(dp1, dp2));
+
+         // Dividing by det only scales, so keep just its sign
+         tan = (dp1 * dt2.y - dp2 * dt1.y) * (det < 0 ? -1.0f : 1.0f);
+         biTan = (dp2 * dt1.x - dp1 * dt2.x) * (det < 0 ? -1.0f : 1.0f);
+
+         if (det == 0.0f || !std::isfinite(det) || !(area > 0.0f)
+          || !IsDirection(tan) || !IsDirection(biTan)) {
+            triTans[t] = triBiTans[t] = vec3(0.0f);
+            weights[3*t] = weights[3*t + 1] = weights[3*t + 2] = 0.0f;
+            continue;
+         }
+
+         triTans[t] = normalize(tan);
+         triBiTans[t] = normalize(biTan);
+         angle0 = CornerAngle(dp1, dp2, 2.0f * area);
+         angle1 = CornerAngle(pts[2] - pts[1], -dp1, 2.0f * area);
+         weights[3*t] = area * angle0;
+         weights[3*t + 1] = area * angle1;
+         weights[3*t + 2] = area * std::max(0.0f,
+          float(M_PI) - angle0 - angle1);
+      }
+   });
+
+   // Corners of each vertex, ascending, as one array sliced by adjStart
+   for (uint i = 0; i < 3 * nt; i++)
+      adjStart[idxs[i] + 1]++;
+   for (uint v = 0; v < numVerts; v++)
+      adjStart[v + 1] += adjStart[v];
+   fill.assign(adjStart.begin(), adjStart.end() - 1);
+   for (uint i = 0; i < 3 * nt; i++)
+      adjCorners[fill[idxs[i]]++] = i;
+
+   Parallel::For(numVerts, threads, [&](uint lo, uint hi) {
+      vec3 tanSum, biTanSum, nrm, tan;
+
+      for (uint v = lo; v < hi; v++) {
+         tanSum = biTanSum = vec3(0.0f);
+         for (uint a = adjStart[v]; a < adjStart[v + 1]; a++) {
+            uint corner = adjCorners[a];
+
+            tanSum += weights[corner] * triTans[corner / 3];
+            biTanSum += weights[corner] * triBiTans[corner / 3];
+         }
+
+         nrm = IsDirection(verts[v].normal) ? normalize(verts[v].normal)
+          : vec3(0, 0, 1);
+         tan = tanSum - nrm * dot(nrm, tanSum);
+         if (!IsDirection(tan))
+            tan = cross(nrm, std::abs(nrm.x) < 0.9f ? vec3(1, 0, 0)
+             : vec3(0, 1, 0));
+         tan = normalize(tan);
+
+         verts[v].tangent = tan;
+         verts[v].biTangent = cross(nrm, tan)
+          * (dot(cross(nrm, tan), biTanSum) < 0 ? -1.0f : 1.0f);
+      }
+   });
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "Model.h"
+
+// Per-vertex tangent frames for normal mapping.  Each triangle with a
+// usable UV mapping contributes its unit tangent and bitangent to its
+// corners, weighted by triangle area times corner angle.  Each vertex then
+// gets its sum, Gram-Schmidt orthogonalized against its normal, and a
+// bitangent of cross(normal, tangent) flipped to match the summed
+// bitangent's handedness.  Vertices with no usable contribution get an
+// arbitrary tangent perpendicular to the normal.
+class TangentGen {
+public:
+   // Triangles below this count are done on the calling thread only
+   static constexpr uint cMinParallel = 16384;
+
+   // Write tangent and biTangent of verts from the numIdxs / 3 triangles
+   // of idxs, using up to |threads| threads (0 for one per core).  The
+   // result is bit-identical for any thread count.
+   static void Generate(Vertex *verts, uint numVerts, const uint *idxs,
+    uint numIdxs, uint threads = 0);
+};
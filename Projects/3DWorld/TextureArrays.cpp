@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include "TextureArrays.h"
+
+using namespace std;
+using namespace glm;
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+TextureArrays Private Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// one layer of single texels into the bound array, nearest-filtered so
+/// no texel bleeds into its neighbors
+void TextureArrays::UploadAtlas(const Class &cls) {
+   vector<uchar> pixels(4 * cls.mWidth * cls.mHeight, 0);
+
+   for (uint i = 0; i < cls.mLayers.size(); i++) {
+      auto clr = dynamic_cast<const TextureClr *>(cls.mLayers[i]);
+
+      if (clr)
+         copy(clr->GetColor(), clr->GetColor() + 4, &pixels[4 * i]);
+      else
+         pixels[4 * i + 3] = 255;
+   }
+
+   glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, cls.mWidth, cls.mHeight,
+    1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data()); GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0); GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   GLChkErr;
+}
+
+/// a full mip chain per layer, each level copied from the level of the
+/// source texture, which TexturePng and TextureNormal fully generate.
+/// Sampling matches those classes'.
+void TextureArrays::UploadLayers(const Class &cls, GLuint arr) {
+   uint levels = (uint)floor(log2(std::max(cls.mWidth, cls.mHeight))) + 1;
+   auto clamp = cls.mRepeat ? GL_REPEAT : GL_MIRRORED_REPEAT;
+   GLfloat fLargest;
+
+   glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, cls.mWidth,
+    cls.mHeight, (GLsizei)cls.mLayers.size()); GLChkErr;
+   for (uint l = 0; l < cls.mLayers.size(); l++)
+      for (uint lvl = 0; lvl < levels; lvl++) {
+         glCopyImageSubData(cls.mLayers[l]->GetId(), GL_TEXTURE_2D, lvl,
+          0, 0, 0, arr, GL_TEXTURE_2D_ARRAY, lvl, 0, 0, l,
+          std::max(1u, cls.mWidth >> lvl), std::max(1u, cls.mHeight >> lvl),
+          1); GLChkErr;
+      }
+
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, clamp); GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, clamp); GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   GLChkErr;
+   glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+    GL_LINEAR_MIPMAP_LINEAR); GLChkErr;
+   glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &fLargest); GLChkErr;
+   glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+    fLargest); GLChkErr;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+TextureArrays Public Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// classes textures by size and wrap mode in order of first use, then
+/// lays the atlas texels out in the smallest square holding them all
+void TextureArrays::Plan(const MaterialRegistry &reg) {
+   map<tuple<uint, uint, bool>, uint> classIds;
+   Class atlas = {0, 0, false, true, {}};
+   uint side;
+
+   mClasses.clear();
+   mArrays.clear();
+   mSlots.clear();
+
+   for (uint m = 0; m < reg.Size(); m++)
+      for (const Texture *tex : {reg.Get(m).mTex.get(),
+       reg.Get(m).mTexNormal.get()}) {
+         if (!tex || mSlots.count(tex))
+            continue;
+
+         if (dynamic_cast<const TextureClr *>(tex) || !tex->GetWidth()) {
+            mSlots[tex] = {0, 0, vec3(0.0f)};
+            atlas.mLayers.push_back(tex);
+            continue;
+         }
+
+         auto key = make_tuple(tex->GetWidth(), tex->GetHeight(),
+          tex->GetRepeat());
+         auto found = classIds.find(key);
+
+         if (found == classIds.end()) {
+            found = classIds.emplace(key, (uint)mClasses.size()).first;
+            mClasses.push_back({tex->GetWidth(), tex->GetHeight(),
+             tex->GetRepeat(), false, {}});
+         }
+         mSlots[tex] = {found->second,
+          (uint)mClasses[found->second].mLayers.size(), vec3(0, 0, 1)};
+         mClasses[found->second].mLayers.push_back(tex);
+      }
+
+   if (atlas.mLayers.empty())
+      return;
+
+   side = (uint)ceil(sqrt((double)atlas.mLayers.size()));
+   atlas.mWidth = atlas.mHeight = side;
+   for (uint i = 0; i < atlas.mLayers.size(); i++)
+      mSlots[atlas.mLayers[i]] = {(uint)mClasses.size(), 0,
+       vec3((i % side + 0.5f) / side, (i / side + 0.5f) / side, 0.0f)};
+   mClasses.push_back(atlas);
+}
+
+/// one GL_TEXTURE_2D_ARRAY per planned class
+void TextureArrays::Upload() {
+   if (!GLEW_VERSION_4_3 && !GLEW_ARB_copy_image)
+      throw WorldException("Texture arrays require ARB_copy_image");
+
+   mArrays.resize(mClasses.size());
+   if (!mArrays.empty()) {
+      glGenTextures((GLsizei)mArrays.size(), mArrays.data()); GLChkErr;
+   }
+   for (uint c = 0; c < mClasses.size(); c++) {
+      glBindTexture(GL_TEXTURE_2D_ARRAY, mArrays[c]); GLChkErr;
+      if (mClasses[c].mAtlas)
+         UploadAtlas(mClasses[c]);
+      else
+         UploadLayers(mClasses[c], mArrays[c]);
+   }
+   glBindTexture(GL_TEXTURE_2D_ARRAY, 0); GLChkErr;
+}
+
+/// binds array a for texArray or normalArray in the shader, leaving the
+/// diffuse unit active as the Texture classes expect
+void TextureArrays::Use(uint a, bool normal) const {
+   glActiveTexture(normal ? GL_TEXTURE5 : GL_TEXTURE4); GLChkErr;
+   glBindTexture(GL_TEXTURE_2D_ARRAY, mArrays[a]); GLChkErr;
+   glActiveTexture(GL_TEXTURE0); GLChkErr;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+TextureArrayState Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// compares the arrays of mat's textures against those bound.  As with
+/// MaterialState, a plain material leaves the normal array in place.
+uint TextureArrayState::Apply(const TextureArrays &arrays,
+ const Material &mat, DrawStats *stats) {
+   uint rtn = 0;
+   int a = (int)arrays.Get(mat.mTex.get()).mArray;
+
+   if (mArray != a) {
+      rtn |= MaterialState::cTexture;
+      mArray = a;
+      stats->mTextureBinds++;
+   }
+   if (mat.mTexNormal) {
+      a = (int)arrays.Get(mat.mTexNormal.get()).mArray;
+      if (mNormalArray != a) {
+         rtn |= MaterialState::cNormal;
+         mNormalArray = a;
+         stats->mTextureBinds++;
+      }
+   }
+
+   return rtn;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/vec3.hpp>
+
+#include "Material.h"
+
+// Every texture of a MaterialRegistry gathered into GL_TEXTURE_2D_ARRAYs,
+// so a shader that indexes layers by material binds once per array rather
+// than once per texture.  Textures of one size and wrap mode share an
+// array, diffuse and normal maps alike, all being RGBA8.  Single colors
+// (TextureClr), and textures that failed to load, which sample black,
+// share one nearest-filtered atlas instead, each a texel of its one layer,
+// reached by squashing texture coordinates onto that texel.  Textures
+// of an odd size or wrap mode get an array to themselves, since an atlas
+// cell could neither repeat nor mip cleanly.
+class TextureArrays {
+public:
+   // Where one texture landed
+   struct Slot {
+      uint mArray;
+      uint mLayer;
+      glm::vec3 mUVXfm;   // Offset xy and scale z, applied after texXfm
+   };
+
+private:
+   // An array's layer size and wrap mode, and its textures by layer, or
+   // for the atlas by texel
+   struct Class {
+      uint mWidth, mHeight;
+      bool mRepeat;
+      bool mAtlas;
+      std::vector<const Texture *> mLayers;
+   };
+
+   std::vector<Class> mClasses;          // The atlas, if any, is last
+   std::vector<GLuint> mArrays;          // Per class, once uploaded
+   std::map<const Texture *, Slot> mSlots;
+
+   void UploadAtlas(const Class &);
+   void UploadLayers(const Class &, GLuint);
+
+public:
+   // Assign every texture of reg a Slot, with no GL calls
+   void Plan(const MaterialRegistry &reg);
+
+   // Create the planned arrays, copying each texture's mip levels in on
+   // the GPU.  Needs GL 4.3 or ARB_copy_image.
+   void Upload();
+
+   const Slot &Get(const Texture *tex) const {return mSlots.at(tex);}
+   uint Size() const {return (uint)mClasses.size();}
+
+   // Bind array |a| to unit 4 for diffuse, or 5 for normal, lookups
+   void Use(uint a, bool normal) const;
+};
+
+// Like MaterialState, but for the arrays holding a material's textures,
+// so consecutive draws whose textures share arrays bind nothing again
+class TextureArrayState {
+   int mArray = -1, mNormalArray = -1;
+
+public:
+   // MaterialState::cTexture and cNormal for the arrays mat needs bound,
+   // tallied into *stats
+   uint Apply(const TextureArrays &, const Material &mat, DrawStats *stats);
+};
@@ -13,7 +13,8 @@ Base Texture class
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 /// base texture initilization
-Texture::Texture(string n) : mName(n) {
+Texture::Texture(string n) : mName(n), mRepeat(false), mWidth(0),
+ mHeight(0) {
    glGenTextures(1, &mId);
 }
 
@@ -26,15 +27,19 @@ TexturePng::TexturePng(string n, string fileName, bool repeat) : Texture(n) {
    uint mipMax, ht, wd;
    vector<uchar> pixels;
 
+   mFile = fileName;
+   mRepeat = repeat;
    auto err = lodepng::decode(pixels, wd, ht, fileName);
 
    if (!err) {
       glBindTexture(GL_TEXTURE_2D, mId);     // Set as 2D texture type
       GLChkErr;
 
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ht, wd,
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, wd, ht,
        0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
       GLChkErr;
+      mWidth = wd;
+      mHeight = ht;
 
       glGenerateMipmap(GL_TEXTURE_2D);
       GLChkErr;
@@ -83,6 +88,8 @@ TextureNormal::TextureNormal(std::string n, std::string fN, bool repeat)
    uint mipMax, ht, wd;
    vector<uchar> pixels;
 
+   mFile = fN;
+   mRepeat = repeat;
    auto err = lodepng::decode(pixels, wd, ht, fN);
 
    // Sufficient MIP levels to bring largest dimension down to 1
@@ -92,9 +99,11 @@ TextureNormal::TextureNormal(std::string n, std::string fN, bool repeat)
       glBindTexture(GL_TEXTURE_2D, mId);     // Set as 2D texture type
       GLChkErr;
 
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ht, wd,
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, wd, ht,
          0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
       GLChkErr;
+      mWidth = wd;
+      mHeight = ht;
 
       glGenerateMipmap(GL_TEXTURE_2D);
       GLChkErr;
@@ -151,6 +160,8 @@ Clear Map Texture Class
 
 /// sets a blank texture of color clr
 TextureClr::TextureClr(string n, unsigned char clr[]) : Texture(n) {
+   copy(clr, clr + 4, mClr);
+   mWidth = mHeight = 1;
    glBindTexture(GL_TEXTURE_2D, mId);     // Set as 2D texture type
    GLChkErr;
    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1,
@@ -158,8 +169,10 @@ TextureClr::TextureClr(string n, unsigned char clr[]) : Texture(n) {
    GLChkErr;
 }
 
-/// binds a cleared texture to current active texture slot
+/// binds a cleared texture to the diffuse slot, as TexturePng does, since
+/// a normal map bound just before leaves its own slot active
 void TextureClr::UseTexture() {
+   glActiveTexture(GL_TEXTURE0);
    glBindTexture(GL_TEXTURE_2D, mId);
    GLChkErr;
 }
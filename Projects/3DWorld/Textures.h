@@ -11,13 +11,20 @@ class Texture {
 protected:
    GLuint mId;
    std::string mName;
+   std::string mFile;   // Image the texture was loaded from, if any
+   bool mRepeat;        // Wrap mode it was loaded with, if from mFile
+   uint mWidth, mHeight; // Of mip level 0, or 0 if nothing was loaded
 
 public:
    Texture(std::string);
 
    virtual void UseTexture() = 0;
    std::string GetName() {return mName;}
-   GLuint GetId() {return mId;}
+   GLuint GetId() const {return mId;}
+   const std::string &GetFile() const {return mFile;}
+   bool GetRepeat() const {return mRepeat;}
+   uint GetWidth() const {return mWidth;}
+   uint GetHeight() const {return mHeight;}
 };
 
 // Texture subclass initialized by a png file. Presumed use is either for
@@ -46,8 +53,11 @@ public:
 
 // Texture subclass initialized by a single color
 class TextureClr : public Texture {
+   unsigned char mClr[4];
+
 public:
    // Name and 4-element RGBA color array
    TextureClr(std::string n, unsigned char clr[]);
    void UseTexture() override;
+   const unsigned char *GetColor() const {return mClr;}
 };
\ No newline at end of file
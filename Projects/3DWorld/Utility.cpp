@@ -50,6 +50,16 @@ vector<string> Split(const std::string& s, char delimiter) {
    return tokens;
 }
 
+/// FNV-1a, 64 bit
+unsigned long long HashString(const string &str) {
+   unsigned long long hash = 14695981039346656037ull;
+
+   for (unsigned char chr : str)
+      hash = (hash ^ chr) * 1099511628211ull;
+
+   return hash;
+}
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
 Print Functions
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
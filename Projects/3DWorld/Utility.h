@@ -21,6 +21,7 @@ typedef unsigned char uchar;
 /// String Functions ///
 std::string StringPrintf(const std::string fmt, ...);
 std::vector<std::string> Split(const std::string& s, char delimiter);
+unsigned long long HashString(const std::string &);
 
 /// Print Functions ///
 void PrintMat(vr::HmdMatrix34_t mat);
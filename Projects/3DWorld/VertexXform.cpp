@@ -0,0 +1,246 @@
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define XFORM_SIMD 1
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+#include "VertexXform.h"
+
+using namespace std;
+using namespace glm;
+
+// Kernels index Vertex as 15 packed floats: loc 0-3, normal 4-6, texLoc
+// 7-8, tangent 9-11, biTangent 12-14, as the Renderer's VAO layout does.
+static_assert(sizeof(Vertex) == 15 * sizeof(float), "Vertex is not packed");
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+Kernels
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// one vertex at a time, as Vertex::ApplyXForm but with the tangent and
+/// texture matrices hoisted out of the loop
+static void XformScalar(Vertex *verts, size_t n, const mat4 &locXfm,
+ const mat3 &normXfm, const mat4 &texXfm) {
+   mat3 dirXfm = mat3(locXfm);
+   vec2 tU = vec2(texXfm[0]), tV = vec2(texXfm[1]), tT = vec2(texXfm[3]);
+
+   for (Vertex *v = verts; v < verts + n; v++) {
+      v->loc = locXfm * v->loc;
+      v->normal = normXfm * v->normal;
+      v->tangent = dirXfm * v->tangent;
+      v->biTangent = dirXfm * v->biTangent;
+      v->texLoc = tU * v->texLoc.x + tV * v->texLoc.y + tT;
+   }
+}
+
+#ifdef XFORM_SIMD
+
+// broadcast lane k of x to all lanes
+#define SPLAT(x, k) _mm_shuffle_ps(x, x, (k) * 0x55)
+
+/// returns a*s0 + b*s1 + c*s2
+static inline __m128 Comb3(__m128 a, __m128 s0, __m128 b, __m128 s1,
+ __m128 c, __m128 s2) {
+   return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, s0), _mm_mul_ps(b, s1)),
+    _mm_mul_ps(c, s2));
+}
+
+/// one vertex per iteration: all 15 floats are loaded, splatted against
+/// the matrix columns, then repacked and stored in place
+static void XformSSE(Vertex *verts, size_t n, const mat4 &locXfm,
+ const mat3 &normXfm, const mat4 &texXfm) {
+   __m128 c0 = _mm_loadu_ps(&locXfm[0][0]), c1 = _mm_loadu_ps(&locXfm[1][0]);
+   __m128 c2 = _mm_loadu_ps(&locXfm[2][0]), c3 = _mm_loadu_ps(&locXfm[3][0]);
+   __m128 n0 = _mm_setr_ps(normXfm[0][0], normXfm[0][1], normXfm[0][2], 0);
+   __m128 n1 = _mm_setr_ps(normXfm[1][0], normXfm[1][1], normXfm[1][2], 0);
+   __m128 n2 = _mm_setr_ps(normXfm[2][0], normXfm[2][1], normXfm[2][2], 0);
+   __m128 t0 = _mm_loadu_ps(&texXfm[0][0]), t1 = _mm_loadu_ps(&texXfm[1][0]);
+   __m128 t3 = _mm_loadu_ps(&texXfm[3][0]);
+   __m128 x0, x1, x2, x3, pos, nrm, tex, tan, bit, tmp;
+
+   for (size_t i = 0; i < n; i++) {
+      float *f = (float *)(verts + i);
+
+      // floats 0-3, 4-7, 8-11 and 11-14, so no load crosses the vertex
+      x0 = _mm_loadu_ps(f);
+      x1 = _mm_loadu_ps(f + 4);
+      x2 = _mm_loadu_ps(f + 8);
+      x3 = _mm_loadu_ps(f + 11);
+
+      pos = _mm_add_ps(Comb3(c0, SPLAT(x0, 0), c1, SPLAT(x0, 1),
+       c2, SPLAT(x0, 2)), _mm_mul_ps(c3, SPLAT(x0, 3)));
+      nrm = Comb3(n0, SPLAT(x1, 0), n1, SPLAT(x1, 1), n2, SPLAT(x1, 2));
+      tex = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t0, SPLAT(x1, 3)),
+       _mm_mul_ps(t1, SPLAT(x2, 0))), t3);
+      tan = Comb3(c0, SPLAT(x2, 1), c1, SPLAT(x2, 2), c2, SPLAT(x3, 0));
+      bit = Comb3(c0, SPLAT(x3, 1), c1, SPLAT(x3, 2), c2, SPLAT(x3, 3));
+
+      // repack as (pos), (nrm.xyz tex.x), (tex.y tan.xyz), (bit.xyz)
+      _mm_storeu_ps(f, pos);
+      tmp = _mm_shuffle_ps(nrm, tex, _MM_SHUFFLE(0, 0, 2, 2));
+      _mm_storeu_ps(f + 4, _mm_shuffle_ps(nrm, tmp, _MM_SHUFFLE(2, 0, 1, 0)));
+      tmp = _mm_shuffle_ps(tex, tan, _MM_SHUFFLE(0, 0, 1, 1));
+      _mm_storeu_ps(f + 8, _mm_shuffle_ps(tmp, tan, _MM_SHUFFLE(2, 1, 2, 0)));
+      _mm_storel_pi((__m64 *)(f + 12), bit);
+      _mm_store_ss(f + 14, _mm_movehl_ps(bit, bit));
+   }
+}
+
+// broadcast lane k of each 128-bit half of x within that half
+#define SPLAT8(x, k) _mm256_permute_ps(x, (k) * 0x55)
+
+/// returns x in both halves of a 256-bit register
+TARGET_AVX2 static inline __m256 Dup(__m128 x) {
+   return _mm256_insertf128_ps(_mm256_castps128_ps256(x), x, 1);
+}
+
+/// returns 4 floats at a in the low half and at b in the high half
+TARGET_AVX2 static inline __m256 Load2(const float *a, const float *b) {
+   return _mm256_insertf128_ps(
+    _mm256_castps128_ps256(_mm_loadu_ps(a)), _mm_loadu_ps(b), 1);
+}
+
+/// stores the low half of x at a and the high half at b
+TARGET_AVX2 static inline void Store2(float *a, float *b, __m256 x) {
+   _mm_storeu_ps(a, _mm256_castps256_ps128(x));
+   _mm_storeu_ps(b, _mm256_extractf128_ps(x, 1));
+}
+
+/// returns a*s0 + b*s1 + c*s2, fused
+TARGET_AVX2 static inline __m256 Comb3(__m256 a, __m256 s0, __m256 b,
+ __m256 s1, __m256 c, __m256 s2) {
+   return _mm256_fmadd_ps(c, s2, _mm256_fmadd_ps(b, s1, _mm256_mul_ps(a, s0)));
+}
+
+/// two vertices per iteration, one per 128-bit half, as in XformSSE but
+/// with FMA; an odd last vertex is left to XformSSE
+TARGET_AVX2 static void XformAVX2(Vertex *verts, size_t n, const mat4 &locXfm,
+ const mat3 &normXfm, const mat4 &texXfm) {
+   __m256 c0 = Dup(_mm_loadu_ps(&locXfm[0][0]));
+   __m256 c1 = Dup(_mm_loadu_ps(&locXfm[1][0]));
+   __m256 c2 = Dup(_mm_loadu_ps(&locXfm[2][0]));
+   __m256 c3 = Dup(_mm_loadu_ps(&locXfm[3][0]));
+   __m256 n0 = Dup(_mm_setr_ps(normXfm[0][0], normXfm[0][1], normXfm[0][2],
+    0));
+   __m256 n1 = Dup(_mm_setr_ps(normXfm[1][0], normXfm[1][1], normXfm[1][2],
+    0));
+   __m256 n2 = Dup(_mm_setr_ps(normXfm[2][0], normXfm[2][1], normXfm[2][2],
+    0));
+   __m256 t0 = Dup(_mm_loadu_ps(&texXfm[0][0]));
+   __m256 t1 = Dup(_mm_loadu_ps(&texXfm[1][0]));
+   __m256 t3 = Dup(_mm_loadu_ps(&texXfm[3][0]));
+   __m256 x0, x1, x2, x3, pos, nrm, tex, tan, bit, tmp;
+   size_t i;
+
+   for (i = 0; i + 2 <= n; i += 2) {
+      float *a = (float *)(verts + i), *b = (float *)(verts + i + 1);
+
+      x0 = Load2(a, b);
+      x1 = Load2(a + 4, b + 4);
+      x2 = Load2(a + 8, b + 8);
+      x3 = Load2(a + 11, b + 11);
+
+      pos = _mm256_fmadd_ps(c3, SPLAT8(x0, 3), Comb3(c0, SPLAT8(x0, 0),
+       c1, SPLAT8(x0, 1), c2, SPLAT8(x0, 2)));
+      nrm = Comb3(n0, SPLAT8(x1, 0), n1, SPLAT8(x1, 1), n2, SPLAT8(x1, 2));
+      tex = _mm256_fmadd_ps(t1, SPLAT8(x2, 0),
+       _mm256_fmadd_ps(t0, SPLAT8(x1, 3), t3));
+      tan = Comb3(c0, SPLAT8(x2, 1), c1, SPLAT8(x2, 2), c2, SPLAT8(x3, 0));
+      bit = Comb3(c0, SPLAT8(x3, 1), c1, SPLAT8(x3, 2), c2, SPLAT8(x3, 3));
+
+      Store2(a, b, pos);
+      tmp = _mm256_shuffle_ps(nrm, tex, _MM_SHUFFLE(0, 0, 2, 2));
+      Store2(a + 4, b + 4,
+       _mm256_shuffle_ps(nrm, tmp, _MM_SHUFFLE(2, 0, 1, 0)));
+      tmp = _mm256_shuffle_ps(tex, tan, _MM_SHUFFLE(0, 0, 1, 1));
+      Store2(a + 8, b + 8,
+       _mm256_shuffle_ps(tmp, tan, _MM_SHUFFLE(2, 1, 2, 0)));
+      _mm_storel_pi((__m64 *)(a + 12), _mm256_castps256_ps128(bit));
+      _mm_store_ss(a + 14, _mm_movehl_ps(_mm256_castps256_ps128(bit),
+       _mm256_castps256_ps128(bit)));
+      tmp = _mm256_permute2f128_ps(bit, bit, 1);
+      _mm_storel_pi((__m64 *)(b + 12), _mm256_castps256_ps128(tmp));
+      _mm_store_ss(b + 14, _mm_movehl_ps(_mm256_castps256_ps128(tmp),
+       _mm256_castps256_ps128(tmp)));
+   }
+
+   if (i < n)
+      XformSSE(verts + i, n - i, locXfm, normXfm, texXfm);
+}
+
+/// true if the CPU and OS support AVX2 and FMA
+static bool HasAVX2() {
+#ifdef _MSC_VER
+   int info[4];
+
+   __cpuid(info, 0);
+   if (info[0] < 7)
+      return false;
+
+   // FMA, OSXSAVE and AVX, then OS-enabled XMM/YMM state, then AVX2
+   __cpuid(info, 1);
+   if ((info[2] & 0x18001000) != 0x18001000 || (_xgetbv(0) & 6) != 6)
+      return false;
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#else
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * /
+VertexXform Functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/// true if kernel was compiled in and the CPU can run it
+bool VertexXform::Supported(Kernel kernel) {
+#ifdef XFORM_SIMD
+   static const bool hasAVX2 = HasAVX2();
+
+   return kernel == Scalar || kernel == SSE || (kernel == AVX2 && hasAVX2);
+#else
+   return kernel == Scalar;
+#endif
+}
+
+/// fastest supported kernel
+VertexXform::Kernel VertexXform::Best() {
+   static const Kernel best = Supported(AVX2) ? AVX2
+    : Supported(SSE) ? SSE : Scalar;
+
+   return best;
+}
+
+/// printable kernel name
+const char *VertexXform::Name(Kernel kernel) {
+   static const char *names[NumKernels] = {"scalar", "sse", "avx2"};
+
+   return names[kernel];
+}
+
+/// transforms n vertices in place with the given kernel
+void VertexXform::Apply(Kernel kernel, Vertex *verts, size_t n,
+ const mat4 &locXfm, const mat3 &normXfm, const mat4 &texXfm) {
+   static const XformFtn kernels[NumKernels] = {XformScalar,
+#ifdef XFORM_SIMD
+    XformSSE, XformAVX2
+#else
+    XformScalar, XformScalar
+#endif
+   };
+
+   if (!Supported(kernel))
+      throw WorldException(StringPrintf(
+       "%s vertex transform unsupported on this CPU", Name(kernel)));
+
+   kernels[kernel](verts, n, locXfm, normXfm, texXfm);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Model.h"
+
+// Batched Vertex::ApplyXForm.  Each kernel transforms loc by the mat4,
+// normal by the mat3 normal matrix, tangent and biTangent by the mat4's
+// upper 3x3, and texLoc by the 2-D affine part of the texture mat4, so all
+// kernels agree with the scalar Vertex::ApplyXForm.  The SSE and AVX2
+// kernels work on the interleaved Vertex layout in place, one and two
+// vertices per iteration respectively.
+class VertexXform {
+public:
+   enum Kernel {Scalar, SSE, AVX2, NumKernels};
+
+   // Kernel signature: vertices, count, loc xfm, normal xfm, texture xfm
+   typedef void (*XformFtn)(Vertex *, size_t, const glm::mat4 &,
+    const glm::mat3 &, const glm::mat4 &);
+
+   // True if this build and CPU can run the kernel
+   static bool Supported(Kernel);
+
+   // Fastest supported kernel, chosen once at first call
+   static Kernel Best();
+
+   static const char *Name(Kernel);
+
+   // Transform n vertices with the given kernel, or the best one
+   static void Apply(Kernel, Vertex *, size_t n, const glm::mat4 &,
+    const glm::mat3 &, const glm::mat4 &);
+   static void Apply(Vertex *verts, size_t n, const glm::mat4 &locXfm,
+    const glm::mat3 &normXfm, const glm::mat4 &texXfm) {
+      Apply(Best(), verts, n, locXfm, normXfm, texXfm);
+   }
+};